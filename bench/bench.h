@@ -0,0 +1,48 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Host timing helpers for the benchmarks. bench_Cycles() is the TSC on x86
+ * and 0 elsewhere; ns/op is always available.
+ */
+
+static inline double bench_Seconds(void) {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline uint64_t bench_Cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Keep the optimizer from deleting a computed result.
+ */
+static inline void bench_Keep(void *p) {
+	__asm__ __volatile__("" : : "r"(p) : "memory");
+}
+
+/*
+ * Deterministic xorshift64* noise, no libc state.
+ */
+static inline double bench_Noise(uint64_t *s) {
+	*s ^= *s >> 12;
+	*s ^= *s << 25;
+	*s ^= *s >> 27;
+	return (double)((*s * 0x2545F4914F6CDD1Dull) >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+}
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "control.h"
+#include "sensors.h"
+#include "sim.h"
+#include "bench.h"
+
+/*
+ * Attitude estimators side by side: per-axis Kalman (control.c default) vs
+ * quaternion AHRS. Time per control_Estimate() on canned sensor data, and
+ * attitude error against simulator truth.
+ *
+ *   bench_ahrs [iterations]
+ *
+ * Exits 1 if the AHRS error exceeds the bound.
+ */
+
+#define RAD2DEG				57.29577951308232
+#define FLIGHT_SECONDS		30
+#define FLIGHTS				4
+#define SETTLE_SECONDS		5
+#define BOUND_DEG			2.0					// rms, per axis
+
+#define SAMPLES				1024
+
+
+static Vect3d	s_accel[SAMPLES], s_gyro[SAMPLES], s_compass[SAMPLES];
+static const char *names[2] = {"kalman", "ahrs"};
+
+
+static double angle_Diff(double a, double b) {
+	return fmod(a - b + 540.0, 360.0) - 180.0;
+}
+
+/*
+ * rms error per axis over FLIGHTS tumbling flights, firmware running open loop
+ */
+static void bench_Flights(uint8_t estimator, double rms[3]) {
+	static sim_world w;
+	double err2[3] = {0, 0, 0};
+	uint64_t n = 0, k;
+	uint32_t run;
+	
+	control_estimator = estimator;
+	for (run = 0; run < FLIGHTS; run++) {
+		sim_Init(&w, 100 + run);
+		w.gust = 0.02;
+		quad_SetEuler(&w.quad, 10 / RAD2DEG, -10 / RAD2DEG, (run * 90) / RAD2DEG);
+		for (k = 1; k <= (uint64_t)FLIGHT_SECONDS * SIM_RATE; k++) {
+			sim_Step(&w);
+			if (k % (SIM_RATE / 100) == 0 && k >= (uint64_t)SETTLE_SECONDS * SIM_RATE) {
+				double r, p, y;
+				
+				quad_Euler(&w.quad, &r, &p, &y);
+				err2[0] += pow(angle_Diff(roll, r * RAD2DEG), 2);
+				err2[1] += pow(angle_Diff(pitch, p * RAD2DEG), 2);
+				err2[2] += pow(angle_Diff(yaw, y * RAD2DEG), 2);
+				n++;
+			}
+		}
+	}
+	for (k = 0; k < 3; k++) rms[k] = sqrt(err2[k] / n);
+}
+
+int main(int argc, char **argv) {
+	uint32_t iterations = argc > 1 ? (uint32_t)atol(argv[1]) : 2000000;
+	uint64_t seed = 7, c0, c1;
+	double t0, t1, ns[2], rms[2][3];
+	uint32_t i;
+	uint8_t e;
+	int fail = 0;
+	
+	// raw register values of a slow wobble around level, heading ~30 deg
+	for (i = 0; i < SAMPLES; i++) {
+		float t = i * 0.01f;
+		
+		s_accel[i].x = 20.0f * sinf(t) + 3.0f * (float)bench_Noise(&seed);
+		s_accel[i].y = -15.0f * cosf(0.7f * t) + 3.0f * (float)bench_Noise(&seed);
+		s_accel[i].z = -256.0f + 3.0f * (float)bench_Noise(&seed);
+		s_gyro[i].x = 50.0f * cosf(t) + 5.0f * (float)bench_Noise(&seed);
+		s_gyro[i].y = 30.0f * sinf(0.7f * t) + 5.0f * (float)bench_Noise(&seed);
+		s_gyro[i].z = 5.0f * (float)bench_Noise(&seed);
+		s_compass[i].x = 200.0f + __COMPASS_X_OFFSET + 5.0f * (float)bench_Noise(&seed);
+		s_compass[i].y = 400.0f + __COMPASS_Y_OFFSET + 5.0f * (float)bench_Noise(&seed);
+		s_compass[i].z = -115.0f + __COMPASS_Z_OFFSET + 5.0f * (float)bench_Noise(&seed);
+	}
+	
+	for (e = 0; e < 2; e++) {
+		control_estimator = e;
+		control_Init();
+		t0 = bench_Seconds();
+		c0 = bench_Cycles();
+		for (i = 0; i < iterations; i++) {
+			accel = s_accel[i & (SAMPLES - 1)];
+			gyro = s_gyro[i & (SAMPLES - 1)];
+			compass = s_compass[i & (SAMPLES - 1)];
+			control_Estimate();
+		}
+		c1 = bench_Cycles();
+		t1 = bench_Seconds();
+		bench_Keep(&roll);
+		ns[e] = (t1 - t0) * 1e9 / iterations;
+		printf("%-8s %7.1f ns/update  %6.0f cycles/update\n", names[e], ns[e], (double)(c1 - c0) / iterations);
+	}
+	
+	for (e = 0; e < 2; e++) {
+		bench_Flights(e, rms[e]);
+		printf("%-8s rms error deg  roll %6.3f  pitch %6.3f  yaw %6.3f\n", names[e], rms[e][0], rms[e][1], rms[e][2]);
+	}
+	for (i = 0; i < 3; i++) {
+		if (rms[CONTROL_EST_AHRS][i] > BOUND_DEG) fail = 1;
+	}
+	
+	printf("%s: ahrs attitude error within %.1f deg rms\n", fail ? "FAIL" : "PASS", BOUND_DEG);
+	return fail;
+}
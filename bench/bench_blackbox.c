@@ -0,0 +1,382 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "blackbox.h"
+#include "blackbox_decode.h"
+#include "control.h"
+#include "sensors.h"
+#include "tasks.h"
+#include "hal_host.h"
+#include "sim.h"
+#include "bench.h"
+
+/*
+ * Flight data recorder: exact round trip of every tick field, raw sensor
+ * sample and rate loop run through the block encoder and the host decoder
+ * on random walks with jumps to float specials, int16 and int32 extremes,
+ * samples stamped out of order, a t_us wrap and a time jump, then lost and
+ * damaged blocks, recording cost per tick, decoder throughput, then a
+ * simulated flight logged over the USB telemetry stream and checked against
+ * the estimator and the low-pass.
+ *
+ *   bench_blackbox [ticks]
+ *
+ * Exits 1 if a check fails or block decoding runs below DECODE_MBS_MIN.
+ */
+
+#define DECODE_MBS_MIN				100
+#define DECODE_PASSES				50
+#define RAW_TICK						(4 + 4 * BLACKBOX_FIELDS)		// u32 t, the fields
+#define RAW_SAMPLE					11							// u32 t, u8 sensor, 3 x i16
+#define RAW_RUN							6								// u32 t, u16 throttle
+#define CAPTURE_SIZE				(32 << 20)
+
+
+static uint8_t			blocks[CAPTURE_SIZE];				// u8 len, block, ...
+static uint32_t			blocks_n, blocks_count;
+static uint32_t			refuse_every;
+static uint8_t			stream[4 << 20];
+static uint32_t			stream_n;
+static int					fail;
+
+
+static void check(int ok, const char *what) {
+	printf("%-52s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok) fail = 1;
+}
+
+static uint8_t sink_Capture(void *ctx, const uint8_t *block, uint8_t len) {
+	(void)ctx;
+	blocks_count++;
+	if (refuse_every && blocks_count % refuse_every == 0) return 0;
+	if (blocks_n + 1 + len > CAPTURE_SIZE) return 0;
+	blocks[blocks_n] = len;
+	memcpy(&blocks[blocks_n + 1], block, len);
+	blocks_n += 1 + len;
+	return 1;
+}
+
+static void sink_Stream(void *ctx, const uint8_t *data, uint16_t len) {
+	(void)ctx;
+	if (stream_n + len > sizeof(stream)) return;
+	memcpy(&stream[stream_n], data, len);
+	stream_n += len;
+}
+
+static void decode_Blocks(blackbox_log *l) {
+	uint32_t i;
+	
+	for (i = 0; i < blocks_n; i += 1 + blocks[i]) blackbox_DecodeBlock(l, &blocks[i + 1], blocks[i]);
+}
+
+static void recorder_Reset(void) {
+	hal_HostReset();
+	task_Init();
+	control_Init();
+	blackbox_Init();
+	blackbox_SetSink(sink_Capture, NULL);
+	blocks_n = 0;
+	blocks_count = 0;
+	refuse_every = 0;
+}
+
+static uint32_t bench_Below(uint64_t *seed, uint32_t n) {
+	return (uint32_t)((bench_Noise(seed) + 1.0) * 0.5 * n);
+}
+
+/*
+ * @brief: Random walk of every recorded tick variable, now and then a jump
+ */
+static void state_Step(uint64_t *seed, uint32_t k) {
+	roll += 0.3f * bench_Noise(seed);
+	pitch += 0.3f * bench_Noise(seed);
+	yaw = k % 1500 == 0 ? -yaw : yaw + 0.3f * bench_Noise(seed);
+	k_roll.x[2] += 0.001f * bench_Noise(seed);
+	k_pitch.x[2] += 0.001f * bench_Noise(seed);
+	k_yaw.x[2] = k % 2000 == 0 ? 1e12f : 0.01f * bench_Noise(seed);
+	k_yaw.P[0] = k % 997 == 0 ? NAN : k_yaw.P[0] + 0.01f * bench_Noise(seed);
+	u_roll = 50 * bench_Noise(seed);
+	u_pitch = 50 * bench_Noise(seed);
+	u_yaw = 50 * bench_Noise(seed);
+	torque[k % 4] = (uint16_t)(k % 101);
+	user_torque = (uint16_t)(k % 97);
+}
+
+/*
+ * @brief: Random walk of the raw samples of one tick into sensors_batch,
+ * 				random sensors and counts, now and then an extreme or a sample
+ * 				stamped before the one ahead of it
+ */
+static void batch_Step(uint64_t *seed, uint32_t k, uint32_t *t) {
+	static int16_t walk[SENSORS_COUNT][3];
+	const int16_t jump[3] = {INT16_MIN, INT16_MAX, 0};
+	uint16_t i;
+	uint8_t a;
+	
+	sensors_batch_n = (uint16_t)bench_Below(seed, 23);
+	for (i = 0; i < sensors_batch_n; i++) {
+		sensors_entry *e = &sensors_batch[i];
+		
+		e->sensor = (uint8_t)bench_Below(seed, SENSORS_COUNT);
+		for (a = 0; a < 3; a++) {
+			walk[e->sensor][a] = k % 997 == 0 ? jump[(i + a) % 3] : (int16_t)(walk[e->sensor][a] + 8 * bench_Noise(seed));
+			e->data[a] = walk[e->sensor][a];
+		}
+		*t += 400 + bench_Below(seed, 40);
+		e->t_us = i % 13 == 12 ? *t - 1700 : *t;
+	}
+}
+
+static void round_Trip(uint32_t ticks) {
+	int32_t *expect = malloc((size_t)ticks * BLACKBOX_FIELDS * sizeof(int32_t));
+	uint32_t *expect_t = malloc((size_t)ticks * sizeof(uint32_t));
+	uint32_t *expect_ends = malloc((size_t)ticks * 2 * sizeof(uint32_t));
+	sensors_entry *expect_s = malloc((size_t)ticks * 23 * sizeof(sensors_entry));
+	uint32_t *expect_r = malloc((size_t)ticks * 11 * 2 * sizeof(uint32_t));
+	blackbox_log l;
+	uint64_t seed = 5, bytes;
+	uint32_t k, i, j, t = 0xFFF00000u, ts, tr, ns = 0, nr = 0, bad;
+	double t0, ns_tick;
+	
+	recorder_Reset();
+	blackbox_Start();
+	ts = tr = t;
+	t0 = bench_Seconds();
+	for (k = 0; k < ticks; k++) {
+		// rate loop runs, now and then at a new throttle
+		for (j = bench_Below(&seed, 11); j > 0; j--) {
+			tr += 1000 + bench_Below(&seed, 5);
+			if (bench_Below(&seed, 8) == 0) user_torque = (uint16_t)bench_Below(&seed, 1000);
+			blackbox_Rate(tr);
+			expect_r[2 * nr] = tr;
+			expect_r[2 * nr++ + 1] = user_torque;
+		}
+		batch_Step(&seed, k, &ts);
+		memcpy(&expect_s[ns], sensors_batch, sensors_batch_n * sizeof(sensors_entry));
+		ns += sensors_batch_n;
+		state_Step(&seed, k);
+		t += 10000 + (k % 7 == 0 ? 3 : 0) + (k == ticks / 2 ? 1u << 29 : 0);
+		blackbox_Fields(&expect[(size_t)k * BLACKBOX_FIELDS]);
+		expect_t[k] = t;
+		expect_ends[2 * k] = ns;
+		expect_ends[2 * k + 1] = nr;
+		blackbox_Record(t);
+		while (task_RunNext());
+	}
+	blackbox_Stop();
+	while (task_RunNext());
+	ns_tick = (bench_Seconds() - t0) * 1e9 / ticks;
+	
+	blackbox_LogInit(&l);
+	decode_Blocks(&l);
+	bad = 0;
+	for (k = 0; k < l.n && k < ticks; k++) {
+		bad += l.t_us[k] != expect_t[k] || l.s_end[k] != expect_ends[2 * k] || l.r_end[k] != expect_ends[2 * k + 1];
+		for (i = 0; i < BLACKBOX_FIELDS; i++) bad += l.col[i][k] != expect[(size_t)k * BLACKBOX_FIELDS + i];
+	}
+	check(l.n == ticks && !bad && !l.bad && !l.lost && !blackbox_lost, "every field of every tick back exactly");
+	bad = 0;
+	for (k = 0; k < l.ns && k < ns; k++) {
+		bad += l.s_t_us[k] != expect_s[k].t_us || l.s_sensor[k] != expect_s[k].sensor;
+		for (i = 0; i < 3; i++) bad += l.s_data[k][i] != expect_s[k].data[i];
+	}
+	check(l.ns == ns && !bad, "every raw sample back exactly");
+	bad = 0;
+	for (k = 0; k < l.nr && k < nr; k++) bad += l.r_t_us[k] != expect_r[2 * k] || l.r_throttle[k] != expect_r[2 * k + 1];
+	check(l.nr == nr && !bad && !blackbox_rate_lost, "every rate loop run back exactly");
+	check(expect_t[0] > expect_t[ticks - 1] && ticks > 2000 && expect[BLACKBOX_DRIFT + 2 + (size_t)2000 * BLACKBOX_FIELDS] == 1000000000,
+				"t_us wrap and jump, extremes and clamps included");
+	bytes = blocks_n - blocks_count;
+	printf("items:        %u ticks, %u samples, %u rate runs in %u blocks, %.2fx of raw\n", ticks, ns, nr, blocks_count,
+				((double)ticks * RAW_TICK + (double)ns * RAW_SAMPLE + (double)nr * RAW_RUN) / bytes);
+	printf("record cost:  %.1f ns/tick, encode and flush\n", ns_tick);
+	blackbox_LogFree(&l);
+	
+	// every 5th block refused by the sink
+	recorder_Reset();
+	refuse_every = 5;
+	blackbox_Start();
+	for (k = 0; k < 5000; k++) {
+		batch_Step(&seed, k, &ts);
+		state_Step(&seed, k);
+		blackbox_Record(k * 10000);
+		while (task_RunNext());
+	}
+	blackbox_Stop();
+	while (task_RunNext());
+	blackbox_LogInit(&l);
+	decode_Blocks(&l);
+	bad = 0;
+	for (k = 0; k < l.n; k++) bad += l.s_end[k] < (k ? l.s_end[k - 1] : 0);
+	check(blackbox_lost == blocks_count / 5 && l.lost == blackbox_lost - (blocks_count % 5 == 0)
+				&& l.blocks == blocks_count - blackbox_lost && !bad, "refused blocks counted on board and as seq gaps");
+	blackbox_LogFree(&l);
+	
+	// damaged blocks: truncated, shorter than the header, zero items, too many
+	blackbox_LogInit(&l);
+	k = blocks[0];
+	blackbox_DecodeBlock(&l, &blocks[1], k - 1);
+	blackbox_DecodeBlock(&l, &blocks[1], 2);
+	blocks[4] = 0;
+	blackbox_DecodeBlock(&l, &blocks[1], k);
+	blocks[4] = 200;
+	blackbox_DecodeBlock(&l, &blocks[1], k);
+	check(l.n == 0 && l.ns == 0 && l.nr == 0 && l.bad == 4 && l.blocks == 0 && !l.version, "malformed blocks add nothing");
+	
+	// a good block from a build with another format
+	blackbox_LogFree(&l);
+	blackbox_LogInit(&l);
+	k = blocks[blocks[0] + 1];
+	blackbox_DecodeBlock(&l, &blocks[blocks[0] + 2], k);
+	blocks[blocks[0] + 2] = BLACKBOX_FORMAT_VERSION + 1;
+	blackbox_DecodeBlock(&l, &blocks[blocks[0] + 2], k);
+	check(l.blocks == 1 && l.bad == 1 && l.version == BLACKBOX_FORMAT_VERSION + 1, "a block of another format version refused");
+	blackbox_LogFree(&l);
+	
+	free(expect);
+	free(expect_t);
+	free(expect_ends);
+	free(expect_s);
+	free(expect_r);
+}
+
+/*
+ * @brief: One tick of samples at the sensor rates, a few LSB of noise
+ */
+static void batch_Flight(uint64_t *seed, uint32_t k) {
+	static int16_t walk[SENSORS_COUNT][3];
+	const uint8_t count[SENSORS_COUNT] = {4, k % 4 != 3, 10};
+	const uint32_t dt[SENSORS_COUNT] = {2500, 13333, 1000};
+	uint8_t s, i, a;
+	
+	sensors_batch_n = 0;
+	for (s = 0; s < SENSORS_COUNT; s++) {
+		for (i = 0; i < count[s]; i++) {
+			sensors_entry *e = &sensors_batch[sensors_batch_n++];
+			
+			e->sensor = s;
+			e->t_us = k * 10000 + i * dt[s] + bench_Below(seed, 4);
+			for (a = 0; a < 3; a++) {
+				walk[s][a] = (int16_t)(walk[s][a] + 3 * bench_Noise(seed));
+				e->data[a] = walk[s][a];
+			}
+		}
+	}
+}
+
+static void throughput(uint32_t ticks) {
+	blackbox_log l;
+	uint64_t seed = 9, samples = 0;
+	uint32_t k, frames = 0;
+	double t0, wall_block, wall_stream;
+	
+	// realistic data: a flight's worth of samples and the random walk, no jumps, captured both ways
+	recorder_Reset();
+	hal_HostSerialSink(sink_Stream, NULL);
+	stream_n = 0;
+	blackbox_Start();
+	for (k = 0; k < ticks; k++) {
+		batch_Flight(&seed, k);
+		samples += sensors_batch_n;
+		state_Step(&seed, k + 1);
+		blackbox_Record(k * 10000);
+		while (task_RunNext());
+	}
+	blackbox_Stop();
+	while (task_RunNext());
+	blackbox_SetSink(blackbox_SinkUSB, NULL);
+	blocks_count = 0;
+	for (k = 0; k < blocks_n && stream_n + 256 < sizeof(stream); k += 1 + blocks[k]) {
+		blackbox_SinkUSB(NULL, &blocks[k + 1], blocks[k]);
+		frames++;
+	}
+	printf("flight-like:  %.1f bytes/tick, %.2fx of raw\n", (double)(blocks_n - frames) / ticks,
+				((double)ticks * RAW_TICK + (double)samples * RAW_SAMPLE) / (blocks_n - frames));
+	
+	blackbox_LogInit(&l);
+	t0 = bench_Seconds();
+	for (k = 0; k < DECODE_PASSES; k++) {
+		l.n = l.ns = l.nr = 0;
+		l.synced = 0;
+		decode_Blocks(&l);
+	}
+	wall_block = bench_Seconds() - t0;
+	check(l.bad == 0 && l.n == ticks && l.ns == samples, "decode passes clean");
+	blackbox_LogFree(&l);
+	
+	blackbox_LogInit(&l);
+	t0 = bench_Seconds();
+	for (k = 0; k < DECODE_PASSES; k++) {
+		l.n = l.ns = l.nr = 0;
+		blackbox_DecodeStream(&l, stream, stream_n);
+	}
+	wall_stream = bench_Seconds() - t0;
+	check(l.bad == 0 && l.blocks == (uint64_t)DECODE_PASSES * frames, "stream decode passes clean");
+	blackbox_LogFree(&l);
+	
+	printf("decode:       %.1f MB/s of blocks, %.1f Mticks/s, %.1f Msamples/s\n", (double)blocks_n * DECODE_PASSES / wall_block / 1e6,
+				(double)ticks * DECODE_PASSES / wall_block / 1e6, (double)samples * DECODE_PASSES / wall_block / 1e6);
+	printf("              %.1f MB/s from the raw USB stream (COBS, CRC)\n", (double)stream_n * DECODE_PASSES / wall_stream / 1e6);
+	if ((double)blocks_n * DECODE_PASSES / wall_block / 1e6 < DECODE_MBS_MIN) fail = 1;
+}
+
+static void flight(void) {
+	static sim_world w;
+	static blackbox_log l;
+	Vect3d a = accel, g, m;
+	uint32_t k, bad = 0;
+	uint64_t bytes;
+	
+	blackbox_mode = BLACKBOX_ON;
+	sim_Init(&w, 1);
+	hal_HostSerialSink(sink_Stream, NULL);
+	stream_n = 0;
+	sim_Command(&w, "30");
+	sim_Run(&w, 5);
+	blackbox_Stop();
+	while (task_RunNext());
+	a = accel;
+	g = gyro;
+	m = compass;
+	
+	blackbox_LogInit(&l);
+	blackbox_DecodeStream(&l, stream, stream_n);
+	for (k = 0; k < l.n; k++) {
+		bad += l.col[BLACKBOX_THROTTLE][k] != 30 && k > 0;
+	}
+	check(l.n == 500 && !l.lost && !l.bad && !blackbox_lost, "sim: 5 s logged over USB, nothing lost");
+	check(!bad && l.t_us[l.n - 1] - l.t_us[0] == 499 * 10000, "sim: throttle column and tick times");
+	check(l.col[BLACKBOX_ATTITUDE + 2][l.n - 1] == (int32_t)(yaw * 100.0f + (yaw < 0 ? -0.5f : 0.5f)), "sim: last yaw matches the estimator");
+	
+	// the low-pass again from nothing but the logged samples
+	memset(&accel, 0, sizeof(accel));
+	memset(&gyro, 0, sizeof(gyro));
+	memset(&compass, 0, sizeof(compass));
+	for (k = 0; k < l.ns; k += sensors_batch_n) {
+		sensors_batch_n = (uint16_t)(l.ns - k < SENSORS_RING_SIZE ? l.ns - k : SENSORS_RING_SIZE);
+		for (bad = 0; bad < sensors_batch_n; bad++) {
+			memcpy(sensors_batch[bad].data, l.s_data[k + bad], sizeof(sensors_batch[bad].data));
+			sensors_batch[bad].sensor = l.s_sensor[k + bad];
+		}
+		sensors_FilterBatch();
+	}
+	check(!memcmp(&a, &accel, sizeof(a)) && !memcmp(&g, &gyro, sizeof(g)) && !memcmp(&m, &compass, sizeof(m)),
+				"sim: low-pass rebuilt from the samples bit for bit");
+	bytes = l.bytes - l.blocks * BLACKBOX_BLOCK_HEADER;
+	printf("sim log:      %u ticks, %u samples, %.0f bytes/s, %.2fx of raw\n", l.n, l.ns, l.bytes / 5.0,
+				((double)l.n * RAW_TICK + (double)l.ns * RAW_SAMPLE) / bytes);
+	blackbox_LogFree(&l);
+}
+
+int main(int argc, char **argv) {
+	uint32_t ticks = argc > 1 ? (uint32_t)atol(argv[1]) : 100000;
+	
+	round_Trip(ticks);
+	throughput(ticks);
+	flight();
+	printf("%s: flight data recorder round trip and decode >= %u MB/s\n", fail ? "FAIL" : "PASS", DECODE_MBS_MIN);
+	return fail;
+}
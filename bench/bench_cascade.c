@@ -0,0 +1,188 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "control.h"
+#include "sensors.h"
+#include "sim.h"
+#include "bench.h"
+
+/*
+ * Cascaded control (CONTROL_CASCADE) in the loop with the quad model, the
+ * rate loop on every gyro sample (1 kHz) against every 10th (100 Hz, the
+ * control tick), same gains:
+ *
+ *   step       20 deg yaw setpoint step in hover: rise time, overshoot,
+ *              settling time and steady error of the attitude the loop
+ *              regulates. Roll and pitch steps hold a tilt long enough for
+ *              the horizontal acceleration to drag the accelerometer-based
+ *              estimate, which is the estimators' business, not this bench's
+ *   impulse    a torque pulse on the roll axis: peak angle and body rate
+ *              against simulator truth
+ *   gust       gusty hover: rms attitude and body rate against level
+ *   headroom   the gust flight with HEADROOM times the rate gains: the 1 kHz
+ *              loop stays stable, the 100 Hz one does not
+ *   cost       ns per control_RateTask
+ *
+ *   bench_cascade [iterations]
+ *
+ * Exits 1 if the step does not settle within bounds or the 1 kHz rate loop
+ * rejects the disturbances no better than the 100 Hz one.
+ */
+
+#define RAD2DEG				57.29577951308232
+#define HOVER				"55"
+#define TAKEOFF_SECONDS		3
+#define STEP_DEG			20.0
+#define STEP_SECONDS		4
+#define IMPULSE_NM			0.3
+#define IMPULSE_SECONDS		0.05
+#define GUST_NM				0.02
+#define GUST_SECONDS		20
+#define HEADROOM			1.5
+#define UNSTABLE			10.0				// rms body rate, x the 1 kHz loop
+#define OVERSHOOT_MAX		0.25				// of the step
+#define SETTLE_MAX			2.0					// s, into 2 %
+#define STEADY_MAX			0.5					// deg
+#define DIVS				2
+
+
+typedef struct {
+	double		rise, overshoot, settle, steady;
+	double		peak, peak_rate;
+	double		rms_angle, rms_rate, rms_rate_headroom;
+} cascade_result;
+
+static const uint16_t	divs[DIVS] = {1, 10};
+static sim_world			w;
+static int						fail;
+
+
+static void check(int ok, const char *what) {
+	printf("%-52s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok) fail = 1;
+}
+
+/*
+ * @brief: Cascade at the given rate divider, in hover after takeoff
+ */
+static void fly(uint16_t div, uint64_t seed) {
+	control_mode = CONTROL_CASCADE;
+	control_rate_div = div;
+	roll_des = pitch_des = yaw_des = 0;
+	sim_Init(&w, seed);
+	sim_Command(&w, HOVER);
+	sim_Run(&w, TAKEOFF_SECONDS);
+}
+
+static void step(cascade_result *res) {
+	uint64_t k, n = (uint64_t)STEP_SECONDS * SIM_RATE;
+	double y0 = yaw, y, peak = 0, t10 = -1, t90 = -1, err = 0;
+	uint32_t tail = 0;
+	
+	res->settle = 0;
+	yaw_des = y0 + STEP_DEG;
+	for (k = 1; k <= n; k++) {
+		sim_Step(&w);
+		y = yaw - y0;
+		if (t10 < 0 && y >= 0.1 * STEP_DEG) t10 = (double)k / SIM_RATE;
+		if (t90 < 0 && y >= 0.9 * STEP_DEG) t90 = (double)k / SIM_RATE;
+		if (y > peak) peak = y;
+		if (fabs(y - STEP_DEG) > 0.02 * STEP_DEG) res->settle = (double)k / SIM_RATE;
+		if (k > n - SIM_RATE / 2) {
+			err += y - STEP_DEG;
+			tail++;
+		}
+	}
+	res->rise = t10 >= 0 && t90 >= 0 ? t90 - t10 : INFINITY;
+	res->overshoot = peak > STEP_DEG ? (peak - STEP_DEG) / STEP_DEG : 0;
+	res->steady = fabs(err / tail);
+}
+
+static void impulse(cascade_result *res) {
+	uint64_t k, n = 2 * SIM_RATE;
+	double r, p, y;
+	
+	res->peak = 0;
+	res->peak_rate = 0;
+	for (k = 1; k <= n; k++) {
+		w.quad.torque_ext[0] = k <= IMPULSE_SECONDS * SIM_RATE ? IMPULSE_NM : 0;
+		sim_Step(&w);
+		quad_Euler(&w.quad, &r, &p, &y);
+		if (fabs(r) * RAD2DEG > res->peak) res->peak = fabs(r) * RAD2DEG;
+		if (fabs(w.quad.w[0]) * RAD2DEG > res->peak_rate) res->peak_rate = fabs(w.quad.w[0]) * RAD2DEG;
+	}
+}
+
+/*
+ * @brief: rms roll/pitch angle and body rate over a gusty hover
+ */
+static void gust(double *rms_angle, double *rms_rate) {
+	uint64_t k, n = (uint64_t)GUST_SECONDS * SIM_RATE;
+	double r, p, y, a2 = 0, w2 = 0;
+	
+	w.gust = GUST_NM;
+	for (k = 1; k <= n; k++) {
+		sim_Step(&w);
+		quad_Euler(&w.quad, &r, &p, &y);
+		a2 += (r * r + p * p) * RAD2DEG * RAD2DEG;
+		w2 += (w.quad.w[0] * w.quad.w[0] + w.quad.w[1] * w.quad.w[1]) * RAD2DEG * RAD2DEG;
+	}
+	w.gust = 0;
+	*rms_angle = sqrt(a2 / (2 * n));
+	*rms_rate = sqrt(w2 / (2 * n));
+}
+
+int main(int argc, char **argv) {
+	uint32_t iterations = argc > 1 ? (uint32_t)atol(argv[1]) : 1000000;
+	cascade_result res[DIVS];
+	double t0, ns;
+	uint32_t i;
+	uint8_t d;
+	
+	for (d = 0; d < DIVS; d++) {
+		cascade_result *r = &res[d];
+		double angle;
+		
+		fly(divs[d], 1);
+		step(r);
+		fly(divs[d], 2);
+		impulse(r);
+		fly(divs[d], 3);
+		gust(&r->rms_angle, &r->rms_rate);
+		control_rate_kp *= HEADROOM;
+		control_rate_ki *= HEADROOM;
+		fly(divs[d], 3);
+		gust(&angle, &r->rms_rate_headroom);
+		control_rate_kp = __RATE_KP;
+		control_rate_ki = __RATE_KI;
+		printf("rate loop %4u Hz: yaw step rise %.3f s overshoot %4.1f%% settle %.3f s steady %.3f deg\n",
+						__GYRO_HZ / divs[d], r->rise, r->overshoot * 100, r->settle, r->steady);
+		printf("                  impulse peak %.2f deg %.1f deg/s; gust rms %.3f deg %.2f deg/s, %.2f deg/s at %.1fx gains\n",
+						r->peak, r->peak_rate, r->rms_angle, r->rms_rate, r->rms_rate_headroom, HEADROOM);
+	}
+	check(res[0].overshoot <= OVERSHOOT_MAX && res[0].settle <= SETTLE_MAX && res[0].steady <= STEADY_MAX,
+				"step: 1 kHz rate loop settles within bounds");
+	check(res[0].peak < res[1].peak && res[0].peak_rate < res[1].peak_rate, "impulse: smaller peak at 1 kHz");
+	check(res[0].rms_rate < res[1].rms_rate && res[0].rms_angle <= res[1].rms_angle, "gust: less body rate at 1 kHz");
+	check(res[0].rms_rate_headroom < 2 * res[0].rms_rate && res[1].rms_rate_headroom > UNSTABLE * res[0].rms_rate_headroom,
+				"headroom: higher gains stable at 1 kHz only");
+	
+	// cost: the rate loop on canned gyro samples, nothing in flight
+	fly(1, 4);
+	t0 = bench_Seconds();
+	for (i = 0; i < iterations; i++) {
+		sensors_last[__MEASURE_GYROSCOPE].x = (int16_t)(i & 63);
+		sensors_last[__MEASURE_GYROSCOPE].t_us += 1000;
+		control_RateTask();
+	}
+	ns = (bench_Seconds() - t0) * 1e9 / iterations;
+	bench_Keep(&u_roll);
+	printf("rate_ns_per_call:       %.1f\n", ns);
+	control_mode = CONTROL_ANGLE;
+	control_rate_div = __RATE_DIV;
+	
+	printf("%s: cascaded rate/angle control\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
@@ -0,0 +1,118 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "fastmath.h"
+#include "bench.h"
+
+/*
+ * fastmath vs libm: max/mean error tables against double precision and
+ * time per call. The timings are the host libm's; glibc's sincosf beats
+ * fastmath_sincos on x86, the M4F's newlib does not (see README).
+ *
+ *   bench_fastmath [iterations]
+ *
+ * Exits 1 if an error leaves the bound documented in fastmath.h.
+ */
+
+#define SAMPLES					4096
+#define SCAN					2000000
+
+
+static float	ys[SAMPLES], xs[SAMPLES], as[SAMPLES];
+static int		fail;
+
+
+static void error_Row(const char *name, const char *range, double max, double sum, uint32_t n, double bound) {
+	printf("%-16s %-18s %10.3e %10.3e %10.1e  %s\n", name, range, max, sum / n, bound, max <= bound ? "ok" : "FAIL");
+	if (max > bound) fail = 1;
+}
+
+static void error_Atan2(void) {
+	double max = 0, sum = 0;
+	uint64_t seed = 3;
+	uint32_t i;
+	
+	for (i = 0; i < SCAN; i++) {
+		double t = (i + 0.5) * (2 * M_PI / SCAN) - M_PI;
+		double m = exp(8 * bench_Noise(&seed));					// magnitude 3e-4..3e3
+		float y = (float)(m * sin(t)), x = (float)(m * cos(t));
+		double e = fabs(fastmath_atan2(y, x) - atan2((double)y, (double)x));
+		
+		if (e > M_PI) e = fabs(e - 2 * M_PI);					// +-pi on the negative x axis
+		if (e > max) max = e;
+		sum += e;
+	}
+	error_Row("atan2", "all quadrants", max, sum, SCAN, 2.0e-6);
+}
+
+static void error_Sincos(const char *range, double lim, double bound) {
+	double max = 0, sum = 0;
+	uint32_t i;
+	
+	for (i = 0; i < SCAN; i++) {
+		float x = (float)(-lim + (i + 0.5) * (2 * lim / SCAN));
+		float s, c;
+		double e;
+		
+		fastmath_sincos(x, &s, &c);
+		e = fmax(fabs(s - sin((double)x)), fabs(c - cos((double)x)));
+		if (e > max) max = e;
+		sum += e;
+	}
+	error_Row("sincos", range, max, sum, SCAN, bound);
+}
+
+int main(int argc, char **argv) {
+	uint32_t iterations = argc > 1 ? (uint32_t)atol(argv[1]) : 20000000;
+	uint64_t seed = 11, c0;
+	double t0, ns[5], cy[5];
+	volatile float sink = 0;
+	float acc, s, c;
+	uint32_t i;
+	
+	printf("%-16s %-18s %10s %10s %10s\n", "function", "range", "max_err", "mean_err", "bound");
+	error_Atan2();
+	error_Sincos("|x| <= pi/4", M_PI / 4, 4.0e-7);
+	error_Sincos("|x| <= 2pi", 2 * M_PI, 4.0e-7);
+	error_Sincos("|x| <= 1000", 1000, 4.0e-7);
+	
+	for (i = 0; i < SAMPLES; i++) {
+		ys[i] = 300.0f * (float)bench_Noise(&seed);
+		xs[i] = 300.0f * (float)bench_Noise(&seed);
+		as[i] = 3.2f * (float)bench_Noise(&seed);
+	}
+	
+#define TIME(slot, expr) \
+	acc = 0; \
+	t0 = bench_Seconds(); \
+	c0 = bench_Cycles(); \
+	for (i = 0; i < iterations; i++) { \
+		uint32_t j = i & (SAMPLES - 1); \
+		expr; \
+	} \
+	cy[slot] = (double)(bench_Cycles() - c0) / iterations; \
+	ns[slot] = (bench_Seconds() - t0) * 1e9 / iterations; \
+	sink += acc;
+	
+	TIME(0, acc += atan2f(ys[j], xs[j] + acc * 1e-30f))
+	TIME(1, acc += fastmath_atan2(ys[j], xs[j] + acc * 1e-30f))
+	TIME(2, sincosf(as[j] + acc * 1e-30f, &s, &c); acc += s + c)
+	TIME(3, acc += sinf(as[j] + acc * 1e-30f) + cosf(as[j] + acc * 1e-30f))
+	TIME(4, fastmath_sincos(as[j] + acc * 1e-30f, &s, &c); acc += s + c)
+	(void)sink;
+	
+	printf("\n%-16s %10s %10s\n", "call", "ns", "cycles");
+	printf("%-16s %10.2f %10.1f\n", "atan2f", ns[0], cy[0]);
+	printf("%-16s %10.2f %10.1f\n", "fastmath_atan2", ns[1], cy[1]);
+	printf("%-16s %10.2f %10.1f\n", "sincosf", ns[2], cy[2]);
+	printf("%-16s %10.2f %10.1f\n", "sinf + cosf", ns[3], cy[3]);
+	printf("%-16s %10.2f %10.1f\n", "fastmath_sincos", ns[4], cy[4]);
+	printf("\nfastmath_atan2 vs atan2f:        %.2fx\n", ns[0] / ns[1]);
+	printf("fastmath_sincos vs sinf + cosf:  %.2fx%s\n", ns[3] / ns[4], ns[4] > ns[3] ? " (slower than this host's libm)" : "");
+	
+	printf("%s: fastmath within documented error bounds\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
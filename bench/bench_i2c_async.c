@@ -0,0 +1,235 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i2c_async.h"
+#include "hal_host.h"
+#include "bench.h"
+
+/*
+ * i2c_async state machine against the mock I2C master: transfer checks
+ * (reads, writes, NAKs, queue full, chaining from the callback), then queue
+ * latency for the sensor read pattern at 400 kHz.
+ *
+ *   bench_i2c_async [seconds]
+ *
+ * Exits 1 if a check fails.
+ */
+
+#define DEV_RAM						0x50
+#define DEV_ABSENT					0x51
+#define DEV_READONLY				0x52
+
+#define POLL_HZ						600
+#define BUS_NS(bits)				((uint64_t)(bits) * 1000000000ull / I2C_HOST_BITRATE)
+
+
+static uint8_t		ram[256];
+static int			fail;
+static uint32_t		callbacks;
+static i2c_txn		chained;
+static uint8_t		chained_buf[2];
+
+
+static int32_t ram_Read(void *ctx, uint8_t addr, int32_t nBytes, uint8_t *pBuf) {
+	int32_t i;
+	
+	(void)ctx;
+	for (i = 0; i < nBytes; i++) pBuf[i] = ram[(uint8_t)(addr + i)];
+	return nBytes;
+}
+
+static int32_t ram_Write(void *ctx, uint8_t addr, int32_t nBytes, uint8_t *pBuf) {
+	int32_t i;
+	
+	(void)ctx;
+	for (i = 0; i < nBytes; i++) ram[(uint8_t)(addr + i)] = pBuf[i];
+	return 1;
+}
+
+static int32_t ro_Write(void *ctx, uint8_t addr, int32_t nBytes, uint8_t *pBuf) {
+	(void)ctx;
+	(void)addr;
+	(void)nBytes;
+	(void)pBuf;
+	return 0;
+}
+
+static void check(int ok, const char *what) {
+	printf("%-44s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok) fail = 1;
+}
+
+static void txn_Set(i2c_txn *t, uint8_t id, uint8_t addr, uint8_t dir, uint8_t n, uint8_t *buf) {
+	memset(t, 0, sizeof(*t));
+	t->id = id;
+	t->addr = addr;
+	t->dir = dir;
+	t->n = n;
+	t->buf = buf;
+}
+
+static void on_Done(i2c_txn *t) {
+	(void)t;
+	callbacks++;
+}
+
+static void on_Chain(i2c_txn *t) {
+	(void)t;
+	txn_Set(&chained, DEV_RAM, 0x20, I2C_TXN_READ, 2, chained_buf);
+	i2c_Submit(&chained);
+}
+
+static void bus_Reset(void) {
+	i2c_host_device dev = {DEV_RAM, ram_Read, ram_Write, NULL};
+	i2c_host_device ro = {DEV_READONLY, ram_Read, ro_Write, NULL};
+	uint32_t i;
+	
+	i2c_HostDetachAll();
+	i2c_HostAttach(&dev);
+	i2c_HostAttach(&ro);
+	for (i = 0; i < sizeof(ram); i++) ram[i] = (uint8_t)(i * 7 + 1);
+	i2c_AsyncInit();
+}
+
+static void bus_Drain(void) {
+	while (!i2c_AsyncIdle()) i2c_HostMockRun(i2c_HostMockNow() + 1000);
+}
+
+static void checks(void) {
+	i2c_txn t[I2C_QUEUE_SIZE + 1];
+	uint8_t buf[8], wr[4] = {0xA1, 0xB2, 0xC3, 0xD4};
+	uint64_t t0, irq0;
+	int i, ok;
+	
+	bus_Reset();
+	txn_Set(&t[0], DEV_RAM, 0x32, I2C_TXN_READ, 6, buf);
+	t0 = i2c_HostMockNow();
+	check(i2c_Submit(&t[0]) == 1 && t[0].status == I2C_TXN_BUSY, "submit starts an idle bus");
+	bus_Drain();
+	check(t[0].status == I2C_TXN_DONE && !memcmp(buf, &ram[0x32], 6), "6-byte burst read");
+	// reg write 20 bits, receive start 19, 4 x cont 9, finish 10
+	check(i2c_HostMockNow() - t0 <= BUS_NS(85) + 1000, "6-byte read takes 85 bit times");
+	
+	txn_Set(&t[0], DEV_RAM, 0x10, I2C_TXN_READ, 1, buf);
+	i2c_Submit(&t[0]);
+	bus_Drain();
+	check(t[0].status == I2C_TXN_DONE && buf[0] == ram[0x10], "single-byte read");
+	
+	txn_Set(&t[0], DEV_RAM, 0x10, I2C_TXN_READ, 2, buf);
+	t[0].rep = 3;
+	t[0].done = on_Done;
+	callbacks = 0;
+	irq0 = i2c_host_interrupts;
+	t0 = i2c_HostMockNow();
+	i2c_Submit(&t[0]);
+	bus_Drain();
+	ok = t[0].status == I2C_TXN_DONE && callbacks == 1;
+	for (i = 0; i < 3; i++) ok &= !memcmp(&buf[2*i], &ram[0x10], 2);
+	check(ok, "repeated register read, one callback");
+	// per block: reg write 20 bits, receive start 19, finish 10; 3 interrupts
+	check(i2c_HostMockNow() - t0 <= 3 * BUS_NS(49) + 1000 && i2c_host_interrupts - irq0 == 9, "repeated read re-addresses each block");
+	
+	txn_Set(&t[0], DEV_RAM, 0x10, I2C_TXN_READ, 2, buf);
+	t[0].rep = 3;
+	txn_Set(&t[1], DEV_RAM, 0x20, I2C_TXN_READ, 2, &buf[6]);
+	t[1].done = on_Done;
+	callbacks = 0;
+	i2c_Submit(&t[0]);
+	i2c_Submit(&t[1]);
+	while (t[1].status != I2C_TXN_DONE && !i2c_AsyncIdle()) i2c_HostMockRun(i2c_HostMockNow() + 1000);
+	ok = t[0].status == I2C_TXN_BUSY && t[0].pos == 1;
+	bus_Drain();
+	ok &= t[0].status == I2C_TXN_DONE && !memcmp(&buf[4], &ram[0x10], 2) && !memcmp(&buf[6], &ram[0x20], 2);
+	check(ok, "repeated read gives way between blocks");
+	
+	txn_Set(&t[0], DEV_RAM, 0x40, I2C_TXN_WRITE, 4, wr);
+	txn_Set(&t[1], DEV_RAM, 0x44, I2C_TXN_WRITE, 1, wr);
+	i2c_Submit(&t[0]);
+	i2c_Submit(&t[1]);
+	check(t[1].status == I2C_TXN_QUEUED, "second transaction waits in the queue");
+	bus_Drain();
+	check(t[0].status == I2C_TXN_DONE && !memcmp(&ram[0x40], wr, 4) && ram[0x44] == wr[0], "burst and single-byte writes");
+	
+	txn_Set(&t[0], DEV_ABSENT, 0x00, I2C_TXN_READ, 6, buf);
+	txn_Set(&t[1], DEV_READONLY, 0x00, I2C_TXN_WRITE, 3, wr);
+	txn_Set(&t[2], DEV_RAM, 0x00, I2C_TXN_READ, 2, buf);
+	t[0].done = on_Done;
+	t[1].done = on_Done;
+	callbacks = 0;
+	for (i = 0; i < 3; i++) i2c_Submit(&t[i]);
+	bus_Drain();
+	check(t[0].status == I2C_TXN_ERROR && callbacks == 2, "address NAK reports error, callback runs");
+	check(t[1].status == I2C_TXN_ERROR, "data NAK mid-burst reports error");
+	check(t[2].status == I2C_TXN_DONE && buf[0] == ram[0] && buf[1] == ram[1], "bus recovers after errors");
+	
+	ok = 1;
+	for (i = 0; i < I2C_QUEUE_SIZE; i++) {
+		txn_Set(&t[i], DEV_RAM, (uint8_t)i, I2C_TXN_READ, 1, &buf[i]);
+		ok &= i2c_Submit(&t[i]) == 1;
+	}
+	txn_Set(&t[I2C_QUEUE_SIZE], DEV_RAM, 0, I2C_TXN_READ, 1, buf);
+	check(ok && i2c_Submit(&t[I2C_QUEUE_SIZE]) == 0, "full queue rejects submit");
+	bus_Drain();
+	for (i = 0; i < I2C_QUEUE_SIZE; i++) ok &= t[i].status == I2C_TXN_DONE && buf[i] == ram[i];
+	check(ok, "queued transactions complete in order");
+	
+	txn_Set(&t[0], DEV_RAM, 0, I2C_TXN_READ, 0, buf);
+	check(i2c_Submit(&t[0]) == 0, "zero-length transaction rejected");
+	
+	txn_Set(&t[0], DEV_RAM, 0x00, I2C_TXN_READ, 1, buf);
+	t[0].done = on_Chain;
+	i2c_Submit(&t[0]);
+	bus_Drain();
+	check(chained.status == I2C_TXN_DONE && chained_buf[0] == ram[0x20], "submit from the completion callback");
+}
+
+/*
+ * sensors_Poll pattern: one 6-byte read per tick, compass ticks also queue
+ * the single-measurement trigger write in front of it
+ */
+static void latency(double seconds) {
+	i2c_txn trigger, rd;
+	uint8_t mode = 1, buf[6];
+	uint64_t ticks = (uint64_t)(seconds * POLL_HZ), k, submitted, lat, lat_min = ~0ull, lat_max = 0, lat_sum = 0;
+	uint32_t done = 0;
+	double t0, wall;
+	
+	bus_Reset();
+	t0 = bench_Seconds();
+	for (k = 0; k < ticks; k++) {
+		i2c_HostMockRun(k * 1000000000ull / POLL_HZ);
+		submitted = i2c_HostMockNow();
+		if (k % 3 == 2) {
+			txn_Set(&trigger, DEV_RAM, 0x02, I2C_TXN_WRITE, 1, &mode);
+			i2c_Submit(&trigger);
+		}
+		txn_Set(&rd, DEV_RAM, 0x03, I2C_TXN_READ, 6, buf);
+		i2c_Submit(&rd);
+		bus_Drain();
+		lat = i2c_HostMockNow() - submitted;
+		if (lat < lat_min) lat_min = lat;
+		if (lat > lat_max) lat_max = lat;
+		lat_sum += lat;
+		done += rd.status == I2C_TXN_DONE;
+	}
+	wall = bench_Seconds() - t0;
+	
+	printf("\npoll_hz:                 %u\n", POLL_HZ);
+	printf("reads:                   %u/%llu\n", done, (unsigned long long)ticks);
+	printf("latency_us min/mean/max: %.1f / %.1f / %.1f\n", lat_min / 1e3, lat_sum / 1e3 / ticks, lat_max / 1e3);
+	printf("bus_utilisation:         %.1f %%\n", 100.0 * i2c_host_busy_ns / (ticks * 1e9 / POLL_HZ));
+	printf("interrupts_per_read:     %.2f\n", (double)i2c_host_interrupts / ticks);
+	printf("host_ns_per_interrupt:   %.1f\n", wall * 1e9 / i2c_host_interrupts);
+	if (done != ticks) fail = 1;
+}
+
+int main(int argc, char **argv) {
+	double seconds = argc > 1 ? atof(argv[1]) : 60;
+	
+	checks();
+	latency(seconds);
+	printf("%s: i2c_async transfers and queue\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
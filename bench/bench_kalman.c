@@ -0,0 +1,97 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "kalman.h"
+#include "kalman_fix.h"
+#include "bench.h"
+
+/*
+ * kalman_innovate vs kalman_fix_innovate: accuracy over a synthetic flight
+ * and time per call.
+ *
+ *   bench_kalman [iterations]
+ *
+ * Exits 1 if the fixed-point estimates leave the stated error bound.
+ */
+
+#ifdef __KALMAN_FIX_Q30
+#define BOUND_ANGLE			0.002f				// deg
+#define BOUND_RATE			0.002f				// deg/s
+#else
+#define BOUND_ANGLE			0.005f
+#define BOUND_RATE			0.005f
+#endif
+
+#define SAMPLES					4096
+
+
+static float	z1s[SAMPLES], z2s[SAMPLES];
+static int32_t	z1q[SAMPLES], z2q[SAMPLES];
+
+
+int main(int argc, char **argv) {
+	uint32_t iterations = argc > 1 ? (uint32_t)atol(argv[1]) : 2000000;
+	kalman_data kf;
+	kalman_fix_data kq;
+	float err[3] = {0, 0, 0};
+	uint64_t seed = 42, c0, c1;
+	double t0, t1, ns_float, ns_fix;
+	uint32_t i, k;
+	int fail = 0;
+	
+	// 100 s at 100 Hz: +-30 deg sweep, 2 deg/s gyro bias, sensor noise
+	kalman_init(&kf);
+	kalman_fix_init(&kq);
+	for (k = 0; k < 10000; k++) {
+		float t = k * _dt;
+		float z1 = 30.0f * sinf(3.14159f * t) + 2.0f * (float)bench_Noise(&seed);
+		float z2 = 30.0f * 3.14159f * cosf(3.14159f * t) + 2.0f + 1.0f * (float)bench_Noise(&seed);
+		
+		kalman_innovate(&kf, z1, z2);
+		kalman_fix_innovate(&kq, KALMAN_FIX(z1), KALMAN_FIX(z2));
+		for (i = 0; i < 3; i++) {
+			float e = fabsf(kf.x[i] - KALMAN_FIX_FLOAT(kq.x[i]));
+			if (e > err[i]) err[i] = e;
+		}
+		if (k < SAMPLES) {
+			z1s[k] = z1;
+			z2s[k] = z2;
+			z1q[k] = KALMAN_FIX(z1);
+			z2q[k] = KALMAN_FIX(z2);
+		}
+	}
+	
+	t0 = bench_Seconds();
+	c0 = bench_Cycles();
+	for (i = 0; i < iterations; i++) {
+		kalman_innovate(&kf, z1s[i & (SAMPLES - 1)], z2s[i & (SAMPLES - 1)]);
+		bench_Keep(&kf);
+	}
+	c1 = bench_Cycles();
+	t1 = bench_Seconds();
+	ns_float = (t1 - t0) * 1e9 / iterations;
+	printf("float_ns_per_call:      %.1f\n", ns_float);
+	printf("float_cycles_per_call:  %.1f\n", (double)(c1 - c0) / iterations);
+	
+	t0 = bench_Seconds();
+	c0 = bench_Cycles();
+	for (i = 0; i < iterations; i++) {
+		kalman_fix_innovate(&kq, z1q[i & (SAMPLES - 1)], z2q[i & (SAMPLES - 1)]);
+		bench_Keep(&kq);
+	}
+	c1 = bench_Cycles();
+	t1 = bench_Seconds();
+	ns_fix = (t1 - t0) * 1e9 / iterations;
+	printf("fix_ns_per_call:        %.1f\n", ns_fix);
+	printf("fix_cycles_per_call:    %.1f\n", (double)(c1 - c0) / iterations);
+	printf("fix_pfrac:              %d\n", KALMAN_FIX_PFRAC);
+	
+	printf("max_err_angle_deg:      %.6f (bound %.3f)\n", err[0], BOUND_ANGLE);
+	printf("max_err_rate_dps:       %.6f (bound %.3f)\n", err[1], BOUND_RATE);
+	printf("max_err_drift_dps:      %.6f (bound %.3f)\n", err[2], BOUND_RATE);
+	if (err[0] > BOUND_ANGLE || err[1] > BOUND_RATE || err[2] > BOUND_RATE) fail = 1;
+	printf("%s\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
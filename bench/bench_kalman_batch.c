@@ -0,0 +1,113 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "kalman.h"
+#include "kalman_batch.h"
+#include "bench.h"
+
+/*
+ * Per-axis cost of kalman_batch_innovate against kalman_innovate in a loop,
+ * for the flight controller's 3 axes and replay-sized batches.
+ *
+ *   bench_kalman_batch [axis-updates per size]
+ *
+ * Fails if a batch filter strays from its kalman_data twin by more than
+ * DIFF_MAX after 1000 updates, with the default noise and with kalman_qr
+ * changed at runtime.
+ */
+
+#define N_MAX			4096
+#define DIFF_MAX	1e-3f			// deg, deg/s
+
+
+static kalman_data	kd[N_MAX];
+static float				storage[KALMAN_BATCH_FLOATS(N_MAX)] __attribute__((aligned(64)));
+static float				z1[N_MAX] __attribute__((aligned(64)));
+static float				z2[N_MAX] __attribute__((aligned(64)));
+
+
+/*
+ * @brief: Run 64 batch and 64 scalar filters on the same noise, 1000 ticks
+ * @param[in]: noise seed
+ * @param[out]: largest state difference
+ */
+static float accuracy(uint64_t * seed) {
+	kalman_batch kb;
+	kalman_data out;
+	uint32_t k, i;
+	float err = 0;
+	
+	kalman_batch_init(&kb, storage, 64);
+	for (k = 0; k < 64; k++) kalman_init(&kd[k]);
+	for (i = 0; i < 1000; i++) {
+		for (k = 0; k < 64; k++) {
+			z1[k] = 20.0f * (float)bench_Noise(seed);
+			z2[k] = 50.0f * (float)bench_Noise(seed);
+			kalman_innovate(&kd[k], z1[k], z2[k]);
+		}
+		kalman_batch_innovate(&kb, z1, z2);
+	}
+	for (k = 0; k < 64; k++) {
+		kalman_batch_get(&kb, k, &out);
+		for (i = 0; i < 3; i++) {
+			if (fabsf(out.x[i] - kd[k].x[i]) > err) err = fabsf(out.x[i] - kd[k].x[i]);
+		}
+	}
+	return err;
+}
+
+
+int main(int argc, char **argv) {
+	static const uint32_t sizes[] = {3, 8, 64, 1024, N_MAX};
+	uint64_t updates = argc > 1 ? strtoull(argv[1], NULL, 0) : 20000000;
+	uint64_t seed = 7;
+	kalman_batch kb;
+	uint32_t s, k, i, rounds;
+	double t0, ns_scalar, ns_batch;
+	float err, err_qr;
+	
+	// accuracy: reciprocal-multiply vs six divides, then with tuned noise
+	err = accuracy(&seed);
+	kalman_qr.q11 *= 10.0f;
+	kalman_qr.r00 *= 0.25f;
+	err_qr = accuracy(&seed);
+	kalman_qr = (kalman_noise){_Q00, _Q11, _Q22, _R00, _R11};
+	printf("max_diff_vs_scalar:  %g (runtime kalman_qr %g)\n", err, err_qr);
+	
+	printf("%8s %14s %14s %8s\n", "filters", "scalar_ns/axis", "batch_ns/axis", "speedup");
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		uint32_t n = sizes[s];
+		
+		for (k = 0; k < n; k++) {
+			kalman_init(&kd[k]);
+			z1[k] = 10.0f * (float)bench_Noise(&seed);
+			z2[k] = 10.0f * (float)bench_Noise(&seed);
+		}
+		kalman_batch_init(&kb, storage, n);
+		rounds = (uint32_t)(updates / n);
+		
+		t0 = bench_Seconds();
+		for (i = 0; i < rounds; i++) {
+			for (k = 0; k < n; k++) kalman_innovate(&kd[k], z1[k], z2[k]);
+			bench_Keep(kd);
+		}
+		ns_scalar = (bench_Seconds() - t0) * 1e9 / ((double)rounds * n);
+		
+		t0 = bench_Seconds();
+		for (i = 0; i < rounds; i++) {
+			kalman_batch_innovate(&kb, z1, z2);
+			bench_Keep(storage);
+		}
+		ns_batch = (bench_Seconds() - t0) * 1e9 / ((double)rounds * n);
+		
+		printf("%8u %14.2f %14.2f %7.2fx\n", n, ns_scalar, ns_batch, ns_scalar / ns_batch);
+	}
+	if (!(err <= DIFF_MAX && err_qr <= DIFF_MAX)) {
+		printf("FAIL: batch filters differ from kalman_innovate by more than %g\n", DIFF_MAX);
+		return 1;
+	}
+	printf("PASS: batch Kalman update\n");
+	return 0;
+}
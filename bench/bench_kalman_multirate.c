@@ -0,0 +1,316 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "kalman.h"
+#include "control.h"
+#include "sensors.h"
+#include "sim.h"
+#include "bench.h"
+
+/*
+ * Multi-rate Kalman (kalman_predict / kalman_correct_*, CONTROL_EST_MULTIRATE)
+ * against the single-rate kalman_innovate:
+ *
+ *   split      kalman_predict(_dt), kalman_correct_angle, kalman_correct_rate
+ *              is kalman_innovate up to rounding
+ *   jitter     samples at jittered times: predicting by the true dt tracks
+ *              the truth better than a fixed _dt step
+ *   long run   LONG_STEPS gyro-rate steps (an hour at 1 kHz) with jittered dt,
+ *              an angle correction every fourth: P stays positive definite
+ *              and within LONG_BOUND of the same recursion in double
+ *   flight     attitude error against simulator truth, both estimators, with
+ *              gusts; the multi-rate one no worse than BOUND_RATIO per axis
+ *   cost       ns per kalman_predict and per correction
+ *
+ *   bench_kalman_multirate [iterations]
+ *
+ * Exits 1 if a check fails.
+ */
+
+#define RAD2DEG				57.29577951308232
+#define UPDATES				30000					// 300 s at 100 Hz
+#define SPLIT_BOUND			1e-3f					// deg, deg/s
+#define JITTER				0.5f					// dt in _dt * [1 - JITTER, 1 + JITTER]
+#define LONG_STEPS			3600000
+#define LONG_BOUND			1e-3					// relative, largest P entry
+#define FLIGHT_SECONDS		30
+#define FLIGHTS				4
+#define SETTLE_SECONDS		5
+#define BOUND_RATIO			1.5
+#define SAMPLES				4096
+
+
+static float	z1s[UPDATES], z2s[UPDATES];
+static int		fail;
+static const char *names[3] = {"kalman", "ahrs", "multirate"};
+
+
+static void check(int ok, const char *what) {
+	printf("%-52s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok) fail = 1;
+}
+
+static double angle_Diff(double a, double b) {
+	return fmod(a - b + 540.0, 360.0) - 180.0;
+}
+
+/*
+ * @brief: +-30 deg sweep, 2 deg/s gyro bias, sensor noise
+ */
+static void samples_Make(void) {
+	uint64_t seed = 42;
+	uint32_t k;
+	
+	for (k = 0; k < UPDATES; k++) {
+		float t = k * _dt;
+		
+		z1s[k] = 30.0f * sinf(0.5f * t) + 2.0f * (float)bench_Noise(&seed);
+		z2s[k] = 15.0f * cosf(0.5f * t) + 2.0f + 1.0f * (float)bench_Noise(&seed);
+	}
+}
+
+/*
+ * @brief: The same measurements through kalman_innovate and the split steps
+ * @param[out]: largest |difference| of angle, rate, drift
+ */
+static void split(float *err) {
+	kalman_data one, two;
+	uint32_t k;
+	uint8_t i;
+	
+	kalman_init(&one);
+	kalman_init(&two);
+	err[0] = err[1] = err[2] = 0;
+	for (k = 0; k < UPDATES; k++) {
+		kalman_innovate(&one, z1s[k], z2s[k]);
+		kalman_predict(&two, _dt);
+		kalman_correct_angle(&two, z1s[k]);
+		kalman_correct_rate(&two, z2s[k]);
+		for (i = 0; i < 3; i++) {
+			float e = fabsf(one.x[i] - two.x[i]);
+			
+			if (e > err[i]) err[i] = e;
+		}
+	}
+}
+
+/*
+ * @brief: A 10 deg, 1 Hz swing sampled at jittered times, 1 deg/s gyro bias
+ * @param[out]: rms angle error of kalman_predict by the true dt and of
+ * 				kalman_innovate, which assumes _dt
+ */
+static void jitter(double *rms_true, double *rms_fixed) {
+	kalman_data a, b;
+	uint64_t seed = 9;
+	double t = 0, e2a = 0, e2b = 0;
+	uint32_t k, n = 0;
+	
+	kalman_init(&a);
+	kalman_init(&b);
+	for (k = 0; k < UPDATES; k++) {
+		float dt = _dt * (1.0f + JITTER * (float)bench_Noise(&seed));
+		float angle, rate;
+		
+		t += dt;
+		angle = 10.0f * sinf(6.2831853f * (float)t);
+		rate = 62.831853f * cosf(6.2831853f * (float)t);
+		kalman_predict(&a, dt);
+		kalman_correct_angle(&a, angle + 0.5f * (float)bench_Noise(&seed));
+		kalman_correct_rate(&a, rate + 1.0f + 0.5f * (float)bench_Noise(&seed));
+		kalman_innovate(&b, angle + 0.5f * (float)bench_Noise(&seed), rate + 1.0f + 0.5f * (float)bench_Noise(&seed));
+		if (k >= UPDATES / 10) {
+			e2a += (a.x[0] - angle) * (a.x[0] - angle);
+			e2b += (b.x[0] - angle) * (b.x[0] - angle);
+			n++;
+		}
+	}
+	*rms_true = sqrt(e2a / n);
+	*rms_fixed = sqrt(e2b / n);
+}
+
+/*
+ * @brief: kalman_predict and kalman_correct_* on P in double
+ */
+static void ref_Predict(double *P, double dt) {
+	double q = dt / _dt;
+	double P01 = P[KALMAN_P01] + dt * (P[KALMAN_P11] - P[KALMAN_P12]);
+	double P02 = P[KALMAN_P02] + dt * (P[KALMAN_P12] - P[KALMAN_P22]);
+	
+	P[KALMAN_P00] += dt * (P[KALMAN_P01] - P[KALMAN_P02]) + dt * (P01 - P02) + kalman_qr.q00 * q;
+	P[KALMAN_P01] = P01;
+	P[KALMAN_P02] = P02;
+	P[KALMAN_P11] += kalman_qr.q11 * q;
+	P[KALMAN_P22] += kalman_qr.q22 * q;
+}
+
+static void ref_Correct(double *P, uint8_t j, double r) {
+	static const uint8_t col[2][3] = {
+		{KALMAN_P00, KALMAN_P01, KALMAN_P02},
+		{KALMAN_P01, KALMAN_P11, KALMAN_P12},
+	};
+	double c[3] = {P[col[j][0]], P[col[j][1]], P[col[j][2]]};
+	double s = c[j] + r;
+	
+	P[KALMAN_P00] -= c[0] * c[0] / s;
+	P[KALMAN_P01] -= c[0] * c[1] / s;
+	P[KALMAN_P02] -= c[0] * c[2] / s;
+	P[KALMAN_P11] -= c[1] * c[1] / s;
+	P[KALMAN_P12] -= c[1] * c[2] / s;
+	P[KALMAN_P22] -= c[2] * c[2] / s;
+}
+
+/*
+ * @brief: Smallest leading principal minor of P, relative to its scale
+ */
+static double pd_Margin(const float *Pf) {
+	double P[6], m1, m2, m3, scale;
+	uint8_t i;
+	
+	for (i = 0; i < 6; i++) P[i] = Pf[i];
+	scale = P[KALMAN_P00] + P[KALMAN_P11] + P[KALMAN_P22];
+	m1 = P[KALMAN_P00];
+	m2 = P[KALMAN_P00] * P[KALMAN_P11] - P[KALMAN_P01] * P[KALMAN_P01];
+	m3 = P[KALMAN_P00] * (P[KALMAN_P11] * P[KALMAN_P22] - P[KALMAN_P12] * P[KALMAN_P12])
+			- P[KALMAN_P01] * (P[KALMAN_P01] * P[KALMAN_P22] - P[KALMAN_P12] * P[KALMAN_P02])
+			+ P[KALMAN_P02] * (P[KALMAN_P01] * P[KALMAN_P12] - P[KALMAN_P11] * P[KALMAN_P02]);
+	m1 /= scale;
+	m2 /= scale * scale;
+	m3 /= scale * scale * scale;
+	return m1 < m2 ? (m1 < m3 ? m1 : m3) : (m2 < m3 ? m2 : m3);
+}
+
+/*
+ * @brief: The multi-rate recursion at the gyro rate for LONG_STEPS
+ * @param[out]: smallest pd_Margin seen, largest |P - double P| relative to
+ * 				the largest entry of the double P
+ */
+static void long_Run(double *margin, double *err) {
+	kalman_data kd;
+	double ref[6];
+	uint64_t seed = 17;
+	uint32_t k;
+	uint8_t i;
+	
+	kalman_init(&kd);
+	for (i = 0; i < 6; i++) ref[i] = kd.P[i];
+	*margin = INFINITY;
+	*err = 0;
+	for (k = 0; k < LONG_STEPS; k++) {
+		float dt = 1e-3f * (1.0f + JITTER * (float)bench_Noise(&seed));
+		double m, big = 0;
+		
+		kalman_predict(&kd, dt);
+		ref_Predict(ref, dt);
+		kalman_correct_rate(&kd, 0);
+		ref_Correct(ref, 1, kalman_qr.r11);
+		if (k % 4 == 0) {
+			kalman_correct_angle(&kd, 0);
+			ref_Correct(ref, 0, kalman_qr.r00);
+		}
+		m = pd_Margin(kd.P);
+		if (m < *margin) *margin = m;
+		if (k % 1000 == 999) {
+			for (i = 0; i < 6; i++) if (fabs(ref[i]) > big) big = fabs(ref[i]);
+			for (i = 0; i < 6; i++) if (fabs(kd.P[i] - ref[i]) / big > *err) *err = fabs(kd.P[i] - ref[i]) / big;
+		}
+	}
+}
+
+/*
+ * @brief: rms error per axis over FLIGHTS gusty flights, firmware running open
+ * 				loop
+ */
+static void flights(uint8_t estimator, double rms[3]) {
+	static sim_world w;
+	double err2[3] = {0, 0, 0};
+	uint64_t n = 0, k;
+	uint32_t run;
+	
+	control_estimator = estimator;
+	for (run = 0; run < FLIGHTS; run++) {
+		sim_Init(&w, 200 + run);
+		w.gust = 0.01;
+		quad_SetEuler(&w.quad, 10 / RAD2DEG, -10 / RAD2DEG, (run * 20) / RAD2DEG);
+		sim_Command(&w, "30");
+		for (k = 1; k <= (uint64_t)FLIGHT_SECONDS * SIM_RATE; k++) {
+			sim_Step(&w);
+			if (k % (SIM_RATE / 100) == 0 && k >= (uint64_t)SETTLE_SECONDS * SIM_RATE) {
+				double r, p, y;
+				
+				quad_Euler(&w.quad, &r, &p, &y);
+				err2[0] += pow(angle_Diff(roll, r * RAD2DEG), 2);
+				err2[1] += pow(angle_Diff(pitch, p * RAD2DEG), 2);
+				err2[2] += pow(angle_Diff(yaw, y * RAD2DEG), 2);
+				n++;
+			}
+		}
+	}
+	control_estimator = CONTROL_EST_KALMAN;
+	for (k = 0; k < 3; k++) rms[k] = sqrt(err2[k] / n);
+}
+
+int main(int argc, char **argv) {
+	uint32_t iterations = argc > 1 ? (uint32_t)atol(argv[1]) : 2000000;
+	kalman_data kd;
+	float err[3];
+	double margin, long_err, rms_true, rms_fixed, rms[3][3], t0, ns_predict, ns_correct, ns_innovate;
+	uint32_t i;
+	uint8_t e, worse = 0;
+	
+	samples_Make();
+	
+	// split
+	split(err);
+	printf("split:        max difference angle %.2e deg, rate %.2e deg/s, drift %.2e deg/s\n", err[0], err[1], err[2]);
+	check(err[0] <= SPLIT_BOUND && err[1] <= SPLIT_BOUND && err[2] <= SPLIT_BOUND, "split: predict + corrections match kalman_innovate");
+	
+	// jitter
+	jitter(&rms_true, &rms_fixed);
+	printf("jitter:       +-%.0f%% dt, rms error %.3f deg by true dt, %.3f deg by _dt\n", JITTER * 100, rms_true, rms_fixed);
+	check(rms_true < rms_fixed, "jitter: true dt tracks better");
+	
+	// long run
+	long_Run(&margin, &long_err);
+	printf("long run:     %u steps, smallest P minor %.2e (relative), largest difference to double %.2e\n",
+					LONG_STEPS, margin, long_err);
+	check(margin > 0 && long_err < LONG_BOUND, "long run: P positive definite, tracks the double recursion");
+	
+	// flight
+	for (e = CONTROL_EST_KALMAN; e <= CONTROL_EST_MULTIRATE; e += CONTROL_EST_MULTIRATE) {
+		flights(e, rms[e]);
+		printf("flight:       %-9s rms error deg  roll %6.3f  pitch %6.3f  yaw %6.3f\n", names[e], rms[e][0], rms[e][1], rms[e][2]);
+	}
+	for (i = 0; i < 3; i++) {
+		if (rms[CONTROL_EST_MULTIRATE][i] > BOUND_RATIO * rms[CONTROL_EST_KALMAN][i]) worse = 1;
+	}
+	check(!worse, "flight: multi-rate error within bounds");
+	
+	// cost
+	kalman_init(&kd);
+	t0 = bench_Seconds();
+	for (i = 0; i < iterations; i++) {
+		kalman_innovate(&kd, z1s[i & (SAMPLES - 1)], z2s[i & (SAMPLES - 1)]);
+		bench_Keep(&kd);
+	}
+	ns_innovate = (bench_Seconds() - t0) * 1e9 / iterations;
+	t0 = bench_Seconds();
+	for (i = 0; i < iterations; i++) {
+		kalman_predict(&kd, _dt);
+		bench_Keep(&kd);
+	}
+	ns_predict = (bench_Seconds() - t0) * 1e9 / iterations;
+	t0 = bench_Seconds();
+	for (i = 0; i < iterations; i++) {
+		kalman_correct_rate(&kd, z2s[i & (SAMPLES - 1)]);
+		bench_Keep(&kd);
+	}
+	ns_correct = (bench_Seconds() - t0) * 1e9 / iterations;
+	printf("innovate_ns_per_call:   %.1f\n", ns_innovate);
+	printf("predict_ns_per_call:    %.1f\n", ns_predict);
+	printf("correct_ns_per_call:    %.1f\n", ns_correct);
+	
+	printf("%s: multi-rate Kalman\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
@@ -0,0 +1,211 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "kalman.h"
+#include "control.h"
+#include "param.h"
+#include "sim.h"
+#include "bench.h"
+
+/*
+ * Steady-state Kalman gain (KALMAN_GAIN_STEADY) against the full filter:
+ *
+ *   solve      kalman_steady_solve reaches the stationary covariance
+ *   exact      with tol 0 the steady filter is the full one bit for bit,
+ *              before and after the switch
+ *   tol        with TOL the switch comes earlier and the estimates stay
+ *              within BOUND_* of the full filter
+ *   re-solve   a noise parameter change restarts the solve and the filters'
+ *              update counts; per-tick steps reach the same gain as a solve
+ *              from scratch
+ *   flight     a simulated flight long enough to switch, against the same
+ *              flight on the full filter
+ *   cost       ns per call after the switch, against the full filter
+ *
+ *   bench_kalman_steady [iterations]
+ *
+ * Exits 1 if a check fails or the steady update is not SPEEDUP_MIN times
+ * faster.
+ */
+
+#define UPDATES					30000					// 300 s at 100 Hz
+#define TOL							1e-3f
+#define BOUND_ANGLE			0.001f				// deg
+#define BOUND_RATE			0.001f				// deg/s
+#define FLIGHT_TICKS		10000					// 100 s
+#define FLIGHT_BOUND		0.01					// deg, rms
+#define SPEEDUP_MIN			2.0
+#define SAMPLES					4096
+
+
+static float	z1s[UPDATES], z2s[UPDATES];
+static int		fail;
+
+
+static void check(int ok, const char *what) {
+	printf("%-52s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok) fail = 1;
+}
+
+/*
+ * @brief: +-30 deg sweep, 2 deg/s gyro bias, sensor noise
+ */
+static void samples_Make(void) {
+	uint64_t seed = 42;
+	uint32_t k;
+	
+	for (k = 0; k < UPDATES; k++) {
+		float t = k * _dt;
+		
+		z1s[k] = 30.0f * sinf(0.5f * t) + 2.0f * (float)bench_Noise(&seed);
+		z2s[k] = 15.0f * cosf(0.5f * t) + 2.0f + 1.0f * (float)bench_Noise(&seed);
+	}
+}
+
+/*
+ * @brief: The same measurements through a full and a steady filter
+ * @param[in]: updates
+ * @param[out]: largest |difference| of angle, rate, drift after the switch;
+ * 				1 if bit for bit throughout
+ */
+static int compare(uint32_t updates, float *err) {
+	kalman_data full, steady;
+	uint32_t k;
+	uint8_t i;
+	int exact = 1;
+	
+	kalman_init(&full);
+	kalman_init(&steady);
+	err[0] = err[1] = err[2] = 0;
+	for (k = 0; k < updates; k++) {
+		kalman_gain_mode = KALMAN_GAIN_FULL;
+		kalman_innovate(&full, z1s[k], z2s[k]);
+		kalman_gain_mode = KALMAN_GAIN_STEADY;
+		kalman_innovate(&steady, z1s[k], z2s[k]);
+		exact &= !memcmp(full.x, steady.x, sizeof(full.x));
+		for (i = 0; i < 3; i++) {
+			float e = fabsf(full.x[i] - steady.x[i]);
+			
+			if (e > err[i]) err[i] = e;
+		}
+	}
+	kalman_gain_mode = KALMAN_GAIN_FULL;
+	return exact;
+}
+
+static double flight(uint8_t mode, uint32_t *steady_n) {
+	static sim_world w;
+	static float trace[FLIGHT_TICKS][2];
+	uint32_t k;
+	double e2 = 0;
+	
+	kalman_gain_mode = mode;
+	sim_Init(&w, 3);
+	w.gust = 0.01;
+	sim_Command(&w, "30");
+	for (k = 0; k < FLIGHT_TICKS; k++) {
+		sim_Run(&w, 0.01);
+		if (mode == KALMAN_GAIN_FULL) {
+			trace[k][0] = roll;
+			trace[k][1] = pitch;
+		} else {
+			e2 += (roll - trace[k][0]) * (roll - trace[k][0]) + (pitch - trace[k][1]) * (pitch - trace[k][1]);
+		}
+	}
+	*steady_n = k_roll.n;
+	kalman_gain_mode = KALMAN_GAIN_FULL;
+	return sqrt(e2 / (2 * FLIGHT_TICKS));
+}
+
+static double time_Calls(uint8_t mode, uint32_t iterations) {
+	kalman_data kd;
+	double t0;
+	uint32_t i;
+	
+	kalman_init(&kd);
+	kalman_gain_mode = mode;
+	for (i = 0; i < UPDATES; i++) kalman_innovate(&kd, z1s[i], z2s[i]);
+	t0 = bench_Seconds();
+	for (i = 0; i < iterations; i++) {
+		kalman_innovate(&kd, z1s[i & (SAMPLES - 1)], z2s[i & (SAMPLES - 1)]);
+		bench_Keep(&kd);
+	}
+	t0 = bench_Seconds() - t0;
+	kalman_gain_mode = KALMAN_GAIN_FULL;
+	return t0 * 1e9 / iterations;
+}
+
+int main(int argc, char **argv) {
+	uint32_t iterations = argc > 1 ? (uint32_t)atol(argv[1]) : 2000000;
+	kalman_steady ref = {0};
+	kalman_data kd;
+	float err[3], r00 = 500.0f;
+	uint32_t n_exact, ticks, steady_n, bits, k;
+	double t0, rms, ns_full, ns_steady;
+	
+	samples_Make();
+	
+	// solve
+	t0 = bench_Seconds();
+	kalman_steady_reset(&kalman_ss, 0.0f);
+	check(kalman_steady_solve(&kalman_ss, 2 * KALMAN_STEADY_ITER_MAX), "solve: stationary covariance reached");
+	t0 = bench_Seconds() - t0;
+	n_exact = kalman_ss.n;
+	printf("solve:        %u iterations (%.1f s of filter), %.2f ms\n", n_exact, n_exact * _dt, t0 * 1e3);
+	printf("gain:         %.6g %.6g / %.6g %.6g / %.6g %.6g\n", kalman_ss.K[0][0], kalman_ss.K[0][1],
+					kalman_ss.K[1][0], kalman_ss.K[1][1], kalman_ss.K[2][0], kalman_ss.K[2][1]);
+	
+	// exact switch
+	check(compare(UPDATES, err), "exact: steady filter bit for bit the full one");
+	
+	// switch within a tolerance
+	kalman_steady_reset(&kalman_ss, TOL);
+	kalman_steady_solve(&kalman_ss, 2 * KALMAN_STEADY_ITER_MAX);
+	printf("tol %.0e:    switch after %u updates (%.1f s)\n", TOL, kalman_ss.n, kalman_ss.n * _dt);
+	check(kalman_ss.state == KALMAN_STEADY_READY && kalman_ss.n < n_exact, "tol: earlier switch");
+	compare(UPDATES, err);
+	printf("tol:          max error angle %.6f deg, rate %.6f deg/s, drift %.6f deg/s\n", err[0], err[1], err[2]);
+	check(err[0] <= BOUND_ANGLE && err[1] <= BOUND_RATE && err[2] <= BOUND_RATE, "tol: estimates within bounds");
+	
+	// noise parameter change, on a filter already switched
+	kalman_steady_reset(&kalman_ss, 0.0f);
+	kalman_steady_solve(&kalman_ss, 2 * KALMAN_STEADY_ITER_MAX);
+	kalman_init(&kd);
+	kalman_gain_mode = KALMAN_GAIN_STEADY;
+	for (k = 0; k < UPDATES; k++) kalman_innovate(&kd, z1s[k], z2s[k]);
+	memcpy(&bits, &r00, sizeof(bits));
+	param_Set(PARAM_R00, bits);
+	check(kalman_ss.state == KALMAN_STEADY_LIMIT, "re-solve: noise change restarts the solve");
+	kalman_steady_reset(&ref, 0.0f);
+	kalman_steady_solve(&ref, 2 * KALMAN_STEADY_ITER_MAX);
+	for (ticks = 0; !kalman_steady_solve(&kalman_ss, KALMAN_STEADY_ITER_TICK); ticks++);
+	printf("re-solve:     %u ticks of %u iterations (%.1f s at 100 Hz)\n", ticks + 1, KALMAN_STEADY_ITER_TICK, (ticks + 1) * _dt);
+	check(!memcmp(ref.K, kalman_ss.K, sizeof(ref.K)) && ref.n == kalman_ss.n, "re-solve: per-tick solve matches one from scratch");
+	check(ref.K[0][0] != 0 && kalman_qr.r00 == 500.0f, "re-solve: gain for the new noise");
+	kalman_innovate(&kd, z1s[0], z2s[0]);
+	check(kd.n == 1, "re-solve: filters count their full updates again");
+	kalman_gain_mode = KALMAN_GAIN_FULL;
+	param_Defaults();
+	
+	// flight
+	flight(KALMAN_GAIN_FULL, &steady_n);
+	rms = flight(KALMAN_GAIN_STEADY, &steady_n);
+	printf("flight:       %u ticks, switched after %u, rms difference %.6f deg\n", FLIGHT_TICKS, kalman_ss.n, rms);
+	check(kalman_ss.state == KALMAN_STEADY_READY && steady_n >= kalman_ss.n, "flight: switched to the steady gain");
+	check(rms <= FLIGHT_BOUND, "flight: attitude matches the full filter");
+	
+	// cost
+	kalman_steady_reset(&kalman_ss, 0.0f);
+	kalman_steady_solve(&kalman_ss, 2 * KALMAN_STEADY_ITER_MAX);
+	ns_full = time_Calls(KALMAN_GAIN_FULL, iterations);
+	ns_steady = time_Calls(KALMAN_GAIN_STEADY, iterations);
+	printf("full_ns_per_call:       %.1f\n", ns_full);
+	printf("steady_ns_per_call:     %.1f (%.1fx)\n", ns_steady, ns_full / ns_steady);
+	check(ns_full / ns_steady >= SPEEDUP_MIN, "cost: steady update faster");
+	
+	printf("%s: steady-state Kalman gain\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
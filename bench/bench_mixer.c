@@ -0,0 +1,321 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "mixer.h"
+#include "control.h"
+#include "sim.h"
+#include "bench.h"
+
+/*
+ * The motor mixer (src/mixer.h) on its own and flying every frame:
+ *
+ *   tables     each built-in table against the simulated airframe: every
+ *              command column turns the frame about its own axis only, and
+ *              none changes the total thrust
+ *   linear     unsaturated outputs are throttle + table x command
+ *   range      random commands never leave [0, out_max]
+ *   authority  saturating commands: the roll and pitch the outputs realize,
+ *              desaturated against clamping each motor
+ *   flight     CONTROL_CASCADE hover for each frame and a custom table: rms
+ *              attitude against level under gusts, a yaw step, a roll torque
+ *              impulse, all against simulator truth
+ *   cost       ns per mixer_mix for each frame, and the clamped quad X mix it
+ *              replaced
+ *
+ *   bench_mixer [iterations]
+ *
+ * Exits 1 if a check fails.
+ */
+
+#define RAD2DEG				57.29577951308232
+#define OUT_MAX				100.0f
+#define SAMPLES				4096
+#define HOVER				"55"
+#define TAKEOFF_SECONDS		3
+#define GUST_NM				0.02
+#define GUST_SECONDS		10
+#define STEP_DEG			20.0
+#define STEP_SECONDS		4
+#define IMPULSE_NM			0.3
+#define IMPULSE_SECONDS		0.05
+#define RMS_MAX				0.5					// deg, gusts
+#define OVERSHOOT_MAX		0.25				// of the step
+#define STEADY_MAX			0.5					// deg
+#define PEAK_MAX			5.0					// deg, impulse
+#define FLIGHTS				(MIXER_FRAMES + 1)
+
+typedef struct {
+	double		rms, overshoot, steady, peak;
+} flight_result;
+
+static const char	*frame_names[FLIGHTS] = {"quad_x", "quad_plus", "hex_x", "octo_x", "custom"};
+// the default quad's geometry as it is, {-sin a, cos a, -dir}: 1/sqrt(2) of
+// the MIXER_QUAD_X rows
+static const float	custom_mix[4][3] = {
+	{+0.7071068f, -0.7071068f, -1.0f},
+	{+0.7071068f, +0.7071068f, +1.0f},
+	{-0.7071068f, -0.7071068f, +1.0f},
+	{-0.7071068f, +0.7071068f, -1.0f},
+};
+static float		cmd[SAMPLES][4];
+static sim_world	w;
+static int			fail;
+
+
+static void check(int ok, const char *what) {
+	printf("%-52s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok) fail = 1;
+}
+
+/*
+ * @brief: The CONTROL_CASCADE mix before the mixer table: X rows, each motor
+ * 				clamped on its own
+ */
+static inline void clamp_Mix(float throttle, float roll, float pitch, float yaw, float out_max, float *out) {
+	static const int8_t mix[4][3] = {
+		{+1, -1, -1},
+		{+1, +1, +1},
+		{-1, -1, +1},
+		{-1, +1, -1},
+	};
+	uint8_t i;
+	
+	for (i = 0; i < 4; i++) {
+		float m = throttle + mix[i][0] * roll + mix[i][1] * pitch + mix[i][2] * yaw;
+		
+		if (m < 0.0f) m = 0.0f;
+		if (m > out_max) m = out_max;
+		out[i] = m;
+	}
+}
+
+/*
+ * @brief: Command the outputs realize on one axis: projection on its column,
+ * 				which the throttle does not reach (columns sum to zero)
+ */
+static double realized(const mixer_data *m, const float *out, uint8_t axis) {
+	double num = 0, den = 0;
+	uint8_t i;
+	
+	for (i = 0; i < m->motors; i++) {
+		num += m->mix[i][axis] * out[i];
+		den += m->mix[i][axis] * m->mix[i][axis];
+	}
+	return num / den;
+}
+
+/*
+ * @brief: Thrust and body torques per unit command on each axis, from the
+ * 				airframe the simulator flies for the frame
+ * @param[out]: largest |cross-axis torque| and |thrust| over the three
+ * 				columns, relative to the on-axis torque; INFINITY if an on-axis
+ * 				torque has the wrong sign
+ */
+static double table_Coupling(const mixer_data *m, const quad_params *p) {
+	double worst = 0;
+	uint8_t axis, k, i;
+	
+	for (axis = 0; axis < 3; axis++) {
+		double t[3] = {0, 0, 0}, thrust = 0;
+		
+		for (i = 0; i < m->motors; i++) {
+			double c = m->mix[i][axis];
+			
+			t[0] += -p->motor_y[i] * c;
+			t[1] += p->motor_x[i] * c;
+			t[2] += -p->motor_dir[i] * c;
+			thrust += c;
+		}
+		if (t[axis] <= 0) return INFINITY;
+		for (k = 0; k < 3; k++) {
+			if (k != axis && fabs(t[k]) / t[axis] > worst) worst = fabs(t[k]) / t[axis];
+		}
+		if (fabs(thrust) / t[axis] > worst) worst = fabs(thrust) / t[axis];
+	}
+	return worst;
+}
+
+/*
+ * @brief: CONTROL_CASCADE on the frame (MIXER_CUSTOM: custom_mix on the
+ * 				default quad), in hover after takeoff
+ */
+static void fly(uint8_t frame, uint64_t seed) {
+	control_mode = CONTROL_CASCADE;
+	control_frame = frame;
+	if (frame == MIXER_CUSTOM) mixer_custom(&control_mixer, custom_mix, 4);
+	roll_des = pitch_des = yaw_des = 0;
+	sim_Init(&w, seed);
+	sim_Command(&w, HOVER);
+	sim_Run(&w, TAKEOFF_SECONDS);
+}
+
+static void flight(uint8_t frame, flight_result *res) {
+	uint64_t k, n;
+	double r, p, y, y0, a2 = 0, peak = 0, err = 0;
+	uint32_t tail = 0;
+	
+	// gusts
+	fly(frame, 1);
+	w.gust = GUST_NM;
+	n = (uint64_t)GUST_SECONDS * SIM_RATE;
+	for (k = 1; k <= n; k++) {
+		sim_Step(&w);
+		quad_Euler(&w.quad, &r, &p, &y);
+		a2 += (r * r + p * p) * RAD2DEG * RAD2DEG;
+	}
+	w.gust = 0;
+	res->rms = sqrt(a2 / (2 * n));
+	
+	// yaw step, on the estimate the loop regulates
+	fly(frame, 2);
+	y0 = yaw;
+	yaw_des = y0 + STEP_DEG;
+	n = (uint64_t)STEP_SECONDS * SIM_RATE;
+	for (k = 1; k <= n; k++) {
+		sim_Step(&w);
+		if (yaw - y0 > peak) peak = yaw - y0;
+		if (k > n - SIM_RATE / 2) {
+			err += yaw - y0 - STEP_DEG;
+			tail++;
+		}
+	}
+	res->overshoot = peak > STEP_DEG ? (peak - STEP_DEG) / STEP_DEG : 0;
+	res->steady = fabs(err / tail);
+	
+	// roll impulse
+	fly(frame, 3);
+	res->peak = 0;
+	for (k = 1; k <= 2 * SIM_RATE; k++) {
+		w.quad.torque_ext[0] = k <= IMPULSE_SECONDS * SIM_RATE ? IMPULSE_NM : 0;
+		sim_Step(&w);
+		quad_Euler(&w.quad, &r, &p, &y);
+		if (fabs(r) * RAD2DEG > res->peak) res->peak = fabs(r) * RAD2DEG;
+	}
+	
+	control_mode = CONTROL_ANGLE;
+	control_frame = __FRAME;
+}
+
+int main(int argc, char **argv) {
+	uint32_t iterations = argc > 1 ? (uint32_t)atol(argv[1]) : 10000000;
+	mixer_data m;
+	flight_result res[FLIGHTS];
+	uint64_t seed = 3;
+	float out[MIXER_MOTORS_MAX];
+	double coupling, lin_err, e2_desat[2], e2_clamp[2], t0, ns;
+	uint32_t i, out_of_range, lost, n_sat;
+	uint8_t f, j, sat, ok;
+	
+	for (i = 0; i < SAMPLES; i++) {
+		for (j = 0; j < 4; j++) cmd[i][j] = (float)bench_Noise(&seed);
+	}
+	
+	// tables
+	ok = 1;
+	for (f = 0; f < MIXER_FRAMES; f++) {
+		control_frame = f;
+		sim_Init(&w, 1);
+		mixer_init(&m, f);
+		coupling = table_Coupling(&m, &w.params);
+		printf("tables:   %-9s %u motors, cross-axis torque and thrust %.1e of on-axis\n", frame_names[f], m.motors, coupling);
+		if (!(coupling < 1e-6) || m.motors != w.params.motors) ok = 0;
+	}
+	control_frame = __FRAME;
+	check(ok, "tables: each column turns about its own axis only");
+	check(!mixer_init(&m, MIXER_CUSTOM) && !mixer_custom(&m, custom_mix, MIXER_MOTORS_MAX + 1), "tables: unknown frame and oversize table refused");
+	
+	// linear, range
+	lin_err = 0;
+	out_of_range = 0;
+	for (f = 0; f < MIXER_FRAMES; f++) {
+		mixer_init(&m, f);
+		for (i = 0; i < SAMPLES; i++) {
+			sat = mixer_mix(&m, 50.0f, 5 * cmd[i][0], 5 * cmd[i][1], 5 * cmd[i][2], OUT_MAX, out);
+			for (j = 0; j < m.motors; j++) {
+				double ref = 50.0 + m.mix[j][0] * 5.0 * cmd[i][0] + m.mix[j][1] * 5.0 * cmd[i][1] + m.mix[j][2] * 5.0 * cmd[i][2];
+				
+				if (fabs(out[j] - ref) > lin_err) lin_err = fabs(out[j] - ref);
+			}
+			if (sat) lin_err = INFINITY;
+			mixer_mix(&m, 50.0f + 60.0f * cmd[i][3], 80 * cmd[i][0], 80 * cmd[i][1], 80 * cmd[i][2], OUT_MAX, out);
+			for (j = 0; j < m.motors; j++) {
+				if (!(out[j] >= 0.0f && out[j] <= OUT_MAX)) out_of_range++;
+			}
+		}
+	}
+	printf("linear:   largest difference to throttle + table x command %.1e\n", lin_err);
+	check(lin_err < 1e-4, "linear: unsaturated outputs are the plain product");
+	check(out_of_range == 0, "range: outputs within [0, out_max]");
+	
+	// authority
+	ok = 1;
+	for (f = 0; f < MIXER_FRAMES; f++) {
+		mixer_init(&m, f);
+		e2_desat[0] = e2_desat[1] = e2_clamp[0] = e2_clamp[1] = 0;
+		lost = n_sat = 0;
+		for (i = 0; i < SAMPLES; i++) {
+			float th = 50.0f + 45.0f * cmd[i][3], r = 30 * cmd[i][0], p = 30 * cmd[i][1], y = 30 * cmd[i][2];
+			float clamp[MIXER_MOTORS_MAX];
+			uint8_t k;
+			
+			sat = mixer_mix(&m, th, r, p, y, OUT_MAX, out);
+			if (!sat) continue;
+			n_sat++;
+			for (k = 0; k < m.motors; k++) {
+				float c = th + m.mix[k][0] * r + m.mix[k][1] * p + m.mix[k][2] * y;
+				
+				clamp[k] = c < 0.0f ? 0.0f : (c > OUT_MAX ? OUT_MAX : c);
+			}
+			e2_desat[0] += pow(realized(&m, out, 0) - r, 2) + pow(realized(&m, out, 1) - p, 2);
+			e2_clamp[0] += pow(realized(&m, clamp, 0) - r, 2) + pow(realized(&m, clamp, 1) - p, 2);
+			e2_desat[1] += pow(realized(&m, out, 2) - y, 2);
+			e2_clamp[1] += pow(realized(&m, clamp, 2) - y, 2);
+			if (!(sat & MIXER_SAT_RP) && (fabs(realized(&m, out, 0) - r) > 1e-3 || fabs(realized(&m, out, 1) - p) > 1e-3)) lost++;
+		}
+		printf("authority: %-9s %4u of %u saturate; rms roll/pitch error %.2f desaturated, %.2f clamped; yaw %.2f, %.2f\n",
+						frame_names[f], n_sat, SAMPLES, sqrt(e2_desat[0] / (2 * n_sat)), sqrt(e2_clamp[0] / (2 * n_sat)),
+						sqrt(e2_desat[1] / n_sat), sqrt(e2_clamp[1] / n_sat));
+		if (lost || n_sat == 0 || !(e2_desat[0] < 0.1 * e2_clamp[0])) ok = 0;
+	}
+	check(ok, "authority: roll and pitch kept whenever they fit");
+	
+	// flight
+	ok = 1;
+	for (f = 0; f < FLIGHTS; f++) {
+		flight_result *r = &res[f];
+		
+		flight(f, r);
+		printf("flight:   %-9s gust rms %.3f deg, yaw step overshoot %4.1f%% steady %.3f deg, impulse peak %.2f deg\n",
+						frame_names[f], r->rms, r->overshoot * 100, r->steady, r->peak);
+		if (!(r->rms < RMS_MAX && r->overshoot <= OVERSHOOT_MAX && r->steady <= STEADY_MAX && r->peak < PEAK_MAX)) ok = 0;
+	}
+	check(ok, "flight: every frame holds attitude and follows yaw");
+	
+	// cost
+	for (f = 0; f < MIXER_FRAMES; f++) {
+		mixer_init(&m, f);
+		t0 = bench_Seconds();
+		for (i = 0; i < iterations; i++) {
+			float *c = cmd[i & (SAMPLES - 1)];
+			
+			mixer_mix(&m, 50.0f + 10 * c[3], 10 * c[0], 10 * c[1], 10 * c[2], OUT_MAX, out);
+			bench_Keep(out);
+		}
+		ns = (bench_Seconds() - t0) * 1e9 / iterations;
+		printf("mix_%s_ns_per_call:\t%.1f\n", frame_names[f], ns);
+	}
+	t0 = bench_Seconds();
+	for (i = 0; i < iterations; i++) {
+		float *c = cmd[i & (SAMPLES - 1)];
+		
+		clamp_Mix(50.0f + 10 * c[3], 10 * c[0], 10 * c[1], 10 * c[2], OUT_MAX, out);
+		bench_Keep(out);
+	}
+	ns = (bench_Seconds() - t0) * 1e9 / iterations;
+	printf("clamp_ns_per_call:\t%.1f\n", ns);
+	
+	printf("%s: motor mixer\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
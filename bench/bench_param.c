@@ -0,0 +1,327 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "param.h"
+#include "control.h"
+#include "kalman.h"
+#include "crc16.h"
+#include "telem_decode.h"
+#include "hal_host.h"
+#include "sim.h"
+
+/*
+ * Runtime parameter store (param.h):
+ *
+ *   table      every entry boots at its macro; set/get round trips and the
+ *              control loop's global follows; NaN, inf, out of range and
+ *              bad ids are refused with the value unchanged
+ *   usb        'P' requests through control_Command, several per read,
+ *              truncated and unknown ones, replies decoded from the stream
+ *   store      save/load through a file store; blank, corrupt and
+ *              wrong-version images are refused with nothing changed; an
+ *              image from a newer build (unknown ids, changed types) and one
+ *              from an older build load the entries this build knows
+ *   busy       save is refused while the motors run
+ *   flight     a flight on parameters that went through the store is bit
+ *              for bit the flight on the compiled-in defaults
+ *
+ *   bench_param
+ *
+ * Exits 1 if a check fails.
+ */
+
+#define REPLIES_MAX					64
+
+
+static telem_decoder	dec;
+static telem_param		replies[REPLIES_MAX];
+static uint32_t				replies_n;
+static char						store[] = "/tmp/bench_param_XXXXXX";
+static int						fail;
+
+
+static void check(int ok, const char *what) {
+	printf("%-52s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok) fail = 1;
+}
+
+static void on_Frame(void *ctx, const telem_frame *f) {
+	(void)ctx;
+	if (replies_n < REPLIES_MAX && telem_ParseParam(f, &replies[replies_n])) replies_n++;
+}
+
+static void sink_Decode(void *ctx, const uint8_t *data, uint16_t len) {
+	telem_Decode(ctx, data, len);
+}
+
+static uint32_t f32(float f) {
+	uint32_t bits;
+	
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+/*
+ * @brief: Send one USB read's worth of bytes and run the command task on it
+ */
+static void usb_Send(const uint8_t *data, uint16_t len) {
+	replies_n = 0;
+	hal_HostSerialInject(data, len);
+	control_Command();
+}
+
+static void usb_Reset(void) {
+	hal_HostReset();
+	telem_DecoderInit(&dec, on_Frame, NULL);
+	hal_HostSerialSink(sink_Decode, &dec);
+	user_torque = 0;
+}
+
+/*
+ * @brief: Snapshot of every value, to check that a refused operation left
+ * 				them alone
+ */
+static void snapshot(uint32_t *bits) {
+	uint8_t i;
+	
+	for (i = 0; i < PARAM_COUNT; i++) param_Get(i, &bits[i]);
+}
+
+static int same(const uint32_t *bits) {
+	uint32_t now[PARAM_COUNT];
+	
+	snapshot(now);
+	return !memcmp(bits, now, sizeof(now));
+}
+
+/*
+ * @brief: Write a store image with the given entries, header and CRC
+ */
+static void image_Write(uint16_t version, const uint8_t (*e)[8], uint16_t entries, int corrupt) {
+	static uint8_t img[HAL_STORE_SIZE];
+	uint32_t n = 8 + 8 * entries;
+	
+	put32(img, PARAM_MAGIC);
+	put32(img + 4, version | (uint32_t)entries << 16);
+	memcpy(img + 8, e, 8 * entries);
+	put32(img + n, crc16_Update(CRC16_INIT, img, n));
+	if (corrupt) img[n / 2] ^= 0x10;
+	unlink(store);
+	hal_StoreWrite(0, img, n + 4);
+}
+
+static void entry(uint8_t *e, uint8_t id, uint8_t type, uint32_t value) {
+	put32(e, id | (uint32_t)type << 8);
+	put32(e + 4, value);
+}
+
+static void test_Table(void) {
+	uint32_t bits, before[PARAM_COUNT];
+	uint8_t i, ok = 1;
+	
+	param_Defaults();
+	for (i = 0; i < PARAM_COUNT; i++) {
+		param_Get(i, &bits);
+		if (param_table[i].type == PARAM_F32) {
+			ok &= bits == f32(param_table[i].def);
+		} else {
+			ok &= bits == (uint32_t)param_table[i].def;
+		}
+	}
+	check(ok && control_kp == __KP && kalman_qr.r11 == _R11 && control_torque_max == __TORQUE_MAX, "table: defaults are the macros");
+	
+	check(param_Set(PARAM_KP, f32(2.5f)) == PARAM_OK && control_kp == 2.5f, "table: set kp reaches control_kp");
+	check(param_Set(PARAM_Q22, f32(0.25f)) == PARAM_OK && kalman_qr.q22 == 0.25f, "table: set q22 reaches kalman_qr");
+	check(param_Set(PARAM_COMPASS_Y, f32(-12.5f)) == PARAM_OK && control_compass.y == -12.5f, "table: set compass_y reaches control_compass");
+	check(param_Set(PARAM_TORQUE_MAX, 80) == PARAM_OK && control_torque_max == 80, "table: set torque_max reaches control_torque_max");
+	param_Get(PARAM_KP, &bits);
+	check(bits == f32(2.5f), "table: get returns what was set");
+	
+	snapshot(before);
+	check(param_Set(PARAM_KP, f32(NAN)) == PARAM_ERANGE, "table: NaN refused");
+	check(param_Set(PARAM_KD, f32(INFINITY)) == PARAM_ERANGE, "table: inf refused");
+	check(param_Set(PARAM_KI, f32(-1.0f)) == PARAM_ERANGE, "table: below min refused");
+	check(param_Set(PARAM_R00, f32(0.0f)) == PARAM_ERANGE, "table: zero noise refused");
+	check(param_Set(PARAM_TORQUE_MAX, __TORQUE_MAX + 1) == PARAM_ERANGE, "table: torque_max above full scale refused");
+	check(param_Set(PARAM_COUNT, 0) == PARAM_EID && param_Get(PARAM_COUNT, &bits) == PARAM_EID, "table: unknown id refused");
+	check(same(before), "table: refused writes changed nothing");
+	param_Defaults();
+}
+
+static void test_Usb(void) {
+	uint8_t req[] = {
+		'P', PARAM_OP_SET, PARAM_KD, 0, 0, 0, 0,
+		'P', PARAM_OP_GET, PARAM_KD,
+		'P', PARAM_OP_SET, PARAM_TORQUE_MAX, 60, 0, 0, 0,
+		'P', PARAM_OP_GET, 200,
+		'P', 9, 0,
+		'P', PARAM_OP_SET, PARAM_KI, 0,
+	};
+	uint8_t dflt[] = {'P', PARAM_OP_DEFAULTS, 0};
+	uint8_t tail[] = {'P', PARAM_OP_GET, PARAM_KP, '4', '0', 0};
+	uint8_t cut[] = {'P', PARAM_OP_GET, PARAM_KP, 'P', PARAM_OP_GET};
+	
+	usb_Reset();
+	put32(&req[3], f32(0.125f));
+	usb_Send(req, sizeof(req));
+	check(replies_n == 6, "usb: one reply per request");
+	check(replies[0].op == PARAM_OP_SET && replies[0].status == PARAM_OK && replies[0].value == f32(0.125f) && control_kd == 0.125f,
+				"usb: set kd");
+	check(replies[1].op == PARAM_OP_GET && replies[1].id == PARAM_KD && replies[1].type == PARAM_F32 && replies[1].value == f32(0.125f),
+				"usb: get kd");
+	check(replies[2].status == PARAM_OK && replies[2].type == PARAM_U16 && replies[2].value == 60 && control_torque_max == 60,
+				"usb: set torque_max");
+	check(replies[3].status == PARAM_EID, "usb: unknown id");
+	check(replies[4].status == PARAM_EREQ, "usb: unknown op");
+	check(replies[5].status == PARAM_EREQ && control_ki == __KI, "usb: truncated set ignored");
+	
+	usb_Send(dflt, sizeof(dflt));
+	check(replies_n == 1 && replies[0].status == PARAM_OK && control_kd == __KD && control_torque_max == __TORQUE_MAX, "usb: defaults");
+	
+	usb_Send((const uint8_t *)"25", 3);
+	check(replies_n == 0 && user_torque == 25, "usb: torque command unchanged");
+	user_torque = 0;
+	
+	usb_Send(tail, sizeof(tail));
+	check(replies_n == 1 && replies[0].status == PARAM_OK && user_torque == 40, "usb: command after a request still runs");
+	user_torque = 0;
+	usb_Send(cut, sizeof(cut));
+	check(replies_n == 2 && replies[0].status == PARAM_OK && replies[1].status == PARAM_EREQ, "usb: request cut short answered");
+}
+
+static void test_Store(void) {
+	uint8_t e[PARAM_COUNT + 4][8], head[8];
+	uint32_t before[PARAM_COUNT], saved[PARAM_COUNT];
+	uint8_t i;
+	
+	param_Defaults();
+	unlink(store);
+	snapshot(before);
+	check(param_Load() == PARAM_ESTORE && same(before), "store: blank store refused");
+	
+	param_Set(PARAM_KP, f32(1.75f));
+	param_Set(PARAM_R00, f32(0.5f));
+	param_Set(PARAM_COMPASS_Z, f32(33.0f));
+	param_Set(PARAM_TORQUE_MAX, 90);
+	snapshot(saved);
+	check(param_Save() == PARAM_OK, "store: save");
+	param_Defaults();
+	check(param_Load() == PARAM_OK && same(saved), "store: load restores every value");
+	
+	// damaged images
+	for (i = 0; i < PARAM_COUNT; i++) entry(e[i], i, param_table[i].type, before[i]);
+	param_Defaults();
+	snapshot(before);
+	image_Write(PARAM_LAYOUT_VERSION, e, PARAM_COUNT, 1);
+	check(param_Load() == PARAM_ESTORE && same(before), "store: bad CRC refused, nothing changed");
+	image_Write(PARAM_LAYOUT_VERSION + 1, e, PARAM_COUNT, 0);
+	check(param_Load() == PARAM_ESTORE && same(before), "store: other layout version refused");
+	put32(head, PARAM_MAGIC);
+	put32(head + 4, PARAM_LAYOUT_VERSION | (uint32_t)((HAL_STORE_SIZE - 12) / 8 + 1) << 16);
+	hal_StoreWrite(0, head, 8);
+	check(param_Load() == PARAM_ESTORE && same(before), "store: entry count past the store refused");
+	
+	// a newer build: extra ids, and kd now a u16
+	entry(e[0], PARAM_KP, PARAM_F32, f32(3.0f));
+	entry(e[1], PARAM_KD, PARAM_U16, 7);
+	entry(e[2], PARAM_COUNT, PARAM_F32, f32(1.0f));
+	entry(e[3], 250, PARAM_U16, 1);
+	entry(e[4], PARAM_TORQUE_MAX, PARAM_U16, 70);
+	entry(e[5], PARAM_Q00, PARAM_F32, f32(-1.0f));
+	image_Write(PARAM_LAYOUT_VERSION, e, 6, 0);
+	check(param_Load() == PARAM_OK && control_kp == 3.0f && control_kd == __KD && control_torque_max == 70
+				&& kalman_qr.q00 == _Q00, "store: newer image loads the known entries");
+	
+	// an older build: fewer entries
+	param_Defaults();
+	entry(e[0], PARAM_KI, PARAM_F32, f32(0.5f));
+	image_Write(PARAM_LAYOUT_VERSION, e, 1, 0);
+	check(param_Load() == PARAM_OK && control_ki == 0.5f && control_kp == __KP, "store: older image leaves the rest alone");
+	param_Defaults();
+}
+
+static void test_Busy(void) {
+	uint8_t save[] = {'P', PARAM_OP_SAVE, 0};
+	uint8_t load[] = {'P', PARAM_OP_LOAD, 0, 'P', PARAM_OP_DEFAULTS, 0};
+	uint32_t bits;
+	
+	usb_Reset();
+	param_Defaults();
+	param_Save();
+	param_Set(PARAM_KP, f32(4.0f));
+	user_torque = 30;
+	usb_Send(save, sizeof(save));
+	check(replies_n == 1 && replies[0].status == PARAM_EBUSY, "busy: save refused while the motors run");
+	param_Load();
+	param_Get(PARAM_KP, &bits);
+	check(bits == f32(__KP), "busy: store untouched");
+	param_Set(PARAM_KP, f32(4.0f));
+	usb_Send(load, sizeof(load));
+	check(replies_n == 2 && replies[0].status == PARAM_EBUSY && replies[1].status == PARAM_EBUSY && control_kp == 4.0f,
+				"busy: load and defaults refused while the motors run");
+	user_torque = 0;
+	param_Set(PARAM_KP, f32(4.0f));
+	usb_Send(save, sizeof(save));
+	param_Defaults();
+	param_Load();
+	check(replies_n == 1 && replies[0].status == PARAM_OK && control_kp == 4.0f, "busy: save once stopped");
+	param_Defaults();
+}
+
+static void flight(float *out) {
+	static sim_world w;
+	
+	sim_Init(&w, 7);
+	w.gust = 0.01;
+	sim_Command(&w, "30");
+	sim_Run(&w, 2);
+	out[0] = roll;
+	out[1] = pitch;
+	out[2] = yaw;
+}
+
+static void test_Flight(void) {
+	float a[3], b[3];
+	uint8_t i;
+	
+	param_Defaults();
+	flight(a);
+	param_Save();
+	for (i = 0; i < PARAM_R11 + 1; i++) param_Set(i, f32(1.0f));
+	param_Set(PARAM_TORQUE_MAX, 50);
+	check(param_Load() == PARAM_OK, "flight: defaults through the store");
+	flight(b);
+	check(!memcmp(a, b, sizeof(a)), "flight: same flight, bit for bit");
+}
+
+int main(void) {
+	int fd = mkstemp(store);
+	
+	if (fd < 0) {
+		perror(store);
+		return 1;
+	}
+	close(fd);
+	hal_host_store_path = store;
+	
+	test_Table();
+	test_Usb();
+	test_Store();
+	test_Busy();
+	test_Flight();
+	
+	unlink(store);
+	printf("%s: parameter store\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
@@ -0,0 +1,288 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "pid.h"
+#include "control.h"
+#include "sensors.h"
+#include "sim.h"
+#include "bench.h"
+
+/*
+ * The PID module (src/pid.h) on its own and in the loop with the quad model:
+ *
+ *   terms      P alone; the integral after 1 s of unit error at 100 Hz and
+ *              1 kHz; no derivative kick on a setpoint step
+ *   filter     derivative of a noisy ramp: converges to the slope, with less
+ *              noise than the plain difference at the same rate
+ *   windup     a step on a plant with a saturated actuator: overshoot with
+ *              conditional integration and back-calculation against a PID
+ *              whose integral is left to wind up
+ *   limits     random inputs never leave the output range
+ *   angle      CONTROL_ANGLE flights are finite and repeat bit for bit (the
+ *              integrators used to be uninitialized)
+ *   rate       the 1 kHz rate loop under gusts and a roll impulse: derivative
+ *              off, filtered at CONTROL_RATE_D_HZ, and unfiltered
+ *   cost       ns per pid_update against an inline unfiltered PID
+ *
+ *   bench_pid [iterations]
+ *
+ * Exits 1 if a check fails.
+ */
+
+#define RAD2DEG				57.29577951308232
+#define SLOPE				5.0f					// ramp, units/s
+#define NOISE				0.01f
+#define FILTER_HZ			20.0f
+#define WINDUP_STEP			10.0f
+#define WINDUP_SECONDS		20
+#define HOVER				"55"
+#define TAKEOFF_SECONDS		3
+#define GUST_NM				0.02
+#define GUST_SECONDS		20
+#define IMPULSE_NM			0.3
+#define IMPULSE_SECONDS		0.05
+#define RATE_KD				0.004f				// torque per deg/s^2
+#define ANGLE_SECONDS		10
+#define SAMPLES				4096
+#define COST_MAX			4.0					// x the inline PID
+
+enum {
+	D_OFF,
+	D_FILTERED,
+	D_RAW,
+	D_COUNT
+};
+
+typedef struct {
+	float			integ, meas_last;
+} plain_data;
+
+static const char	*d_names[D_COUNT] = {"off", "filtered", "unfiltered"};
+static float		meas[SAMPLES], sets[SAMPLES];
+static sim_world	w;
+static int			fail;
+
+
+static void check(int ok, const char *what) {
+	printf("%-52s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok) fail = 1;
+}
+
+/*
+ * @brief: The textbook loop body, no filter, no limits; the cost baseline
+ */
+static inline float plain_update(plain_data *pd, float kp, float ki, float kd, float setpoint, float m, float dt) {
+	float e = setpoint - m;
+	float d = (m - pd->meas_last) / dt;
+	
+	pd->meas_last = m;
+	pd->integ += ki * e * dt;
+	return kp * e + pd->integ - kd * d;
+}
+
+/*
+ * @brief: Integral after 1 s of unit error
+ */
+static float integral(float hz) {
+	pid_data pd;
+	float u = 0;
+	uint32_t k;
+	
+	pid_init(&pd, -100, 100, 0);
+	for (k = 0; k < (uint32_t)hz; k++) u = pid_update(&pd, 0, 1, 0, 1, 0, 1.0f / hz);
+	return u;
+}
+
+/*
+ * @brief: Derivative of a noisy ramp sampled at 1 kHz
+ * @param[out]: mean and rms deviation from the slope over the last half
+ */
+static void ramp(float d_hz, double *mean, double *rms) {
+	pid_data pd;
+	uint64_t seed = 5;
+	double s = 0, s2 = 0;
+	uint32_t k, n = 2000;
+	
+	pid_init(&pd, -1e6f, 1e6f, d_hz);
+	for (k = 0; k < n; k++) {
+		pid_update(&pd, 0, 0, 1, 0, SLOPE * k * 1e-3f + NOISE * (float)bench_Noise(&seed), 1e-3f);
+		if (k >= n / 2) {
+			s += pd.d;
+			s2 += (pd.d - SLOPE) * (pd.d - SLOPE);
+		}
+	}
+	*mean = s / (n / 2);
+	*rms = sqrt(s2 / (n / 2));
+}
+
+/*
+ * @brief: Setpoint step on x' = u, u limited to +-1, at 100 Hz
+ * @param[in]: kt < 0 for the wound-up PID
+ * @param[out]: overshoot of the step
+ */
+static double windup(float kt) {
+	pid_data pd;
+	double x = 0, peak = 0;
+	uint32_t k;
+	
+	pid_init(&pd, kt < 0 ? -1e6f : -1, kt < 0 ? 1e6f : 1, 0);
+	pd.kt = kt > 0 ? kt : 0;
+	for (k = 0; k < WINDUP_SECONDS * 100; k++) {
+		float u = pid_update(&pd, 0.5f, 0.2f, 0, WINDUP_STEP, (float)x, 0.01f);
+		
+		if (u > 1) u = 1;
+		if (u < -1) u = -1;
+		x += u * 0.01;
+		if (x > peak) peak = x;
+	}
+	return (peak - WINDUP_STEP) / WINDUP_STEP;
+}
+
+/*
+ * @brief: CONTROL_ANGLE gusty flight on the ground throttle
+ * @param[out]: sum of the axis outputs over the flight; 0 if one is not finite
+ */
+static double angle_Flight(void) {
+	double sum = 0;
+	uint64_t k;
+	
+	sim_Init(&w, 11);
+	w.gust = GUST_NM;
+	sim_Command(&w, "30");
+	for (k = 1; k <= (uint64_t)ANGLE_SECONDS * SIM_RATE; k++) {
+		sim_Step(&w);
+		if (!isfinite(u_roll) || !isfinite(u_pitch) || !isfinite(u_yaw)) return 0;
+		sum += u_roll + u_pitch + u_yaw;
+	}
+	w.gust = 0;
+	return sum;
+}
+
+/*
+ * @brief: Cascade at 1 kHz with the rate derivative off, filtered or raw
+ * @param[out]: rms roll/pitch body rate under gusts, peak roll rate after a
+ * 				torque impulse, deg/s
+ */
+static void rate_Flight(uint8_t mode, double *rms_rate, double *peak_rate) {
+	double w2 = 0;
+	uint64_t k, n = (uint64_t)GUST_SECONDS * SIM_RATE;
+	uint8_t run;
+	
+	control_mode = CONTROL_CASCADE;
+	control_rate_kd = mode == D_OFF ? 0 : RATE_KD;
+	*peak_rate = 0;
+	for (run = 0; run < 2; run++) {
+		roll_des = pitch_des = yaw_des = 0;
+		sim_Init(&w, 3 + run);
+		if (mode == D_RAW) {
+			pid_init(&pid_roll_rate, -CONTROL_U_MAX, CONTROL_U_MAX, 0);
+			pid_init(&pid_pitch_rate, -CONTROL_U_MAX, CONTROL_U_MAX, 0);
+		}
+		sim_Command(&w, HOVER);
+		sim_Run(&w, TAKEOFF_SECONDS);
+		for (k = 1; k <= n; k++) {
+			if (run) {
+				w.quad.torque_ext[0] = k <= IMPULSE_SECONDS * SIM_RATE ? IMPULSE_NM : 0;
+				if (fabs(w.quad.w[0]) * RAD2DEG > *peak_rate) *peak_rate = fabs(w.quad.w[0]) * RAD2DEG;
+			} else {
+				w.gust = GUST_NM;
+				w2 += (w.quad.w[0] * w.quad.w[0] + w.quad.w[1] * w.quad.w[1]) * RAD2DEG * RAD2DEG;
+			}
+			sim_Step(&w);
+		}
+		w.gust = 0;
+	}
+	*rms_rate = sqrt(w2 / (2 * n));
+	control_mode = CONTROL_ANGLE;
+	control_rate_kd = __RATE_KD;
+}
+
+int main(int argc, char **argv) {
+	uint32_t iterations = argc > 1 ? (uint32_t)atol(argv[1]) : 10000000;
+	pid_data pd;
+	plain_data plain = {0, 0};
+	uint64_t seed = 77;
+	double mean_raw, rms_raw, mean_filt, rms_filt, ov_naive, ov_cond, ov_back;
+	double a1, a2, rms_rate[D_COUNT], peak_rate[D_COUNT], t0, ns_pid, ns_plain;
+	float u, u0, i100, i1k;
+	uint32_t i, out = 0;
+	uint8_t m;
+	
+	// terms
+	pid_init(&pd, -100, 100, 0);
+	u = pid_update(&pd, 2, 0, 0, 3, 0, 0.01f);
+	check(u == 6.0f, "terms: P alone is kp e");
+	i100 = integral(100);
+	i1k = integral(1000);
+	printf("terms:    integral after 1 s, 100 Hz %.5f, 1 kHz %.5f\n", i100, i1k);
+	check(fabsf(i100 - 1) < 1e-3f && fabsf(i1k - 1) < 1e-3f, "terms: integral independent of the rate");
+	pid_init(&pd, -100, 100, FILTER_HZ);
+	u0 = pid_update(&pd, 1, 0, 10, 0, 0, 0.01f);
+	u = pid_update(&pd, 1, 0, 10, 10, 0, 0.01f);
+	check(u - u0 == 10.0f, "terms: no derivative kick on a setpoint step");
+	
+	// filter
+	ramp(0, &mean_raw, &rms_raw);
+	ramp(FILTER_HZ, &mean_filt, &rms_filt);
+	printf("filter:   ramp %.1f/s at 1 kHz, derivative %.3f rms %.3f raw, %.3f rms %.3f at %.0f Hz\n",
+					SLOPE, mean_raw, rms_raw, mean_filt, rms_filt, FILTER_HZ);
+	check(fabs(mean_filt - SLOPE) < 0.05 * SLOPE && rms_filt < 0.25 * rms_raw, "filter: tracks the slope, less noise");
+	
+	// windup
+	ov_naive = windup(-1);
+	ov_cond = windup(0);
+	ov_back = windup(2);
+	printf("windup:   overshoot %.1f%% wound up, %.1f%% conditional, %.1f%% back-calculation\n",
+					ov_naive * 100, ov_cond * 100, ov_back * 100);
+	check(ov_cond < 0.5 * ov_naive && ov_back < 0.5 * ov_naive, "windup: both schemes cut the overshoot");
+	
+	// limits
+	for (i = 0; i < 100000; i++) {
+		if (i % 1000 == 0) pid_init(&pd, -1, 2, i % 2000 ? FILTER_HZ : 0);
+		pd.kt = (i / 1000) % 3 == 2 ? 5.0f : 0.0f;
+		u = pid_update(&pd, 3, 10, 0.1f, 100 * (float)bench_Noise(&seed), 100 * (float)bench_Noise(&seed), 1e-3f);
+		if (!(u >= -1 && u <= 2) || pd.integ < -1 || pd.integ > 2) out++;
+	}
+	check(out == 0, "limits: output and integral stay in range");
+	
+	// angle
+	a1 = angle_Flight();
+	a2 = angle_Flight();
+	printf("angle:    CONTROL_ANGLE output sum %.6g, repeat %.6g\n", a1, a2);
+	check(a1 != 0 && a1 == a2, "angle: outputs finite and repeatable");
+	
+	// rate
+	for (m = 0; m < D_COUNT; m++) {
+		rate_Flight(m, &rms_rate[m], &peak_rate[m]);
+		printf("rate:     derivative %-10s gust rms %.2f deg/s, impulse peak %.1f deg/s\n", d_names[m], rms_rate[m], peak_rate[m]);
+	}
+	check(rms_rate[D_FILTERED] < rms_rate[D_OFF] && peak_rate[D_FILTERED] < peak_rate[D_OFF], "rate: filtered derivative damps the 1 kHz loop");
+	check(rms_rate[D_FILTERED] < rms_rate[D_RAW], "rate: filtered beats the raw difference under gusts");
+	
+	// cost
+	for (i = 0; i < SAMPLES; i++) {
+		meas[i] = 10 * (float)bench_Noise(&seed);
+		sets[i] = 10 * (float)bench_Noise(&seed);
+	}
+	pid_init(&pd, -CONTROL_U_MAX, CONTROL_U_MAX, CONTROL_RATE_D_HZ);
+	t0 = bench_Seconds();
+	for (i = 0; i < iterations; i++) {
+		u = pid_update(&pd, __RATE_KP, __RATE_KI, RATE_KD, sets[i & (SAMPLES - 1)], meas[i & (SAMPLES - 1)], 1e-3f);
+		bench_Keep(&u);
+	}
+	ns_pid = (bench_Seconds() - t0) * 1e9 / iterations;
+	t0 = bench_Seconds();
+	for (i = 0; i < iterations; i++) {
+		u = plain_update(&plain, __RATE_KP, __RATE_KI, RATE_KD, sets[i & (SAMPLES - 1)], meas[i & (SAMPLES - 1)], 1e-3f);
+		bench_Keep(&u);
+	}
+	ns_plain = (bench_Seconds() - t0) * 1e9 / iterations;
+	printf("pid_ns_per_call:        %.1f\n", ns_pid);
+	printf("plain_ns_per_call:      %.1f\n", ns_plain);
+	check(ns_pid < COST_MAX * ns_plain + 5, "cost: pid_update near the inline PID");
+	
+	printf("%s: PID\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
@@ -0,0 +1,126 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "control.h"
+#include "sim.h"
+#include "pool.h"
+#include "bench.h"
+
+/*
+ * Work-stealing pool (sim/pool.h) behind skyalpha_tune:
+ *
+ *   skewed     every costly job starts in the first worker's range; the
+ *              others must steal them, and each job must run exactly once
+ *   flights    simulated flights on forked workers give the same results as
+ *              in this process, at any worker count
+ *   scaling    equal CPU-bound jobs at 1 .. cores workers
+ *
+ *   bench_pool [workers]
+ *
+ * Exits 1 if a check fails, or on two or more cores if the speedup at one
+ * worker per core is below SCALING_MIN of the core count.
+ */
+
+#define SKEWED_JOBS					4096
+#define SKEWED_HEAVY				(SKEWED_JOBS / 8)
+#define FLIGHTS							12
+#define SCALING_JOBS				256
+#define SCALING_MIN					0.6
+
+
+static int					fail;
+
+
+static void check(int ok, const char *what) {
+	printf("%-52s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok) fail = 1;
+}
+
+static uint64_t spin(uint64_t n, uint64_t seed) {
+	uint64_t i;
+	
+	for (i = 0; i < n; i++) bench_Noise(&seed);
+	return seed;
+}
+
+static void job_Skewed(void *ctx, uint32_t job, void *result) {
+	(void)ctx;
+	*(uint64_t *)result = spin(job < SKEWED_HEAVY ? 20000 : 10, job + 1);
+}
+
+static void job_Spin(void *ctx, uint32_t job, void *result) {
+	(void)ctx;
+	*(uint64_t *)result = spin(200000, job + 1);
+}
+
+static void job_Flight(void *ctx, uint32_t job, void *result) {
+	static sim_world w;
+	float *r = result;
+	
+	(void)ctx;
+	sim_Init(&w, job + 1);
+	w.gust = 0.01;
+	sim_Command(&w, "30");
+	sim_Run(&w, 1);
+	r[0] = roll;
+	r[1] = pitch;
+	r[2] = yaw;
+}
+
+static uint64_t total(const pool_stats *st, const uint64_t *v) {
+	uint64_t n = 0;
+	uint32_t i;
+	
+	for (i = 0; i < st->workers; i++) n += v[i];
+	return n;
+}
+
+int main(int argc, char **argv) {
+	static uint64_t		res[SKEWED_JOBS];
+	static float			ref[FLIGHTS][3], got[FLIGHTS][3];
+	static pool_stats	st;
+	uint32_t	cores = pool_Cores(), workers = argc > 1 ? (uint32_t)atol(argv[1]) : (cores < 4 ? 4 : cores);
+	uint32_t	i, n, bad = 0;
+	double		base = 0, speedup = 0;
+	
+	printf("%u cores, %u workers\n", cores, workers);
+	
+	// skewed load
+	check(pool_Run(workers, SKEWED_JOBS, job_Skewed, NULL, res, sizeof(res[0]), &st) == 0, "skewed: workers ran and exited");
+	for (i = 0; i < SKEWED_JOBS; i++) bad += res[i] != spin(i < SKEWED_HEAVY ? 20000 : 10, i + 1);
+	check(!bad && total(&st, st.jobs) == SKEWED_JOBS, "skewed: every job ran exactly once");
+	check(workers < 2 || total(&st, st.steals) - st.steals[0] > 0, "skewed: the costly range was stolen");
+	printf("skewed:       %.3f s, steals %llu, jobs/worker", st.wall, (unsigned long long)total(&st, st.steals));
+	for (i = 0; i < st.workers; i++) printf(" %llu", (unsigned long long)st.jobs[i]);
+	printf("\n");
+	
+	// flight code in forked workers
+	for (i = 0; i < FLIGHTS; i++) job_Flight(NULL, i, ref[i]);
+	for (n = 1; n <= workers; n *= 2) {
+		char line[64];
+		
+		memset(got, 0, sizeof(got));
+		pool_Run(n, FLIGHTS, job_Flight, NULL, got, sizeof(got[0]), NULL);
+		snprintf(line, sizeof(line), "flights: %u workers match this process", n);
+		check(!memcmp(ref, got, sizeof(ref)), line);
+	}
+	
+	// scaling
+	for (n = 1;; n = n * 2 > cores ? cores : n * 2) {
+		pool_Run(n, SCALING_JOBS, job_Spin, NULL, res, sizeof(res[0]), &st);
+		if (n == 1) base = st.wall;
+		speedup = base / st.wall;
+		printf("scaling:      %3u workers %7.3f s  %.2fx  %.0f%%\n", n, st.wall, speedup, 100 * speedup / n);
+		if (n >= cores) break;
+	}
+	if (cores >= 2) {
+		check(speedup >= SCALING_MIN * cores, "scaling: one worker per core");
+	} else {
+		printf("scaling:      one core, speedup not checked\n");
+	}
+	
+	printf("%s: work-stealing pool\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
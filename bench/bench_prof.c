@@ -0,0 +1,155 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prof.h"
+#include "telemetry.h"
+#include "telem_decode.h"
+#include "hal_host.h"
+#include "sim.h"
+#include "bench.h"
+
+/*
+ * Loop profiling probes: histogram buckets and window statistics, the host
+ * cycle clock against CLOCK_MONOTONIC, the cost of one probe, then a
+ * simulated flight asked for a report with the 'p' command. The report is
+ * decoded from the USB stream and printed per probe in host microseconds
+ * and as a share of the 10 ms control period.
+ *
+ *   bench_prof [seconds]
+ *
+ * Exits 1 if a check fails, a probe costs more than PROBE_NS_MAX, or the
+ * report misses a probe or disagrees with itself.
+ */
+
+#define PROBE_NS_MAX			1000
+#define PROBE_LOOPS				2000000
+#define CAPTURE_SIZE			4096
+
+
+static uint8_t				capture[CAPTURE_SIZE];
+static uint32_t				capture_n;
+static telem_profile	reports[PROF_COUNT];
+static uint32_t				reported;
+static int						fail;
+
+
+static void check(int ok, const char *what) {
+	printf("%-52s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok) fail = 1;
+}
+
+static void sink_Capture(void *ctx, const uint8_t *data, uint16_t len) {
+	(void)ctx;
+	if (capture_n + len > CAPTURE_SIZE) capture_n = 0;
+	memcpy(&capture[capture_n], data, len);
+	capture_n += len;
+}
+
+static void on_Frame(void *ctx, const telem_frame *f) {
+	telem_profile r;
+	
+	(void)ctx;
+	if (telem_ParseProfile(f, &r) && r.probe < PROF_COUNT) {
+		reports[r.probe] = r;
+		reported |= 1u << r.probe;
+	}
+}
+
+static void checks(void) {
+	prof_probe p;
+	double t0, wall;
+	uint32_t c0, hz, k, ok;
+	
+	ok = prof_Bucket(0) == 0 && prof_Bucket(31) == 0 && prof_Bucket(32) == 1 && prof_Bucket(63) == 1
+				&& prof_Bucket(64) == 2 && prof_Bucket(1u << 18) == 14 && prof_Bucket(1u << 19) == 15
+				&& prof_Bucket(0xFFFFFFFF) == PROF_BUCKETS - 1;
+	check(ok, "log2 buckets, ends open");
+	
+	prof_Init();
+	prof_Record(PROF_PID, 100);
+	prof_Record(PROF_PID, 50);
+	prof_Record(PROF_PID, 3000);
+	prof_Snapshot(PROF_PID, &p, 1);
+	check(p.count == 3 && p.min == 50 && p.max == 3000 && p.sum == 3150 && p.hist[1] == 1 && p.hist[2] == 1
+				&& p.hist[7] == 1, "count, min, max, sum, histogram");
+	prof_Snapshot(PROF_PID, &p, 0);
+	check(p.count == 0 && p.max == 0, "report starts a new window");
+	
+	hz = hal_CycleHz();
+	t0 = bench_Seconds();
+	c0 = hal_Cycles();
+	do {
+		wall = bench_Seconds() - t0;
+	} while (wall < 0.05);
+	k = hal_Cycles() - c0;
+	printf("cycle clock:  %.1f MHz\n", hz / 1e6);
+	check(k > 0.98 * hz * wall && k < 1.02 * hz * wall, "hal_CycleHz within 2% of CLOCK_MONOTONIC");
+}
+
+/*
+ * @brief: ns for one prof_Begin / prof_End pair around nothing
+ */
+static double probe_Cost(void) {
+	double t0;
+	uint32_t k, t;
+	
+	prof_Init();
+	t0 = bench_Seconds();
+	for (k = 0; k < PROBE_LOOPS; k++) {
+		t = prof_Begin();
+		prof_End(PROF_MIXER, t);
+	}
+	t0 = (bench_Seconds() - t0) * 1e9 / PROBE_LOOPS;
+	prof_Init();
+	return t0;
+}
+
+static void flight(double seconds) {
+	static sim_world w;
+	telem_decoder d;
+	double us;
+	uint32_t ok = 1, sum, i;
+	uint8_t id;
+	
+	sim_Init(&w, 1);
+	hal_HostSerialSink(sink_Capture, NULL);
+	sim_Command(&w, "30");
+	sim_Run(&w, seconds);
+	capture_n = 0;
+	sim_Command(&w, "p");
+	sim_Run(&w, 0.01);
+	telem_DecoderInit(&d, on_Frame, NULL);
+	telem_Decode(&d, capture, capture_n);
+	
+	check(reported == (1u << PROF_COUNT) - 1, "'p' reports every probe");
+	us = reports[0].hz ? 1e6 / reports[0].hz : 0;
+	printf("\nprobe            count   min_us   mean_us    max_us   of 10 ms\n");
+	for (id = 0; id < PROF_COUNT; id++) {
+		const telem_profile *r = &reports[id];
+		double per_tick = (double)r->count * r->mean * us / (seconds * 100);
+		
+		printf("%-12s %9u %8.2f %9.2f %9.2f   %6.3f%%\n", prof_names[id], r->count, r->min * us, r->mean * us, r->max * us,
+					per_tick / 100);
+		for (i = 0, sum = 0; i < PROF_BUCKETS; i++) sum += r->hist[i];
+		// the rate loop only runs in CONTROL_CASCADE
+		ok &= (r->count > 0 || id == PROF_RATE) && r->min <= r->mean && r->mean <= r->max && sum == r->count && r->hz == hal_CycleHz();
+	}
+	check(ok, "every probe ran, min <= mean <= max, histogram sums");
+	check(reports[PROF_ESTIMATE].count >= seconds * 100 - 1 && reports[PROF_SENSORS].count >= seconds * SENSORS_TICK_HZ - 1,
+				"one estimate per tick, one sensors per TIMER2A");
+}
+
+int main(int argc, char **argv) {
+	double seconds = argc > 1 ? atof(argv[1]) : 5;
+	double ns;
+	
+	checks();
+	ns = probe_Cost();
+	printf("probe cost:   %.1f ns\n", ns);
+	if (ns > PROBE_NS_MAX) fail = 1;
+	flight(seconds);
+	printf("%s: loop profiling probes\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
@@ -0,0 +1,194 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "control.h"
+#include "tasks.h"
+#include "blackbox.h"
+#include "blackbox_decode.h"
+#include "replay.h"
+#include "hal_host.h"
+#include "sim.h"
+#include "bench.h"
+
+/*
+ * Deterministic replay: flies the simulator with the flight data recorder
+ * on, once per estimator, with the steady-state gain and in cascade control
+ * at two rate loop dividers, replays each log through the flight code in the modes it records and
+ * checks that every recorded field comes back bit for bit. A flipped bit in
+ * one raw sample must show from its record on, and a log cut in flight must
+ * settle after replay_Seed. Then the replay speed.
+ *
+ *   bench_replay [seconds]
+ *
+ * Exits 1 if a check fails or the replay runs below REPLAY_MRPS_MIN.
+ */
+
+#define REPLAY_MRPS_MIN				1.0						// Mrecords/s, 10000x real time at 100 Hz
+#define REPLAY_REPEATS				5
+#define SETTLE_RECORDS				500
+#define SETTLE_CENTI					50						// 0.5 deg
+
+
+static uint8_t			stream[16 << 20];
+static uint32_t			stream_n;
+static int					fail;
+
+
+static void check(int ok, const char *what) {
+	printf("%-52s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok) fail = 1;
+}
+
+static void sink_Stream(void *ctx, const uint8_t *data, uint16_t len) {
+	(void)ctx;
+	if (stream_n + len > sizeof(stream)) return;
+	memcpy(&stream[stream_n], data, len);
+	stream_n += len;
+}
+
+/*
+ * @brief: Fly with the recorder on, decode its log from the USB stream
+ */
+static void flight_Log(blackbox_log *l, uint8_t estimator, uint8_t mode, uint8_t gain, uint16_t div, double seconds) {
+	static sim_world w;
+	
+	control_estimator = estimator;
+	control_mode = mode;
+	kalman_gain_mode = gain;
+	control_rate_div = div;
+	blackbox_mode = BLACKBOX_ON;
+	sim_Init(&w, 3);
+	hal_HostSerialSink(sink_Stream, NULL);
+	stream_n = 0;
+	sim_Command(&w, "45");
+	w.gust = 0.02;
+	sim_Run(&w, seconds);
+	blackbox_Stop();
+	while (task_RunNext());
+	blackbox_LogInit(l);
+	blackbox_DecodeStream(l, stream, stream_n);
+	control_estimator = CONTROL_EST_KALMAN;
+	control_mode = CONTROL_ANGLE;
+	kalman_gain_mode = KALMAN_GAIN_FULL;
+	control_rate_div = __RATE_DIV;
+}
+
+/*
+ * @brief: Drop the first r records and the samples and rate runs before them
+ */
+static void log_Trim(blackbox_log *l, uint32_t r) {
+	uint32_t s = l->s_end[r - 1], q = l->r_end[r - 1], i;
+	
+	for (i = 0; i < BLACKBOX_FIELDS; i++) memmove(l->col[i], l->col[i] + r, (l->n - r) * sizeof(int32_t));
+	memmove(l->t_us, l->t_us + r, (l->n - r) * sizeof(uint32_t));
+	for (i = 0; i + r < l->n; i++) {
+		l->s_end[i] = l->s_end[i + r] - s;
+		l->r_end[i] = l->r_end[i + r] - q;
+	}
+	l->n -= r;
+	memmove(l->s_t_us, l->s_t_us + s, (l->ns - s) * sizeof(uint32_t));
+	memmove(l->s_sensor, l->s_sensor + s, (l->ns - s) * sizeof(uint8_t));
+	memmove(l->s_data, l->s_data + s, (l->ns - s) * sizeof(*l->s_data));
+	l->ns -= s;
+	memmove(l->r_t_us, l->r_t_us + q, (l->nr - q) * sizeof(uint32_t));
+	memmove(l->r_throttle, l->r_throttle + q, (l->nr - q) * sizeof(uint16_t));
+	l->nr -= q;
+}
+
+static void exact(uint8_t estimator, uint8_t mode, uint8_t gain, uint16_t div, double seconds, const char *what) {
+	static blackbox_log l;
+	replay_result res;
+	char line[64];
+	uint32_t i, r, diffs = 0;
+	
+	flight_Log(&l, estimator, mode, gain, div, seconds);
+	replay_Reset(&l);
+	replay_Run(&l, &res);
+	for (i = 0; i < BLACKBOX_FIELDS; i++) diffs += res.diffs[i];
+	snprintf(line, sizeof(line), "%s: %u records back bit for bit", what, res.n);
+	check(l.n == (uint32_t)(seconds * 100) && !l.lost && !blackbox_lost && !blackbox_rate_lost && !diffs, line);
+	snprintf(line, sizeof(line), "%s: modes, %u samples, %u rate runs", what, l.ns, l.nr);
+	check(BLACKBOX_MODE_EST(l.modes) == estimator && BLACKBOX_MODE_CONTROL(l.modes) == mode && BLACKBOX_MODE_GAIN(l.modes) == gain
+				&& l.rate_div == div && l.ns > l.n * 10 && (mode == CONTROL_CASCADE ? l.nr > l.n * 10 / div / 2 : l.nr == 0), line);
+	
+	if (estimator == CONTROL_EST_KALMAN && mode == CONTROL_ANGLE && gain == KALMAN_GAIN_FULL) {
+		uint32_t s;
+		
+		// the sign of one raw compass sample
+		for (s = l.ns / 2; l.s_sensor[s] != __MEASURE_COMPASS; s++);
+		for (r = 0; l.s_end[r] <= s; r++);
+		l.s_data[s][0] ^= (int16_t)0x8000;
+		replay_Reset(&l);
+		replay_Run(&l, &res);
+		check(res.first == r, "a flipped sample bit shows, from its record on");
+		l.s_data[s][0] ^= (int16_t)0x8000;
+		
+		// a log joined in flight: drop the first half, seed, let it settle
+		log_Trim(&l, l.n / 2);
+		replay_Reset(&l);
+		replay_Seed(&l, 0);
+		{
+			int32_t v[BLACKBOX_FIELDS], worst = 0;
+			
+			for (r = 0; r < l.n; r++) {
+				replay_Step(&l, r, v);
+				if (r < SETTLE_RECORDS) continue;
+				for (i = BLACKBOX_ATTITUDE; i < BLACKBOX_ATTITUDE + 2; i++) {
+					int32_t d = abs(v[i] - l.col[i][r]);
+					
+					if (d > worst) worst = d;
+				}
+			}
+			printf("seeded in flight: roll/pitch within %.2f deg after %u records\n", worst / 100.0, SETTLE_RECORDS);
+			check(l.n > SETTLE_RECORDS && worst <= SETTLE_CENTI, "seeded replay of a log joined in flight settles");
+		}
+	}
+	if (mode == CONTROL_CASCADE && div == 1) {
+		uint32_t s, q = l.nr / 2;
+		
+		// the gyro sample one rate loop run read, logged with a later tick
+		for (s = 0; s < l.ns && (l.s_sensor[s] != __MEASURE_GYROSCOPE || l.s_t_us[s] != l.r_t_us[q]); s++);
+		for (r = 0; l.r_end[r] <= q; r++);
+		if (s < l.ns) l.s_data[s][0] ^= (int16_t)0x8000;
+		replay_Reset(&l);
+		replay_Run(&l, &res);
+		check(s < l.ns && res.first == r, "a flipped gyro bit shows, from its rate run on");
+	}
+	blackbox_LogFree(&l);
+}
+
+static void speed(double seconds) {
+	static blackbox_log l;
+	replay_result res;
+	double t0, best = 0;
+	uint32_t k;
+	
+	flight_Log(&l, CONTROL_EST_KALMAN, CONTROL_ANGLE, KALMAN_GAIN_FULL, __RATE_DIV, seconds);
+	for (k = 0; k < REPLAY_REPEATS; k++) {
+		replay_Reset(&l);
+		t0 = bench_Seconds();
+		replay_Run(&l, &res);
+		t0 = bench_Seconds() - t0;
+		if (k == 0 || t0 < best) best = t0;
+	}
+	printf("replay:       %u records, %.2f Mrecords/s, %.2f Msamples/s, %.0fx real time\n", res.n, res.n / best / 1e6,
+				l.ns / best / 1e6, seconds / best);
+	if (res.n / best / 1e6 < REPLAY_MRPS_MIN) fail = 1;
+	blackbox_LogFree(&l);
+}
+
+int main(int argc, char **argv) {
+	double seconds = argc > 1 ? atof(argv[1]) : 60;
+	
+	exact(CONTROL_EST_KALMAN, CONTROL_ANGLE, KALMAN_GAIN_FULL, 1, seconds, "kalman");
+	exact(CONTROL_EST_KALMAN, CONTROL_ANGLE, KALMAN_GAIN_STEADY, 1, seconds, "steady gain");
+	exact(CONTROL_EST_AHRS, CONTROL_ANGLE, KALMAN_GAIN_FULL, 1, seconds, "ahrs");
+	exact(CONTROL_EST_MULTIRATE, CONTROL_ANGLE, KALMAN_GAIN_FULL, 1, seconds, "multirate");
+	exact(CONTROL_EST_KALMAN, CONTROL_CASCADE, KALMAN_GAIN_FULL, 1, seconds, "cascade");
+	exact(CONTROL_EST_KALMAN, CONTROL_CASCADE, KALMAN_GAIN_FULL, 3, seconds, "cascade div 3");
+	speed(seconds);
+	printf("%s: replay bit-exact in every mode, >= %.1f Mrecords/s\n", fail ? "FAIL" : "PASS", REPLAY_MRPS_MIN);
+	return fail;
+}
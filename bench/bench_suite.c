@@ -0,0 +1,459 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "control.h"
+#include "sensors.h"
+#include "telemetry.h"
+#include "telem_decode.h"
+#include "i2c_async.h"
+#include "spsc.h"
+#include "tasks.h"
+#include "hal_host.h"
+#include "bench.h"
+
+/*
+ * Regression suite: the per-tick kernels of the flight code timed on the
+ * host, results as JSON for tracking per commit.
+ *
+ *   kalman_innovate     one axis of the Kalman estimator
+ *   kalman_steady       the same past the switch to the steady-state gain
+ *   estimate_kalman     control_Estimate, three filters and tilt-compensated heading
+ *   estimate_ahrs       control_Estimate with the quaternion AHRS
+ *   control_step        PID, mixer and PWM writes (control_Step)
+ *   telem_binary        one tick of binary telemetry into the USB ring
+ *   telem_text          one tick of TELEM_TEXT lines (send_USB_CDC_Data path)
+ *   telem_decode        decoding one tick of binary telemetry on the ground
+ *   i2c_read6           a 6-byte register read through the i2c_async state
+ *                       machine and the mock master, bus time not counted
+ *   spsc_push_pop       one sensor sample through an spsc ring
+ *   task_post_run       task_Post and task_RunNext of an empty task
+ *
+ *   bench_suite [-s scale] [-r repeats] [-k name] [--label text] [--json file]
+ *               [--baseline file] [--tolerance pct]
+ *
+ * Each kernel runs its default iterations times scale, repeats times; ns/op
+ * is reported as the minimum and the median of the repeats. --json writes the
+ * results ("-" for stdout); --baseline compares median ns/op against a file
+ * written by --json and exits 1 if any kernel is slower by more than
+ * tolerance percent (default 30). bench/baseline.json holds the numbers of
+ * the commit that added the suite; regenerate it on the machine you compare
+ * on. Without --baseline it exits 1 only if a kernel's own check fails.
+ */
+
+#define REPEATS_MAX				15
+#define RESULTS_MAX				16
+#define KERNEL_NAME_MAX				32
+#define DECODE_TICKS			64
+
+
+typedef struct {
+	const char	*name;
+	uint32_t		iterations;										// at scale 1
+	void				(*setup)(void);
+	void				(*run)(uint32_t n);
+	int					(*check)(void);								// optional, 0 = kernel misbehaved
+} kernel;
+
+typedef struct {
+	const char	*name;
+	uint32_t		iterations, repeats;
+	double			ns_min, ns_median, cycles;
+	int					ok;
+} result;
+
+
+static Vect3d			s_accel[1024], s_gyro[1024], s_compass[1024];
+static uint64_t		sink_bytes;
+static uint8_t		stream[DECODE_TICKS * 256];
+static uint32_t		stream_n, decoded;
+static uint8_t		ram[256], rd_buf[6];
+static uint8_t		ring_buf[SENSORS_RING_SIZE * 8];
+static spsc_ring	ring;
+static uint32_t		task_runs;
+
+
+static void sink_Count(void *ctx, const uint8_t *data, uint16_t len) {
+	(void)ctx;
+	bench_Keep((void *)data);
+	sink_bytes += len;
+}
+
+static void sink_Stream(void *ctx, const uint8_t *data, uint16_t len) {
+	(void)ctx;
+	if (stream_n + len > sizeof(stream)) return;
+	memcpy(&stream[stream_n], data, len);
+	stream_n += len;
+}
+
+static void samples_Load(void) {
+	uint64_t seed = 3;
+	uint32_t i;
+	
+	for (i = 0; i < 1024; i++) {
+		s_accel[i].x = 10 * bench_Noise(&seed);
+		s_accel[i].y = 10 * bench_Noise(&seed);
+		s_accel[i].z = -256 + 10 * bench_Noise(&seed);
+		s_gyro[i].x = 30 * bench_Noise(&seed);
+		s_gyro[i].y = 30 * bench_Noise(&seed);
+		s_gyro[i].z = 30 * bench_Noise(&seed);
+		s_compass[i].x = 200 + 20 * bench_Noise(&seed);
+		s_compass[i].y = -300 + 20 * bench_Noise(&seed);
+		s_compass[i].z = 100 + 20 * bench_Noise(&seed);
+	}
+}
+
+static void firmware_Setup(void) {
+	hal_HostReset();
+	hal_HostSerialSink(sink_Count, NULL);
+	task_Init();
+	control_Init();
+	samples_Load();
+	telem_mode = TELEM_BINARY;
+	control_estimator = CONTROL_EST_KALMAN;
+	kalman_gain_mode = KALMAN_GAIN_FULL;
+}
+
+/*
+ * Kernels
+ */
+static void run_Kalman(uint32_t n) {
+	uint32_t k;
+	
+	for (k = 0; k < n; k++) kalman_innovate(&k_roll, s_accel[k & 1023].x, s_gyro[k & 1023].x);
+	bench_Keep(&k_roll);
+}
+
+static void run_Estimate(uint32_t n) {
+	uint32_t k;
+	
+	for (k = 0; k < n; k++) {
+		accel = s_accel[k & 1023];
+		gyro = s_gyro[k & 1023];
+		compass = s_compass[k & 1023];
+		control_Estimate();
+	}
+	bench_Keep(&roll);
+}
+
+static void setup_Steady(void) {
+	uint32_t k;
+	
+	firmware_Setup();
+	kalman_gain_mode = KALMAN_GAIN_STEADY;
+	kalman_steady_solve(&kalman_ss, 2 * KALMAN_STEADY_ITER_MAX);
+	for (k = 0; k < kalman_ss.n; k++) kalman_innovate(&k_roll, s_accel[k & 1023].x, s_gyro[k & 1023].x);
+}
+
+static int check_Steady(void) {
+	return kalman_ss.state == KALMAN_STEADY_READY && k_roll.n >= kalman_ss.n;
+}
+
+static void setup_Ahrs(void) {
+	firmware_Setup();
+	control_estimator = CONTROL_EST_AHRS;
+}
+
+static void run_Step(uint32_t n) {
+	uint32_t k;
+	
+	for (k = 0; k < n; k++) {
+		roll = s_accel[k & 1023].x;
+		pitch = s_accel[k & 1023].y;
+		gyro = s_gyro[k & 1023];
+		user_torque = (uint16_t)(k % __TORQUE_MAX);
+		control_Step();
+	}
+}
+
+static int check_Step(void) {
+	uint32_t i;
+	
+	for (i = 0; i < HAL_PWM_CHANNELS; i++) {
+		if (hal_host_pwm[i] < pwm_msec || hal_host_pwm[i] > 2 * pwm_msec) return 0;
+	}
+	return 1;
+}
+
+static void run_Telemetry(uint32_t n) {
+	uint32_t k;
+	
+	for (k = 0; k < n; k++) {
+		roll = s_accel[k & 1023].x;
+		control_Telemetry(k * 10000);
+	}
+}
+
+static int check_Telemetry(void) {
+	return sink_bytes > 0 && telem_dropped == 0;
+}
+
+static void setup_Text(void) {
+	firmware_Setup();
+	telem_mode = TELEM_TEXT;
+}
+
+static void setup_Decode(void) {
+	uint32_t k;
+	
+	firmware_Setup();
+	hal_HostSerialSink(sink_Stream, NULL);
+	stream_n = 0;
+	for (k = 0; k < DECODE_TICKS; k++) control_Telemetry(k * 10000);
+}
+
+static void on_Frame(void *ctx, const telem_frame *f) {
+	(void)ctx;
+	(void)f;
+	decoded++;
+}
+
+static void run_Decode(uint32_t n) {
+	telem_decoder d;
+	uint32_t k;
+	
+	// an op is one tick's frames; the stream holds DECODE_TICKS, whole seq wraps
+	decoded = 0;
+	telem_DecoderInit(&d, on_Frame, NULL);
+	for (k = 0; k < n; k += DECODE_TICKS) telem_Decode(&d, stream, stream_n);
+}
+
+static int check_Decode(void) {
+	return decoded > 0 && decoded % (DECODE_TICKS * 4) == 0 && stream_n < sizeof(stream);
+}
+
+static int32_t ram_Read(void *ctx, uint8_t addr, int32_t nBytes, uint8_t *pBuf) {
+	(void)ctx;
+	memcpy(pBuf, &ram[addr], nBytes);
+	return nBytes;
+}
+
+static int32_t ram_Write(void *ctx, uint8_t addr, int32_t nBytes, uint8_t *pBuf) {
+	(void)ctx;
+	memcpy(&ram[addr], pBuf, nBytes);
+	return 1;
+}
+
+static void setup_I2C(void) {
+	i2c_host_device dev = {0x53, ram_Read, ram_Write, NULL};
+	uint32_t i;
+	
+	hal_HostReset();
+	i2c_HostDetachAll();
+	i2c_HostAttach(&dev);
+	for (i = 0; i < sizeof(ram); i++) ram[i] = (uint8_t)(i * 5 + 3);
+	i2c_AsyncInit();
+}
+
+static void run_I2C(uint32_t n) {
+	i2c_txn t;
+	uint32_t k;
+	
+	for (k = 0; k < n; k++) {
+		memset(&t, 0, sizeof(t));
+		t.id = 0x53;
+		t.addr = 0x32;
+		t.dir = I2C_TXN_READ;
+		t.n = 6;
+		t.buf = rd_buf;
+		i2c_Submit(&t);
+		while (!i2c_AsyncIdle()) i2c_HostMockRun(i2c_HostMockNow() + 1000000);
+	}
+}
+
+static int check_I2C(void) {
+	return !memcmp(rd_buf, &ram[0x32], 6);
+}
+
+static void setup_Spsc(void) {
+	spsc_Init(&ring, ring_buf, SENSORS_RING_SIZE, 8);
+}
+
+static void run_Spsc(uint32_t n) {
+	uint8_t e[8] = {1, 2, 3, 4, 5, 6, 7, 8}, out[8];
+	uint32_t k;
+	
+	for (k = 0; k < n; k++) {
+		e[0] = (uint8_t)k;
+		spsc_Push(&ring, e);
+		spsc_Pop(&ring, out);
+	}
+	bench_Keep(out);
+}
+
+static int check_Spsc(void) {
+	return spsc_Count(&ring) == 0 && ring.dropped == 0;
+}
+
+static void task_Nop(void) {
+	task_runs++;
+}
+
+static void setup_Task(void) {
+	hal_HostReset();
+	task_Init();
+	task_Register(TASK_COMMAND, "nop", task_Nop, 1000);
+	task_runs = 0;
+}
+
+static void run_Task(uint32_t n) {
+	uint32_t k;
+	
+	for (k = 0; k < n; k++) {
+		task_Post(TASK_COMMAND);
+		task_RunNext();
+	}
+}
+
+static int check_Task(void) {
+	return task_runs == task_table[TASK_COMMAND].posts && !task_table[TASK_COMMAND].overruns;
+}
+
+
+static const kernel kernels[] = {
+	{"kalman_innovate",		2000000,	firmware_Setup,	run_Kalman,			NULL},
+	{"kalman_steady",			2000000,	setup_Steady,		run_Kalman,			check_Steady},
+	{"estimate_kalman",		500000,		firmware_Setup,	run_Estimate,		NULL},
+	{"estimate_ahrs",			500000,		setup_Ahrs,			run_Estimate,		NULL},
+	{"control_step",			500000,		firmware_Setup,	run_Step,				check_Step},
+	{"telem_binary",			200000,		firmware_Setup,	run_Telemetry,	check_Telemetry},
+	{"telem_text",				200000,		setup_Text,			run_Telemetry,	check_Telemetry},
+	{"telem_decode",			200000,		setup_Decode,		run_Decode,			check_Decode},
+	{"i2c_read6",					200000,		setup_I2C,			run_I2C,				check_I2C},
+	{"spsc_push_pop",			5000000,	setup_Spsc,			run_Spsc,				check_Spsc},
+	{"task_post_run",			2000000,	setup_Task,			run_Task,				check_Task},
+};
+#define KERNELS					(sizeof(kernels) / sizeof(kernels[0]))
+
+
+static int cmp_Double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	
+	return x < y ? -1 : x > y;
+}
+
+static void measure(const kernel *k, double scale, uint32_t repeats, result *r) {
+	double ns[REPEATS_MAX], t0;
+	uint64_t c0, cycles = ~0ull;
+	uint32_t i, n = (uint32_t)(k->iterations * scale);
+	
+	if (n < 1) n = 1;
+	k->setup();
+	k->run(n / 10 + 1);																// warm up
+	for (i = 0; i < repeats; i++) {
+		t0 = bench_Seconds();
+		c0 = bench_Cycles();
+		k->run(n);
+		c0 = bench_Cycles() - c0;
+		ns[i] = (bench_Seconds() - t0) * 1e9 / n;
+		if (c0 < cycles) cycles = c0;
+	}
+	qsort(ns, repeats, sizeof(double), cmp_Double);
+	r->name = k->name;
+	r->iterations = n;
+	r->repeats = repeats;
+	r->ns_min = ns[0];
+	r->ns_median = ns[repeats / 2];
+	r->cycles = (double)cycles / n;
+	r->ok = k->check == NULL || k->check();
+}
+
+static void json_Write(FILE *f, const char *label, const result *r, uint32_t n) {
+	uint32_t i;
+	
+	fprintf(f, "{\n  \"suite\": \"skyalpha\",\n  \"label\": \"%s\",\n  \"results\": [\n", label);
+	for (i = 0; i < n; i++) {
+		fprintf(f, "    {\"name\": \"%s\", \"iterations\": %u, \"repeats\": %u, \"ns_min\": %.3f, \"ns_median\": %.3f, \"cycles\": %.1f}%s\n",
+					r[i].name, r[i].iterations, r[i].repeats, r[i].ns_min, r[i].ns_median, r[i].cycles, i + 1 < n ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+}
+
+/*
+ * @brief: Median ns/op of a kernel in a file written by json_Write
+ * @param[in]: open file, kernel name
+ * @param[out]: ns, 0 if the kernel is not in the file
+ */
+static double baseline_Find(FILE *f, const char *name) {
+	char line[512], got[KERNEL_NAME_MAX];
+	const char *p;
+	double ns;
+	
+	rewind(f);
+	while (fgets(line, sizeof(line), f) != NULL) {
+		p = strstr(line, "\"name\": \"");
+		if (p == NULL || sscanf(p + 9, "%31[^\"]", got) != 1 || strcmp(got, name)) continue;
+		p = strstr(line, "\"ns_median\": ");
+		if (p != NULL && sscanf(p + 13, "%lf", &ns) == 1) return ns;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	static result results[RESULTS_MAX];
+	const char *filter = NULL, *label = "", *json = NULL, *baseline = NULL;
+	double scale = 1, tolerance = 30, base;
+	uint32_t repeats = 5, n = 0, i;
+	FILE *f;
+	int fail = 0, slow = 0;
+	
+	for (i = 1; i < (uint32_t)argc; i++) {
+		if (!strcmp(argv[i], "-s") && i + 1 < (uint32_t)argc)								scale = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i + 1 < (uint32_t)argc)					repeats = (uint32_t)atol(argv[++i]);
+		else if (!strcmp(argv[i], "-k") && i + 1 < (uint32_t)argc)					filter = argv[++i];
+		else if (!strcmp(argv[i], "--label") && i + 1 < (uint32_t)argc)			label = argv[++i];
+		else if (!strcmp(argv[i], "--json") && i + 1 < (uint32_t)argc)			json = argv[++i];
+		else if (!strcmp(argv[i], "--baseline") && i + 1 < (uint32_t)argc)	baseline = argv[++i];
+		else if (!strcmp(argv[i], "--tolerance") && i + 1 < (uint32_t)argc)	tolerance = atof(argv[++i]);
+		else {
+			fprintf(stderr, "usage: %s [-s scale] [-r repeats] [-k name] [--label text] [--json file] [--baseline file] [--tolerance pct]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (repeats < 1) repeats = 1;
+	if (repeats > REPEATS_MAX) repeats = REPEATS_MAX;
+	
+	printf("kernel             iterations    ns_min  ns_median    cycles\n");
+	for (i = 0; i < KERNELS; i++) {
+		if (filter != NULL && strstr(kernels[i].name, filter) == NULL) continue;
+		measure(&kernels[i], scale, repeats, &results[n]);
+		printf("%-17s %11u %9.2f  %9.2f  %8.1f%s\n", results[n].name, results[n].iterations, results[n].ns_min,
+					results[n].ns_median, results[n].cycles, results[n].ok ? "" : "  check FAILED");
+		if (!results[n].ok) fail = 1;
+		n++;
+	}
+	
+	if (json != NULL) {
+		f = strcmp(json, "-") ? fopen(json, "w") : stdout;
+		if (f == NULL) {
+			perror(json);
+			return 1;
+		}
+		json_Write(f, label, results, n);
+		if (f != stdout) fclose(f);
+	}
+	
+	if (baseline != NULL) {
+		f = fopen(baseline, "r");
+		if (f == NULL) {
+			perror(baseline);
+			return 1;
+		}
+		printf("\nkernel             baseline   now      change\n");
+		for (i = 0; i < n; i++) {
+			base = baseline_Find(f, results[i].name);
+			if (base <= 0) {
+				printf("%-17s %9s %8.2f\n", results[i].name, "-", results[i].ns_median);
+				continue;
+			}
+			printf("%-17s %9.2f %8.2f  %+6.1f%%%s\n", results[i].name, base, results[i].ns_median,
+						100 * (results[i].ns_median / base - 1), results[i].ns_median > base * (1 + tolerance / 100) ? "  SLOWER" : "");
+			if (results[i].ns_median > base * (1 + tolerance / 100)) slow = 1;
+		}
+		fclose(f);
+	}
+	
+	printf("%s: %u kernels%s\n", fail || slow ? "FAIL" : "PASS", n, baseline != NULL ? (slow ? ", regression against baseline" : ", within baseline") : "");
+	return fail || slow;
+}
@@ -0,0 +1,291 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc16.h"
+#include "telemetry.h"
+#include "telem_decode.h"
+#include "control.h"
+#include "hal_host.h"
+#include "bench.h"
+
+/*
+ * Binary telemetry: framing checks through the host USB transmit ring and
+ * the decoder (round trip of every message, arbitrary payloads across the
+ * ring wrap, corruption, seq gaps, a stalled host), then the cost of one
+ * control tick of telemetry in TELEM_TEXT and TELEM_BINARY against the three
+ * Kalman filter updates, and decoder throughput.
+ *
+ *   bench_telemetry [ticks]
+ *
+ * Exits 1 if a check fails or a binary tick costs more than a text tick.
+ */
+
+#define CAPTURE_SIZE				(1 << 20)
+#define STREAM_TICKS				10240						// whole seq wraps, 4 frames a tick
+#define DECODE_PASSES				64
+
+
+static uint8_t		capture[CAPTURE_SIZE];
+static uint32_t		capture_n;
+static uint64_t		sink_bytes;
+static int				fail;
+
+static telem_frame	last;
+static uint8_t			last_payload[TELEM_PAYLOAD_MAX];
+static uint32_t			seen;
+
+
+static void check(int ok, const char *what) {
+	printf("%-48s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok) fail = 1;
+}
+
+static void sink_Capture(void *ctx, const uint8_t *data, uint16_t len) {
+	(void)ctx;
+	if (capture_n + len > CAPTURE_SIZE) len = CAPTURE_SIZE - capture_n;
+	memcpy(&capture[capture_n], data, len);
+	capture_n += len;
+}
+
+static void sink_Count(void *ctx, const uint8_t *data, uint16_t len) {
+	(void)ctx;
+	bench_Keep((void *)data);
+	sink_bytes += len;
+}
+
+static void on_Frame(void *ctx, const telem_frame *f) {
+	(void)ctx;
+	last = *f;
+	memcpy(last_payload, f->payload, f->len);
+	last.payload = last_payload;
+	seen++;
+}
+
+static void capture_Reset(void) {
+	hal_HostReset();
+	hal_HostSerialSink(sink_Capture, NULL);
+	capture_n = 0;
+	telem_mode = TELEM_BINARY;
+}
+
+static uint32_t decode_Capture(telem_decoder *d) {
+	telem_DecoderInit(d, on_Frame, NULL);
+	seen = 0;
+	return telem_Decode(d, capture, capture_n);
+}
+
+static void checks(void) {
+	static const uint16_t mot[4] = {0, 1, 100, 0xFFFF};
+	sensors_sample imu[SENSORS_COUNT];
+	uint8_t payload[TELEM_PAYLOAD_MAX], text[32];
+	telem_decoder d;
+	telem_attitude a;
+	telem_imu m;
+	telem_motors p;
+	telem_timing t;
+	telem_writer *w, *inner;
+	uint64_t seed = 7;
+	uint32_t i, k, n, start, ok, frames0;
+	
+	check(crc16_Update(CRC16_INIT, (const uint8_t *)"123456789", 9) == 0x29B1, "crc16 check value 0x29B1");
+	
+	capture_Reset();
+	telem_Attitude(123456789, 12.345f, -0.004f, -179.99f);
+	decode_Capture(&d);
+	check(seen == 1 && telem_ParseAttitude(&last, &a) && a.t_us == 123456789 && a.roll > 12.339f && a.roll < 12.351f
+				&& a.pitch == 0.0f && a.yaw < -179.98f, "attitude round trip, 0.01 deg");
+	
+	for (i = 0; i < SENSORS_COUNT; i++) {
+		imu[i].x = (int16_t)(i * 1000 - 32768);
+		imu[i].y = 0;
+		imu[i].z = (int16_t)(i + 1);
+	}
+	capture_Reset();
+	telem_Imu(imu);
+	decode_Capture(&d);
+	check(seen == 1 && telem_ParseImu(&last, &m) && m.accel[0] == imu[__MEASURE_ACCELEROMETER].x
+				&& m.gyro[0] == imu[__MEASURE_GYROSCOPE].x && m.compass[2] == imu[__MEASURE_COMPASS].z && m.accel[1] == 0,
+				"raw IMU round trip, accel/gyro/compass order");
+	
+	capture_Reset();
+	telem_Motors(mot);
+	telem_Timing(0xFFFFFFFF, 10000, 0);
+	strcpy((char *)text, "torque setted: 50\n");
+	telem_Text(text);
+	decode_Capture(&d);
+	ok = seen == 3 && last.id == TELEM_MSG_TEXT && last.len == 18 && !memcmp(last_payload, "torque setted: 50\n", 18) && text[0] == 0;
+	check(ok, "text frame, buffer cleared");
+	ok = 1;
+	for (i = 0, k = 0; i < capture_n; i++) {
+		if (!capture[i]) {
+			telem_frame f;
+			
+			// re-decode each frame on its own to reach motors and timing
+			telem_DecoderInit(&d, on_Frame, NULL);
+			telem_Decode(&d, &capture[k], i + 1 - k);
+			f = last;
+			if (f.id == TELEM_MSG_MOTORS) ok &= telem_ParseMotors(&f, &p) && !memcmp(p.torque, mot, sizeof(mot));
+			if (f.id == TELEM_MSG_TIMING) ok &= telem_ParseTiming(&f, &t) && t.t_us == 0xFFFFFFFF && t.period_us == 10000 && t.dropped == 0;
+			k = i + 1;
+		}
+	}
+	check(ok, "motors and timing round trip");
+	
+	// a writer interrupting an open frame is dropped, and its fields do not
+	// reach the open one
+	capture_Reset();
+	n = telem_dropped;
+	w = telem_Begin(TELEM_MSG_MOTORS, TELEM_MOTORS_SIZE);
+	for (i = 0; i < 2; i++) telem_U16(w, mot[i]);
+	inner = telem_Begin(TELEM_MSG_ATTITUDE, TELEM_ATTITUDE_SIZE);
+	ok = !inner && telem_dropped == n + 1;
+	telem_U32(inner, 0xDEADBEEF);
+	telem_End(inner);
+	for (i = 2; i < 4; i++) telem_U16(w, mot[i]);
+	telem_End(w);
+	decode_Capture(&d);
+	check(ok && seen == 1 && telem_ParseMotors(&last, &p) && !memcmp(p.torque, mot, sizeof(mot)),
+				"nested frame dropped, open frame intact");
+	
+	// arbitrary payloads, zeros and 0xFF runs included, walking the ring wrap
+	capture_Reset();
+	ok = 1;
+	for (k = 0; k < 2000; k++) {
+		n = (uint32_t)(bench_Noise(&seed) * 0.5 * TELEM_PAYLOAD_MAX + 0.5 * TELEM_PAYLOAD_MAX);
+		if (n > TELEM_PAYLOAD_MAX) n = TELEM_PAYLOAD_MAX;
+		for (i = 0; i < n; i++) {
+			double r = bench_Noise(&seed);
+			
+			payload[i] = r < -0.5 ? 0 : r > 0.5 ? 0xFF : (uint8_t)(int)(r * 1000);
+		}
+		start = capture_n;
+		w = telem_Begin(0x40, (uint8_t)n);
+		for (i = 0; i < n; i++) telem_U8(w, payload[i]);
+		telem_End(w);
+		ok &= capture_n - start <= TELEM_FRAME_MAX(n) && capture[capture_n - 1] == 0;
+		for (i = start; i < capture_n - 1; i++) ok &= capture[i] != 0;
+		telem_DecoderInit(&d, on_Frame, NULL);
+		seen = 0;
+		telem_Decode(&d, &capture[start], capture_n - start);
+		ok &= seen == 1 && last.id == 0x40 && last.len == n && !memcmp(last_payload, payload, n);
+	}
+	check(ok, "2000 random payloads, no zero inside, exact size");
+	
+	n = decode_Capture(&d);
+	check(n == 2000 && d.lost == 0 && !d.crc_errors && !d.malformed, "continuous stream decodes, seq contiguous");
+	telem_DecoderInit(&d, NULL, NULL);
+	for (i = 0, n = 0; i < capture_n; i++) n += telem_Decode(&d, &capture[i], 1);
+	check(n == 2000, "byte-at-a-time feed");
+	
+	// damage one byte in every 10th frame (never into a delimiter), leave out another 10th
+	telem_DecoderInit(&d, NULL, NULL);
+	for (i = 0, k = 0, start = 0, n = 0; i < capture_n; i++) {
+		if (capture[i]) continue;
+		if (k % 10 == 1) capture[start + (i - start) / 2] ^= capture[start + (i - start) / 2] == 0x5A ? 0x01 : 0x5A;
+		if (k % 10 != 5) n += telem_Decode(&d, &capture[start], i + 1 - start);
+		start = i + 1;
+		k++;
+	}
+	check(n == 1600 && d.crc_errors + d.malformed == 200 && d.lost == 400, "damaged frames rejected, gaps counted");
+	
+	// decoder joining mid-frame
+	capture_Reset();
+	telem_Attitude(1, 0, 0, 0);
+	telem_Attitude(2, 0, 0, 0);
+	telem_DecoderInit(&d, on_Frame, NULL);
+	seen = 0;
+	telem_Decode(&d, &capture[3], capture_n - 3);
+	check(seen == 1 && telem_ParseAttitude(&last, &a) && a.t_us == 2, "resync on the next delimiter");
+	
+	// USB host not reading: whole frames are dropped, nothing torn
+	capture_Reset();
+	hal_host_tx_stall = 1;
+	frames0 = telem_frames;
+	telem_dropped = 0;
+	for (k = 0; k < 20; k++) telem_Attitude(k, 1, 2, 3);
+	n = (HAL_HOST_TX_SIZE - 1) / TELEM_FRAME_MAX(TELEM_ATTITUDE_SIZE);
+	ok = telem_frames - frames0 == n && telem_dropped == 20 - n && capture_n == 0;
+	hal_host_tx_stall = 0;
+	telem_Timing(0, 0, 0);
+	ok &= decode_Capture(&d) == n + 1 && !d.crc_errors && !d.malformed && !d.lost;
+	check(ok, "stalled host: frames dropped whole, rest intact");
+	telem_dropped = 0;
+}
+
+/*
+ * @brief: ns per control tick of telemetry in a mode, and bytes it sends
+ */
+static double tick_Cost(uint8_t mode, uint32_t ticks, double *bytes) {
+	double t0;
+	uint32_t k;
+	
+	hal_HostReset();
+	hal_HostSerialSink(sink_Count, NULL);
+	sink_bytes = 0;
+	telem_mode = mode;
+	t0 = bench_Seconds();
+	for (k = 0; k < ticks; k++) {
+		roll = (k % 3600) * 0.1f - 180.0f;
+		pitch = -roll * 0.5f;
+		yaw = roll * 0.25f;
+		u_roll = roll * 0.01f;
+		control_Telemetry(k * 10000);
+	}
+	*bytes = (double)sink_bytes / ticks;
+	return (bench_Seconds() - t0) * 1e9 / ticks;
+}
+
+static double kalman_Cost(uint32_t ticks) {
+	kalman_data kf[3];
+	double t0;
+	uint32_t k, j;
+	
+	for (j = 0; j < 3; j++) kalman_init(&kf[j]);
+	t0 = bench_Seconds();
+	for (k = 0; k < ticks; k++) {
+		for (j = 0; j < 3; j++) kalman_innovate(&kf[j], (k % 100) * 0.1f + j, 0.5f);
+	}
+	bench_Keep(kf);
+	return (bench_Seconds() - t0) * 1e9 / ticks;
+}
+
+static void throughput(uint32_t ticks) {
+	telem_decoder d;
+	double ns_text, ns_bin, ns_kf, b_text, b_bin, t0, wall;
+	uint32_t k;
+	
+	ns_text = tick_Cost(TELEM_TEXT, ticks, &b_text);
+	ns_bin = tick_Cost(TELEM_BINARY, ticks, &b_bin);
+	ns_kf = kalman_Cost(ticks);
+	
+	// a recorded stream of STREAM_TICKS control ticks
+	capture_Reset();
+	for (k = 0; k < STREAM_TICKS; k++) control_Telemetry(k * 10000);
+	telem_DecoderInit(&d, NULL, NULL);
+	t0 = bench_Seconds();
+	for (k = 0; k < DECODE_PASSES; k++) telem_Decode(&d, capture, capture_n);
+	wall = bench_Seconds() - t0;
+	telem_mode = __TELEMETRY;
+	
+	printf("\nper control tick           ns      bytes   messages\n");
+	printf("text (sprintf)        %8.1f   %8.1f   attitude, u\n", ns_text, b_text);
+	printf("binary (COBS)         %8.1f   %8.1f   attitude, imu, motors, timing\n", ns_bin, b_bin);
+	printf("3x kalman_innovate    %8.1f\n", ns_kf);
+	printf("\nbinary/text cost:        %.2f\n", ns_bin / ns_text);
+	printf("usb bytes/s at 100 Hz:   %.0f binary, %.0f text\n", b_bin * 100, b_text * 100);
+	printf("decode MB/s:             %.1f\n", (double)d.bytes / wall / 1e6);
+	printf("decode frames/s:         %.3g\n", d.frames / wall);
+	if (d.frames != (uint64_t)DECODE_PASSES * STREAM_TICKS * 4 || d.crc_errors || d.malformed || d.lost) fail = 1;
+	if (ns_bin >= ns_text) fail = 1;
+}
+
+int main(int argc, char **argv) {
+	uint32_t ticks = argc > 1 ? (uint32_t)atol(argv[1]) : 200000;
+	
+	checks();
+	throughput(ticks);
+	printf("%s: telemetry framing and cost\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
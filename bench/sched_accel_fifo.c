@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "sensors.h"
+#include "hal_host.h"
+#include "sim.h"
+
+/*
+ * ADXL345 at 800 Hz on the mock 400 kHz bus, polled by the scheduler versus
+ * streamed through the FIFO with the watermark interrupt. Gyro and compass
+ * run as usual; the accelerometer's share of bus transactions, I2C
+ * interrupts and bus time is the difference against a run with the
+ * accelerometer stopped. Every entry is still one register read on the bus
+ * (the part pops one entry per DATAX0..DATAZ1 read), so what FIFO mode saves
+ * is transactions, completion callbacks and task wakeups, not bus time.
+ *
+ *   sched_accel_fifo [seconds]
+ *
+ * Exits 1 if either mode misses 800 Hz by more than 1%, loses FIFO entries,
+ * reports a bus error or overrun on any sensor, the two modes disagree on the
+ * filtered reading, or FIFO mode does not cut transactions per sample by the
+ * watermark.
+ */
+
+#define ACCEL_HZ				800
+
+
+typedef struct {
+	const char	*name;
+	uint32_t		samples, reads, errors, overruns, fifo_lost;
+	uint32_t		others;												// gyro and compass errors and overruns
+	uint64_t		interrupts, busy_ns;
+	double			dt_mean, az;
+} run_result;
+
+
+static void run(run_result *r, const char *name, uint8_t mode, uint16_t hz, double seconds) {
+	static sim_world w;
+	sensors_channel *ch = &sensors_chan[__MEASURE_ACCELEROMETER];
+	uint64_t irq0, busy0;
+	uint8_t s;
+	
+	sensors_accel_mode = mode;
+	sim_Init(&w, 1);
+	if (mode == SENSORS_ACCEL_POLLED) sensors_SetRate(__MEASURE_ACCELEROMETER, hz);
+	sim_Run(&w, 0.1);
+	sensors_StatsReset();
+	irq0 = i2c_host_interrupts;
+	busy0 = i2c_host_busy_ns;
+	sim_Run(&w, seconds);
+	
+	r->name = name;
+	r->samples = ch->samples;
+	r->reads = ch->reads;
+	r->errors = ch->errors;
+	r->overruns = ch->overruns;
+	r->fifo_lost = w.imu.adxl345_overruns;
+	r->others = 0;
+	for (s = 0; s < SENSORS_COUNT; s++) {
+		if (s != __MEASURE_ACCELEROMETER) r->others += sensors_chan[s].errors + sensors_chan[s].overruns;
+	}
+	r->interrupts = i2c_host_interrupts - irq0;
+	r->busy_ns = i2c_host_busy_ns - busy0;
+	r->dt_mean = ch->samples > 1 ? (double)ch->dt_sum / (ch->samples - 1) : 0;
+	r->az = accel.z;
+}
+
+int main(int argc, char **argv) {
+	double seconds = argc > 1 ? atof(argv[1]) : 5;
+	run_result base, polled, fifo;
+	const run_result *m[2] = {&polled, &fifo};
+	int fail = 0;
+	uint8_t i;
+	
+	run(&base, "none", SENSORS_ACCEL_POLLED, 0, seconds);
+	run(&polled, "polled", SENSORS_ACCEL_POLLED, ACCEL_HZ, seconds);
+	run(&fifo, "fifo", SENSORS_ACCEL_FIFO, 0, seconds);
+	sensors_accel_mode = __ACCEL_MODE;
+	
+	printf("accel %u Hz, watermark %u, bus %u Hz, %.1f s\n\n", ACCEL_HZ, __ACCEL_WATERMARK, I2C_HOST_BITRATE, seconds);
+	printf("mode     hz_got  dt_mean_us  txn/sample  i2c_irq/sample  bus_us/sample  bus_util  accel.z\n");
+	for (i = 0; i < 2; i++) {
+		const run_result *r = m[i];
+		double n = r->samples ? r->samples : 1;
+		double irq = (double)r->interrupts - (double)base.interrupts;
+		double busy = (double)r->busy_ns - (double)base.busy_ns;
+		
+		printf("%-7s %7.1f  %10.1f  %10.3f  %14.3f  %13.1f  %7.1f%%  %7.2f\n", r->name, r->samples / seconds, r->dt_mean,
+					r->reads / n, irq / n, busy / 1e3 / n, 100.0 * busy / (seconds * 1e9), r->az);
+		if (fabs(r->samples / seconds - ACCEL_HZ) > 0.01 * ACCEL_HZ) fail = 1;
+		if (r->errors || r->overruns || r->fifo_lost || r->others) fail = 1;
+	}
+	printf("\nfifo entries lost:       %u\n", fifo.fifo_lost);
+	printf("errors / overruns:       %u / %u polled, %u / %u fifo\n", polled.errors, polled.overruns, fifo.errors, fifo.overruns);
+	printf("gyro+compass misses:     %u polled, %u fifo\n", polled.others, fifo.others);
+	printf("transactions cut:        %.1fx\n", fifo.reads ? ((double)polled.reads / polled.samples) / ((double)fifo.reads / fifo.samples) : 0);
+	
+	if (fabs(polled.az - fifo.az) > 3) fail = 1;
+	if (fifo.reads * __ACCEL_WATERMARK > fifo.samples + __ACCEL_WATERMARK) fail = 1;
+	
+	printf("%s: FIFO streaming holds %u Hz with 1/%u of the transactions\n", fail ? "FAIL" : "PASS", ACCEL_HZ, __ACCEL_WATERMARK);
+	return fail;
+}
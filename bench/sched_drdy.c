@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sensors.h"
+#include "hal_host.h"
+#include "sim.h"
+
+/*
+ * Sensor freshness and data-ready to filter latency in the simulator, with
+ * the parts converting on their own clocks (see imu_model.odr_ppm). Three
+ * runs: the scheduler reading at fixed rates (SENSORS_ACQ_TIMER), data-ready
+ * interrupts (SENSORS_ACQ_DRDY), and data-ready with one step in 24 losing
+ * the accelerometer and gyro edges, which the tick has to recover.
+ *
+ * Per sensor: conversions, reads that got a new conversion (fresh), reads
+ * that got one already read (stale), conversions never read (missed), bus
+ * time spent on stale reads, and the age of each fresh sample from the
+ * conversion to its last byte, i.e. to the filter input. The firmware's own
+ * trigger to filter latency is printed alongside.
+ *
+ *   sched_drdy [seconds]
+ *
+ * Exits 1 if a data-ready run makes a stale read or misses a conversion of
+ * the accelerometer or gyro, a sensor reports an error or overrun, the worst
+ * age exceeds DRDY_AGE_MAX_US (one tick more when edges are lost), or the
+ * firmware latency disagrees with the model's age.
+ */
+
+#define DRDY_AGE_MAX_US			700							// three reads queued on coinciding edges
+#define READ_US					212.5						// 85 bits at 400 kHz
+#define LOSSY_EVERY				24							// steps
+
+
+typedef struct {
+	const char	*name;
+	uint8_t			acq;
+	uint8_t			lossy;
+	int32_t			ppm[3];
+	imu_stream	st[SENSORS_COUNT];
+	sensors_channel	ch[SENSORS_COUNT];
+} run_result;
+
+
+static const char *names[SENSORS_COUNT] = {"accel", "compass", "gyro"};
+static const uint8_t model[SENSORS_COUNT] = {0, 2, 1};					// imu_model.stream index
+
+
+static void run(run_result *r, double seconds) {
+	static sim_world w;
+	uint64_t n = (uint64_t)(seconds * SIM_RATE), k;
+	uint8_t s;
+	
+	sensors_acq = r->acq;
+	sim_Init(&w, 1);
+	sim_Run(&w, 0.1);
+	sensors_StatsReset();
+	memset(w.imu.stream, 0, sizeof(w.imu.stream));
+	for (k = 0; k < n; k++) {
+		uint8_t drop = r->lossy && k % LOSSY_EVERY == 0;
+		
+		if (drop) {
+			hal_host_exti_enabled[HAL_EXTI_ACCEL] = 0;
+			hal_host_exti_enabled[HAL_EXTI_GYRO] = 0;
+		}
+		sim_Step(&w);
+		if (drop) {
+			hal_host_exti_enabled[HAL_EXTI_ACCEL] = 1;
+			hal_host_exti_enabled[HAL_EXTI_GYRO] = 1;
+		}
+	}
+	memcpy(r->ppm, w.imu.odr_ppm, sizeof(r->ppm));
+	for (s = 0; s < SENSORS_COUNT; s++) {
+		r->st[s] = w.imu.stream[model[s]];
+		r->ch[s] = sensors_chan[s];
+	}
+}
+
+int main(int argc, char **argv) {
+	double seconds = argc > 1 ? atof(argv[1]) : 10;
+	run_result runs[3] = {
+		{"timer", SENSORS_ACQ_TIMER, 0},
+		{"drdy", SENSORS_ACQ_DRDY, 0},
+		{"drdy-lossy", SENSORS_ACQ_DRDY, 1},
+	};
+	int fail = 0;
+	uint8_t i, s;
+	
+	for (i = 0; i < 3; i++) run(&runs[i], seconds);
+	sensors_acq = __SENSORS_ACQ;
+	
+	printf("%.1f s, sensor clock error accel/gyro/compass %+d/%+d/%+d ppm\n\n", seconds, runs[0].ppm[0], runs[0].ppm[1], runs[0].ppm[2]);
+	printf("run         sensor   conv/s   fresh    stale  missed  stale_bus_us/s  age_us mean/max   fw_lat_us mean/max  ovr err\n");
+	for (i = 0; i < 3; i++) {
+		const run_result *r = &runs[i];
+		
+		for (s = 0; s < SENSORS_COUNT; s++) {
+			const imu_stream *st = &r->st[s];
+			const sensors_channel *ch = &r->ch[s];
+			uint32_t done = ch->reads - ch->errors;
+			double age = st->fresh ? st->age_sum_ns / 1e3 / st->fresh : 0;
+			double lat = done ? (double)ch->lat_sum / done : 0;
+			
+			printf("%-11s %-7s %7.1f  %6u  %7u  %6u  %14.1f  %7.1f / %6.1f  %8.1f / %6u  %3u %3u\n", i == 0 || s == 0 ? r->name : "", names[s],
+						st->conversions / seconds, st->fresh, st->stale, st->missed, st->stale * READ_US / seconds,
+						age, st->age_max_ns / 1e3, lat, ch->lat_max, ch->overruns, ch->errors);
+			if (ch->overruns || ch->errors) fail = 1;
+			if (r->acq != SENSORS_ACQ_DRDY) continue;
+			if (st->stale || st->age_max_ns > (DRDY_AGE_MAX_US + (r->lossy ? 1000000 / SENSORS_TICK_HZ : 0)) * 1000ull) fail = 1;
+			// a lost compass edge is a lost sample; the latched lines must not lose any
+			if (st->missed && (s != __MEASURE_COMPASS || !r->lossy)) fail = 1;
+			// edge time is the conversion time, so both clocks must agree to a tick of hal_Micros
+			if (!r->lossy && (lat > age + 1.0 || lat < age - 1.0)) fail = 1;
+		}
+	}
+	
+	printf("%s: data-ready acquisition reads every conversion once, within %u us\n", fail ? "FAIL" : "PASS", DRDY_AGE_MAX_US);
+	return fail;
+}
@@ -0,0 +1,197 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tasks.h"
+#include "control.h"
+#include "hal_host.h"
+#include "sim.h"
+
+/*
+ * The main-loop task scheduler. First with synthetic tasks that burn a set
+ * number of microseconds of hal_Micros() time while a 100 Hz timer keeps
+ * posting the control tick into them, as TIMER1A would:
+ *
+ *   nominal   the four control tasks well inside the period: every post
+ *             runs once, in deadline order, nothing late, WCET = cost
+ *   overload  every SPIKE_EVERY ticks telemetry takes SPIKE_US, longer
+ *             than a period: the next estimate/control must come out late,
+ *             the command task overrun, and the spike show up as the WCET,
+ *             while the ticks after the spike catch up
+ *
+ * Then the simulator flying the real control tasks from the main loop and
+ * from TIMER1A (TASKS_ISR) must end in the same attitude.
+ *
+ *   sched_tasks [ticks]
+ *
+ * Exits 1 on any of the above not holding.
+ */
+
+#define TICK_US					10000
+#define SPIKE_EVERY				50
+#define SPIKE_US				15000
+#define TRACE_MAX				16
+
+
+static const uint32_t	cost_us[4] = {300, 150, 400, 50};		// estimate, control, telemetry, command
+static const uint32_t	deadline_us[4] = {CONTROL_ESTIMATE_DEADLINE_US, CONTROL_STEP_DEADLINE_US,
+																				CONTROL_TELEMETRY_DEADLINE_US, CONTROL_COMMAND_DEADLINE_US};
+
+static uint64_t		next_tick_ns;
+static uint32_t		ticks_posted, spike;
+static uint8_t		trace[TRACE_MAX];
+static uint32_t		trace_n;
+static int				fail;
+
+
+static void check(int ok, const char *what) {
+	printf("%-52s %s\n", what, ok ? "ok" : "FAIL");
+	if (!ok) fail = 1;
+}
+
+/*
+ * @brief: TIMER1A: post the control tick
+ */
+static void timer_Tick(void) {
+	uint8_t id;
+	
+	for (id = TASK_ESTIMATE; id <= TASK_COMMAND; id++) task_Post(id);
+	ticks_posted++;
+	next_tick_ns += TICK_US * 1000ull;
+}
+
+/*
+ * @brief: Spend us of CPU time, taking the timer interrupts that come due
+ */
+static void busy(uint32_t us) {
+	uint64_t end = hal_host_time_ns + us * 1000ull;
+	
+	while (next_tick_ns <= end) {
+		hal_host_time_ns = next_tick_ns;
+		timer_Tick();
+	}
+	hal_host_time_ns = end;
+}
+
+static void task_Body(uint8_t id) {
+	if (trace_n < TRACE_MAX) trace[trace_n++] = id;
+	busy(id == TASK_TELEMETRY && spike && ticks_posted % SPIKE_EVERY == 0 ? SPIKE_US : cost_us[id]);
+}
+
+static void fake_Estimate(void)		{ task_Body(TASK_ESTIMATE); }
+static void fake_Control(void)		{ task_Body(TASK_CONTROL); }
+static void fake_Telemetry(void)	{ task_Body(TASK_TELEMETRY); }
+static void fake_Command(void)		{ task_Body(TASK_COMMAND); }
+
+/*
+ * @brief: The main loop for a number of ticks, idling between them
+ */
+static void run(uint32_t ticks, uint8_t with_spike) {
+	hal_HostReset();
+	task_Init();
+	task_Register(TASK_ESTIMATE, "estimate", fake_Estimate, deadline_us[0]);
+	task_Register(TASK_CONTROL, "control", fake_Control, deadline_us[1]);
+	task_Register(TASK_TELEMETRY, "telemetry", fake_Telemetry, deadline_us[2]);
+	task_Register(TASK_COMMAND, "command", fake_Command, deadline_us[3]);
+	next_tick_ns = TICK_US * 1000ull;
+	ticks_posted = 0;
+	trace_n = 0;
+	spike = with_spike;
+	
+	while (ticks_posted < ticks) {
+		if (!task_RunNext()) busy(1);
+	}
+	// timer off, finish what is pending
+	next_tick_ns = UINT64_MAX;
+	while (task_RunNext());
+}
+
+static void report(const char *title, uint32_t ticks) {
+	uint8_t id;
+	
+	printf("\n%s, %u ticks\n", title, ticks);
+	printf("task        posts   runs  overruns  late  wcet_us  mean_us  lat_max_us\n");
+	for (id = TASK_ESTIMATE; id <= TASK_COMMAND; id++) {
+		const task_info *t = &task_table[id];
+		
+		printf("%-10s %6u %6u  %8u %5u  %7u  %7.1f  %10u\n", t->name, t->posts, t->runs, t->overruns, t->late,
+					t->wcet_us, t->runs ? (double)t->exec_sum_us / t->runs : 0, t->lat_max_us);
+	}
+}
+
+static void synthetic(uint32_t ticks) {
+	static const uint8_t order[8] = {0, 1, 2, 3, 0, 1, 2, 3};
+	uint32_t ok, spikes;
+	uint8_t id;
+	
+	run(ticks, 0);
+	report("nominal", ticks);
+	ok = 1;
+	for (id = TASK_ESTIMATE; id <= TASK_COMMAND; id++) {
+		const task_info *t = &task_table[id];
+		
+		ok &= t->posts == ticks && t->runs == ticks && !t->overruns && !t->late && t->wcet_us == cost_us[id];
+	}
+	check(ok, "nominal: every post runs once, none late, wcet = cost");
+	check(trace_n >= 8 && !memcmp(trace, order, 8), "nominal: deadline order estimate..command");
+	check(task_table[TASK_COMMAND].lat_max_us == cost_us[0] + cost_us[1] + cost_us[2], "nominal: command waits for the three before it");
+	
+	run(ticks, 1);
+	report("overload", ticks);
+	spikes = (ticks - 1) / SPIKE_EVERY;							// the last one has no tick after it
+	check(task_table[TASK_TELEMETRY].wcet_us == SPIKE_US, "overload: spike is the telemetry wcet");
+	check(task_table[TASK_ESTIMATE].late >= spikes && task_table[TASK_CONTROL].late >= spikes,
+				"overload: tick after each spike late");
+	check(task_table[TASK_COMMAND].overruns >= spikes, "overload: command posted again before it ran");
+	check(task_table[TASK_ESTIMATE].runs == ticks && task_table[TASK_CONTROL].runs == ticks,
+				"overload: estimate and control never skipped");
+	ok = 1;
+	for (id = TASK_ESTIMATE; id <= TASK_COMMAND; id++) {
+		ok &= task_table[id].late <= 2 * spikes && task_table[id].runs + task_table[id].overruns == ticks;
+	}
+	check(ok, "overload: caught up between spikes, posts accounted");
+}
+
+/*
+ * @brief: Fly the simulator, tasks in the main loop or in TIMER1A
+ */
+static void fly(uint8_t mode, double seconds, float att[3], uint32_t *bytes) {
+	static sim_world w;
+	
+	task_mode = mode;
+	sim_Init(&w, 1);
+	sim_Command(&w, "30");
+	sim_Run(&w, seconds);
+	att[0] = roll;
+	att[1] = pitch;
+	att[2] = yaw;
+	*bytes = w.serial_bytes;
+}
+
+static void simulated(double seconds) {
+	float loop[3], isr[3];
+	uint32_t loop_bytes, isr_bytes, ok = 1;
+	uint8_t id;
+	
+	fly(TASKS_ISR, seconds, isr, &isr_bytes);
+	fly(TASKS_LOOP, seconds, loop, &loop_bytes);
+	report("simulator, main loop", (uint32_t)(seconds * 100));
+	task_mode = __TASKS_MODE;
+	
+	for (id = TASK_ESTIMATE; id <= TASK_COMMAND; id++) {
+		ok &= task_table[id].runs == task_table[id].posts && !task_table[id].late && !task_table[id].overruns;
+	}
+	check(ok, "sim: control tasks all ran, none late");
+	check(!memcmp(loop, isr, sizeof(loop)) && loop_bytes == isr_bytes, "sim: main loop and TIMER1A fly the same");
+	check(user_torque == 30, "sim: command task took the throttle");
+}
+
+int main(int argc, char **argv) {
+	uint32_t ticks = argc > 1 ? (uint32_t)atol(argv[1]) : 5000;
+	
+	synthetic(ticks);
+	simulated(5);
+	printf("%s: main-loop scheduler deadlines and counters\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
@@ -0,0 +1,148 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "kalman.h"
+#include "bench.h"
+
+/*
+ * Long-duration covariance soak: runs kalman_innovate on noisy synthetic
+ * measurements and checks after every step that P is finite and positive
+ * definite (Sylvester: all leading minors > 0). Symmetry holds by storage.
+ *
+ * The covariance recursion does not depend on the measurements, so on its
+ * own it settles within seconds and stays there. To keep the update away
+ * from steady state, every SEGMENT steps each of kalman_qr is set to its
+ * default times a random factor in [1e-3, 1e3], and every PERTURB steps P
+ * is replaced by a random positive definite matrix with entries from 1e-3
+ * to 1e3. The same recursion runs in double alongside; P must stay within
+ * REF_BOUND of it, relative to its largest entry.
+ *
+ *   soak_kalman [steps]     default 1e8 (~11.5 days of flight at 100 Hz)
+ *
+ * Exits 1 at the first step that fails.
+ */
+
+#define SEGMENT			4096
+#define PERTURB			65536
+#define REF_BOUND		1e-3
+
+
+static double noise_Scale(uint64_t *seed, double decades) {
+	return pow(10.0, decades * bench_Noise(seed));
+}
+
+/*
+ * @brief: kalman_innovate's covariance step in double, full 3x3 matrices
+ */
+static void ref_Innovate(double P[3][3]) {
+	static const double F[3][3] = {{1, _dt, -_dt}, {0, 1, 0}, {0, 0, 1}};
+	double FP[3][3], Pp[3][3], K[3][2], S00, S01, S11, det;
+	uint8_t i, j, l;
+	
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			for (FP[i][j] = 0, l = 0; l < 3; l++) FP[i][j] += F[i][l] * P[l][j];
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			for (Pp[i][j] = 0, l = 0; l < 3; l++) Pp[i][j] += FP[i][l] * F[j][l];
+	Pp[0][0] += kalman_qr.q00;
+	Pp[1][1] += kalman_qr.q11;
+	Pp[2][2] += kalman_qr.q22;
+	
+	S00 = Pp[0][0] + kalman_qr.r00;
+	S01 = Pp[0][1];
+	S11 = Pp[1][1] + kalman_qr.r11;
+	det = S00 * S11 - S01 * S01;
+	for (i = 0; i < 3; i++) {
+		K[i][0] = (Pp[i][0] * S11 - Pp[i][1] * S01) / det;
+		K[i][1] = (Pp[i][1] * S00 - Pp[i][0] * S01) / det;
+	}
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++) P[i][j] = Pp[i][j] - K[i][0] * Pp[0][j] - K[i][1] * Pp[1][j];
+}
+
+/*
+ * @brief: Random positive definite P = L L^T, into both filters
+ */
+static void perturb(kalman_data * kd, double P[3][3], uint64_t *seed) {
+	double L[3][3] = {{0}};
+	uint8_t i, j, l;
+	
+	for (i = 0; i < 3; i++) {
+		L[i][i] = sqrt(noise_Scale(seed, 3.0));
+		for (j = 0; j < i; j++) L[i][j] = 0.9 * bench_Noise(seed) * L[i][i];
+	}
+	for (i = 0; i < 3; i++)
+		for (j = i; j < 3; j++) {
+			double s = 0;
+		
+			for (l = 0; l < 3; l++) s += L[i][l] * L[j][l];
+			P[i][j] = P[j][i] = (float)s;
+		}
+	kd->P[KALMAN_P00] = (float)P[0][0];
+	kd->P[KALMAN_P01] = (float)P[0][1];
+	kd->P[KALMAN_P02] = (float)P[0][2];
+	kd->P[KALMAN_P11] = (float)P[1][1];
+	kd->P[KALMAN_P12] = (float)P[1][2];
+	kd->P[KALMAN_P22] = (float)P[2][2];
+}
+
+int main(int argc, char **argv) {
+	static const uint8_t row[6] = {0, 0, 0, 1, 1, 2}, col[6] = {0, 1, 2, 1, 2, 2};
+	uint64_t steps = argc > 1 ? (uint64_t)strtod(argv[1], NULL) : 100000000ull;
+	uint64_t seed = 3, k;
+	kalman_data kd;
+	const float *P = kd.P;
+	double ref[3][3] = {{1000, 0, 0}, {0, 1000, 0}, {0, 0, 1000}};
+	double min_det = INFINITY, max_err = 0, t0;
+	
+	kalman_init(&kd);
+	t0 = bench_Seconds();
+	for (k = 0; k < steps; k++) {
+		float z1 = 90.0f * (float)bench_Noise(&seed);
+		float z2 = 200.0f * (float)bench_Noise(&seed);
+		double m1, m2, m3, big = 0, err = 0;
+		uint8_t i;
+		
+		if (k % SEGMENT == 0) {
+			kalman_qr.q00 = _Q00 * (float)noise_Scale(&seed, 3.0);
+			kalman_qr.q11 = _Q11 * (float)noise_Scale(&seed, 3.0);
+			kalman_qr.q22 = _Q22 * (float)noise_Scale(&seed, 3.0);
+			kalman_qr.r00 = _R00 * (float)noise_Scale(&seed, 3.0);
+			kalman_qr.r11 = _R11 * (float)noise_Scale(&seed, 3.0);
+		}
+		if (k % PERTURB == PERTURB / 2) perturb(&kd, ref, &seed);
+		kalman_innovate(&kd, z1, z2);
+		ref_Innovate(ref);
+		
+		m1 = P[KALMAN_P00];
+		m2 = (double)P[KALMAN_P00] * P[KALMAN_P11] - (double)P[KALMAN_P01] * P[KALMAN_P01];
+		m3 = P[KALMAN_P00] * ((double)P[KALMAN_P11] * P[KALMAN_P22] - (double)P[KALMAN_P12] * P[KALMAN_P12])
+			 - P[KALMAN_P01] * ((double)P[KALMAN_P01] * P[KALMAN_P22] - (double)P[KALMAN_P12] * P[KALMAN_P02])
+			 + P[KALMAN_P02] * ((double)P[KALMAN_P01] * P[KALMAN_P12] - (double)P[KALMAN_P11] * P[KALMAN_P02]);
+		if (!(m1 > 0) || !(m2 > 0) || !(m3 > 0) || !isfinite(kd.x[0])) {
+			printf("step %llu: P not positive definite (minors %g %g %g)\n", (unsigned long long)k, m1, m2, m3);
+			printf("FAIL\n");
+			return 1;
+		}
+		for (i = 0; i < 6; i++) if (fabs(ref[row[i]][col[i]]) > big) big = fabs(ref[row[i]][col[i]]);
+		for (i = 0; i < 6; i++) if (fabs(P[i] - ref[row[i]][col[i]]) > err) err = fabs(P[i] - ref[row[i]][col[i]]);
+		err /= big;
+		if (!(err < REF_BOUND)) {
+			printf("step %llu: P off the double recursion by %g (relative)\n", (unsigned long long)k, err);
+			printf("FAIL\n");
+			return 1;
+		}
+		if (m3 < min_det) min_det = m3;
+		if (err > max_err) max_err = err;
+	}
+	printf("steps:        %llu\n", (unsigned long long)steps);
+	printf("seconds:      %.1f\n", bench_Seconds() - t0);
+	printf("P:            %g %g %g / %g %g / %g\n", P[0], P[1], P[2], P[3], P[4], P[5]);
+	printf("min_det_P:    %g\n", min_det);
+	printf("max_err_ref:  %.2e\n", max_err);
+	printf("PASS\n");
+	return 0;
+}
@@ -0,0 +1,204 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "spsc.h"
+#include "bench.h"
+
+/*
+ * spsc ring between a producer and a consumer thread (on separate cores when
+ * there are two):
+ *
+ *   elements  8-byte records pushed and popped one at a time through a
+ *             SENSORS_RING_SIZE ring, producer retrying when full
+ *   bulk      a byte stream through a USB_BUFFER_SIZE ring in random-sized
+ *             spsc_Write / spsc_Read chunks
+ *   lossy     the producer never waits, as an interrupt would; the consumer
+ *             is slow and must see an increasing subsequence with nothing
+ *             torn, and popped + dropped must account for every push
+ *
+ *   stress_spsc [millions]
+ *
+ * Exits 1 on a lost, duplicated, reordered or corrupted element.
+ */
+
+#define ELEM_RING				64
+#define BYTE_RING				256
+#define CHUNK_MAX				64
+
+
+typedef struct {
+	uint32_t	seq;
+	uint32_t	check;
+} elem;
+
+typedef struct {
+	spsc_ring	r;
+	uint64_t	n;
+	uint64_t	popped, errors;
+	uint32_t	last;
+	uint8_t		done;
+} run_state;
+
+
+static elem			elem_buf[ELEM_RING];
+static uint8_t		byte_buf[BYTE_RING];
+
+
+static inline uint32_t elem_Check(uint32_t seq) {
+	return seq * 2654435761u ^ 0xA5A5A5A5u;
+}
+
+static inline uint8_t byte_At(uint64_t i) {
+	return (uint8_t)(i ^ i >> 8 ^ i >> 16);
+}
+
+static void *elem_Producer(void *arg) {
+	run_state *s = arg;
+	elem e;
+	uint64_t i;
+	
+	for (i = 0; i < s->n; i++) {
+		e.seq = (uint32_t)i;
+		e.check = elem_Check(e.seq);
+		while (!spsc_Push(&s->r, &e)) sched_yield();
+	}
+	return NULL;
+}
+
+static void *elem_Consumer(void *arg) {
+	run_state *s = arg;
+	elem e;
+	
+	while (s->popped < s->n) {
+		if (!spsc_Pop(&s->r, &e)) {
+			sched_yield();
+			continue;
+		}
+		if (e.seq != (uint32_t)s->popped || e.check != elem_Check(e.seq)) s->errors++;
+		s->popped++;
+	}
+	return NULL;
+}
+
+static void *byte_Producer(void *arg) {
+	run_state *s = arg;
+	uint8_t chunk[CHUNK_MAX];
+	uint64_t i = 0, seed = 11;
+	uint32_t n, k, w;
+	
+	while (i < s->n) {
+		n = 1 + (uint32_t)((bench_Noise(&seed) + 1) * 0.5 * (CHUNK_MAX - 1));
+		if (n > s->n - i) n = (uint32_t)(s->n - i);
+		for (k = 0; k < n; k++) chunk[k] = byte_At(i + k);
+		w = 0;
+		while (w < n) {
+			uint32_t got = spsc_Write(&s->r, chunk + w, n - w);
+			
+			if (!got) sched_yield();
+			w += got;
+		}
+		i += n;
+	}
+	return NULL;
+}
+
+static void *byte_Consumer(void *arg) {
+	run_state *s = arg;
+	uint8_t chunk[CHUNK_MAX];
+	uint64_t seed = 13;
+	uint32_t n, k;
+	
+	while (s->popped < s->n) {
+		n = spsc_Read(&s->r, chunk, 1 + (uint32_t)((bench_Noise(&seed) + 1) * 0.5 * (CHUNK_MAX - 1)));
+		if (!n) {
+			sched_yield();
+			continue;
+		}
+		for (k = 0; k < n; k++) s->errors += chunk[k] != byte_At(s->popped + k);
+		s->popped += n;
+	}
+	return NULL;
+}
+
+static void *lossy_Producer(void *arg) {
+	run_state *s = arg;
+	elem e;
+	uint64_t i;
+	
+	for (i = 0; i < s->n; i++) {
+		e.seq = (uint32_t)i + 1;
+		e.check = elem_Check(e.seq);
+		spsc_Push(&s->r, &e);
+	}
+	__atomic_store_n(&s->done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void *lossy_Consumer(void *arg) {
+	run_state *s = arg;
+	volatile uint32_t spin;
+	elem e;
+	
+	for (;;) {
+		uint8_t done = __atomic_load_n(&s->done, __ATOMIC_ACQUIRE);
+		
+		if (!spsc_Pop(&s->r, &e)) {
+			if (done) break;
+			continue;
+		}
+		if (e.seq <= s->last || e.check != elem_Check(e.seq)) s->errors++;
+		s->last = e.seq;
+		s->popped++;
+		for (spin = 0; spin < 50; spin++);
+	}
+	return NULL;
+}
+
+static double run(run_state *s, void *(*producer)(void *), void *(*consumer)(void *)) {
+	pthread_t p, c;
+	double t0 = bench_Seconds();
+	
+	pthread_create(&c, NULL, consumer, s);
+	pthread_create(&p, NULL, producer, s);
+	pthread_join(p, NULL);
+	pthread_join(c, NULL);
+	return bench_Seconds() - t0;
+}
+
+int main(int argc, char **argv) {
+	uint64_t n = (uint64_t)((argc > 1 ? atof(argv[1]) : 20) * 1e6);
+	static run_state s;
+	double wall;
+	int fail = 0;
+	
+	memset(&s, 0, sizeof(s));
+	spsc_Init(&s.r, elem_buf, ELEM_RING, sizeof(elem));
+	s.n = n;
+	wall = run(&s, elem_Producer, elem_Consumer);
+	printf("elements  %10llu in %3u-slot ring  %7.1f Mops/s  errors %llu\n", (unsigned long long)s.popped, ELEM_RING,
+				s.popped / wall / 1e6, (unsigned long long)s.errors);
+	if (s.errors || s.popped != n) fail = 1;
+	
+	memset(&s, 0, sizeof(s));
+	spsc_Init(&s.r, byte_buf, BYTE_RING, 1);
+	s.n = n * 8;
+	wall = run(&s, byte_Producer, byte_Consumer);
+	printf("bulk      %10llu B in %3u-byte ring %7.1f MB/s    errors %llu\n", (unsigned long long)s.popped, BYTE_RING,
+				s.popped / wall / 1e6, (unsigned long long)s.errors);
+	if (s.errors || s.popped != n * 8) fail = 1;
+	
+	memset(&s, 0, sizeof(s));
+	spsc_Init(&s.r, elem_buf, ELEM_RING, sizeof(elem));
+	s.n = n / 4;
+	wall = run(&s, lossy_Producer, lossy_Consumer);
+	printf("lossy     %10llu pushed, %llu popped, %u dropped      errors %llu\n", (unsigned long long)s.n,
+				(unsigned long long)s.popped, s.r.dropped, (unsigned long long)s.errors);
+	if (s.errors || s.popped + s.r.dropped != s.n) fail = 1;
+	
+	printf("%s: spsc ring under two threads\n", fail ? "FAIL" : "PASS");
+	return fail;
+}
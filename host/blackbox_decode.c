@@ -0,0 +1,228 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blackbox_decode.h"
+
+
+const char *blackbox_names[BLACKBOX_FIELDS] = {
+	"roll", "pitch", "yaw", "drift_roll", "drift_pitch", "drift_yaw", "u_roll", "u_pitch", "u_yaw",
+	"torque0", "torque1", "torque2", "torque3", "throttle", "state"
+};
+
+const char *blackbox_sensors[3] = {"accel", "compass", "gyro"};
+
+#define LOG_GROW(a, cap)		do { if ((p = realloc(a, (cap) * sizeof(*(a)))) == NULL) return 0; a = p; } while (0)
+
+
+/*
+ * @brief: LEB128 varint, at most 5 bytes
+ * @param[in]: position, end of the block
+ * @param[out]: value, position after it or NULL if it runs past the end
+ */
+static inline const uint8_t *rd_Varint(const uint8_t *p, const uint8_t *end, uint32_t *v) {
+	uint32_t x;
+	uint8_t shift;
+	
+	if (p < end && *p < 0x80) {
+		*v = *p;
+		return p + 1;
+	}
+	for (x = 0, shift = 0; p < end && shift < 35; shift += 7) {
+		uint8_t b = *p++;
+		
+		x |= (uint32_t)(b & 0x7F) << shift;
+		if (b < 0x80) {
+			*v = x;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static inline uint32_t unZigzag(uint32_t v) {
+	return (v >> 1) ^ (0u - (v & 1));
+}
+
+static uint32_t log_Cap(uint32_t cap, uint32_t want) {
+	if (!cap) cap = 4096;
+	while (cap < want) cap *= 2;
+	return cap;
+}
+
+/*
+ * @brief: Room for at least need more records, samples and rate runs
+ */
+static int log_Reserve(blackbox_log *l, uint32_t need) {
+	uint32_t cap, i;
+	void *p;
+	
+	if (l->n + need > l->cap) {
+		cap = log_Cap(l->cap, l->n + need);
+		LOG_GROW(l->t_us, cap);
+		LOG_GROW(l->s_end, cap);
+		LOG_GROW(l->r_end, cap);
+		for (i = 0; i < BLACKBOX_FIELDS; i++) LOG_GROW(l->col[i], cap);
+		l->cap = cap;
+	}
+	if (l->ns + need > l->scap) {
+		cap = log_Cap(l->scap, l->ns + need);
+		LOG_GROW(l->s_t_us, cap);
+		LOG_GROW(l->s_sensor, cap);
+		LOG_GROW(l->s_data, cap);
+		l->scap = cap;
+	}
+	if (l->nr + need > l->rcap) {
+		cap = log_Cap(l->rcap, l->nr + need);
+		LOG_GROW(l->r_t_us, cap);
+		LOG_GROW(l->r_throttle, cap);
+		l->rcap = cap;
+	}
+	return 1;
+}
+
+static void on_Frame(void *ctx, const telem_frame *f) {
+	if (f->id == TELEM_MSG_LOG) blackbox_DecodeBlock(ctx, f->payload, f->len);
+}
+
+/*
+ * @brief: Empty log, nothing allocated yet
+ * @param[in]: log
+ * @param[out]: none
+ */
+void blackbox_LogInit(blackbox_log *l) {
+	memset(l, 0, sizeof(*l));
+	telem_DecoderInit(&l->td, on_Frame, l);
+}
+
+void blackbox_LogFree(blackbox_log *l) {
+	uint32_t i;
+	
+	free(l->t_us);
+	for (i = 0; i < BLACKBOX_FIELDS; i++) free(l->col[i]);
+	free(l->s_end);
+	free(l->r_end);
+	free(l->s_t_us);
+	free(l->s_sensor);
+	free(l->s_data);
+	free(l->r_t_us);
+	free(l->r_throttle);
+	blackbox_LogInit(l);
+}
+
+/*
+ * @brief: Append the items of one block
+ * @param[in]: log, block as the sink got it
+ * @param[out]: records appended, -1 if malformed or of another format
+ * 				version (log unchanged)
+ */
+int32_t blackbox_DecodeBlock(blackbox_log *l, const uint8_t *block, uint32_t len) {
+	const uint8_t *p = block + BLACKBOX_BLOCK_HEADER, *end = block + len;
+	uint32_t v, t, last_t, kind_t[5], kind_dt[5], k, i, count, n, ns, nr;
+	int32_t prev[BLACKBOX_FIELDS], prev_s[3][3];
+	uint16_t seq, throttle = 0;
+	uint8_t kind, slot, seen = 0, throttle_known = 0;
+	
+	if (len && block[0] != BLACKBOX_FORMAT_VERSION) {
+		// another build's layout: none of it can be read as this one
+		l->version = block[0];
+		l->bad++;
+		return -1;
+	}
+	if (len < BLACKBOX_BLOCK_HEADER || len > BLACKBOX_BLOCK_SIZE || !block[3] || !log_Reserve(l, block[3])) {
+		l->bad++;
+		return -1;
+	}
+	seq = (uint16_t)(block[1] | block[2] << 8);
+	count = block[3];
+	n = l->n;
+	ns = l->ns;
+	nr = l->nr;
+	if (l->synced && seq != l->seq_next) {
+		// a gap: what was waiting for its tick went with the lost block
+		ns = n ? l->s_end[n - 1] : 0;
+		nr = n ? l->r_end[n - 1] : 0;
+	}
+	
+	if ((p = rd_Varint(p, end, &t)) == NULL) goto bad;
+	last_t = t;
+	for (k = 0; k < count; k++) {
+		if ((p = rd_Varint(p, end, &v)) == NULL) goto bad;
+		kind = v & 7;
+		slot = kind >= BLACKBOX_ITEM_RATE ? 4 : kind;
+		t = (seen & (1 << slot) ? kind_t[slot] + kind_dt[slot] : last_t) + unZigzag(v >> 3);
+		
+		if (kind < BLACKBOX_ITEM_TICK) {
+			for (i = 0; i < 3; i++) {
+				if ((p = rd_Varint(p, end, &v)) == NULL) goto bad;
+				prev_s[kind][i] = seen & (1 << slot) ? (int32_t)((uint32_t)prev_s[kind][i] + unZigzag(v)) : (int32_t)unZigzag(v);
+				l->s_data[ns][i] = (int16_t)prev_s[kind][i];
+			}
+			l->s_t_us[ns] = t;
+			l->s_sensor[ns] = kind;
+			ns++;
+		} else if (kind == BLACKBOX_ITEM_TICK) {
+			for (i = 0; i < BLACKBOX_FIELDS; i++) {
+				if ((p = rd_Varint(p, end, &v)) == NULL) goto bad;
+				prev[i] = seen & (1 << slot) ? (int32_t)((uint32_t)prev[i] + unZigzag(v)) : (int32_t)unZigzag(v);
+				l->col[i][n] = prev[i];
+			}
+			l->t_us[n] = t;
+			l->s_end[n] = ns;
+			l->r_end[n] = nr;
+			n++;
+			throttle = (uint16_t)prev[BLACKBOX_THROTTLE];
+			throttle_known = 1;
+		} else if (kind <= BLACKBOX_ITEM_RATE_THROTTLE) {
+			if (kind == BLACKBOX_ITEM_RATE_THROTTLE) {
+				if ((p = rd_Varint(p, end, &v)) == NULL) goto bad;
+				throttle = (uint16_t)v;
+				throttle_known = 1;
+			}
+			if (!throttle_known) goto bad;
+			l->r_t_us[nr] = t;
+			l->r_throttle[nr] = throttle;
+			nr++;
+		} else {
+			goto bad;
+		}
+		kind_dt[slot] = seen & (1 << slot) ? t - kind_t[slot] : 0;
+		kind_t[slot] = t;
+		seen |= 1 << slot;
+		last_t = t;
+	}
+	if (p != end) goto bad;
+	
+	if (l->synced) l->lost += (uint16_t)(seq - l->seq_next);
+	if (!l->blocks) {
+		l->modes = block[4];
+		l->rate_div = block[5];
+	}
+	l->seq_next = seq + 1;
+	l->synced = 1;
+	count = n - l->n;
+	l->n = n;
+	l->ns = ns;
+	l->nr = nr;
+	l->blocks++;
+	l->bytes += len;
+	return (int32_t)count;
+	
+bad:
+	l->bad++;
+	return -1;
+}
+
+/*
+ * @brief: Feed raw telemetry bytes; TELEM_MSG_LOG frames are decoded, the
+ * 				rest skipped
+ * @param[in]: log, bytes as read from the port or a capture
+ * @param[out]: log frames completed
+ */
+uint32_t blackbox_DecodeStream(blackbox_log *l, const uint8_t *data, size_t len) {
+	uint64_t blocks = l->blocks + l->bad;
+	
+	telem_Decode(&l->td, data, len);
+	return (uint32_t)(l->blocks + l->bad - blocks);
+}
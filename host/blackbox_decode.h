@@ -0,0 +1,54 @@
+#ifndef _BLACKBOX_DECODE_H_
+#define _BLACKBOX_DECODE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "blackbox.h"
+#include "telem_decode.h"
+
+/*
+ * Ground side of the flight data recorder (blackbox.h): expands blocks into
+ * one array per tick field, t_us[n] and col[BLACKBOX_*][n], and arrays of
+ * the raw sensor samples and the rate loop runs, growing as needed. The
+ * samples of record r are s_*[r ? s_end[r - 1] : 0 .. s_end[r]), its rate
+ * runs likewise up to r_end[r]. Blocks come either one at a time
+ * (blackbox_DecodeBlock, e.g. read back from flash) or inside a telemetry
+ * stream (blackbox_DecodeStream, any chunk sizes, other messages skipped). A
+ * malformed block adds nothing, nor does one of another
+ * BLACKBOX_FORMAT_VERSION, whose version is kept for the tools to report.
+ * Seq gaps count blocks lost on board or on the way, and drop the samples
+ * and runs whose tick went with them.
+ */
+
+typedef struct {
+	uint32_t				n, cap;														// tick records
+	uint32_t				*t_us;
+	int32_t					*col[BLACKBOX_FIELDS];
+	uint32_t				*s_end, *r_end;										// per record: samples, rate runs up to its own
+	uint32_t				ns, scap;													// sensor samples
+	uint32_t				*s_t_us;
+	uint8_t					*s_sensor;												// __MEASURE_*
+	int16_t					(*s_data)[3];
+	uint32_t				nr, rcap;													// rate loop runs
+	uint32_t				*r_t_us;													// of the gyro sample each read
+	uint16_t				*r_throttle;
+	uint8_t					modes;														// first block's, BLACKBOX_MODE_*
+	uint8_t					rate_div;													// first block's control_rate_div
+	uint8_t					version;													// last block refused for its version, 0 if none
+	uint64_t				blocks, bytes;										// good blocks and their size
+	uint64_t				bad, lost;												// malformed, seq gaps
+	uint16_t				seq_next;
+	uint8_t					synced;
+	telem_decoder		td;
+} blackbox_log;
+
+
+extern const char		*blackbox_names[BLACKBOX_FIELDS];
+extern const char		*blackbox_sensors[3];								// __MEASURE_* order
+
+extern void			blackbox_LogInit(blackbox_log *l);
+extern void			blackbox_LogFree(blackbox_log *l);
+extern int32_t	blackbox_DecodeBlock(blackbox_log *l, const uint8_t *block, uint32_t len);
+extern uint32_t	blackbox_DecodeStream(blackbox_log *l, const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,96 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "blackbox_decode.h"
+
+/*
+ * blackbox_dump - expand the flight data log in a telemetry stream.
+ *
+ *   blackbox_dump [-s] [-c prefix] [file]      default stdin
+ *
+ * Prints CSV, t_us then the BLACKBOX_* fields of each tick; with -s the raw
+ * sensor samples instead, t_us, sensor, x, y, z. With -c, writes one raw
+ * little-endian array per column: prefix.t_us.u32 and prefix.<field>.i32 for
+ * the ticks, prefix.s_t_us.u32, prefix.s_sensor.u8 (__MEASURE_*) and
+ * prefix.s_data.i16 (x, y, z per sample) for the samples, prefix.r_t_us.u32
+ * and prefix.r_throttle.u16 for the rate loop runs, ready for
+ * numpy.fromfile. Counters go to stderr.
+ */
+
+static int column_Write(const char *prefix, const char *name, const char *ext, const void *data, size_t size, size_t n) {
+	char path[512];
+	FILE *f;
+	
+	snprintf(path, sizeof(path), "%s.%s.%s", prefix, name, ext);
+	f = fopen(path, "wb");
+	if (f == NULL) {
+		perror(path);
+		return 1;
+	}
+	fwrite(data, size, n, f);
+	fclose(f);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	static uint8_t buf[65536];
+	static blackbox_log l;
+	const char *prefix = NULL, *name = NULL;
+	FILE *in = stdin;
+	uint32_t r, i;
+	size_t n;
+	int a, err = 0, samples = 0;
+	
+	for (a = 1; a < argc; a++) {
+		if (!strcmp(argv[a], "-c") && a + 1 < argc) prefix = argv[++a];
+		else if (!strcmp(argv[a], "-s")) samples = 1;
+		else if (argv[a][0] != '-' && name == NULL) name = argv[a];
+		else {
+			fprintf(stderr, "usage: %s [-s] [-c prefix] [file]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (name != NULL) {
+		in = fopen(name, "rb");
+		if (in == NULL) {
+			perror(name);
+			return 1;
+		}
+	}
+	blackbox_LogInit(&l);
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) blackbox_DecodeStream(&l, buf, n);
+	if (in != stdin) fclose(in);
+	if (l.version) {
+		fprintf(stderr, "blocks of format version %u skipped, this build reads %u\n", l.version, BLACKBOX_FORMAT_VERSION);
+	}
+	
+	if (prefix != NULL) {
+		err |= column_Write(prefix, "t_us", "u32", l.t_us, 4, l.n);
+		for (i = 0; i < BLACKBOX_FIELDS; i++) err |= column_Write(prefix, blackbox_names[i], "i32", l.col[i], 4, l.n);
+		err |= column_Write(prefix, "s_t_us", "u32", l.s_t_us, 4, l.ns);
+		err |= column_Write(prefix, "s_sensor", "u8", l.s_sensor, 1, l.ns);
+		err |= column_Write(prefix, "s_data", "i16", l.s_data, 6, l.ns);
+		err |= column_Write(prefix, "r_t_us", "u32", l.r_t_us, 4, l.nr);
+		err |= column_Write(prefix, "r_throttle", "u16", l.r_throttle, 2, l.nr);
+	} else if (samples) {
+		fputs("t_us,sensor,x,y,z\n", stdout);
+		for (r = 0; r < l.ns; r++) {
+			printf("%u,%s,%d,%d,%d\n", l.s_t_us[r], blackbox_sensors[l.s_sensor[r]], l.s_data[r][0], l.s_data[r][1], l.s_data[r][2]);
+		}
+	} else {
+		fputs("t_us", stdout);
+		for (i = 0; i < BLACKBOX_FIELDS; i++) printf(",%s", blackbox_names[i]);
+		fputc('\n', stdout);
+		for (r = 0; r < l.n; r++) {
+			printf("%u", l.t_us[r]);
+			for (i = 0; i < BLACKBOX_FIELDS; i++) printf(",%d", l.col[i][r]);
+			fputc('\n', stdout);
+		}
+	}
+	
+	fprintf(stderr, "records %u samples %u rate runs %u blocks %llu bad %llu lost %llu\n", l.n, l.ns, l.nr,
+				(unsigned long long)l.blocks, (unsigned long long)l.bad, (unsigned long long)l.lost);
+	blackbox_LogFree(&l);
+	return err;
+}
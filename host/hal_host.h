@@ -0,0 +1,65 @@
+#ifndef _HAL_HOST_H_
+#define _HAL_HOST_H_
+
+#include <stdint.h>
+#include "hal.h"
+
+/*
+ * Host-side hooks into the Linux HAL backend.
+ *
+ * Sensor models attach to the fake I2C bus by 7-bit address; PWM widths,
+ * timer acknowledges and serial traffic are exposed for inspection. Bytes
+ * committed to the transmit ring go to the sink at once, as if the USB host
+ * read them, unless hal_host_tx_stall holds them in the ring.
+ * hal_host_time_ns is the clock behind hal_Micros(); the harness owns it, and
+ * drives the sensor interrupt pins through hal_host_exti_level and latches
+ * their edges in hal_host_exti_pending.
+ *
+ * The same bus sits behind a mock of the TM4C I2C master (hal_I2C*): each
+ * command takes its bit time at i2c_host_bitrate, and i2c_HostMockRun()
+ * advances hal_host_time_ns, completing due commands and calling
+ * i2c_AsyncISR() at their completion times.
+ *
+ * The non-volatile store is the file at hal_host_store_path, none while it
+ * is NULL; bytes past its end read as erased EEPROM, 0xFF.
+ */
+
+#define I2C_HOST_DEVICES_MAX				8
+#define HAL_HOST_SERIAL_SIZE				256
+#define HAL_HOST_TX_SIZE						256		// UART_BUFFER_SIZE, the USB transmit ring
+#define HAL_HOST_PWM_CLOCK					1250000		// SYSCTL_PWMDIV_64 at 80 MHz
+#define I2C_HOST_BITRATE						400000		// I2C_Config fast mode
+
+
+typedef struct {
+	uint8_t		id;																											// 7-bit slave address
+	int32_t		(*read)(void *ctx, uint8_t addr, int32_t nBytes, uint8_t *pBuf);		// returns bytes read, 0 = NAK
+	int32_t		(*write)(void *ctx, uint8_t addr, int32_t nBytes, uint8_t *pBuf);	// returns 1 on ACK, 0 = NAK
+	void			*ctx;
+} i2c_host_device;
+
+typedef void (*hal_host_sink)(void *ctx, const uint8_t *data, uint16_t len);
+
+
+extern uint32_t		hal_host_pwm[HAL_PWM_CHANNELS];
+extern uint32_t		hal_host_timer_acks[2];
+extern uint64_t		hal_host_time_ns;
+extern uint8_t		hal_host_exti_enabled[HAL_EXTI_LINES];
+extern uint8_t		hal_host_exti_level[HAL_EXTI_LINES];
+extern uint8_t		hal_host_exti_pending[HAL_EXTI_LINES];
+extern uint8_t		hal_host_tx_stall;														// USB host not reading
+extern uint32_t		i2c_host_bitrate;
+extern uint64_t		i2c_host_busy_ns;															// bus time used by the master
+extern uint32_t		i2c_host_interrupts;
+extern const char	*hal_host_store_path;
+
+extern void i2c_HostAttach(const i2c_host_device *dev);
+extern void i2c_HostDetachAll(void);
+extern void i2c_HostMockRun(uint64_t until_ns);
+extern uint64_t i2c_HostMockNow(void);
+
+extern void hal_HostReset(void);
+extern void hal_HostSerialInject(const uint8_t *data, uint16_t len);
+extern void hal_HostSerialSink(hal_host_sink sink, void *ctx);
+
+#endif
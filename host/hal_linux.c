@@ -0,0 +1,237 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "hal_host.h"
+#include "spsc.h"
+
+
+uint32_t		hal_host_pwm[HAL_PWM_CHANNELS];
+uint32_t		hal_host_timer_acks[2];
+uint64_t		hal_host_time_ns;
+uint8_t			hal_host_exti_enabled[HAL_EXTI_LINES];
+uint8_t			hal_host_exti_level[HAL_EXTI_LINES];
+uint8_t			hal_host_exti_pending[HAL_EXTI_LINES];
+uint8_t			hal_host_tx_stall;
+const char	*hal_host_store_path;
+
+static uint8_t				serial_rx_buf[HAL_HOST_SERIAL_SIZE];
+static spsc_ring			serial_rx;																// as usb_rx_ring
+static uint8_t				serial_tx[HAL_HOST_TX_SIZE];
+static uint16_t				serial_tx_head, serial_tx_used;
+static hal_host_sink	serial_sink;
+static void						*serial_sink_ctx;
+static uint32_t				cycle_hz;
+
+
+/*
+ * @brief: Clear PWM outputs, counters, serial buffers and sink
+ * @param[in]: none
+ * @param[out]: none
+ */
+void hal_HostReset(void) {
+	memset(hal_host_pwm, 0, sizeof(hal_host_pwm));
+	memset(hal_host_timer_acks, 0, sizeof(hal_host_timer_acks));
+	hal_host_time_ns = 0;
+	memset(hal_host_exti_enabled, 0, sizeof(hal_host_exti_enabled));
+	memset(hal_host_exti_level, 0, sizeof(hal_host_exti_level));
+	memset(hal_host_exti_pending, 0, sizeof(hal_host_exti_pending));
+	hal_host_tx_stall = 0;
+	spsc_Init(&serial_rx, serial_rx_buf, HAL_HOST_SERIAL_SIZE, 1);
+	serial_tx_head = 0;
+	serial_tx_used = 0;
+	serial_sink = NULL;
+	serial_sink_ctx = NULL;
+}
+
+/*
+ * @brief: Queue bytes as if received from the USB host
+ * @param[in]: data, length; truncated to HAL_HOST_SERIAL_SIZE
+ * @param[out]: none
+ */
+void hal_HostSerialInject(const uint8_t *data, uint16_t len) {
+	spsc_Write(&serial_rx, data, len);
+}
+
+/*
+ * @brief: Route bytes written by the flight code, NULL to discard
+ * @param[in]: sink callback, its context
+ * @param[out]: none
+ */
+void hal_HostSerialSink(hal_host_sink sink, void *ctx) {
+	serial_sink = sink;
+	serial_sink_ctx = ctx;
+}
+
+
+void hal_PWMWrite(uint8_t channel, uint32_t width) {
+	if (channel < HAL_PWM_CHANNELS) hal_host_pwm[channel] = width;
+}
+
+uint32_t hal_PWMMsec(void) {
+	return HAL_HOST_PWM_CLOCK / 1000;
+}
+
+void hal_TimerAck(uint8_t timer) {
+	if (timer < 2) hal_host_timer_acks[timer]++;
+}
+
+uint16_t hal_SerialRead(uint8_t *buffer) {
+	return (uint16_t)spsc_Read(&serial_rx, buffer, HAL_HOST_SERIAL_SIZE);
+}
+
+void hal_SerialWrite(uint8_t *buffer) {
+	uint16_t i;
+	uint16_t data_len;
+	
+	for (i = 0; i < 512; i++) {
+		if (buffer[i] == 0) break;
+	}
+	data_len = i;
+	
+	if (serial_sink != NULL) serial_sink(serial_sink_ctx, buffer, data_len);
+	
+	memset(buffer, 0, data_len + 1);
+}
+
+/*
+ * @brief: Hand what is in the transmit ring to the sink, in at most two pieces
+ */
+static void serial_TxDeliver(void) {
+	uint16_t tail = (serial_tx_head + HAL_HOST_TX_SIZE - serial_tx_used) % HAL_HOST_TX_SIZE;
+	uint16_t n = HAL_HOST_TX_SIZE - tail < serial_tx_used ? HAL_HOST_TX_SIZE - tail : serial_tx_used;
+	
+	if (serial_sink != NULL) {
+		serial_sink(serial_sink_ctx, &serial_tx[tail], n);
+		if (n < serial_tx_used) serial_sink(serial_sink_ctx, serial_tx, serial_tx_used - n);
+	}
+	serial_tx_used = 0;
+}
+
+uint8_t *hal_SerialTxRing(uint16_t *size, uint16_t *head, uint16_t *space) {
+	if (!hal_host_tx_stall && serial_tx_used) serial_TxDeliver();
+	*size = HAL_HOST_TX_SIZE;
+	*head = serial_tx_head;
+	*space = HAL_HOST_TX_SIZE - 1 - serial_tx_used;
+	return serial_tx;
+}
+
+void hal_SerialTxCommit(uint16_t len) {
+	serial_tx_head = (serial_tx_head + len) % HAL_HOST_TX_SIZE;
+	serial_tx_used += len;
+	if (!hal_host_tx_stall) serial_TxDeliver();
+}
+
+void hal_ExtIntEnable(uint8_t line) {
+	if (line < HAL_EXTI_LINES) hal_host_exti_enabled[line] = 1;
+}
+
+uint8_t hal_ExtIntPending(uint8_t line) {
+	return line < HAL_EXTI_LINES ? hal_host_exti_pending[line] : 0;
+}
+
+void hal_ExtIntAck(uint8_t line) {
+	if (line < HAL_EXTI_LINES) hal_host_exti_pending[line] = 0;
+}
+
+uint8_t hal_ExtIntLevel(uint8_t line) {
+	return line < HAL_EXTI_LINES ? hal_host_exti_level[line] : 0;
+}
+
+/*
+ * @brief: Read from the store file, 0xFF past its end
+ * @param[in]: byte address and length, multiples of 4
+ * @param[out]: data; 1 on success
+ */
+uint8_t hal_StoreRead(uint32_t addr, void *data, uint32_t len) {
+	FILE *f;
+	size_t n = 0;
+	
+	if ((addr | len) & 3 || addr + len > HAL_STORE_SIZE || hal_host_store_path == NULL) return 0;
+	f = fopen(hal_host_store_path, "rb");
+	if (f != NULL) {
+		if (fseek(f, addr, SEEK_SET) == 0) n = fread(data, 1, len, f);
+		fclose(f);
+	}
+	memset((uint8_t *)data + n, 0xFF, len - n);
+	return 1;
+}
+
+/*
+ * @brief: Write to the store file, created on first use
+ * @param[in]: byte address and length, multiples of 4, data
+ * @param[out]: 1 on success
+ */
+uint8_t hal_StoreWrite(uint32_t addr, const void *data, uint32_t len) {
+	static const uint8_t erased[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+	FILE *f;
+	long end;
+	int ok;
+	
+	if ((addr | len) & 3 || addr + len > HAL_STORE_SIZE || hal_host_store_path == NULL) return 0;
+	f = fopen(hal_host_store_path, "r+b");
+	if (f == NULL) f = fopen(hal_host_store_path, "w+b");
+	if (f == NULL) return 0;
+	// a gap before addr is erased EEPROM
+	ok = fseek(f, 0, SEEK_END) == 0 && (end = ftell(f)) >= 0;
+	while (ok && end < (long)addr) {
+		ok = fwrite(erased, 1, 4 - (end & 3), f) == (size_t)(4 - (end & 3));
+		end += 4 - (end & 3);
+	}
+	ok = ok && fseek(f, addr, SEEK_SET) == 0 && fwrite(data, 1, len, f) == len;
+	return (fclose(f) == 0) & ok;
+}
+
+uint32_t hal_Micros(void) {
+	return (uint32_t)(hal_host_time_ns / 1000);
+}
+
+/*
+ * @brief: Profiling clock: the TSC on x86, calibrated against CLOCK_MONOTONIC,
+ * 				nanoseconds elsewhere; real time, not hal_host_time_ns
+ */
+void hal_CyclesInit(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	struct timespec t0, t1;
+	uint64_t c0;
+	
+	if (cycle_hz) return;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	c0 = __rdtsc();
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+	} while ((t1.tv_sec - t0.tv_sec) * 1000000000ll + (t1.tv_nsec - t0.tv_nsec) < 20000000);
+	cycle_hz = (uint32_t)((__rdtsc() - c0) * 1e9 / ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)));
+#else
+	cycle_hz = 1000000000;
+#endif
+}
+
+uint32_t hal_Cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return (uint32_t)__rdtsc();
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000000000ull + ts.tv_nsec);
+#endif
+}
+
+uint32_t hal_CycleHz(void) {
+	if (!cycle_hz) hal_CyclesInit();
+	return cycle_hz;
+}
+
+uint32_t hal_CriticalEnter(void) {
+	return 0;
+}
+
+void hal_CriticalExit(uint32_t state) {
+	(void)state;
+}
@@ -0,0 +1,202 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "i2cu.h"
+#include "i2c_async.h"
+#include "hal_host.h"
+
+
+uint32_t								i2c_host_bitrate = I2C_HOST_BITRATE;
+uint64_t								i2c_host_busy_ns;
+uint32_t								i2c_host_interrupts;
+
+static i2c_host_device	i2c_devices[I2C_HOST_DEVICES_MAX];
+static uint8_t					i2c_devices_count;
+
+// mock I2C master
+static struct {
+	uint8_t			id, receive;
+	uint8_t			data_tx, data_rx;
+	uint8_t			reg;														// slave register pointer
+	uint8_t			first;													// next sent byte is the register address
+	uint8_t			cmd, busy, err, int_enabled;
+	uint64_t		done_ns;
+} i2c_mock;
+
+
+/*
+ * @brief: Attach a device model to the host I2C bus
+ * @param[in]: device descriptor, copied
+ * @param[out]: none
+ */
+void i2c_HostAttach(const i2c_host_device *dev) {
+	uint8_t i;
+	
+	for (i = 0; i < i2c_devices_count; i++) {
+		if (i2c_devices[i].id == dev->id) {
+			i2c_devices[i] = *dev;
+			return;
+		}
+	}
+	if (i2c_devices_count < I2C_HOST_DEVICES_MAX) {
+		i2c_devices[i2c_devices_count++] = *dev;
+	}
+}
+
+/*
+ * @brief: Remove all device models from the host I2C bus
+ * @param[in]: none
+ * @param[out]: none
+ */
+void i2c_HostDetachAll(void) {
+	i2c_devices_count = 0;
+	memset(&i2c_mock, 0, sizeof(i2c_mock));
+	i2c_host_busy_ns = 0;
+	i2c_host_interrupts = 0;
+}
+
+static i2c_host_device *i2c_HostFind(uint8_t SlaveID) {
+	uint8_t i;
+	
+	for (i = 0; i < i2c_devices_count; i++) {
+		if (i2c_devices[i].id == SlaveID) return &i2c_devices[i];
+	}
+	return NULL;
+}
+
+/*
+ * Same contract as the TM4C backend in i2cu.c: 0 on error (no device answers).
+ */
+uint8_t i2c_ReadByte(uint8_t SlaveID, uint8_t addr) {
+	i2c_host_device *dev = i2c_HostFind(SlaveID);
+	uint8_t data = 0;
+	
+	if (dev == NULL || dev->read == NULL) return 0;
+	if (dev->read(dev->ctx, addr, 1, &data) != 1) return 0;
+	return data;
+}
+
+int32_t i2c_WriteByte(uint8_t SlaveID, uint8_t addr, uint8_t data) {
+	i2c_host_device *dev = i2c_HostFind(SlaveID);
+	
+	if (dev == NULL || dev->write == NULL) return 0;
+	return dev->write(dev->ctx, addr, 1, &data) ? 1 : 0;
+}
+
+int32_t i2c_ReadBuf(uint8_t SlaveID, uint8_t addr, int32_t nBytes, uint8_t* pBuf) {
+	i2c_host_device *dev = i2c_HostFind(SlaveID);
+	
+	if (dev == NULL || dev->read == NULL) return 0;
+	return dev->read(dev->ctx, addr, nBytes, pBuf);
+}
+
+int32_t i2c_WriteBuf(uint8_t SlaveID, uint8_t addr, int32_t nBytes, uint8_t* pBuf) {
+	i2c_host_device *dev = i2c_HostFind(SlaveID);
+	
+	if (dev == NULL || dev->write == NULL) return 0;
+	return dev->write(dev->ctx, addr, nBytes, pBuf) ? 1 : 0;
+}
+
+
+/*
+ * Mock TM4C I2C master. A command is latched by hal_I2CCommand and takes
+ * effect when its bit time has elapsed on the mock clock.
+ */
+static uint32_t i2c_MockBits(uint8_t cmd) {
+	switch (cmd) {
+		case HAL_I2C_SINGLE_SEND:
+		case HAL_I2C_SINGLE_RECEIVE:					return 1 + 9 + 9 + 1;		// start, address, data, stop
+		case HAL_I2C_BURST_SEND_START:
+		case HAL_I2C_BURST_RECEIVE_START:			return 1 + 9 + 9;
+		case HAL_I2C_BURST_SEND_FINISH:
+		case HAL_I2C_BURST_RECEIVE_FINISH:		return 9 + 1;
+		case HAL_I2C_BURST_SEND_STOP:
+		case HAL_I2C_BURST_RECEIVE_STOP:			return 1;
+		default:															return 9;
+	}
+}
+
+static void i2c_MockComplete(void) {
+	uint8_t cmd = i2c_mock.cmd;
+	i2c_host_device *dev = i2c_HostFind(i2c_mock.id);
+	
+	i2c_mock.busy = 0;
+	if (cmd == HAL_I2C_BURST_SEND_STOP || cmd == HAL_I2C_BURST_RECEIVE_STOP) return;
+	if (dev == NULL) {
+		i2c_mock.err = 1;
+		return;
+	}
+	if (!i2c_mock.receive) {
+		if (cmd == HAL_I2C_SINGLE_SEND || cmd == HAL_I2C_BURST_SEND_START) i2c_mock.first = 1;
+		if (i2c_mock.first) {
+			i2c_mock.reg = i2c_mock.data_tx;
+			i2c_mock.first = 0;
+		} else if (dev->write == NULL || !dev->write(dev->ctx, i2c_mock.reg++, 1, &i2c_mock.data_tx)) {
+			i2c_mock.err = 1;
+		}
+	} else {
+		if (dev->read == NULL || dev->read(dev->ctx, i2c_mock.reg++, 1, &i2c_mock.data_rx) != 1) i2c_mock.err = 1;
+	}
+}
+
+void hal_I2CSlave(uint8_t id, uint8_t receive) {
+	i2c_mock.id = id;
+	i2c_mock.receive = receive;
+}
+
+void hal_I2CPut(uint8_t data) {
+	i2c_mock.data_tx = data;
+}
+
+uint8_t hal_I2CGet(void) {
+	return i2c_mock.data_rx;
+}
+
+void hal_I2CCommand(uint8_t cmd) {
+	uint64_t ns = (uint64_t)i2c_MockBits(cmd) * 1000000000ull / i2c_host_bitrate;
+	
+	// an absent slave NAKs its address: start + address only
+	if (cmd != HAL_I2C_BURST_SEND_STOP && cmd != HAL_I2C_BURST_RECEIVE_STOP && i2c_HostFind(i2c_mock.id) == NULL) {
+		ns = 10ull * 1000000000ull / i2c_host_bitrate;
+	}
+	i2c_mock.cmd = cmd;
+	i2c_mock.err = 0;
+	i2c_mock.busy = 1;
+	i2c_mock.done_ns = hal_host_time_ns + ns;
+	i2c_host_busy_ns += ns;
+}
+
+uint8_t hal_I2CError(void) {
+	return i2c_mock.err;
+}
+
+void hal_I2CIntEnable(void) {
+	i2c_mock.int_enabled = 1;
+}
+
+void hal_I2CIntAck(void) {
+}
+
+/*
+ * @brief: Advance the mock clock, completing due commands and raising the
+ * 				I2C interrupt for each; commands issued by the ISR start at the
+ * 				completion time of the previous one
+ * @param[in]: absolute mock time, ns
+ * @param[out]: none
+ */
+void i2c_HostMockRun(uint64_t until_ns) {
+	while (i2c_mock.busy && i2c_mock.done_ns <= until_ns) {
+		hal_host_time_ns = i2c_mock.done_ns;
+		i2c_MockComplete();
+		if (i2c_mock.int_enabled) {
+			i2c_host_interrupts++;
+			i2c_AsyncISR();
+		}
+	}
+	if (until_ns > hal_host_time_ns) hal_host_time_ns = until_ns;
+}
+
+uint64_t i2c_HostMockNow(void) {
+	return hal_host_time_ns;
+}
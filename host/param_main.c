@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "param.h"
+#include "telem_decode.h"
+#include "hal_host.h"
+
+/*
+ * skyalpha_param - runtime parameters (param.h) by name.
+ *
+ *   skyalpha_param [--store file] command...
+ *
+ *   get <name|all>
+ *   set <name> <value>
+ *   save | load | defaults
+ *
+ * Without --store the requests go to stdout, e.g. > /dev/ttyACM0, and the
+ * replies come back as "par" lines in telem_dump. With --store the commands
+ * run here, through the same param_Command as the firmware, on a store
+ * image: it is loaded first (defaults if blank), and "save" writes it back.
+ * skyalpha_sim --store flies the result.
+ */
+
+static const char *status_names[] = {"ok", "no such parameter", "out of range", "store unreadable or corrupt", "bad request", "motors running"};
+static int failed;
+
+
+static void print_Value(uint8_t id, uint32_t bits) {
+	float f;
+	
+	if (param_table[id].type == PARAM_F32) {
+		memcpy(&f, &bits, sizeof(f));
+		printf("%-12s %.9g\n", param_table[id].name, f);
+	} else {
+		printf("%-12s %u\n", param_table[id].name, bits);
+	}
+}
+
+static void on_Frame(void *ctx, const telem_frame *f) {
+	static const char *ops[] = {"get", "set", "save", "load", "defaults"};
+	telem_param q;
+	
+	(void)ctx;
+	if (!telem_ParseParam(f, &q)) return;
+	if (q.status != PARAM_OK) {
+		fprintf(stderr, "%s %s: %s\n", q.op <= PARAM_OP_DEFAULTS ? ops[q.op] : "?",
+						q.id < PARAM_COUNT && q.op <= PARAM_OP_SET ? param_table[q.id].name : "",
+						q.status <= PARAM_EBUSY ? status_names[q.status] : "?");
+		failed = 1;
+	} else if (q.op <= PARAM_OP_SET) {
+		print_Value(q.id, q.value);
+	}
+}
+
+static void serial_Write(void *ctx, const uint8_t *data, uint16_t len) {
+	telem_Decode(ctx, data, len);
+}
+
+static int param_Find(const char *name) {
+	int i;
+	
+	for (i = 0; i < PARAM_COUNT; i++) {
+		if (!strcmp(name, param_table[i].name)) return i;
+	}
+	fprintf(stderr, "unknown parameter %s\n", name);
+	return -1;
+}
+
+static uint16_t request(uint8_t *req, uint8_t op, uint8_t id, uint32_t value) {
+	req[0] = 'P';
+	req[1] = op;
+	req[2] = id;
+	if (op != PARAM_OP_SET) return 3;
+	req[3] = (uint8_t)value;
+	req[4] = (uint8_t)(value >> 8);
+	req[5] = (uint8_t)(value >> 16);
+	req[6] = (uint8_t)(value >> 24);
+	return 7;
+}
+
+int main(int argc, char **argv) {
+	static uint8_t req[16 * PARAM_COUNT + 256];
+	static telem_decoder dec;
+	const char *store = NULL;
+	uint16_t n = 0;
+	int a = 1, id;
+	
+	if (a + 1 < argc && !strcmp(argv[a], "--store")) {
+		store = argv[a + 1];
+		a += 2;
+	}
+	if (a == argc) {
+		fprintf(stderr, "usage: %s [--store file] get name|all | set name value | save | load | defaults ...\n", argv[0]);
+		return 2;
+	}
+	for (; a < argc; a++) {
+		if (n + 7 > sizeof(req)) {
+			fprintf(stderr, "too many commands\n");
+			return 2;
+		}
+		if (!strcmp(argv[a], "get") && a + 1 < argc) {
+			if (!strcmp(argv[++a], "all")) {
+				for (id = 0; id < PARAM_COUNT && n + 3 <= sizeof(req); id++) n += request(req + n, PARAM_OP_GET, id, 0);
+				continue;
+			}
+			if ((id = param_Find(argv[a])) < 0) return 2;
+			n += request(req + n, PARAM_OP_GET, id, 0);
+		} else if (!strcmp(argv[a], "set") && a + 2 < argc) {
+			uint32_t bits;
+			float f;
+			
+			if ((id = param_Find(argv[++a])) < 0) return 2;
+			if (param_table[id].type == PARAM_F32) {
+				f = strtof(argv[++a], NULL);
+				memcpy(&bits, &f, sizeof(bits));
+			} else {
+				bits = (uint32_t)strtoul(argv[++a], NULL, 0);
+			}
+			n += request(req + n, PARAM_OP_SET, id, bits);
+		} else if (!strcmp(argv[a], "save")) {
+			n += request(req + n, PARAM_OP_SAVE, 0, 0);
+		} else if (!strcmp(argv[a], "load")) {
+			n += request(req + n, PARAM_OP_LOAD, 0, 0);
+		} else if (!strcmp(argv[a], "defaults")) {
+			n += request(req + n, PARAM_OP_DEFAULTS, 0, 0);
+		} else {
+			fprintf(stderr, "bad command %s\n", argv[a]);
+			return 2;
+		}
+	}
+	
+	if (store == NULL) {
+		fwrite(req, 1, n, stdout);
+		return 0;
+	}
+	
+	hal_HostReset();
+	hal_host_store_path = store;
+	param_Init();
+	telem_DecoderInit(&dec, on_Frame, NULL);
+	hal_HostSerialSink(serial_Write, &dec);
+	if (param_Command(req, n) != n) failed = 1;
+	return failed;
+}
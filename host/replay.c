@@ -0,0 +1,143 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "sensors.h"
+#include "control.h"
+#include "tasks.h"
+#include "replay.h"
+
+
+static uint32_t		replay_gyro;									// sample index the rate loop last read
+
+
+/*
+ * @brief: Flight code as after power-up in the log's modes, frame and rate
+ * 				loop divider, recorder off
+ * @param[in]: log
+ * @param[out]: none
+ */
+void replay_Reset(const blackbox_log *l) {
+	control_estimator = BLACKBOX_MODE_EST(l->modes);
+	control_mode = BLACKBOX_MODE_CONTROL(l->modes);
+	kalman_gain_mode = BLACKBOX_MODE_GAIN(l->modes);
+	control_frame = BLACKBOX_MODE_FRAME(l->modes);
+	control_rate_div = l->rate_div;
+	task_Init();
+	control_Init();
+	memset(&accel, 0, sizeof(accel));
+	memset(&gyro, 0, sizeof(gyro));
+	memset(&compass, 0, sizeof(compass));
+	memset(sensors_last, 0, sizeof(sensors_last));
+	sensors_batch_n = 0;
+	blackbox_mode = BLACKBOX_OFF;
+	user_torque = 0;
+	replay_gyro = 0;
+}
+
+/*
+ * @brief: Kalman angles and drift from record r and the low-pass from each
+ * 				sensor's first sample, for a log started in flight
+ * @param[in]: log, record
+ * @param[out]: none
+ */
+void replay_Seed(const blackbox_log *l, uint32_t r) {
+	kalman_data * const k[3] = {&k_roll, &k_pitch, &k_yaw};
+	static Vect3d * const reading[SENSORS_COUNT] = {&accel, &compass, &gyro};
+	uint8_t i, seeded = 0;
+	uint32_t s;
+	
+	for (i = 0; i < 3; i++) {
+		k[i]->x[0] = l->col[BLACKBOX_ATTITUDE + i][r] / 100.0f;
+		k[i]->x[2] = l->col[BLACKBOX_DRIFT + i][r] / 100.0f;
+	}
+	roll = k_roll.x[0];
+	pitch = k_pitch.x[0];
+	yaw = k_yaw.x[0];
+	for (s = r ? l->s_end[r - 1] : 0; s < l->ns && seeded != 7; s++) {
+		if (seeded & (1 << l->s_sensor[s])) continue;
+		reading[l->s_sensor[s]]->x = l->s_data[s][0];
+		reading[l->s_sensor[s]]->y = l->s_data[s][1];
+		reading[l->s_sensor[s]]->z = l->s_data[s][2];
+		seeded |= 1 << l->s_sensor[s];
+	}
+	replay_gyro = r ? l->s_end[r - 1] : 0;
+}
+
+/*
+ * @brief: The gyro sample a rate loop run read, by its time; samples are
+ * 				logged with the tick that filtered them, so it can sit in a later
+ * 				record. A sample the log lost leaves the previous one in place.
+ */
+static void replay_Gyro(const blackbox_log *l, uint32_t t_us) {
+	sensors_sample *g = &sensors_last[__MEASURE_GYROSCOPE];
+	uint32_t s;
+	
+	g->t_us = t_us;
+	for (s = replay_gyro; s < l->ns; s++) {
+		if (l->s_sensor[s] != __MEASURE_GYROSCOPE) continue;
+		if ((int32_t)(l->s_t_us[s] - t_us) > 0) break;
+		replay_gyro = s;
+		if (l->s_t_us[s] == t_us) {
+			g->x = l->s_data[s][0];
+			g->y = l->s_data[s][1];
+			g->z = l->s_data[s][2];
+			break;
+		}
+	}
+}
+
+/*
+ * @brief: One control tick on record r's inputs, the rate loop runs before it
+ * @param[in]: log, record
+ * @param[out]: v[BLACKBOX_FIELDS], the record the board would have written
+ */
+void replay_Step(const blackbox_log *l, uint32_t r, int32_t *v) {
+	uint32_t s, k;
+	
+	for (s = r ? l->r_end[r - 1] : 0; s < l->r_end[r]; s++) {
+		user_torque = l->r_throttle[s];
+		replay_Gyro(l, l->r_t_us[s]);
+		// the runs control_rate_div skips are not logged
+		for (k = 0; k < control_rate_div; k++) control_RateTask();
+	}
+	s = r ? l->s_end[r - 1] : 0;
+	sensors_batch_n = (uint16_t)(l->s_end[r] - s);
+	for (k = 0; k < sensors_batch_n; k++, s++) {
+		sensors_batch[k].data[0] = l->s_data[s][0];
+		sensors_batch[k].data[1] = l->s_data[s][1];
+		sensors_batch[k].data[2] = l->s_data[s][2];
+		sensors_batch[k].sensor = l->s_sensor[s];
+		sensors_batch[k].t_us = l->s_t_us[s];
+	}
+	sensors_FilterBatch();
+	user_torque = (uint16_t)l->col[BLACKBOX_THROTTLE][r];
+	control_Estimate();
+	control_Step();
+	blackbox_Fields(v);
+}
+
+/*
+ * @brief: Replay every record of the log from the current state, compare
+ * @param[in]: log
+ * @param[out]: per-field differences
+ */
+void replay_Run(const blackbox_log *l, replay_result *res) {
+	int32_t v[BLACKBOX_FIELDS];
+	uint32_t r, i;
+	
+	memset(res, 0, sizeof(*res));
+	res->first = l->n;
+	for (r = 0; r < l->n; r++) {
+		replay_Step(l, r, v);
+		for (i = 0; i < BLACKBOX_FIELDS; i++) {
+			uint32_t d;
+			
+			if (v[i] == l->col[i][r]) continue;
+			d = v[i] > l->col[i][r] ? (uint32_t)v[i] - (uint32_t)l->col[i][r] : (uint32_t)l->col[i][r] - (uint32_t)v[i];
+			if (d > res->max[i]) res->max[i] = d;
+			res->diffs[i]++;
+			if (r < res->first) res->first = r;
+		}
+	}
+	res->n = l->n;
+}
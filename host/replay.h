@@ -0,0 +1,42 @@
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include <stdint.h>
+#include "blackbox.h"
+#include "blackbox_decode.h"
+
+/*
+ * Deterministic replay of a flight data log (blackbox.h) through the flight
+ * code itself, in the estimator, gain and control modes, frame and rate loop
+ * divider the log records; gains and noise constants are the replaying
+ * build's, so a change to them can be tried on the flight.
+ * Per record, its rate loop runs go through control_RateTask() with the gyro
+ * sample each one read in sensors_last and the throttle it saw; its raw
+ * samples go into sensors_batch and through the low-pass, and its throttle
+ * into user_torque. Then control_Estimate() and control_Step() run as in the
+ * control tasks and blackbox_Fields() is compared with what the board
+ * recorded, including the hash of the filter and controller float bits.
+ *
+ * Starting from replay_Reset() the state matches a log recorded from
+ * control_Init() on, so every field comes back bit for bit as long as both
+ * builds round floats the same way: single precision IEEE-754 and no fused
+ * multiply-add contraction (-ffp-contract=off on both). A log started in
+ * flight has no filter covariance or low-pass state to start from;
+ * replay_Seed() sets the angles and drift from its first record and the
+ * low-pass from the first samples, and the fields converge instead.
+ */
+
+typedef struct {
+	uint32_t		n;																// records replayed
+	uint32_t		diffs[BLACKBOX_FIELDS];						// records where the field differs
+	uint32_t		max[BLACKBOX_FIELDS];							// largest |replayed - recorded|
+	uint32_t		first;														// first record that differs, n if none
+} replay_result;
+
+
+extern void replay_Reset(const blackbox_log *l);
+extern void replay_Seed(const blackbox_log *l, uint32_t r);
+extern void replay_Step(const blackbox_log *l, uint32_t r, int32_t *v);
+extern void replay_Run(const blackbox_log *l, replay_result *res);
+
+#endif
@@ -0,0 +1,128 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "blackbox.h"
+#include "blackbox_decode.h"
+#include "replay.h"
+
+/*
+ * skyalpha_replay - rerun the estimator and controller on a recorded flight.
+ *
+ *   skyalpha_replay [options] [file]      telemetry stream, default stdin
+ *
+ *   --seed         log started in flight: seed the angles from its first record
+ *   -r <n>         replay n times for the throughput figure, default 5
+ *   --csv <file>   replayed records, blackbox_dump columns
+ *
+ * The estimator, Kalman gain and control modes, the frame and the rate loop
+ * divider come from the log; gains and noise constants are this build's.
+ * Prints the records and fields that differ from the recorded ones and the
+ * replay speed. Exits 0 if every field came back bit for bit, 1 if not.
+ */
+
+static double wall_Seconds(void) {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void replay_Start(const blackbox_log *l, int seed) {
+	replay_Reset(l);
+	if (seed && l->n) replay_Seed(l, 0);
+}
+
+static void csv_Write(FILE *f, const blackbox_log *l, int seed) {
+	int32_t v[BLACKBOX_FIELDS];
+	uint32_t r, i;
+	
+	replay_Start(l, seed);
+	fputs("t_us", f);
+	for (i = 0; i < BLACKBOX_FIELDS; i++) fprintf(f, ",%s", blackbox_names[i]);
+	fputc('\n', f);
+	for (r = 0; r < l->n; r++) {
+		replay_Step(l, r, v);
+		fprintf(f, "%u", l->t_us[r]);
+		for (i = 0; i < BLACKBOX_FIELDS; i++) fprintf(f, ",%d", v[i]);
+		fputc('\n', f);
+	}
+}
+
+int main(int argc, char **argv) {
+	static uint8_t buf[65536];
+	static blackbox_log l;
+	replay_result res;
+	const char *name = NULL, *csv_name = NULL;
+	uint32_t repeats = 5, k, i;
+	double t0, best = 0;
+	FILE *in = stdin;
+	size_t n;
+	int a, seed = 0;
+	
+	for (a = 1; a < argc; a++) {
+		if (!strcmp(argv[a], "--seed"))												seed = 1;
+		else if (!strcmp(argv[a], "-r") && a + 1 < argc)						repeats = (uint32_t)atol(argv[++a]);
+		else if (!strcmp(argv[a], "--csv") && a + 1 < argc)				csv_name = argv[++a];
+		else if (argv[a][0] != '-' && name == NULL)									name = argv[a];
+		else {
+			fprintf(stderr, "usage: %s [--seed] [-r n] [--csv file] [file]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (name != NULL) {
+		in = fopen(name, "rb");
+		if (in == NULL) {
+			perror(name);
+			return 2;
+		}
+	}
+	blackbox_LogInit(&l);
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) blackbox_DecodeStream(&l, buf, n);
+	if (in != stdin) fclose(in);
+	if (l.version) {
+		fprintf(stderr, "blocks of format version %u skipped, this build reads %u\n", l.version, BLACKBOX_FORMAT_VERSION);
+	}
+	printf("records %u samples %u rate runs %u blocks %llu bad %llu lost %llu\n", l.n, l.ns, l.nr,
+				(unsigned long long)l.blocks, (unsigned long long)l.bad, (unsigned long long)l.lost);
+	printf("estimator %u gain mode %u control mode %u frame %u rate div %u\n", BLACKBOX_MODE_EST(l.modes),
+				BLACKBOX_MODE_GAIN(l.modes), BLACKBOX_MODE_CONTROL(l.modes), BLACKBOX_MODE_FRAME(l.modes), l.rate_div);
+	if (l.lost) printf("blocks lost: the replay is only exact up to the first gap\n");
+	if (l.n == 0) return 2;
+	
+	if (repeats == 0) repeats = 1;
+	for (k = 0; k < repeats; k++) {
+		replay_Start(&l, seed);
+		t0 = wall_Seconds();
+		replay_Run(&l, &res);
+		t0 = wall_Seconds() - t0;
+		if (k == 0 || t0 < best) best = t0;
+	}
+	
+	printf("%-12s %10s %12s\n", "field", "diffs", "max");
+	for (i = 0; i < BLACKBOX_FIELDS; i++) {
+		if (res.diffs[i]) printf("%-12s %10u %12u\n", blackbox_names[i], res.diffs[i], res.max[i]);
+	}
+	if (res.first == res.n) {
+		printf("bit-exact: all %u records\n", res.n);
+	} else {
+		printf("first difference at record %u, t_us %u\n", res.first, l.t_us[res.first]);
+	}
+	printf("replay: %.2f Mrecords/s, %.2f Msamples/s, %.0fx real time (best of %u)\n", res.n / best / 1e6,
+				l.ns / best / 1e6, (l.t_us[l.n - 1] - l.t_us[0]) * 1e-6 / best, repeats);
+	
+	if (csv_name != NULL) {
+		FILE *f = fopen(csv_name, "w");
+		
+		if (f == NULL) {
+			perror(csv_name);
+			return 2;
+		}
+		csv_Write(f, &l, seed);
+		fclose(f);
+	}
+	blackbox_LogFree(&l);
+	return res.first != res.n;
+}
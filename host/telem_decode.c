@@ -0,0 +1,174 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "crc16.h"
+#include "telem_decode.h"
+
+
+static inline uint16_t rd_U16(const uint8_t *p) {
+	return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static inline uint32_t rd_U32(const uint8_t *p) {
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/*
+ * @brief: Delimiter seen: check and deliver the frame, reset for the next
+ */
+static uint32_t telem_FrameEnd(telem_decoder *d) {
+	telem_frame f;
+	uint16_t n = d->n;
+	uint32_t ok = 0;
+	
+	if (!d->in_frame) return 0;																// back-to-back delimiters
+	if (d->bad || d->left || n < 4) {
+		d->malformed++;
+	} else if (crc16_Update(CRC16_INIT, d->buf, n - 2) != rd_U16(&d->buf[n - 2])) {
+		d->crc_errors++;
+	} else {
+		f.id = d->buf[0];
+		f.seq = d->buf[1];
+		f.len = (uint8_t)(n - 4);
+		f.payload = &d->buf[2];
+		if (d->synced) d->lost += (uint8_t)(f.seq - d->seq_next);
+		d->seq_next = f.seq + 1;
+		d->synced = 1;
+		d->frames++;
+		ok = 1;
+		if (d->cb != NULL) d->cb(d->ctx, &f);
+	}
+	d->n = 0;
+	d->left = 0;
+	d->in_frame = 0;
+	d->bad = 0;
+	return ok;
+}
+
+/*
+ * @brief: Empty decoder, expecting a frame to start with the first byte
+ * @param[in]: decoder, per-frame callback and its argument
+ * @param[out]: none
+ */
+void telem_DecoderInit(telem_decoder *d, telem_frame_cb cb, void *ctx) {
+	memset(d, 0, sizeof(*d));
+	d->cb = cb;
+	d->ctx = ctx;
+}
+
+/*
+ * @brief: Feed received bytes
+ * @param[in]: decoder, data, length
+ * @param[out]: good frames completed in this call
+ */
+uint32_t telem_Decode(telem_decoder *d, const uint8_t *data, size_t len) {
+	const uint8_t *end = data + len;
+	uint32_t frames = 0;
+	
+	d->bytes += len;
+	while (data < end) {
+		uint8_t b = *data++;
+		
+		if (!b) {
+			frames += telem_FrameEnd(d);
+			continue;
+		}
+		if (d->bad) continue;
+		if (d->left) {
+			// inside a block: copy up to its end, stopping at a delimiter
+			const uint8_t *stop = end - data < d->left - 1 ? end : data + d->left - 1;
+			
+			if (d->n + (stop - data) + 1 > sizeof(d->buf)) {
+				d->bad = 1;
+				continue;
+			}
+			d->buf[d->n++] = b;
+			d->left--;
+			while (data < stop && *data) {
+				d->buf[d->n++] = *data++;
+				d->left--;
+			}
+			continue;
+		}
+		// code byte; the block before it ended in a zero unless it was full
+		if (d->in_frame && d->code < 0xFF) {
+			if (d->n >= sizeof(d->buf)) {
+				d->bad = 1;
+				continue;
+			}
+			d->buf[d->n++] = 0;
+		}
+		d->in_frame = 1;
+		d->code = b;
+		d->left = b - 1;
+	}
+	return frames;
+}
+
+/*
+ * @brief: Typed views of a frame's payload
+ * @param[in]: frame from the callback
+ * @param[out]: decoded message; returns 0 if the id or length does not match
+ */
+int telem_ParseAttitude(const telem_frame *f, telem_attitude *out) {
+	if (f->id != TELEM_MSG_ATTITUDE || f->len != TELEM_ATTITUDE_SIZE) return 0;
+	out->t_us = rd_U32(f->payload);
+	out->roll = (int16_t)rd_U16(f->payload + 4) * 0.01f;
+	out->pitch = (int16_t)rd_U16(f->payload + 6) * 0.01f;
+	out->yaw = (int16_t)rd_U16(f->payload + 8) * 0.01f;
+	return 1;
+}
+
+int telem_ParseImu(const telem_frame *f, telem_imu *out) {
+	uint8_t i;
+	
+	if (f->id != TELEM_MSG_IMU || f->len != TELEM_IMU_SIZE) return 0;
+	for (i = 0; i < 3; i++) {
+		out->accel[i] = (int16_t)rd_U16(f->payload + 2*i);
+		out->gyro[i] = (int16_t)rd_U16(f->payload + 6 + 2*i);
+		out->compass[i] = (int16_t)rd_U16(f->payload + 12 + 2*i);
+	}
+	return 1;
+}
+
+int telem_ParseMotors(const telem_frame *f, telem_motors *out) {
+	uint8_t i;
+	
+	if (f->id != TELEM_MSG_MOTORS || f->len != TELEM_MOTORS_SIZE) return 0;
+	for (i = 0; i < 4; i++) out->torque[i] = rd_U16(f->payload + 2*i);
+	return 1;
+}
+
+int telem_ParseTiming(const telem_frame *f, telem_timing *out) {
+	if (f->id != TELEM_MSG_TIMING || f->len != TELEM_TIMING_SIZE) return 0;
+	out->t_us = rd_U32(f->payload);
+	out->period_us = rd_U16(f->payload + 4);
+	out->exec_us = rd_U16(f->payload + 6);
+	out->dropped = rd_U16(f->payload + 8);
+	return 1;
+}
+
+int telem_ParseProfile(const telem_frame *f, telem_profile *out) {
+	uint8_t i;
+	
+	if (f->id != TELEM_MSG_PROFILE || f->len != TELEM_PROFILE_SIZE) return 0;
+	out->probe = f->payload[0];
+	out->hz = rd_U32(f->payload + 1);
+	out->count = rd_U32(f->payload + 5);
+	out->min = rd_U32(f->payload + 9);
+	out->max = rd_U32(f->payload + 13);
+	out->mean = rd_U32(f->payload + 17);
+	for (i = 0; i < PROF_BUCKETS; i++) out->hist[i] = rd_U16(f->payload + 21 + 2 * i);
+	return 1;
+}
+
+int telem_ParseParam(const telem_frame *f, telem_param *out) {
+	if (f->id != TELEM_MSG_PARAM || f->len != TELEM_PARAM_SIZE) return 0;
+	out->op = f->payload[0];
+	out->id = f->payload[1];
+	out->status = f->payload[2];
+	out->type = f->payload[3];
+	out->value = rd_U32(f->payload + 4);
+	return 1;
+}
@@ -0,0 +1,79 @@
+#ifndef _TELEM_DECODE_H_
+#define _TELEM_DECODE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetry.h"
+
+/*
+ * Receiving side of the telemetry stream (telemetry.h), for ground tools on
+ * Linux: feed it whatever read() returns from /dev/ttyACM*, in any chunk
+ * sizes, and it calls back once per good frame. Damaged frames are counted
+ * and skipped up to the next delimiter; seq gaps count frames lost in
+ * transit. The payload pointer is valid during the callback only.
+ */
+
+typedef struct {
+	uint8_t				id, seq;
+	uint8_t				len;															// payload bytes
+	const uint8_t	*payload;
+} telem_frame;
+
+typedef void (*telem_frame_cb)(void *ctx, const telem_frame *f);
+
+typedef struct {
+	uint8_t				buf[TELEM_PAYLOAD_MAX + 4];				// id, seq, payload, crc
+	uint16_t			n;
+	uint8_t				code;															// COBS code of the current block
+	uint8_t				left;															// bytes still to come in it
+	uint8_t				in_frame, bad;
+	uint8_t				seq_next, synced;
+	uint64_t			bytes, frames;
+	uint64_t			crc_errors, malformed;						// frames rejected
+	uint64_t			lost;															// seq gaps
+	telem_frame_cb	cb;
+	void					*ctx;
+} telem_decoder;
+
+typedef struct {
+	uint32_t	t_us;
+	float			roll, pitch, yaw;												// deg
+} telem_attitude;
+
+typedef struct {
+	int16_t		accel[3], gyro[3], compass[3];
+} telem_imu;
+
+typedef struct {
+	uint16_t	torque[4];
+} telem_motors;
+
+typedef struct {
+	uint32_t	t_us;
+	uint16_t	period_us, exec_us, dropped;
+} telem_timing;
+
+typedef struct {
+	uint8_t		probe;														// PROF_*
+	uint32_t	hz;																// cycles per second
+	uint32_t	count, min, max, mean;						// cycles
+	uint16_t	hist[PROF_BUCKETS];
+} telem_profile;
+
+typedef struct {
+	uint8_t		op, id, status, type;						// param.h
+	uint32_t	value;														// float bits or u16
+} telem_param;
+
+
+extern void			telem_DecoderInit(telem_decoder *d, telem_frame_cb cb, void *ctx);
+extern uint32_t	telem_Decode(telem_decoder *d, const uint8_t *data, size_t len);
+
+extern int			telem_ParseAttitude(const telem_frame *f, telem_attitude *out);
+extern int			telem_ParseImu(const telem_frame *f, telem_imu *out);
+extern int			telem_ParseMotors(const telem_frame *f, telem_motors *out);
+extern int			telem_ParseTiming(const telem_frame *f, telem_timing *out);
+extern int			telem_ParseProfile(const telem_frame *f, telem_profile *out);
+extern int			telem_ParseParam(const telem_frame *f, telem_param *out);
+
+#endif
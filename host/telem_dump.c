@@ -0,0 +1,83 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "telem_decode.h"
+
+/*
+ * telem_dump - print a telemetry stream one message per line.
+ *
+ *   telem_dump [file]      default stdin, e.g. < /dev/ttyACM0
+ *
+ * Lines: "att t_us roll pitch yaw", "imu ax ay az gx gy gz mx my mz",
+ * "mot t0 t1 t2 t3", "tim t_us period_us exec_us dropped",
+ * "prf probe count min_us max_us mean_us h0..h15" (PROF_* id,
+ * histogram counts of the prof.h buckets), "par op id status value bits"
+ * (param.h reply, value as float), "txt ..." and "id=N len=N" for anything
+ * else. Stream counters go to stderr at the end.
+ */
+
+static void on_Frame(void *ctx, const telem_frame *f) {
+	FILE *out = ctx;
+	telem_attitude a;
+	telem_imu m;
+	telem_motors p;
+	telem_timing t;
+	telem_profile r;
+	telem_param q;
+	uint8_t i;
+	
+	if (telem_ParseAttitude(f, &a)) {
+		fprintf(out, "att %u %.2f %.2f %.2f\n", a.t_us, a.roll, a.pitch, a.yaw);
+	} else if (telem_ParseImu(f, &m)) {
+		fprintf(out, "imu %d %d %d %d %d %d %d %d %d\n", m.accel[0], m.accel[1], m.accel[2],
+					m.gyro[0], m.gyro[1], m.gyro[2], m.compass[0], m.compass[1], m.compass[2]);
+	} else if (telem_ParseMotors(f, &p)) {
+		fprintf(out, "mot %u %u %u %u\n", p.torque[0], p.torque[1], p.torque[2], p.torque[3]);
+	} else if (telem_ParseTiming(f, &t)) {
+		fprintf(out, "tim %u %u %u %u\n", t.t_us, t.period_us, t.exec_us, t.dropped);
+	} else if (telem_ParseProfile(f, &r)) {
+		double us = r.hz ? 1e6 / r.hz : 0;
+		
+		fprintf(out, "prf %u %u %.2f %.2f %.2f", r.probe, r.count,
+					r.min * us, r.max * us, r.mean * us);
+		for (i = 0; i < PROF_BUCKETS; i++) fprintf(out, " %u", r.hist[i]);
+		fputc('\n', out);
+	} else if (telem_ParseParam(f, &q)) {
+		float v;
+		
+		memcpy(&v, &q.value, sizeof(v));
+		fprintf(out, "par %u %u %u %g %u\n", q.op, q.id, q.status, v, q.value);
+	} else if (f->id == TELEM_MSG_TEXT) {
+		fprintf(out, "txt %.*s", f->len, (const char *)f->payload);
+		if (!f->len || f->payload[f->len - 1] != '\n') fputc('\n', out);
+	} else {
+		fprintf(out, "id=%u len=%u\n", f->id, f->len);
+	}
+}
+
+int main(int argc, char **argv) {
+	static uint8_t buf[65536];
+	telem_decoder d;
+	FILE *in = stdin;
+	size_t n;
+	
+	if (argc > 2 || (argc == 2 && !strcmp(argv[1], "-h"))) {
+		fprintf(stderr, "usage: %s [file]\n", argv[0]);
+		return 2;
+	}
+	if (argc == 2) {
+		in = fopen(argv[1], "rb");
+		if (in == NULL) {
+			perror(argv[1]);
+			return 1;
+		}
+	}
+	telem_DecoderInit(&d, on_Frame, stdout);
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) telem_Decode(&d, buf, n);
+	if (in != stdin) fclose(in);
+	
+	fprintf(stderr, "bytes %llu frames %llu crc_errors %llu malformed %llu lost %llu\n", (unsigned long long)d.bytes,
+				(unsigned long long)d.frames, (unsigned long long)d.crc_errors, (unsigned long long)d.malformed, (unsigned long long)d.lost);
+	return 0;
+}
@@ -0,0 +1,467 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "hal_host.h"
+#include "adxl345.h"
+#include "itg3200.h"
+#include "hmc5883l.h"
+
+#include "imu.h"
+
+
+#define RAD2DEG							57.29577951308232
+#define ITG3200_LSB_PER_DPS	14.375
+
+
+void rng_Seed(sim_rng *r, uint64_t seed) {
+	r->s = seed * 0x9E3779B97F4A7C15ull + 0x2545F4914F6CDD1Dull;
+	if (r->s == 0) r->s = 1;
+}
+
+/*
+ * @brief: xorshift64*, [0, 1)
+ */
+double rng_Uniform(sim_rng *r) {
+	r->s ^= r->s >> 12;
+	r->s ^= r->s << 25;
+	r->s ^= r->s >> 27;
+	return (double)((r->s * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * @brief: Standard normal, Box-Muller
+ */
+double rng_Gauss(sim_rng *r) {
+	double u1 = rng_Uniform(r), u2 = rng_Uniform(r);
+	
+	if (u1 < 1e-300) u1 = 1e-300;
+	return sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+}
+
+static void imu_Mount(const int8_t m[3][3], const double b[3], double s[3]) {
+	uint8_t i;
+	
+	for (i = 0; i < 3; i++) s[i] = m[i][0]*b[0] + m[i][1]*b[1] + m[i][2]*b[2];
+}
+
+static int16_t imu_Sat(double v, int32_t lim) {
+	int32_t i = (int32_t)lround(v);
+	
+	if (i > lim) i = lim;
+	if (i < -lim - 1) i = -lim - 1;
+	return (int16_t)i;
+}
+
+/*
+ * Free-run bookkeeping: a conversion lands, its first data byte is read
+ * (imu_Load), its last data byte is read (imu_Done).
+ */
+static void imu_Convert(imu_model *m, uint8_t sensor) {
+	imu_stream *st = &m->stream[sensor];
+	
+	if (st->unread) st->missed++;
+	st->unread = 1;
+	st->conversions++;
+	st->t_conv_ns = i2c_HostMockNow();
+}
+
+static void imu_Load(imu_model *m, uint8_t sensor, uint8_t *regs) {
+	imu_stream *st = &m->stream[sensor];
+	
+	memcpy(regs, m->latest[sensor], 6);
+	if (st->unread) {
+		st->unread = 0;
+		st->fresh++;
+		st->t_regs_ns = st->t_conv_ns;
+	} else {
+		st->stale++;
+		st->t_regs_ns = 0;
+	}
+	m->reads[sensor]++;
+}
+
+static void imu_Done(imu_model *m, uint8_t sensor) {
+	imu_stream *st = &m->stream[sensor];
+	uint64_t age;
+	
+	if (!st->t_regs_ns) return;
+	age = i2c_HostMockNow() - st->t_regs_ns;
+	st->age_sum_ns += age;
+	if (age > st->age_max_ns) st->age_max_ns = age;
+	st->t_regs_ns = 0;
+}
+
+static uint8_t imu_Covers(uint8_t addr, int32_t nBytes, uint8_t reg) {
+	return addr <= reg && addr + nBytes > reg;
+}
+
+/*
+ * ADXL345: little-endian DATAX0..DATAZ1, scale from DATA_FORMAT.
+ */
+static void adxl345_Measure(imu_model *m, uint8_t *out) {
+	uint8_t fmt = m->adxl345_regs[ADXL345_RA_DATA_FORMAT];
+	uint8_t range = fmt & 0x03;
+	double lsb_per_g;
+	int32_t lim;
+	double s[3];
+	uint8_t i;
+	
+	if (fmt & ADXL345_DATA_FULLRES_ENABLE) {
+		lsb_per_g = 256.0;
+		lim = (1 << (9 + range)) - 1;
+	} else {
+		lsb_per_g = 256.0 / (1 << range);
+		lim = 511;
+	}
+	imu_Mount(m->mount_accel, m->quad->specific_force, s);
+	for (i = 0; i < 3; i++) {
+		int16_t v = imu_Sat((s[i] + m->accel_noise * rng_Gauss(&m->rng)) / QUAD_G * lsb_per_g, lim);
+		out[2*i] = (uint8_t)v;
+		out[2*i + 1] = (uint8_t)((uint16_t)v >> 8);
+	}
+}
+
+static uint8_t adxl345_Streaming(const imu_model *m) {
+	return (m->adxl345_regs[ADXL345_RA_FIFO_CTL] & 0xC0) != ADXL345_FIFO_BYPASS;
+}
+
+/*
+ * @brief: FIFO_STATUS and INT_SOURCE from the FIFO fill, INT1 from the
+ * 				enabled sources not mapped to INT2
+ */
+static void adxl345_Status(imu_model *m) {
+	uint8_t *r = m->adxl345_regs;
+	uint8_t src = r[ADXL345_RA_INT_SOURCE] & ~((1 << 7) | (1 << 1));
+	
+	if (adxl345_Streaming(m)) {
+		if (m->adxl345_fifo_count) src |= 1 << 7;
+		if (m->adxl345_fifo_count >= (r[ADXL345_RA_FIFO_CTL] & 0x1F)) src |= 1 << 1;
+	} else if (r[ADXL345_RA_INT_SOURCE] & (1 << 7)) {
+		src |= 1 << 7;
+	}
+	r[ADXL345_RA_INT_SOURCE] = src;
+	r[ADXL345_RA_FIFO_STATUS] = m->adxl345_fifo_count & ADXL345_FIFO_ENTRIES;
+	m->adxl345_int1 = (src & r[ADXL345_RA_INT_ENABLE] & ~r[ADXL345_RA_INT_MAP]) != 0;
+	if (m->accel_int1 != NULL) *m->accel_int1 = m->adxl345_int1;
+}
+
+/*
+ * @brief: Data registers: the oldest FIFO entry in stream mode, else the
+ * 				latest conversion (free run) or a fresh measurement
+ */
+static void adxl345_Latch(imu_model *m) {
+	if (adxl345_Streaming(m)) {
+		if (m->adxl345_fifo_count) {
+			memcpy(&m->adxl345_regs[ADXL345_RA_DATAX0], m->adxl345_fifo[m->adxl345_fifo_head], 6);
+			m->adxl345_fifo_head = (m->adxl345_fifo_head + 1) % ADXL345_FIFO_SIZE;
+			m->adxl345_fifo_count--;
+		}
+		m->reads[0]++;
+	} else if (m->free_run) {
+		imu_Load(m, 0, &m->adxl345_regs[ADXL345_RA_DATAX0]);
+	} else {
+		adxl345_Measure(m, &m->adxl345_regs[ADXL345_RA_DATAX0]);
+		m->reads[0]++;
+	}
+	m->adxl345_regs[ADXL345_RA_INT_SOURCE] &= ~(1 << 7);
+	adxl345_Status(m);
+}
+
+/*
+ * ITG3200: big-endian GYRO_XOUT_H..GYRO_ZOUT_L, 14.375 LSB/(deg/s).
+ */
+static void itg3200_Measure(imu_model *m, uint8_t *out) {
+	double s[3];
+	uint8_t i;
+	
+	imu_Mount(m->mount_gyro, m->quad->w, s);
+	for (i = 0; i < 3; i++) {
+		double w = s[i] + m->gyro_bias[i] + m->gyro_noise * rng_Gauss(&m->rng);
+		int16_t v = imu_Sat(w * RAD2DEG * ITG3200_LSB_PER_DPS, 32767);
+		out[2*i] = (uint8_t)((uint16_t)v >> 8);
+		out[2*i + 1] = (uint8_t)v;
+	}
+}
+
+/*
+ * @brief: INT pin from RAW_DATA_RDY and INT_CFG, polarity included
+ */
+static void itg3200_Pin(imu_model *m) {
+	uint8_t cfg = m->itg3200_regs[ITG3200_RA_INT_CFG];
+	uint8_t active = (cfg & ITG3200_INT_CFG_RAW_DRY_EN) && (m->itg3200_regs[ITG3200_RA_INT_STATUS] & 0x01);
+	
+	m->itg3200_int = (cfg & ITG3200_INT_CFG_ACTL) ? !active : active;
+	if (m->gyro_int != NULL) *m->gyro_int = m->itg3200_int;
+}
+
+static void itg3200_Latch(imu_model *m) {
+	if (m->free_run) {
+		imu_Load(m, 1, &m->itg3200_regs[ITG3200_RA_GYRO_XOUT_H]);
+	} else {
+		itg3200_Measure(m, &m->itg3200_regs[ITG3200_RA_GYRO_XOUT_H]);
+		m->reads[1]++;
+	}
+}
+
+/*
+ * HMC5883L: big-endian, register order X, Z, Y; gain from CONFIG_B.
+ */
+static void hmc5883l_Measure(imu_model *m, uint8_t *out) {
+	static const double lsb_per_gauss[8] = {1370, 1090, 820, 660, 440, 390, 330, 230};
+	static const uint8_t order[3] = {0, 2, 1};
+	double gain = lsb_per_gauss[m->hmc5883l_regs[HMC5883L_RA_CONFIG_B] >> 5];
+	double b[3], s[3];
+	uint8_t i;
+	
+	quad_WorldToBody(m->quad, m->compass_field, b);
+	imu_Mount(m->mount_compass, b, s);
+	for (i = 0; i < 3; i++) {
+		double c = (s[i] + m->compass_noise * rng_Gauss(&m->rng)) * gain + m->compass_offset[i];
+		int16_t v = imu_Sat(c, 2047);
+		out[2*order[i]] = (uint8_t)((uint16_t)v >> 8);
+		out[2*order[i] + 1] = (uint8_t)v;
+	}
+}
+
+static void hmc5883l_Latch(imu_model *m) {
+	hmc5883l_Measure(m, &m->hmc5883l_regs[HMC5883L_DATA]);
+	m->reads[2]++;
+}
+
+static int32_t adxl345_Read(void *ctx, uint8_t addr, int32_t nBytes, uint8_t *pBuf) {
+	imu_model *m = ctx;
+	int32_t i;
+	
+	if (imu_Covers(addr, nBytes, ADXL345_RA_DATAX0)) adxl345_Latch(m);
+	for (i = 0; i < nBytes; i++) pBuf[i] = m->adxl345_regs[(addr + i) & 0x3F];
+	if (m->free_run && !adxl345_Streaming(m) && imu_Covers(addr, nBytes, ADXL345_RA_DATAZ1)) imu_Done(m, 0);
+	return nBytes;
+}
+
+static int32_t adxl345_Write(void *ctx, uint8_t addr, int32_t nBytes, uint8_t *pBuf) {
+	imu_model *m = ctx;
+	int32_t i;
+	
+	for (i = 0; i < nBytes; i++) {
+		uint8_t reg = (addr + i) & 0x3F;
+		
+		m->adxl345_regs[reg] = pBuf[i];
+		if (reg == ADXL345_RA_FIFO_CTL && !adxl345_Streaming(m)) m->adxl345_fifo_count = 0;
+	}
+	adxl345_Status(m);
+	return 1;
+}
+
+static int32_t itg3200_Read(void *ctx, uint8_t addr, int32_t nBytes, uint8_t *pBuf) {
+	imu_model *m = ctx;
+	int32_t i;
+	
+	if (imu_Covers(addr, nBytes, ITG3200_RA_GYRO_XOUT_H)) itg3200_Latch(m);
+	for (i = 0; i < nBytes; i++) pBuf[i] = m->itg3200_regs[(addr + i) & 0x3F];
+	if (m->free_run && imu_Covers(addr, nBytes, ITG3200_RA_GYRO_ZOUT_L)) imu_Done(m, 1);
+	// latched interrupt: cleared by reading INT_STATUS, or by any read
+	if ((m->itg3200_regs[ITG3200_RA_INT_CFG] & ITG3200_INT_CFG_INT_ANYRD_2CLEAR) || imu_Covers(addr, nBytes, ITG3200_RA_INT_STATUS)) {
+		m->itg3200_regs[ITG3200_RA_INT_STATUS] &= ~0x01;
+		itg3200_Pin(m);
+	}
+	return nBytes;
+}
+
+static int32_t itg3200_Write(void *ctx, uint8_t addr, int32_t nBytes, uint8_t *pBuf) {
+	imu_model *m = ctx;
+	int32_t i;
+	
+	for (i = 0; i < nBytes; i++) m->itg3200_regs[(addr + i) & 0x3F] = pBuf[i];
+	itg3200_Pin(m);
+	return 1;
+}
+
+static int32_t hmc5883l_Read(void *ctx, uint8_t addr, int32_t nBytes, uint8_t *pBuf) {
+	imu_model *m = ctx;
+	uint8_t continuous = m->hmc5883l_regs[HMC5883L_RA_MODE] == HMC5883L_MODE_CONTINUOUS;
+	int32_t i;
+	
+	// continuous mode converts on its own; single mode was latched by the MODE write
+	if (continuous && imu_Covers(addr, nBytes, HMC5883L_DATA)) {
+		if (m->free_run) {
+			imu_Load(m, 2, &m->hmc5883l_regs[HMC5883L_DATA]);
+			m->hmc5883l_regs[HMC5883L_RA_STATUS] &= ~(1 << HMC5883L_STATUS_READY_BIT);
+		} else {
+			hmc5883l_Latch(m);
+		}
+	}
+	for (i = 0; i < nBytes; i++) pBuf[i] = m->hmc5883l_regs[(addr + i) % 13];
+	if (continuous && m->free_run && imu_Covers(addr, nBytes, HMC5883L_DATA + 5)) imu_Done(m, 2);
+	return nBytes;
+}
+
+static int32_t hmc5883l_Write(void *ctx, uint8_t addr, int32_t nBytes, uint8_t *pBuf) {
+	imu_model *m = ctx;
+	int32_t i;
+	
+	for (i = 0; i < nBytes; i++) {
+		uint8_t reg = (addr + i) % 13;
+		
+		if (reg > HMC5883L_RA_MODE) continue;		// read-only
+		m->hmc5883l_regs[reg] = pBuf[i];
+		if (reg == HMC5883L_RA_MODE && pBuf[i] == HMC5883L_MODE_SINGLE) {
+			hmc5883l_Latch(m);
+			m->hmc5883l_regs[HMC5883L_RA_MODE] = HMC5883L_MODE_IDLE;
+		}
+	}
+	return 1;
+}
+
+/*
+ * @brief: Power-on register state, default mounting, noise and clock errors
+ * @param[in]: model, quad to sense, noise seed
+ * @param[out]: none
+ */
+void imu_Init(imu_model *m, const quad_state *quad, uint64_t seed) {
+	memset(m, 0, sizeof(*m));
+	m->quad = quad;
+	rng_Seed(&m->rng, seed);
+	
+	m->mount_accel[0][0] = -1;	m->mount_accel[1][1] = -1;	m->mount_accel[2][2] = 1;
+	m->mount_gyro[0][0] = 1;		m->mount_gyro[1][1] = 1;		m->mount_gyro[2][2] = 1;
+	m->mount_compass[0][0] = 1;	m->mount_compass[1][1] = 1;	m->mount_compass[2][2] = 1;
+	
+	m->accel_noise = 0.04;
+	m->gyro_noise = 0.003;
+	m->compass_noise = 0.002;
+	m->compass_field[0] = 0.20;
+	m->compass_field[1] = 0.0;
+	m->compass_field[2] = 0.45;
+	// control.c calibration, which reads the register Z pair as y
+	m->compass_offset[0] = -82.0;
+	m->compass_offset[1] = -283.0;
+	m->compass_offset[2] = 136.5;
+	// free-running RC oscillators drift against the MCU crystal
+	m->odr_ppm[0] = -800;
+	m->odr_ppm[1] = 1500;
+	m->odr_ppm[2] = 1200;
+	
+	m->adxl345_regs[ADXL345_RA_DEVID] = 0xE5;
+	m->adxl345_regs[ADXL345_RA_BW_RATE] = ADXL345_BW_100;
+	m->adxl345_regs[ADXL345_RA_FIFO_STATUS] = 0;
+	m->itg3200_regs[ITG3200_RA_WHO_AM_I] = I2C_ID_ITG3200;
+	m->hmc5883l_regs[HMC5883L_RA_CONFIG_A] = 0x10;
+	m->hmc5883l_regs[HMC5883L_RA_CONFIG_B] = HMC5883L_GAIN_1090;
+	m->hmc5883l_regs[HMC5883L_RA_MODE] = HMC5883L_MODE_SINGLE;
+	m->hmc5883l_regs[HMC5883L_RA_ID_A] = 'H';
+	m->hmc5883l_regs[HMC5883L_RA_ID_B] = '4';
+	m->hmc5883l_regs[HMC5883L_RA_ID_C] = '3';
+}
+
+/*
+ * @brief: ADXL345 output data rate from BW_RATE, 3200 Hz at code 0x0F
+ * @param[in]: model
+ * @param[out]: Hz, 0 below 6 Hz
+ */
+uint32_t imu_AccelODR(const imu_model *m) {
+	return 3200u >> (15 - (m->adxl345_regs[ADXL345_RA_BW_RATE] & 0x0F));
+}
+
+/*
+ * @brief: ITG3200 sample rate: 8 kHz internal with the 256 Hz filter, else
+ * 				1 kHz, divided by SMPLRT_DIV + 1
+ */
+uint32_t imu_GyroODR(const imu_model *m) {
+	uint32_t internal = (m->itg3200_regs[ITG3200_RA_DLPF_FS] & 0x07) == ITG3200_DLPF_FS_FILTER_256HZ ? 8000 : 1000;
+	
+	return internal / (m->itg3200_regs[ITG3200_RA_SMPLRT_DIV] + 1u);
+}
+
+/*
+ * @brief: HMC5883L continuous-mode rate from CONFIG_A; 0 in single/idle
+ * 				mode and for the fractional rates, which are not clocked
+ */
+uint32_t imu_CompassODR(const imu_model *m) {
+	static const uint32_t hz[8] = {0, 0, 3, 0, 15, 30, 75, 0};
+	
+	if (m->hmc5883l_regs[HMC5883L_RA_MODE] != HMC5883L_MODE_CONTINUOUS) return 0;
+	return hz[(m->hmc5883l_regs[HMC5883L_RA_CONFIG_A] >> 2) & 0x07];
+}
+
+/*
+ * @brief: One ADXL345 conversion: into the FIFO in stream mode (dropping the
+ * 				oldest entry when full), else the data registers and data ready
+ * @param[in]: model
+ * @param[out]: 1 if INT1 went high
+ */
+uint8_t imu_AccelSample(imu_model *m) {
+	uint8_t was = m->adxl345_int1;
+	
+	if (!(m->adxl345_regs[ADXL345_RA_POWER_CTL] & ADXL345_MEASURE_ENABLE)) return 0;
+	if (adxl345_Streaming(m)) {
+		if (m->adxl345_fifo_count == ADXL345_FIFO_SIZE) {
+			m->adxl345_fifo_head = (m->adxl345_fifo_head + 1) % ADXL345_FIFO_SIZE;
+			m->adxl345_fifo_count--;
+			m->adxl345_overruns++;
+		}
+		adxl345_Measure(m, m->adxl345_fifo[(m->adxl345_fifo_head + m->adxl345_fifo_count) % ADXL345_FIFO_SIZE]);
+		m->adxl345_fifo_count++;
+	} else {
+		if (m->free_run) {
+			adxl345_Measure(m, m->latest[0]);
+			imu_Convert(m, 0);
+		}
+		m->adxl345_regs[ADXL345_RA_INT_SOURCE] |= 1 << 7;
+	}
+	adxl345_Status(m);
+	return !was && m->adxl345_int1;
+}
+
+/*
+ * @brief: One ITG3200 sample: RAW_DATA_RDY and INT, which drops again at
+ * 				once unless latched (the 50 us pulse is below the sim resolution)
+ * @param[in]: model
+ * @param[out]: 1 if INT went high
+ */
+uint8_t imu_GyroSample(imu_model *m) {
+	uint8_t was = m->itg3200_int, rose;
+	
+	if (m->free_run) {
+		itg3200_Measure(m, m->latest[1]);
+		imu_Convert(m, 1);
+	}
+	m->itg3200_regs[ITG3200_RA_INT_STATUS] |= 0x01;
+	itg3200_Pin(m);
+	rose = !was && m->itg3200_int;
+	if (!(m->itg3200_regs[ITG3200_RA_INT_CFG] & ITG3200_INT_CFG_LATCH_INT_EN)) {
+		m->itg3200_regs[ITG3200_RA_INT_STATUS] &= ~0x01;
+		itg3200_Pin(m);
+	}
+	return rose;
+}
+
+/*
+ * @brief: One HMC5883L continuous-mode measurement, RDY set
+ * @param[in]: model
+ * @param[out]: 1 for the DRDY low pulse
+ */
+uint8_t imu_CompassSample(imu_model *m) {
+	if (m->hmc5883l_regs[HMC5883L_RA_MODE] != HMC5883L_MODE_CONTINUOUS) return 0;
+	if (m->free_run) {
+		hmc5883l_Measure(m, m->latest[2]);
+		imu_Convert(m, 2);
+	}
+	m->hmc5883l_regs[HMC5883L_RA_STATUS] |= 1 << HMC5883L_STATUS_READY_BIT;
+	return 1;
+}
+
+/*
+ * @brief: Put the three sensors on the host I2C bus
+ */
+void imu_Attach(imu_model *m) {
+	i2c_host_device dev;
+	
+	dev.ctx = m;
+	dev.id = I2C_ID_ADXL345;	dev.read = adxl345_Read;	dev.write = adxl345_Write;
+	i2c_HostAttach(&dev);
+	dev.id = I2C_ID_ITG3200;	dev.read = itg3200_Read;	dev.write = itg3200_Write;
+	i2c_HostAttach(&dev);
+	dev.id = I2C_ID_HMC5883L;	dev.read = hmc5883l_Read;	dev.write = hmc5883l_Write;
+	i2c_HostAttach(&dev);
+}
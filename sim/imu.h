@@ -0,0 +1,88 @@
+#ifndef _IMU_H_
+#define _IMU_H_
+
+#include <stdint.h>
+#include "quad.h"
+
+/*
+ * Register-level models of the ADXL345, ITG3200 and HMC5883L attached to the
+ * host I2C bus. Data registers are latched from the quad state when read, so
+ * the firmware drivers see exactly the byte layout of the real parts.
+ *
+ * With free_run set the parts convert on their own clocks instead, driven by
+ * sim timers at the rates their registers select (imu_*Sample), and a read
+ * returns the latest conversion. That makes the ADXL345 FIFO, the data-ready
+ * pins and stale or missed samples behave as on the bench; stream[] counts
+ * them and the age of each sample when its last byte leaves the part.
+ *
+ * mount_* map body FRD axes onto sensor axes. The defaults reproduce the
+ * sign conventions control.c assumes: accelerometer turned 180 deg about z,
+ * gyro and compass aligned with the body.
+ */
+
+typedef struct {
+	uint64_t	s;
+} sim_rng;
+
+typedef struct {
+	uint32_t	conversions;
+	uint32_t	fresh;																// reads returning a new conversion
+	uint32_t	stale;																// reads returning one already read
+	uint32_t	missed;																// conversions overwritten unread
+	uint64_t	age_sum_ns, age_max_ns;								// conversion to last data byte, fresh reads
+	uint64_t	t_conv_ns;														// latest conversion
+	uint64_t	t_regs_ns;														// conversion in the data registers
+	uint8_t		unread;
+} imu_stream;
+
+typedef struct {
+	const quad_state	*quad;
+	sim_rng						rng;
+	
+	int8_t		mount_accel[3][3];
+	int8_t		mount_gyro[3][3];
+	int8_t		mount_compass[3][3];
+	
+	double		accel_noise;													// m/s^2 rms
+	double		gyro_noise;														// rad/s rms
+	double		gyro_bias[3];													// rad/s
+	double		compass_noise;												// Gauss rms
+	double		compass_field[3];											// Earth field, Gauss, NED
+	double		compass_offset[3];										// hard iron, counts, sensor axes
+	
+	uint8_t		free_run;															// convert on the sim timers, not on each read
+	int32_t		odr_ppm[3];														// sensor clock error: accel, gyro, compass
+	
+	uint8_t		adxl345_regs[0x40];
+	uint8_t		itg3200_regs[0x40];
+	uint8_t		hmc5883l_regs[0x10];
+	
+	uint8_t		adxl345_fifo[32][6];									// ADXL345_FIFO_SIZE
+	uint8_t		adxl345_fifo_head, adxl345_fifo_count;
+	uint32_t	adxl345_overruns;											// entries lost to a full FIFO
+	uint8_t		adxl345_int1;													// INT1 pin level
+	uint8_t		*accel_int1;													// mirror of the pin, NULL if unwired
+	uint8_t		itg3200_int;													// INT pin level
+	uint8_t		*gyro_int;
+	uint8_t		latest[3][6];													// free-run conversions not yet in the registers
+	
+	imu_stream	stream[3];													// accel (not in FIFO mode), gyro, compass
+	
+	uint32_t	reads[3];															// data reads: accel, gyro, compass
+} imu_model;
+
+
+extern void		rng_Seed(sim_rng *r, uint64_t seed);
+extern double	rng_Uniform(sim_rng *r);
+extern double	rng_Gauss(sim_rng *r);
+
+extern void imu_Init(imu_model *m, const quad_state *quad, uint64_t seed);
+extern void imu_Attach(imu_model *m);
+extern uint32_t imu_AccelODR(const imu_model *m);
+extern uint32_t imu_GyroODR(const imu_model *m);
+extern uint32_t imu_CompassODR(const imu_model *m);
+extern uint8_t imu_AccelSample(imu_model *m);
+extern uint8_t imu_GyroSample(imu_model *m);
+extern uint8_t imu_CompassSample(imu_model *m);
+
+#endif
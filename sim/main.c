@@ -0,0 +1,208 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "control.h"
+#include "sensors.h"
+#include "telemetry.h"
+#include "tasks.h"
+#include "blackbox.h"
+#include "param.h"
+#include "hal_host.h"
+#include "sim.h"
+
+/*
+ * skyalpha_sim - fly the firmware control loop against the quad model.
+ *
+ *   -t <s>         flight duration, default 60
+ *   -n <runs>      number of flights, seeds seed..seed+runs-1, default 1
+ *   -s <seed>      default 1
+ *   --throttle <n> user torque sent over USB CDC at t=0, 0..__TORQUE_MAX
+ *   --tilt <deg>   initial roll and pitch
+ *   --gust <Nm>    rms disturbance torque
+ *   --quiet-imu    no sensor noise
+ *   --ahrs         quaternion AHRS instead of the per-axis Kalman filters
+ *   --steady-gain  Kalman filters switch to their steady-state gain once converged
+ *   --multirate    Kalman filters predict and correct on every sensor sample
+ *   --cascade      angle loop at the control tick over a rate loop per gyro sample
+ *   --rate-div <n> cascade rate loop on every n-th gyro sample, default __RATE_DIV
+ *   --frame <f>    airframe and mixer: x (default), plus, hex, octo
+ *   --accel-fifo   ADXL345 FIFO streaming instead of polled reads
+ *   --drdy         read the sensors on their data-ready interrupts
+ *   --isr          run the control tasks in TIMER1A instead of the main loop
+ *   --blackbox     flight data log in the telemetry stream (blackbox_dump decodes it)
+ *   --store <file> parameters from this store image (skyalpha_param writes one)
+ *   --csv <file>   trace of the first flight at control rate
+ *   --telemetry <file>  USB CDC output of the first flight (telem_dump decodes it)
+ *   --text         TELEM_TEXT lines instead of binary telemetry
+ */
+
+#define RAD2DEG			57.29577951308232
+
+
+static double wall_Seconds(void) {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static sim_world		w;
+static const char		*frame_names[MIXER_FRAMES] = {"x", "plus", "hex", "octo"};
+
+
+static void telemetry_Write(void *ctx, const uint8_t *data, uint16_t len) {
+	fwrite(data, 1, len, (FILE *)ctx);
+	w.serial_bytes += len;
+}
+
+static int frame_Parse(const char *name) {
+	uint8_t f;
+	
+	for (f = 0; f < MIXER_FRAMES; f++) {
+		if (!strcmp(name, frame_names[f])) {
+			control_frame = f;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static double angle_Diff(double a, double b) {
+	double d = fmod(a - b + 540.0, 360.0) - 180.0;
+	
+	return d;
+}
+
+int main(int argc, char **argv) {
+	double		duration = 60, tilt = 0, gust = 0;
+	uint32_t	runs = 1, run;
+	uint64_t	seed = 1;
+	int				throttle = -1, quiet = 0;
+	const char	*csv_name = NULL, *telem_name = NULL, *store_name = NULL;
+	FILE			*csv = NULL, *telem = NULL;
+	double		err2[3] = {0, 0, 0};
+	uint64_t	err_n = 0, steps = 0;
+	double		t0, wall;
+	int				i;
+	
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-t") && i + 1 < argc)								duration = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)					runs = (uint32_t)atol(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)					seed = strtoull(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "--throttle") && i + 1 < argc)	throttle = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--tilt") && i + 1 < argc)			tilt = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--gust") && i + 1 < argc)			gust = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--quiet-imu"))									quiet = 1;
+		else if (!strcmp(argv[i], "--ahrs"))											control_estimator = CONTROL_EST_AHRS;
+		else if (!strcmp(argv[i], "--steady-gain"))								kalman_gain_mode = KALMAN_GAIN_STEADY;
+		else if (!strcmp(argv[i], "--multirate"))									control_estimator = CONTROL_EST_MULTIRATE;
+		else if (!strcmp(argv[i], "--cascade"))										control_mode = CONTROL_CASCADE;
+		else if (!strcmp(argv[i], "--rate-div") && i + 1 < argc)	control_rate_div = (uint16_t)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--frame") && i + 1 < argc && frame_Parse(argv[i + 1]))	i++;
+		else if (!strcmp(argv[i], "--accel-fifo"))								sensors_accel_mode = SENSORS_ACCEL_FIFO;
+		else if (!strcmp(argv[i], "--drdy"))											sensors_acq = SENSORS_ACQ_DRDY;
+		else if (!strcmp(argv[i], "--isr"))												task_mode = TASKS_ISR;
+		else if (!strcmp(argv[i], "--blackbox"))									blackbox_mode = BLACKBOX_ON;
+		else if (!strcmp(argv[i], "--store") && i + 1 < argc)			store_name = argv[++i];
+		else if (!strcmp(argv[i], "--csv") && i + 1 < argc)				csv_name = argv[++i];
+		else if (!strcmp(argv[i], "--telemetry") && i + 1 < argc)	telem_name = argv[++i];
+		else if (!strcmp(argv[i], "--text"))											telem_mode = TELEM_TEXT;
+		else {
+			fprintf(stderr, "usage: %s [-t s] [-n runs] [-s seed] [--throttle n] [--tilt deg] [--gust Nm] [--quiet-imu] [--ahrs] [--steady-gain] [--multirate] [--cascade] [--rate-div n] [--frame x|plus|hex|octo] [--accel-fifo] [--drdy] [--csv file] [--telemetry file] [--text] [--blackbox] [--store file]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (store_name != NULL) {
+		hal_host_store_path = store_name;
+		if (param_Load() != PARAM_OK) {
+			fprintf(stderr, "%s: no valid parameter image\n", store_name);
+			return 1;
+		}
+	}
+	if (csv_name != NULL) {
+		csv = fopen(csv_name, "w");
+		if (csv == NULL) {
+			perror(csv_name);
+			return 1;
+		}
+		fprintf(csv, "t,roll,pitch,yaw,roll_est,pitch_est,yaw_est,alt,m0,m1,m2,m3\n");
+	}
+	if (telem_name != NULL) {
+		telem = fopen(telem_name, "wb");
+		if (telem == NULL) {
+			perror(telem_name);
+			return 1;
+		}
+	}
+	
+	t0 = wall_Seconds();
+	for (run = 0; run < runs; run++) {
+		uint64_t n = (uint64_t)(duration * SIM_RATE + 0.5), k;
+		
+		sim_Init(&w, seed + run);
+		if (telem != NULL && run == 0) hal_HostSerialSink(telemetry_Write, telem);
+		w.gust = gust;
+		if (quiet) {
+			w.imu.accel_noise = 0;
+			w.imu.gyro_noise = 0;
+			w.imu.compass_noise = 0;
+		}
+		quad_SetEuler(&w.quad, tilt / RAD2DEG, tilt / RAD2DEG, 0);
+		if (throttle >= 0) {
+			char cmd[16];
+			
+			sprintf(cmd, "%d", throttle);
+			sim_Command(&w, cmd);
+		}
+		
+		for (k = 1; k <= n; k++) {
+			sim_Step(&w);
+			if (k % (SIM_RATE / 100) == 0) {
+				double r, p, y;
+				
+				quad_Euler(&w.quad, &r, &p, &y);
+				r *= RAD2DEG;
+				p *= RAD2DEG;
+				y *= RAD2DEG;
+				// estimator error once the filters have settled
+				if (k >= 5 * SIM_RATE) {
+					err2[0] += angle_Diff(roll, r) * angle_Diff(roll, r);
+					err2[1] += angle_Diff(pitch, p) * angle_Diff(pitch, p);
+					err2[2] += angle_Diff(yaw, y) * angle_Diff(yaw, y);
+					err_n++;
+				}
+				if (csv != NULL && run == 0) {
+					fprintf(csv, "%.2f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%u,%u,%u,%u\n", k / (double)SIM_RATE,
+								r, p, y, roll, pitch, yaw, -w.quad.pos[2], torque[0], torque[1], torque[2], torque[3]);
+				}
+			}
+		}
+		if (blackbox_mode == BLACKBOX_ON) {
+			// last partial block out, recording on again for the next flight
+			blackbox_Stop();
+			while (task_RunNext());
+			blackbox_mode = BLACKBOX_ON;
+		}
+		steps += w.steps;
+	}
+	wall = wall_Seconds() - t0;
+	if (csv != NULL) fclose(csv);
+	if (telem != NULL) fclose(telem);
+	
+	printf("flights:             %u\n", runs);
+	printf("sim_seconds:         %.1f\n", duration * runs);
+	printf("sim_steps:           %llu\n", (unsigned long long)steps);
+	printf("wall_seconds:        %.3f\n", wall);
+	printf("sim_steps_per_sec:   %.0f\n", steps / wall);
+	printf("realtime_factor:     %.0f\n", duration * runs / wall);
+	if (err_n) {
+		printf("est_rms_roll_deg:    %.3f\n", sqrt(err2[0] / err_n));
+		printf("est_rms_pitch_deg:   %.3f\n", sqrt(err2[1] / err_n));
+		printf("est_rms_yaw_deg:     %.3f\n", sqrt(err2[2] / err_n));
+	}
+	return 0;
+}
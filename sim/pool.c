@@ -0,0 +1,166 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "pool.h"
+
+
+typedef struct {
+	uint64_t		range __attribute__((aligned(64)));		// end << 32 | begin
+	uint64_t		jobs, steals;
+	double			busy;
+} pool_queue;
+
+
+static double pool_Seconds(void) {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline uint64_t pool_Range(uint32_t begin, uint32_t end) {
+	return (uint64_t)end << 32 | begin;
+}
+
+/*
+ * @brief: Next job from the front of our own range
+ * @param[in]: queue
+ * @param[out]: 1 and the job, 0 if the range is empty
+ */
+static int pool_Take(pool_queue *q, uint32_t *job) {
+	uint64_t r = __atomic_load_n(&q->range, __ATOMIC_ACQUIRE);
+	
+	while ((uint32_t)r < (uint32_t)(r >> 32)) {
+		if (__atomic_compare_exchange_n(&q->range, &r, r + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			*job = (uint32_t)r;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * @brief: Move the back half of the fullest other range into ours, which is
+ * 				empty and so touched by nobody else
+ * @param[in]: queues, workers, our index
+ * @param[out]: 1 if something was stolen, 0 if every range is empty
+ */
+static int pool_Steal(pool_queue *q, uint32_t workers, uint32_t self) {
+	for (;;) {
+		uint32_t i, victim = self, most = 0;
+		uint64_t r;
+		
+		for (i = 0; i < workers; i++) {
+			uint64_t v = __atomic_load_n(&q[i].range, __ATOMIC_RELAXED);
+			uint32_t left = (uint32_t)(v >> 32) - (uint32_t)v;
+			
+			if (i != self && (uint32_t)v < (uint32_t)(v >> 32) && left > most) {
+				most = left;
+				victim = i;
+			}
+		}
+		if (victim == self) return 0;
+		
+		r = __atomic_load_n(&q[victim].range, __ATOMIC_ACQUIRE);
+		while ((uint32_t)r < (uint32_t)(r >> 32)) {
+			uint32_t begin = (uint32_t)r, end = (uint32_t)(r >> 32), mid = begin + (end - begin) / 2;
+			
+			if (__atomic_compare_exchange_n(&q[victim].range, &r, pool_Range(begin, mid), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				__atomic_store_n(&q[self].range, pool_Range(mid, end), __ATOMIC_RELEASE);
+				q[self].steals++;
+				return 1;
+			}
+		}
+	}
+}
+
+static void pool_Worker(pool_queue *q, uint32_t workers, uint32_t self, pool_job fn, void *ctx,
+												uint8_t *results, size_t result_size) {
+	uint32_t job;
+	
+	do {
+		while (pool_Take(&q[self], &job)) {
+			double t0 = pool_Seconds();
+			
+			fn(ctx, job, results + (size_t)job * result_size);
+			q[self].busy += pool_Seconds() - t0;
+			q[self].jobs++;
+		}
+	} while (pool_Steal(q, workers, self));
+}
+
+/*
+ * @brief: Online cores
+ */
+uint32_t pool_Cores(void) {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	
+	return n < 1 ? 1 : n > POOL_WORKERS_MAX ? POOL_WORKERS_MAX : (uint32_t)n;
+}
+
+/*
+ * @brief: Run jobs 0..jobs-1 on forked workers, collect their results; the
+ * 				caller's own state is left as it was
+ * @param[in]: workers (0: one per core), jobs, job function and its context,
+ * 				result array and element size
+ * @param[out]: results filled in, stats if not NULL; 0, -1 if a worker could
+ * 				not be started or died
+ */
+int pool_Run(uint32_t workers, uint32_t jobs, pool_job fn, void *ctx,
+							void *results, size_t result_size, pool_stats *st) {
+	size_t qsize = sizeof(pool_queue) * POOL_WORKERS_MAX;
+	size_t size = qsize + (size_t)jobs * result_size;
+	pid_t pid[POOL_WORKERS_MAX];
+	pool_queue *q;
+	uint32_t i, started = 0;
+	double t0;
+	int status, err = 0;
+	
+	if (workers == 0) workers = pool_Cores();
+	if (workers > POOL_WORKERS_MAX) workers = POOL_WORKERS_MAX;
+	q = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (q == MAP_FAILED) return -1;
+	
+	// contiguous starting ranges, stealing evens them out
+	for (i = 0; i < workers; i++) {
+		q[i].range = pool_Range((uint32_t)((uint64_t)jobs * i / workers), (uint32_t)((uint64_t)jobs * (i + 1) / workers));
+	}
+	fflush(NULL);
+	t0 = pool_Seconds();
+	for (i = 0; i < workers; i++) {
+		pid[i] = fork();
+		if (pid[i] < 0) {
+			err = -1;
+			break;
+		}
+		if (pid[i] == 0) {
+			pool_Worker(q, workers, i, fn, ctx, (uint8_t *)q + qsize, result_size);
+			_exit(0);
+		}
+		started++;
+	}
+	// with a worker missing its range is still stolen by the others
+	for (i = 0; i < started; i++) {
+		if (waitpid(pid[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) err = -1;
+	}
+	if (started == 0) err = -1;
+	
+	if (st != NULL) {
+		memset(st, 0, sizeof(*st));
+		st->workers = workers;
+		st->wall = pool_Seconds() - t0;
+		for (i = 0; i < workers; i++) {
+			st->jobs[i] = q[i].jobs;
+			st->steals[i] = q[i].steals;
+			st->busy[i] = q[i].busy;
+		}
+	}
+	memcpy(results, (uint8_t *)q + qsize, (size_t)jobs * result_size);
+	munmap(q, size);
+	return err;
+}
@@ -0,0 +1,41 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Work-stealing pool for independent jobs 0..jobs-1 on every host core.
+ *
+ * The flight code keeps its state in globals, as on the target, so two
+ * flights cannot share an address space: workers are forked processes, each
+ * with its own copy of the firmware and simulator state. What they share is
+ * one anonymous mapping with the results and the work queues.
+ *
+ * Each worker owns a range [begin, end) of job indices packed into one
+ * 64-bit word. It takes jobs from the front with a CAS; a worker whose range
+ * is empty picks the victim with the most left and CASes away the back half
+ * into its own range. Every queue operation is a single CAS on a single
+ * word, so it is lock-free across processes. Each job runs exactly once and
+ * writes result_size bytes at results + job * result_size.
+ */
+
+#define POOL_WORKERS_MAX				256
+
+
+typedef void (*pool_job)(void *ctx, uint32_t job, void *result);
+
+typedef struct {
+	uint32_t		workers;
+	double			wall;																// seconds, fork to last exit
+	uint64_t		jobs[POOL_WORKERS_MAX];							// run by each worker
+	uint64_t		steals[POOL_WORKERS_MAX];						// ranges taken from others
+	double			busy[POOL_WORKERS_MAX];							// seconds inside jobs
+} pool_stats;
+
+
+extern uint32_t	pool_Cores(void);
+extern int			pool_Run(uint32_t workers, uint32_t jobs, pool_job fn, void *ctx,
+												void *results, size_t result_size, pool_stats *st);
+
+#endif
@@ -0,0 +1,201 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "quad.h"
+
+
+/*
+ * @brief: 1 kg, 450 mm X quad; motor order matches torque[0..3] in control.c
+ * 				0 rear-left, 1 front-left, 2 rear-right, 3 front-right
+ * @param[in]: ptr to params
+ * @param[out]: none
+ */
+void quad_DefaultParams(quad_params *p) {
+	const double arm = 0.225 * 0.70710678;
+	
+	memset(p, 0, sizeof(*p));
+	p->mass = 1.0;
+	p->I[0] = 0.0095;
+	p->I[1] = 0.0095;
+	p->I[2] = 0.0186;
+	p->omega_max = 1000.0;
+	p->kT = p->mass * QUAD_G / (p->omega_max * p->omega_max);		// 4*kT*(omega_max/2)^2 = m*g: hover at half speed
+	p->kQ = p->kT * 0.016;
+	p->tau_motor = 0.04;
+	p->drag = 0.25;
+	p->motors = 4;
+	p->motor_x[0] = -arm;	p->motor_y[0] = -arm;	p->motor_dir[0] = +1;
+	p->motor_x[1] = +arm;	p->motor_y[1] = -arm;	p->motor_dir[1] = -1;
+	p->motor_x[2] = -arm;	p->motor_y[2] = +arm;	p->motor_dir[2] = -1;
+	p->motor_x[3] = +arm;	p->motor_y[3] = +arm;	p->motor_dir[3] = +1;
+}
+
+/*
+ * @brief: The default quad's motors and arms, n of them on the same 225 mm
+ * 				circle; mass and inertia scale with n, so it still hovers at half
+ * 				speed
+ * @param[in]: ptr to params, motor count, angle of each motor from the nose
+ * 				towards the right arm (deg), spin (+1 clockwise seen from above)
+ * @param[out]: none
+ */
+void quad_RingParams(quad_params *p, uint8_t motors, const double *angle_deg, const int8_t *dir) {
+	const double radius = 0.225, deg = 3.14159265358979 / 180.0;
+	double k = motors / 4.0;
+	uint8_t i;
+	
+	quad_DefaultParams(p);
+	p->mass *= k;
+	for (i = 0; i < 3; i++) p->I[i] *= k;
+	p->motors = motors;
+	for (i = 0; i < motors; i++) {
+		p->motor_x[i] = radius * cos(angle_deg[i] * deg);
+		p->motor_y[i] = radius * sin(angle_deg[i] * deg);
+		p->motor_dir[i] = dir[i];
+	}
+}
+
+/*
+ * @brief: Level, at rest on the ground, motors stopped
+ */
+void quad_Reset(quad_state *s, const quad_params *p) {
+	(void)p;
+	memset(s, 0, sizeof(*s));
+	s->q[0] = 1.0;
+	s->on_ground = 1;
+	s->specific_force[2] = -QUAD_G;
+}
+
+/*
+ * @brief: Set attitude from ZYX Euler angles, rad
+ */
+void quad_SetEuler(quad_state *s, double roll, double pitch, double yaw) {
+	double cr = cos(roll/2), sr = sin(roll/2);
+	double cp = cos(pitch/2), sp = sin(pitch/2);
+	double cy = cos(yaw/2), sy = sin(yaw/2);
+	
+	s->q[0] = cr*cp*cy + sr*sp*sy;
+	s->q[1] = sr*cp*cy - cr*sp*sy;
+	s->q[2] = cr*sp*cy + sr*cp*sy;
+	s->q[3] = cr*cp*sy - sr*sp*cy;
+}
+
+/*
+ * @brief: ZYX Euler angles of the attitude, rad
+ */
+void quad_Euler(const quad_state *s, double *roll, double *pitch, double *yaw) {
+	const double *q = s->q;
+	double sp = 2*(q[0]*q[2] - q[3]*q[1]);
+	
+	if (sp > 1) sp = 1;
+	if (sp < -1) sp = -1;
+	*roll = atan2(2*(q[0]*q[1] + q[2]*q[3]), 1 - 2*(q[1]*q[1] + q[2]*q[2]));
+	*pitch = asin(sp);
+	*yaw = atan2(2*(q[0]*q[3] + q[1]*q[2]), 1 - 2*(q[2]*q[2] + q[3]*q[3]));
+}
+
+void quad_BodyToWorld(const quad_state *s, const double b[3], double w[3]) {
+	const double *q = s->q;
+	
+	w[0] = (1 - 2*(q[2]*q[2] + q[3]*q[3]))*b[0] + 2*(q[1]*q[2] - q[0]*q[3])*b[1] + 2*(q[1]*q[3] + q[0]*q[2])*b[2];
+	w[1] = 2*(q[1]*q[2] + q[0]*q[3])*b[0] + (1 - 2*(q[1]*q[1] + q[3]*q[3]))*b[1] + 2*(q[2]*q[3] - q[0]*q[1])*b[2];
+	w[2] = 2*(q[1]*q[3] - q[0]*q[2])*b[0] + 2*(q[2]*q[3] + q[0]*q[1])*b[1] + (1 - 2*(q[1]*q[1] + q[2]*q[2]))*b[2];
+}
+
+void quad_WorldToBody(const quad_state *s, const double w[3], double b[3]) {
+	const double *q = s->q;
+	
+	b[0] = (1 - 2*(q[2]*q[2] + q[3]*q[3]))*w[0] + 2*(q[1]*q[2] + q[0]*q[3])*w[1] + 2*(q[1]*q[3] - q[0]*q[2])*w[2];
+	b[1] = 2*(q[1]*q[2] - q[0]*q[3])*w[0] + (1 - 2*(q[1]*q[1] + q[3]*q[3]))*w[1] + 2*(q[2]*q[3] + q[0]*q[1])*w[2];
+	b[2] = 2*(q[1]*q[3] + q[0]*q[2])*w[0] + 2*(q[2]*q[3] - q[0]*q[1])*w[1] + (1 - 2*(q[1]*q[1] + q[2]*q[2]))*w[2];
+}
+
+/*
+ * @brief: Advance motors and rigid body by dt (semi-implicit Euler)
+ * @param[in]: state, params, step in seconds
+ * @param[out]: none
+ */
+void quad_Step(quad_state *s, const quad_params *p, double dt) {
+	double thrust = 0;
+	double tau[3];
+	double f_body[3], f_world[3], acc[3];
+	double Iw[3], wdot[3];
+	double *q = s->q;
+	double dq[4], n;
+	double alpha = dt / (p->tau_motor + dt);
+	uint8_t i;
+	
+	tau[0] = s->torque_ext[0];
+	tau[1] = s->torque_ext[1];
+	tau[2] = s->torque_ext[2];
+	
+	for (i = 0; i < p->motors; i++) {
+		double t = s->throttle[i];
+		double T;
+		
+		if (t < 0) t = 0;
+		if (t > 1) t = 1;
+		s->omega[i] += (t * p->omega_max - s->omega[i]) * alpha;
+		T = p->kT * s->omega[i] * s->omega[i];
+		thrust += T;
+		// thrust along -z at (x, y): r x F = (-y*T, x*T, 0)
+		tau[0] += -p->motor_y[i] * T;
+		tau[1] +=  p->motor_x[i] * T;
+		tau[2] += -p->motor_dir[i] * p->kQ * s->omega[i] * s->omega[i];
+	}
+	
+	// Translational: thrust + drag + disturbance + gravity
+	f_body[0] = 0;
+	f_body[1] = 0;
+	f_body[2] = -thrust;
+	quad_BodyToWorld(s, f_body, f_world);
+	for (i = 0; i < 3; i++) {
+		f_world[i] += s->force_ext[i] - p->drag * s->vel[i];
+		acc[i] = f_world[i] / p->mass;
+	}
+	acc[2] += QUAD_G;
+	
+	if (s->on_ground && acc[2] >= 0) {
+		// resting on the ground: normal force cancels everything, attitude held
+		memset(s->vel, 0, sizeof(s->vel));
+		memset(s->w, 0, sizeof(s->w));
+		s->pos[2] = 0;
+		f_world[0] = 0;
+		f_world[1] = 0;
+		f_world[2] = -QUAD_G * p->mass;
+		quad_WorldToBody(s, f_world, s->specific_force);
+		for (i = 0; i < 3; i++) s->specific_force[i] /= p->mass;
+		return;
+	}
+	s->on_ground = 0;
+	
+	for (i = 0; i < 3; i++) {
+		s->vel[i] += acc[i] * dt;
+		s->pos[i] += s->vel[i] * dt;
+	}
+	if (s->pos[2] >= 0) {
+		s->pos[2] = 0;
+		s->on_ground = 1;
+	}
+	
+	quad_WorldToBody(s, f_world, s->specific_force);
+	for (i = 0; i < 3; i++) s->specific_force[i] /= p->mass;
+	
+	// Rotational: I*wdot = tau - w x (I*w)
+	Iw[0] = p->I[0] * s->w[0];
+	Iw[1] = p->I[1] * s->w[1];
+	Iw[2] = p->I[2] * s->w[2];
+	wdot[0] = (tau[0] - (s->w[1]*Iw[2] - s->w[2]*Iw[1])) / p->I[0];
+	wdot[1] = (tau[1] - (s->w[2]*Iw[0] - s->w[0]*Iw[2])) / p->I[1];
+	wdot[2] = (tau[2] - (s->w[0]*Iw[1] - s->w[1]*Iw[0])) / p->I[2];
+	for (i = 0; i < 3; i++) s->w[i] += wdot[i] * dt;
+	
+	// q' = 1/2 q (x) (0, w)
+	dq[0] = 0.5 * (-q[1]*s->w[0] - q[2]*s->w[1] - q[3]*s->w[2]);
+	dq[1] = 0.5 * ( q[0]*s->w[0] + q[2]*s->w[2] - q[3]*s->w[1]);
+	dq[2] = 0.5 * ( q[0]*s->w[1] - q[1]*s->w[2] + q[3]*s->w[0]);
+	dq[3] = 0.5 * ( q[0]*s->w[2] + q[1]*s->w[1] - q[2]*s->w[0]);
+	for (i = 0; i < 4; i++) q[i] += dq[i] * dt;
+	n = 1.0 / sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+	for (i = 0; i < 4; i++) q[i] *= n;
+}
@@ -0,0 +1,54 @@
+#ifndef _QUAD_H_
+#define _QUAD_H_
+
+#include <stdint.h>
+
+/*
+ * Rigid-body multirotor with first-order motor/ESC lag.
+ *
+ * World frame is NED, body frame is FRD (x forward, y right, z down).
+ * q is the body->world attitude quaternion (w, x, y, z).
+ */
+
+#define QUAD_MOTORS_MAX							8
+#define QUAD_G											9.80665
+
+
+typedef struct {
+	double		mass;																	// kg
+	double		I[3];																	// principal inertia, kg*m^2
+	double		kT;																		// thrust, N/(rad/s)^2
+	double		kQ;																		// rotor drag torque, N*m/(rad/s)^2
+	double		omega_max;														// motor speed at full throttle, rad/s
+	double		tau_motor;														// ESC + motor time constant, s
+	double		drag;																	// linear airframe drag, N/(m/s)
+	uint8_t		motors;
+	double		motor_x[QUAD_MOTORS_MAX];							// arm position in body frame, m
+	double		motor_y[QUAD_MOTORS_MAX];
+	int8_t		motor_dir[QUAD_MOTORS_MAX];						// +1 = clockwise seen from above
+} quad_params;
+
+typedef struct {
+	double		pos[3];																// m, NED
+	double		vel[3];																// m/s, NED
+	double		q[4];
+	double		w[3];																	// body rates, rad/s
+	double		omega[QUAD_MOTORS_MAX];								// rad/s
+	double		throttle[QUAD_MOTORS_MAX];						// ESC command, 0..1
+	double		force_ext[3];													// disturbance force, N, world
+	double		torque_ext[3];												// disturbance torque, N*m, body
+	double		specific_force[3];										// what an accelerometer feels, m/s^2, body
+	uint8_t		on_ground;
+} quad_state;
+
+
+extern void quad_DefaultParams(quad_params *p);
+extern void quad_RingParams(quad_params *p, uint8_t motors, const double *angle_deg, const int8_t *dir);
+extern void quad_Reset(quad_state *s, const quad_params *p);
+extern void quad_SetEuler(quad_state *s, double roll, double pitch, double yaw);
+extern void quad_Euler(const quad_state *s, double *roll, double *pitch, double *yaw);
+extern void quad_BodyToWorld(const quad_state *s, const double b[3], double w[3]);
+extern void quad_WorldToBody(const quad_state *s, const double w[3], double b[3]);
+extern void quad_Step(quad_state *s, const quad_params *p, double dt);
+
+#endif
@@ -0,0 +1,239 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "hal_host.h"
+#include "sensors.h"
+#include "control.h"
+#include "tasks.h"
+#include "prof.h"
+#include "blackbox.h"
+
+#include "sim.h"
+
+
+typedef struct {
+	uint8_t		motors;
+	double		angle[QUAD_MOTORS_MAX];										// deg from the nose, towards the right arm
+	int8_t		dir[QUAD_MOTORS_MAX];
+} sim_frame;
+
+// airframes in mixer.c's motor order; MIXER_QUAD_X and MIXER_CUSTOM fly the
+// default quad (quad_DefaultParams)
+static const sim_frame sim_frames[MIXER_FRAMES] = {
+	{0, {0}, {0}},
+	{4, {0, 90, 180, 270}, {+1, -1, +1, -1}},
+	{6, {30, 90, 150, 210, 270, 330}, {+1, -1, +1, -1, +1, -1}},
+	{8, {22.5, 67.5, 112.5, 157.5, 202.5, 247.5, 292.5, 337.5}, {+1, -1, +1, -1, +1, -1, +1, -1}},
+};
+
+
+static void sim_Serial(void *ctx, const uint8_t *data, uint16_t len) {
+	sim_world *w = ctx;
+	
+	(void)data;
+	w->serial_bytes += len;
+}
+
+/*
+ * TIMER1A_Handler / TIMER2A_Handler in main.c
+ */
+static void sim_Timer1A(void *ctx) {
+	(void)ctx;
+	control_Update();
+	hal_TimerAck(HAL_TIMER_CONTROL);
+}
+
+static void sim_Timer2A(void *ctx) {
+	uint32_t t = prof_Begin();
+	
+	(void)ctx;
+	sensors_Poll();
+	prof_End(PROF_SENSORS, t);
+	hal_TimerAck(HAL_TIMER_SENSORS);
+}
+
+/*
+ * GPIOPortE_Handler in main.c, entered on an edge of an enabled line
+ */
+static void sim_GPIOPortE(uint8_t line) {
+	static const uint8_t sensor[HAL_EXTI_LINES] = {__MEASURE_ACCELEROMETER, __MEASURE_GYROSCOPE, __MEASURE_COMPASS};
+	uint8_t i;
+	
+	if (!hal_host_exti_enabled[line]) return;
+	hal_host_exti_pending[line] = 1;
+	for (i = 0; i < HAL_EXTI_LINES; i++) {
+		if (hal_ExtIntPending(i)) {
+			hal_ExtIntAck(i);
+			sensors_DataReady(sensor[i]);
+		}
+	}
+}
+
+/*
+ * Sensor conversion clocks
+ */
+static void sim_AccelODR(void *ctx) {
+	sim_world *w = ctx;
+	
+	if (imu_AccelSample(&w->imu)) sim_GPIOPortE(HAL_EXTI_ACCEL);
+}
+
+static void sim_GyroODR(void *ctx) {
+	sim_world *w = ctx;
+	
+	if (imu_GyroSample(&w->imu)) sim_GPIOPortE(HAL_EXTI_GYRO);
+}
+
+static void sim_CompassODR(void *ctx) {
+	sim_world *w = ctx;
+	
+	if (imu_CompassSample(&w->imu)) sim_GPIOPortE(HAL_EXTI_COMPASS);
+}
+
+/*
+ * @brief: Sensor clock at the rate its registers select, 0 leaves it off
+ */
+static void sim_AddSensor(sim_world *w, uint32_t hz, int32_t ppm, sim_isr isr) {
+	sim_timer *t;
+	
+	if (!hz) return;
+	t = sim_AddTimer(w, hz, isr, w);
+	if (t != NULL) t->ppm = ppm;
+}
+
+/*
+ * @brief: Time of a timer's next interrupt
+ */
+static uint64_t sim_Due(const sim_timer *t) {
+	if (!t->ppm) return t->count * 1000000000ull / t->hz;
+	return (uint64_t)((double)t->count * 1e9 / (t->hz * (1.0 + t->ppm * 1e-6)));
+}
+
+/*
+ * @brief: Fresh world: quad (the control_frame airframe) on the ground, sensors
+ * 				on the bus, firmware booted
+ * @param[in]: world, seed for sensor noise and disturbances
+ * @param[out]: none
+ */
+void sim_Init(sim_world *w, uint64_t seed) {
+	memset(w, 0, sizeof(*w));
+	if (control_frame < MIXER_FRAMES && sim_frames[control_frame].motors) {
+		quad_RingParams(&w->params, sim_frames[control_frame].motors, sim_frames[control_frame].angle, sim_frames[control_frame].dir);
+	} else {
+		quad_DefaultParams(&w->params);
+	}
+	quad_Reset(&w->quad, &w->params);
+	imu_Init(&w->imu, &w->quad, seed);
+	rng_Seed(&w->rng, seed ^ 0x5A5A5A5Aull);
+	w->gust_tau = 0.5;
+	
+	hal_HostReset();
+	hal_HostSerialSink(sim_Serial, w);
+	i2c_HostDetachAll();
+	imu_Attach(&w->imu);
+	w->imu.free_run = 1;
+	w->imu.accel_int1 = &hal_host_exti_level[HAL_EXTI_ACCEL];
+	w->imu.gyro_int = &hal_host_exti_level[HAL_EXTI_GYRO];
+	
+	// main(): timers first, so the interrupt order below matches NVIC priority
+	sim_AddTimer(w, 100, sim_Timer1A, NULL);
+	sim_AddTimer(w, SENSORS_TICK_HZ, sim_Timer2A, NULL);
+	prof_Init();
+	task_Init();
+	blackbox_Init();
+	sensors_Init();
+	control_Init();
+	// the sensors free-run at the rates sensors_Init configured
+	sim_AddSensor(w, imu_AccelODR(&w->imu), w->imu.odr_ppm[0], sim_AccelODR);
+	sim_AddSensor(w, imu_GyroODR(&w->imu), w->imu.odr_ppm[1], sim_GyroODR);
+	sim_AddSensor(w, imu_CompassODR(&w->imu), w->imu.odr_ppm[2], sim_CompassODR);
+}
+
+/*
+ * @brief: Register a periodic interrupt; same-time timers fire in order added
+ * @param[in]: world, rate, handler and its argument
+ * @param[out]: the timer, NULL if SIM_TIMERS_MAX are in use
+ */
+sim_timer *sim_AddTimer(sim_world *w, uint32_t hz, sim_isr isr, void *ctx) {
+	sim_timer *t;
+	
+	if (w->timers_count >= SIM_TIMERS_MAX) return NULL;
+	t = &w->timers[w->timers_count++];
+	t->isr = isr;
+	t->ctx = ctx;
+	t->hz = hz;
+	t->ppm = 0;
+	t->count = 1;
+	return t;
+}
+
+/*
+ * @brief: Send a NUL-terminated command as if typed on the USB CDC port
+ */
+void sim_Command(sim_world *w, const char *cmd) {
+	(void)w;
+	hal_HostSerialInject((const uint8_t *)cmd, (uint16_t)(strlen(cmd) + 1));
+}
+
+/*
+ * @brief: One physics step, then every timer interrupt that came due, each
+ * 				followed by the tasks it posted
+ * @param[in]: world
+ * @param[out]: none
+ */
+void sim_Step(sim_world *w) {
+	const double dt = 1.0 / SIM_RATE;
+	double pwm_msec = (double)hal_PWMMsec();
+	double a;
+	uint8_t i;
+	
+	// the ESCs take a new pulse width once per PWM frame
+	if (w->steps % (SIM_RATE / HAL_PWM_HZ) == 0) {
+		for (i = 0; i < w->params.motors && i < HAL_PWM_CHANNELS; i++) {
+			w->quad.throttle[i] = ((double)hal_host_pwm[i] - pwm_msec) / pwm_msec;
+		}
+	}
+	
+	if (w->gust > 0) {
+		// first-order Gauss-Markov torque
+		a = dt / w->gust_tau;
+		for (i = 0; i < 3; i++) {
+			w->quad.torque_ext[i] += a * (w->gust * sqrt(2.0 / a) * rng_Gauss(&w->rng) - w->quad.torque_ext[i]);
+		}
+	}
+	
+	quad_Step(&w->quad, &w->params, dt);
+	w->steps++;
+	w->time_ns = w->steps * 1000000000ull / SIM_RATE;
+	
+	// timer interrupts due in this step, in time order; I2C transfers run on
+	// bus time in between, so each ISR sees the bus as it is at its own instant
+	for (;;) {
+		sim_timer *next = NULL;
+		uint64_t due = 0;
+		
+		for (i = 0; i < w->timers_count; i++) {
+			sim_timer *t = &w->timers[i];
+			uint64_t d = sim_Due(t);
+			
+			if (d <= w->time_ns && (next == NULL || d < due)) {
+				next = t;
+				due = d;
+			}
+		}
+		if (next == NULL) break;
+		i2c_HostMockRun(due);
+		next->isr(next->ctx);
+		next->count++;
+		// main loop, taking no time, before the next interrupt
+		while (task_RunNext());
+	}
+	i2c_HostMockRun(w->time_ns);
+}
+
+void sim_Run(sim_world *w, double seconds) {
+	uint64_t n = (uint64_t)(seconds * SIM_RATE + 0.5);
+	
+	while (n--) sim_Step(w);
+}
@@ -0,0 +1,55 @@
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <stdint.h>
+#include "quad.h"
+#include "imu.h"
+
+/*
+ * Software-in-the-loop harness: steps the quad model at SIM_RATE and fires
+ * the firmware timer handlers at their hardware rates against the host HAL.
+ * Interrupts fire at their exact times within a step, with the mock I2C bus
+ * and hal_Micros() advanced to that instant. The sensors convert on their own
+ * timers, off by their clock error, and raise the GPIO interrupt lines.
+ * The main loop (task_RunNext) runs after every interrupt and takes no
+ * simulated time.
+ */
+
+#define SIM_RATE										1200			// physics steps per second
+#define SIM_TIMERS_MAX							8
+
+
+typedef void (*sim_isr)(void *ctx);
+
+typedef struct {
+	sim_isr		isr;
+	void			*ctx;
+	uint32_t	hz;
+	int32_t		ppm;																// clock error, + runs fast
+	uint64_t	count;
+} sim_timer;
+
+typedef struct {
+	quad_params		params;
+	quad_state		quad;
+	imu_model			imu;
+	sim_rng				rng;
+	
+	uint64_t			steps;
+	uint64_t			time_ns;
+	sim_timer			timers[SIM_TIMERS_MAX];
+	uint8_t				timers_count;
+	
+	double				gust;																// disturbance torque rms, N*m
+	double				gust_tau;														// disturbance correlation time, s
+	uint32_t			serial_bytes;
+} sim_world;
+
+
+extern void sim_Init(sim_world *w, uint64_t seed);
+extern sim_timer *sim_AddTimer(sim_world *w, uint32_t hz, sim_isr isr, void *ctx);
+extern void sim_Command(sim_world *w, const char *cmd);
+extern void sim_Step(sim_world *w);
+extern void sim_Run(sim_world *w, double seconds);
+
+#endif
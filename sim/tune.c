@@ -0,0 +1,344 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "control.h"
+#include "param.h"
+#include "sim.h"
+#include "pool.h"
+
+/*
+ * skyalpha_tune - Monte-Carlo search over the PID gains and the Kalman noise
+ * constants, every candidate flown on the same randomized flights.
+ *
+ *   -c <n>         candidates, the first is the compiled-in defaults; default 64
+ *   -f <n>         flights per candidate, default 4
+ *   -t <s>         flight duration, default 5
+ *   -s <seed>      default 1
+ *   -j <workers>   default one per core
+ *   --span <x>     candidates drawn log-uniform in [default/x, default*x], default 4
+ *   --vary <list>  comma-separated parameters to vary, default all of the mode's
+ *   --cascade      fly CONTROL_CASCADE and search its gains instead
+ *   --gust <Nm>    largest rms disturbance torque, default 0.02
+ *   --scaling      run the whole search at 1, 2, 4 .. cores workers and
+ *                  report the speedup
+ *   --csv <file>   every candidate with its metrics
+ *
+ * The searched parameters are the Kalman noise constants and the gains of the
+ * control mode: kp, kd, ki for CONTROL_ANGLE, angle_kp .. rate_div for
+ * CONTROL_CASCADE. A parameter whose default is 0 stays 0, and each value is
+ * kept within the parameter's range.
+ *
+ * Each flight takes off level at hover throttle under a random gust level
+ * and the IMU noise of its seed. After TAKEOFF_SECONDS a roll and a pitch
+ * torque impulse of random size and sign knock the airframe over, and the
+ * controller flies it back to roll_des, pitch_des through the mixer. (A
+ * setpoint step would not do: a sustained tilt in flight accelerates the
+ * airframe, which the accelerometer cannot tell from level.) Per flight,
+ * from the knock, on the true attitude:
+ *
+ *   settle     s until roll and pitch stay within SETTLE_DEG of the setpoint
+ *   overshoot  deg they went past the setpoint on the way back
+ *   effort     rms of u_roll, u_pitch, what the mixer turns into motor commands
+ *
+ * Candidates are ranked on the means; the report is the Pareto front of
+ * the three.
+ */
+
+#define TUNE_PARAMS						PARAM_COUNT				// p[] by param_table id; tune_ids picks the searched ones
+#define SETTLE_DEG						1.0
+#define HOVER									"55"
+#define TAKEOFF_SECONDS				3
+#define IMPULSE_MIN_NM				0.3
+#define IMPULSE_MAX_NM				1.0
+#define IMPULSE_SECONDS				0.05
+#define RAD2DEG								57.29577951308232
+
+
+typedef struct {
+	float				settle, overshoot, effort;
+} tune_result;
+
+typedef struct {
+	float				p[TUNE_PARAMS];
+	tune_result	mean;
+	uint8_t			pareto;
+} tune_candidate;
+
+typedef struct {
+	tune_candidate	*cand;
+	uint32_t		flights;
+	double			seconds, gust;
+	uint64_t		seed;
+} tune_job;
+
+
+static const uint8_t tune_angle[] = {PARAM_KP, PARAM_KD, PARAM_KI, PARAM_Q00, PARAM_Q11, PARAM_Q22, PARAM_R00, PARAM_R11};
+static const uint8_t tune_cascade[] = {PARAM_ANGLE_KP, PARAM_YAW_KP, PARAM_RATE_KP, PARAM_RATE_KI, PARAM_RATE_KD,
+															PARAM_YAW_RATE_KP, PARAM_YAW_RATE_KI, PARAM_RATE_DIV,
+															PARAM_Q00, PARAM_Q11, PARAM_Q22, PARAM_R00, PARAM_R11};
+static const uint8_t *tune_ids = tune_angle;
+static uint8_t tune_n = sizeof(tune_angle);
+
+
+/*
+ * @brief: Candidate value of a parameter: kept in its range, whole for u16
+ */
+static float tune_Value(uint8_t id, double v) {
+	const param_entry *e = &param_table[id];
+	
+	if (v < e->min) v = e->min;
+	if (v > e->max) v = e->max;
+	return (float)(e->type == PARAM_F32 ? v : floor(v + 0.5));
+}
+
+/*
+ * @brief: Set a parameter to a tune_Value
+ */
+static void tune_Set(uint8_t id, float v) {
+	const param_entry *e = &param_table[id];
+	uint32_t bits;
+	
+	if (e->type == PARAM_F32) {
+		memcpy(&bits, &v, 4);
+	} else {
+		bits = (uint32_t)v;
+	}
+	param_Set(id, bits);
+}
+
+/*
+ * @brief: One flight of one candidate, in a pool worker
+ */
+static void tune_Flight(void *ctx, uint32_t job, void *result) {
+	static sim_world w;
+	const tune_job *t = ctx;
+	const tune_candidate *c = &t->cand[job / t->flights];
+	tune_result *res = result;
+	uint64_t n = (uint64_t)(t->seconds * SIM_RATE + 0.5), k, samples = 0;
+	double kick[2], sign[2], last_out = 0, over = 0, u2 = 0;
+	sim_rng rng;
+	uint8_t i;
+	
+	for (i = 0; i < tune_n; i++) tune_Set(tune_ids[i], c->p[tune_ids[i]]);
+	
+	// flight f is the same for every candidate
+	rng_Seed(&rng, t->seed * 1000003u + job % t->flights);
+	sim_Init(&w, rng.s);
+	w.gust = t->gust * rng_Uniform(&rng);
+	for (i = 0; i < 2; i++) {
+		kick[i] = IMPULSE_MIN_NM + (IMPULSE_MAX_NM - IMPULSE_MIN_NM) * rng_Uniform(&rng);
+		if (rng_Uniform(&rng) < 0.5) kick[i] = -kick[i];
+		sign[i] = kick[i] > 0 ? 1 : -1;
+	}
+	roll_des = pitch_des = yaw_des = 0;
+	sim_Command(&w, HOVER);
+	sim_Run(&w, TAKEOFF_SECONDS);
+	
+	for (k = 1; k <= n; k++) {
+		for (i = 0; i < 2; i++) w.quad.torque_ext[i] = k <= IMPULSE_SECONDS * SIM_RATE ? kick[i] : 0;
+		sim_Step(&w);
+		if (k % (SIM_RATE / 100) == 0) {
+			double r, p, y, e[2];
+			
+			quad_Euler(&w.quad, &r, &p, &y);
+			e[0] = r * RAD2DEG - roll_des;
+			e[1] = p * RAD2DEG - pitch_des;
+			for (i = 0; i < 2; i++) {
+				// the knock tilts along sign, the way back overshoots against it
+				if (-sign[i] * e[i] > over) over = -sign[i] * e[i];
+			}
+			if (fabs(e[0]) >= SETTLE_DEG || fabs(e[1]) >= SETTLE_DEG) last_out = (double)k / SIM_RATE;
+			u2 += u_roll * u_roll + u_pitch * u_pitch;
+			samples++;
+		}
+	}
+	res->settle = (float)last_out;
+	res->overshoot = (float)over;
+	res->effort = (float)sqrt(u2 / (samples ? samples : 1));
+}
+
+static int tune_Dominates(const tune_result *a, const tune_result *b) {
+	return a->settle <= b->settle && a->overshoot <= b->overshoot && a->effort <= b->effort
+				&& (a->settle < b->settle || a->overshoot < b->overshoot || a->effort < b->effort);
+}
+
+static int tune_BySettle(const void *a, const void *b) {
+	const tune_candidate *x = *(tune_candidate * const *)a, *y = *(tune_candidate * const *)b;
+	
+	return x->mean.settle < y->mean.settle ? -1 : x->mean.settle > y->mean.settle;
+}
+
+static void candidate_Print(FILE *f, const tune_candidate *c, const char *mark) {
+	uint8_t i;
+	
+	for (i = 0; i < tune_n; i++) fprintf(f, "%10.4g ", c->p[tune_ids[i]]);
+	fprintf(f, "%8.2f %9.2f %9.4f %s\n", c->mean.settle, c->mean.overshoot, c->mean.effort, mark);
+}
+
+static void stats_Print(const pool_stats *st, uint32_t jobs) {
+	uint64_t steals = 0, jmin = UINT64_MAX, jmax = 0;
+	double busy = 0;
+	uint32_t i;
+	
+	for (i = 0; i < st->workers; i++) {
+		steals += st->steals[i];
+		busy += st->busy[i];
+		if (st->jobs[i] < jmin) jmin = st->jobs[i];
+		if (st->jobs[i] > jmax) jmax = st->jobs[i];
+	}
+	printf("%3u workers %8.2f s %8.1f flights/s  jobs/worker %llu..%llu  steals %llu  busy %.0f%%\n",
+				st->workers, st->wall, jobs / st->wall, (unsigned long long)jmin, (unsigned long long)jmax,
+				(unsigned long long)steals, 100 * busy / (st->wall * st->workers));
+}
+
+int main(int argc, char **argv) {
+	tune_job		t = {NULL, 4, 5, 0.02, 1};
+	uint32_t		cands = 64, workers = 0, jobs, c, f, i, front = 0, beat = 0;
+	uint8_t			vary[TUNE_PARAMS];
+	double			span = 4, base_wall = 0;
+	const char	*csv_name = NULL;
+	int					scaling = 0, vary_all = 1, a;
+	tune_result	*res, *ref = NULL;
+	tune_candidate	**order;
+	pool_stats	st;
+	sim_rng			rng;
+	
+	memset(vary, 1, sizeof(vary));
+	for (a = 1; a < argc; a++) {
+		if (!strcmp(argv[a], "-c") && a + 1 < argc)									cands = (uint32_t)atol(argv[++a]);
+		else if (!strcmp(argv[a], "-f") && a + 1 < argc)						t.flights = (uint32_t)atol(argv[++a]);
+		else if (!strcmp(argv[a], "-t") && a + 1 < argc)						t.seconds = atof(argv[++a]);
+		else if (!strcmp(argv[a], "-s") && a + 1 < argc)						t.seed = strtoull(argv[++a], NULL, 0);
+		else if (!strcmp(argv[a], "-j") && a + 1 < argc)						workers = (uint32_t)atol(argv[++a]);
+		else if (!strcmp(argv[a], "--span") && a + 1 < argc)				span = atof(argv[++a]);
+		else if (!strcmp(argv[a], "--gust") && a + 1 < argc)				t.gust = atof(argv[++a]);
+		else if (!strcmp(argv[a], "--csv") && a + 1 < argc)				csv_name = argv[++a];
+		else if (!strcmp(argv[a], "--scaling"))											scaling = 1;
+		else if (!strcmp(argv[a], "--cascade"))											control_mode = CONTROL_CASCADE;
+		else if (!strcmp(argv[a], "--vary") && a + 1 < argc) {
+			char *list = argv[++a], *name;
+			
+			memset(vary, 0, sizeof(vary));
+			vary_all = 0;
+			for (name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+				for (i = 0; i < TUNE_PARAMS && strcmp(name, param_table[i].name); i++);
+				if (i == TUNE_PARAMS) {
+					fprintf(stderr, "unknown parameter %s\n", name);
+					return 2;
+				}
+				vary[i] = 1;
+			}
+		} else {
+			fprintf(stderr, "usage: %s [-c n] [-f n] [-t s] [-s seed] [-j workers] [--span x] [--vary list] [--cascade] [--gust Nm] [--scaling] [--csv file]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (cands == 0 || t.flights == 0 || span < 1) return 2;
+	if (control_mode == CONTROL_CASCADE) {
+		tune_ids = tune_cascade;
+		tune_n = sizeof(tune_cascade);
+	}
+	for (i = 0; i < TUNE_PARAMS; i++) {
+		if (vary[i] && !vary_all && !memchr(tune_ids, (int)i, tune_n)) {
+			fprintf(stderr, "%s is not searched in this control mode\n", param_table[i].name);
+			return 2;
+		}
+	}
+	if (workers == 0) workers = pool_Cores();
+	
+	// candidate 0 is what the firmware flies today
+	t.cand = calloc(cands, sizeof(tune_candidate));
+	rng_Seed(&rng, t.seed);
+	for (c = 0; c < cands; c++) {
+		for (i = 0; i < tune_n; i++) {
+			uint8_t id = tune_ids[i];
+			double x = c && vary[id] ? 2 * rng_Uniform(&rng) - 1 : 0;
+			
+			t.cand[c].p[id] = tune_Value(id, param_table[id].def * pow(span, x));
+		}
+	}
+	jobs = cands * t.flights;
+	res = malloc((size_t)jobs * sizeof(tune_result));
+	printf("%u candidates x %u flights of %.1f s, %u cores\n", cands, t.flights, t.seconds, pool_Cores());
+	
+	if (scaling) {
+		uint32_t n = 1;
+		
+		ref = malloc((size_t)jobs * sizeof(tune_result));
+		printf("scaling:\n");
+		for (;;) {
+			if (pool_Run(n, jobs, tune_Flight, &t, res, sizeof(tune_result), &st)) {
+				fprintf(stderr, "worker failed\n");
+				return 1;
+			}
+			if (n == 1) {
+				base_wall = st.wall;
+				memcpy(ref, res, (size_t)jobs * sizeof(tune_result));
+			}
+			stats_Print(&st, jobs);
+			printf("            speedup %.2fx, efficiency %.0f%%%s\n", base_wall / st.wall, 100 * base_wall / st.wall / n,
+						memcmp(ref, res, (size_t)jobs * sizeof(tune_result)) ? ", RESULTS DIFFER" : "");
+			if (n >= workers) break;
+			n = n * 2 > workers ? workers : n * 2;
+		}
+	} else {
+		if (pool_Run(workers, jobs, tune_Flight, &t, res, sizeof(tune_result), &st)) {
+			fprintf(stderr, "worker failed\n");
+			return 1;
+		}
+		stats_Print(&st, jobs);
+	}
+	
+	for (c = 0; c < cands; c++) {
+		tune_result *m = &t.cand[c].mean;
+		
+		for (f = 0; f < t.flights; f++) {
+			m->settle += res[c * t.flights + f].settle / t.flights;
+			m->overshoot += res[c * t.flights + f].overshoot / t.flights;
+			m->effort += res[c * t.flights + f].effort / t.flights;
+		}
+	}
+	order = malloc(cands * sizeof(*order));
+	for (c = 0; c < cands; c++) {
+		t.cand[c].pareto = 1;
+		for (i = 0; i < cands && t.cand[c].pareto; i++) {
+			if (tune_Dominates(&t.cand[i].mean, &t.cand[c].mean)) t.cand[c].pareto = 0;
+		}
+		if (t.cand[c].pareto) order[front++] = &t.cand[c];
+		if (c && tune_Dominates(&t.cand[c].mean, &t.cand[0].mean)) beat++;
+	}
+	qsort(order, front, sizeof(*order), tune_BySettle);
+	
+	printf("\nPareto front, %u of %u candidates (settle s, overshoot deg, effort rms u):\n", front, cands);
+	for (i = 0; i < tune_n; i++) printf("%10s ", param_table[tune_ids[i]].name);
+	printf("%8s %9s %9s\n", "settle", "overshoot", "effort");
+	for (c = 0; c < front; c++) candidate_Print(stdout, order[c], order[c] == &t.cand[0] ? "defaults" : "");
+	if (!t.cand[0].pareto) {
+		candidate_Print(stdout, &t.cand[0], "defaults");
+		printf("defaults dominated by %u candidates\n", beat);
+	}
+	
+	if (csv_name != NULL) {
+		FILE *csv = fopen(csv_name, "w");
+		
+		if (csv == NULL) {
+			perror(csv_name);
+			return 1;
+		}
+		for (i = 0; i < tune_n; i++) fprintf(csv, "%s,", param_table[tune_ids[i]].name);
+		fprintf(csv, "settle,overshoot,effort,pareto\n");
+		for (c = 0; c < cands; c++) {
+			for (i = 0; i < tune_n; i++) fprintf(csv, "%g,", t.cand[c].p[tune_ids[i]]);
+			fprintf(csv, "%g,%g,%g,%u\n", t.cand[c].mean.settle, t.cand[c].mean.overshoot, t.cand[c].mean.effort, t.cand[c].pareto);
+		}
+		fclose(csv);
+	}
+	free(order);
+	free(ref);
+	free(res);
+	free(t.cand);
+	return 0;
+}
@@ -22,6 +22,7 @@ void adxl345_Init(void) {
 													ADXL345_INT_WATERMARK_DISABLE,
 													ADXL345_INT_OVERRUN_DISABLE
 												);
+	adxl345_WriteBWRate(0, ADXL345_BW_200);	// normal power, 400 Hz output data rate
 	adxl345_WriteFIFOCtl(ADXL345_FIFO_BYPASS, ADXL345_TRIG_INT1, ADXL345_SAMPLE_WATERMARKDISABLE);
 	adxl345_WritePWRCtl(ADXL345_LINK_DISABLE,ADXL345_ASLEEP_DISABLE,ADXL345_MEASURE_ENABLE,ADXL345_SLEEP_DISABLE,ADXL345_WAKE_8HZ);
 }
@@ -525,9 +526,19 @@ void adxl345_WriteDataFormat(uint8_t selftest, uint8_t spi, uint8_t intinv, uint
 void adxl345_ReadXYZ(int16_t *xdata, int16_t *ydata, int16_t *zdata){
 	uint8_t b[6];
 	i2c_ReadBuf(I2C_ID_ADXL345, ADXL345_RA_DATAX0, 6, b);
-	*xdata = (int16_t)((uint16_t)b[0]<<8|(uint16_t)b[1]);
-	*ydata = (int16_t)((uint16_t)b[2]<<8|(uint16_t)b[3]);
-	*zdata = (int16_t)((uint16_t)b[4]<<8|(uint16_t)b[5]);
+	adxl345_DecodeXYZ(b, xdata, ydata, zdata);
+}
+
+/*
+ * @brief: Unpack DATAX0..DATAZ1 as read from the bus
+ * @param[in]: 6 raw bytes, ptr output to individual axes
+ * @param[out]: none
+ */
+void adxl345_DecodeXYZ(const uint8_t *b, int16_t *xdata, int16_t *ydata, int16_t *zdata){
+	// DATAx0 is the low byte
+	*xdata = (int16_t)((uint16_t)b[1]<<8|(uint16_t)b[0]);
+	*ydata = (int16_t)((uint16_t)b[3]<<8|(uint16_t)b[2]);
+	*zdata = (int16_t)((uint16_t)b[5]<<8|(uint16_t)b[4]);
 }
 
 /*
@@ -565,3 +576,27 @@ void adxl345_WriteFIFOCtl(uint8_t fifo, uint8_t trigger, uint8_t sample){
 void adxl345_ReadFIFOStatus(uint8_t *fifost){
 	*fifost = i2c_ReadByte(I2C_ID_ADXL345, ADXL345_RA_FIFO_STATUS);
 }
+
+/*
+ * @brief: Stream mode: the 32-entry FIFO fills at the output data rate and
+ * 				INT1 goes high while it holds at least watermark entries
+ * 				(INT_MAP power-on default routes everything to INT1)
+ * @param[in]: ADXL345_BW_*, watermark 1..31
+ * @param[out]: none
+ */
+void adxl345_InitFifo(uint8_t bw, uint8_t watermark){
+	adxl345_WritePWRCtl(ADXL345_LINK_DISABLE,ADXL345_ASLEEP_DISABLE,ADXL345_MEASURE_DISABLE,ADXL345_SLEEP_DISABLE,ADXL345_WAKE_8HZ);
+	adxl345_WriteBWRate(0, bw);
+	adxl345_WriteFIFOCtl(ADXL345_FIFO_STREAM, ADXL345_TRIG_INT1, watermark & 0x1F);
+	adxl345_WriteINTEnable(
+													ADXL345_INT_DATARDY_DISABLE,
+													ADXL345_INT_SINGLETAP_DISABLE,
+													ADXL345_INT_DOUBLTAP_DISABLE,
+													ADXL345_INT_ACTIVITY_DISABLE,
+													ADXL345_INT_INACTIVITY_DISABLE,
+													ADXL345_INT_FREEFALL_DISABLE,
+													ADXL345_INT_WATERMARK_ENABLE,
+													ADXL345_INT_OVERRUN_DISABLE
+												);
+	adxl345_WritePWRCtl(ADXL345_LINK_DISABLE,ADXL345_ASLEEP_DISABLE,ADXL345_MEASURE_ENABLE,ADXL345_SLEEP_DISABLE,ADXL345_WAKE_8HZ);
+}
@@ -121,7 +121,7 @@
 #define ADXL345_DATA_SPI_3														0x01<<6
 #define ADXL345_DATA_SPI_4														0x00<<6
 #define ADXL345_DATA_INT_INVERT_ENABLE								0x01<<5
-#define ADXL345_DATA_INT_INVERT_DISABLE								0x00<5
+#define ADXL345_DATA_INT_INVERT_DISABLE								0x00<<5
 #define ADXL345_DATA_FULLRES_ENABLE										0x01<<3
 #define ADXL345_DATA_FULLRES_DISABLE									0x00<<3
 #define ADXL345_DATA_JUSTIFY_LEFT											0x01<<2
@@ -140,6 +140,9 @@
 #define ADXL345_SAMPLE_WATERMARKENABLE								0x00
 #define ADXL345_SAMPLE_WATERMARKDISABLE								0x01
 
+#define ADXL345_FIFO_SIZE															32
+#define ADXL345_FIFO_ENTRIES													0x3F		// FIFO_STATUS entry count
+
 
 
 extern void adxl345_Init(void);
@@ -186,6 +189,8 @@ extern void adxl345_ReadINTSource(uint8_t *intsource);
 extern void adxl345_ReadDataFormat(uint8_t *data);
 extern void adxl345_WriteDataFormat(uint8_t selftest, uint8_t spi, uint8_t intinv, uint8_t fullres, uint8_t justify, uint8_t range);
 extern void adxl345_ReadXYZ(int16_t *xdata, int16_t *ydata, int16_t *zdata);
+extern void adxl345_DecodeXYZ(const uint8_t *b, int16_t *xdata, int16_t *ydata, int16_t *zdata);
 extern void adxl345_ReadFIFOCtl(uint8_t *fifo);
 extern void adxl345_WriteFIFOCtl(uint8_t fifo, uint8_t trigger, uint8_t sample);
 extern void adxl345_ReadFIFOStatus(uint8_t *fifost);
+extern void adxl345_InitFifo(uint8_t bw, uint8_t watermark);
@@ -0,0 +1,116 @@
+#include <stdint.h>
+#include <math.h>
+#include "ahrs.h"
+#include "fastmath.h"
+
+
+void ahrs_init(ahrs_data * ad) {
+	ad->q[0] = 1.0f;
+	ad->q[1] = 0.0f;
+	ad->q[2] = 0.0f;
+	ad->q[3] = 0.0f;
+	ad->bias[0] = 0.0f;
+	ad->bias[1] = 0.0f;
+	ad->bias[2] = 0.0f;
+	ad->kp = AHRS_KP;
+	ad->ki = AHRS_KI;
+	ad->gain = AHRS_KP_INIT;
+}
+
+/*
+ * @brief: One filter step
+ * @param[in]: gyro rad/s, accel (any unit), mag (any unit, offsets removed), dt s
+ * 				a zero mag vector skips the heading correction
+ * @param[out]: none
+ */
+void ahrs_update(ahrs_data * ad, const Vect3d * gyro, const Vect3d * accel, const Vect3d * mag, float dt) {
+	float q0 = ad->q[0], q1 = ad->q[1], q2 = ad->q[2], q3 = ad->q[3];
+	float ax = accel->x, ay = accel->y, az = accel->z;
+	float mx = mag->x, my = mag->y, mz = mag->z;
+	float gx, gy, gz;
+	float ex = 0.0f, ey = 0.0f, ez = 0.0f;
+	float n, vx, vy, vz;
+	float hx, hy, bx, bz, wx, wy, wz, em;
+	float dq0, dq1, dq2, dq3;
+	
+	n = ax*ax + ay*ay + az*az;
+	if (n == 0.0f) return;
+	
+	// gravity: accelerometer feels -g, i.e. NED (0, 0, -1) rotated into the body
+	n = 1.0f / sqrtf(n);
+	ax *= n;
+	ay *= n;
+	az *= n;
+	vx = -2.0f * (q1*q3 - q0*q2);
+	vy = -2.0f * (q2*q3 + q0*q1);
+	vz = -(1.0f - 2.0f * (q1*q1 + q2*q2));
+	ex = ay*vz - az*vy;
+	ey = az*vx - ax*vz;
+	ez = ax*vy - ay*vx;
+	
+	// magnetic field: rotate to NED, collapse onto the north/down plane, rotate back
+	n = mx*mx + my*my + mz*mz;
+	if (n > 0.0f) {
+		n = 1.0f / sqrtf(n);
+		mx *= n;
+		my *= n;
+		mz *= n;
+		hx = 2.0f * (mx*(0.5f - q2*q2 - q3*q3) + my*(q1*q2 - q0*q3) + mz*(q1*q3 + q0*q2));
+		hy = 2.0f * (mx*(q1*q2 + q0*q3) + my*(0.5f - q1*q1 - q3*q3) + mz*(q2*q3 - q0*q1));
+		bx = sqrtf(hx*hx + hy*hy);
+		bz = 2.0f * (mx*(q1*q3 - q0*q2) + my*(q2*q3 + q0*q1) + mz*(0.5f - q1*q1 - q2*q2));
+		wx = 2.0f * (bx*(0.5f - q2*q2 - q3*q3) + bz*(q1*q3 - q0*q2));
+		wy = 2.0f * (bx*(q1*q2 - q0*q3) + bz*(q0*q1 + q2*q3));
+		wz = 2.0f * (bx*(q0*q2 + q1*q3) + bz*(0.5f - q1*q1 - q2*q2));
+		// heading error only: component along the measured vertical, scaled by
+		// the horizontal field squared so convergence does not depend on dip
+		em = (my*wz - mz*wy)*ax + (mz*wx - mx*wz)*ay + (mx*wy - my*wx)*az;
+		if (bx > 0.1f) em /= bx*bx;
+		ex += em * ax;
+		ey += em * ay;
+		ez += em * az;
+	}
+	
+	// PI feedback into the gyro, integrator held during the start-up ramp
+	if (ad->gain > ad->kp) {
+		ad->gain -= (AHRS_KP_INIT - AHRS_KP) / AHRS_INIT_SECONDS * dt;
+		if (ad->gain < ad->kp) ad->gain = ad->kp;
+	} else {
+		ad->bias[0] += ad->ki * ex * dt;
+		ad->bias[1] += ad->ki * ey * dt;
+		ad->bias[2] += ad->ki * ez * dt;
+	}
+	gx = gyro->x + ad->gain * ex + ad->bias[0];
+	gy = gyro->y + ad->gain * ey + ad->bias[1];
+	gz = gyro->z + ad->gain * ez + ad->bias[2];
+	
+	// q' = 1/2 q (x) (0, w)
+	dq0 = 0.5f * (-q1*gx - q2*gy - q3*gz);
+	dq1 = 0.5f * ( q0*gx + q2*gz - q3*gy);
+	dq2 = 0.5f * ( q0*gy - q1*gz + q3*gx);
+	dq3 = 0.5f * ( q0*gz + q1*gy - q2*gx);
+	q0 += dq0 * dt;
+	q1 += dq1 * dt;
+	q2 += dq2 * dt;
+	q3 += dq3 * dt;
+	n = 1.0f / sqrtf(q0*q0 + q1*q1 + q2*q2 + q3*q3);
+	ad->q[0] = q0 * n;
+	ad->q[1] = q1 * n;
+	ad->q[2] = q2 * n;
+	ad->q[3] = q3 * n;
+}
+
+/*
+ * @brief: ZYX Euler angles in degrees, same sense as control.c roll/pitch/yaw
+ * 				pitch is clamped at +-90 deg; the quaternion itself has no singularity
+ */
+void ahrs_euler(const ahrs_data * ad, float * roll, float * pitch, float * yaw) {
+	const float *q = ad->q;
+	float sp = 2.0f * (q[0]*q[2] - q[3]*q[1]);
+	
+	if (sp > 1.0f) sp = 1.0f;
+	if (sp < -1.0f) sp = -1.0f;
+	*roll = fastmath_atan2(2.0f * (q[0]*q[1] + q[2]*q[3]), 1.0f - 2.0f * (q[1]*q[1] + q[2]*q[2])) * FASTMATH_RAD2DEG;
+	*pitch = fastmath_atan2(sp, sqrtf(1.0f - sp*sp)) * FASTMATH_RAD2DEG;
+	*yaw = fastmath_atan2(2.0f * (q[0]*q[3] + q[1]*q[2]), 1.0f - 2.0f * (q[2]*q[2] + q[3]*q[3])) * FASTMATH_RAD2DEG;
+}
@@ -0,0 +1,39 @@
+#ifndef _AHRS_H_
+#define _AHRS_H_
+
+#include <stdint.h>
+#include "var.h"
+
+/*
+ * Mahony complementary filter on the quaternion: gyro integration corrected by
+ * the cross product between measured and predicted gravity and magnetic field
+ * directions, with integral gyro bias estimation. One update fuses all nine
+ * axes with multiplies, adds, a division and four square roots (two without
+ * a compass reading); ahrs_euler takes one more.
+ *
+ * The magnetometer correction is projected onto the measured vertical so a
+ * disturbed field can only pull heading, never roll and pitch. The filter
+ * starts with AHRS_KP_INIT and ramps down to kp over AHRS_INIT_SECONDS, so it
+ * locks on within the first second instead of crawling in at kp.
+ *
+ * Frames: body FRD, world NED. q is body->world (w, x, y, z).
+ */
+
+#define AHRS_KP						0.5f					// proportional gain, 1/s
+#define AHRS_KI						0.01f					// integral gain, 1/s^2
+#define AHRS_KP_INIT				10.0f					// start-up gain
+#define AHRS_INIT_SECONDS			2.0f
+
+
+typedef struct {
+	float			q[4];
+	float			bias[3];							// integral feedback, rad/s
+	float			kp, ki;
+	float			gain;								// current proportional gain
+} ahrs_data;
+
+void ahrs_init(ahrs_data * ad);
+void ahrs_update(ahrs_data * ad, const Vect3d * gyro, const Vect3d * accel, const Vect3d * mag, float dt);
+void ahrs_euler(const ahrs_data * ad, float * roll, float * pitch, float * yaw);
+
+#endif
@@ -0,0 +1,346 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "hal.h"
+#include "sensors.h"
+#include "control.h"
+#include "telemetry.h"
+#include "spsc.h"
+#include "tasks.h"
+#include "blackbox.h"
+
+
+uint8_t					blackbox_mode = __BLACKBOX;
+uint32_t				blackbox_records;
+uint32_t				blackbox_blocks;
+uint32_t				blackbox_lost;
+uint32_t				blackbox_rate_lost;
+
+typedef struct {
+	uint32_t		t_us;											// of the gyro sample the run read
+	uint16_t		throttle;
+} blackbox_run;
+
+static blackbox_block	blackbox_cur;						// being filled by blackbox_Record
+static uint8_t				blackbox_n;							// items in it
+static uint16_t				blackbox_seq;
+static uint32_t				blackbox_last_t;				// previous item
+static uint32_t				blackbox_kind_t[5];			// last item per kind: samples, tick, rate run
+static uint32_t				blackbox_kind_dt[5];		// and its interval
+static uint8_t				blackbox_seen;					// kinds in the block so far, bit per kind
+static uint8_t				blackbox_throttle_known;
+static uint16_t				blackbox_throttle;
+static int32_t				blackbox_prev_s[3][3];	// last sample per sensor
+static int32_t				blackbox_prev[BLACKBOX_FIELDS];
+static blackbox_block	blackbox_queue_buf[BLACKBOX_QUEUE];
+static spsc_ring			blackbox_queue;					// control task -> TASK_LOG
+static blackbox_run		blackbox_rate_buf[BLACKBOX_RATE_QUEUE];
+static spsc_ring			blackbox_rate_queue;		// rate loop -> control task
+static blackbox_sink	blackbox_out;
+static void						*blackbox_out_ctx;
+
+
+static inline uint8_t blackbox_Varint(uint8_t *p, uint32_t v) {
+	uint8_t n = 0;
+	
+	while (v >= 0x80) {
+		p[n++] = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (uint8_t)v;
+	return n;
+}
+
+static inline uint32_t blackbox_Zigzag(uint32_t v) {
+	return (v << 1) ^ (uint32_t)((int32_t)v >> 31);
+}
+
+/*
+ * @brief: Hundredths, rounded as telemetry does, clamped, NaN as 0
+ */
+static int32_t blackbox_Centi(float v) {
+	float c = v * 100.0f;
+	
+	if (!(c > -1e9f && c < 1e9f)) return c > 0 ? 1000000000 : c < 0 ? -1000000000 : 0;
+	return (int32_t)(c < 0 ? c - 0.5f : c + 0.5f);
+}
+
+/*
+ * @brief: FNV-1a over the bits of n floats
+ */
+static uint32_t blackbox_Hash(uint32_t h, const float *f, uint8_t n) {
+	uint32_t w;
+	uint8_t i;
+	
+	for (i = 0; i < n; i++) {
+		memcpy(&w, &f[i], sizeof(w));
+		h = (h ^ w) * 16777619u;
+	}
+	return h;
+}
+
+/*
+ * @brief: A rate run at a throttle the block has not seen carries it
+ */
+static inline uint8_t blackbox_Kind(uint8_t kind, const int32_t *v) {
+	if (kind == BLACKBOX_ITEM_RATE && (!blackbox_throttle_known || (uint16_t)v[0] != blackbox_throttle)) {
+		return BLACKBOX_ITEM_RATE_THROTTLE;
+	}
+	return kind;
+}
+
+/*
+ * @brief: Encode one item against the block so far, differences wrap in 32 bits
+ * @param[in]: t_us, BLACKBOX_ITEM_*, its values: 3 axes, BLACKBOX_FIELDS, or
+ * 				the throttle of a rate run
+ * @param[out]: item bytes, length; 0 if t_us is too far from the prediction
+ */
+static uint8_t blackbox_Encode(uint8_t *p, uint32_t t_us, uint8_t kind, const int32_t *v) {
+	uint8_t		slot = kind == BLACKBOX_ITEM_RATE ? 4 : kind, i, n, count;
+	uint32_t	pred = blackbox_seen & (1 << slot) ? blackbox_kind_t[slot] + blackbox_kind_dt[slot] : blackbox_last_t;
+	int32_t		d = (int32_t)(t_us - pred);
+	const int32_t	*prev;
+	
+	if (d >= (1 << 28) || d < -(1 << 28)) return 0;
+	kind = blackbox_Kind(kind, v);
+	n = blackbox_Varint(p, blackbox_Zigzag((uint32_t)d) << 3 | kind);
+	if (kind == BLACKBOX_ITEM_RATE) return n;
+	if (kind == BLACKBOX_ITEM_RATE_THROTTLE) return n + blackbox_Varint(p + n, (uint32_t)v[0]);
+	
+	prev = kind == BLACKBOX_ITEM_TICK ? blackbox_prev : blackbox_prev_s[kind];
+	count = kind == BLACKBOX_ITEM_TICK ? BLACKBOX_FIELDS : 3;
+	if (blackbox_seen & (1 << slot)) {
+		for (i = 0; i < count; i++) n += blackbox_Varint(p + n, blackbox_Zigzag((uint32_t)v[i] - (uint32_t)prev[i]));
+	} else {
+		for (i = 0; i < count; i++) n += blackbox_Varint(p + n, blackbox_Zigzag((uint32_t)v[i]));
+	}
+	return n;
+}
+
+/*
+ * @brief: Queue the current block for TASK_LOG
+ */
+static void blackbox_Close(void) {
+	if (!blackbox_n) return;
+	blackbox_cur.data[3] = blackbox_n;
+	if (!spsc_Push(&blackbox_queue, &blackbox_cur)) blackbox_lost++;
+	task_Post(TASK_LOG);
+	blackbox_seq++;
+	blackbox_n = 0;
+	blackbox_cur.len = 0;
+}
+
+/*
+ * @brief: Start a block at t0 with the current modes, nothing to delta against
+ */
+static void blackbox_Open(uint32_t t0) {
+	blackbox_cur.data[0] = BLACKBOX_FORMAT_VERSION;
+	blackbox_cur.data[1] = (uint8_t)blackbox_seq;
+	blackbox_cur.data[2] = (uint8_t)(blackbox_seq >> 8);
+	blackbox_cur.data[4] = (uint8_t)(control_estimator | kalman_gain_mode << 2 | control_mode << 3 | control_frame << 4);
+	blackbox_cur.data[5] = (uint8_t)control_rate_div;
+	blackbox_cur.len = BLACKBOX_BLOCK_HEADER + blackbox_Varint(&blackbox_cur.data[BLACKBOX_BLOCK_HEADER], t0);
+	blackbox_last_t = t0;
+	blackbox_seen = 0;
+	blackbox_throttle_known = 0;
+}
+
+/*
+ * @brief: Append one item; a block that cannot take it is queued and the
+ * 				item opens the next one
+ * @param[in]: t_us, BLACKBOX_ITEM_* (BLACKBOX_ITEM_RATE for any rate run),
+ * 				values as blackbox_Encode
+ * @param[out]: none
+ */
+static void blackbox_Append(uint32_t t_us, uint8_t kind, const int32_t *v) {
+	uint8_t		item[BLACKBOX_ITEM_MAX];
+	uint8_t		len = 0, slot = kind == BLACKBOX_ITEM_RATE ? 4 : kind;
+	
+	if (blackbox_n) {
+		len = blackbox_Encode(item, t_us, kind, v);
+		if (!len || blackbox_cur.len + len > BLACKBOX_BLOCK_SIZE) blackbox_Close();
+	}
+	if (!blackbox_n) {
+		blackbox_Open(t_us);
+		len = blackbox_Encode(item, t_us, kind, v);
+	}
+	memcpy(&blackbox_cur.data[blackbox_cur.len], item, len);
+	blackbox_cur.len += len;
+	blackbox_n++;
+	
+	if (kind == BLACKBOX_ITEM_TICK) {
+		memcpy(blackbox_prev, v, sizeof(blackbox_prev));
+		blackbox_throttle = (uint16_t)v[BLACKBOX_THROTTLE];
+		blackbox_throttle_known = 1;
+	} else if (kind == BLACKBOX_ITEM_RATE) {
+		blackbox_throttle = (uint16_t)v[0];
+		blackbox_throttle_known = 1;
+	} else {
+		memcpy(blackbox_prev_s[kind], v, sizeof(blackbox_prev_s[kind]));
+	}
+	blackbox_kind_dt[slot] = blackbox_seen & (1 << slot) ? t_us - blackbox_kind_t[slot] : 0;
+	blackbox_kind_t[slot] = t_us;
+	blackbox_seen |= 1 << slot;
+	blackbox_last_t = t_us;
+}
+
+/*
+ * @brief: Empty queue, USB sink, TASK_LOG registered; recording as blackbox_mode
+ * @param[in]: none
+ * @param[out]: none
+ */
+void blackbox_Init(void) {
+	spsc_Init(&blackbox_queue, blackbox_queue_buf, BLACKBOX_QUEUE, sizeof(blackbox_block));
+	spsc_Init(&blackbox_rate_queue, blackbox_rate_buf, BLACKBOX_RATE_QUEUE, sizeof(blackbox_run));
+	blackbox_out = blackbox_SinkUSB;
+	blackbox_out_ctx = NULL;
+	blackbox_n = 0;
+	blackbox_seq = 0;
+	blackbox_cur.len = 0;
+	blackbox_records = 0;
+	blackbox_blocks = 0;
+	blackbox_lost = 0;
+	blackbox_rate_lost = 0;
+	task_Register(TASK_LOG, "log", blackbox_Flush, BLACKBOX_DEADLINE_US);
+}
+
+/*
+ * @brief: Where finished blocks go, from TASK_LOG
+ * @param[in]: sink, its context
+ * @param[out]: none
+ */
+void blackbox_SetSink(blackbox_sink sink, void *ctx) {
+	blackbox_out = sink;
+	blackbox_out_ctx = ctx;
+}
+
+/*
+ * @brief: Start recording; rate runs left from an earlier recording dropped
+ */
+void blackbox_Start(void) {
+	blackbox_run run;
+	
+	while (spsc_Pop(&blackbox_rate_queue, &run));
+	blackbox_n = 0;
+	blackbox_cur.len = 0;
+	blackbox_mode = BLACKBOX_ON;
+}
+
+/*
+ * @brief: Stop recording, queue the partial block
+ */
+void blackbox_Stop(void) {
+	blackbox_Close();
+	blackbox_mode = BLACKBOX_OFF;
+}
+
+/*
+ * @brief: This tick's record, in BLACKBOX_* order and units
+ * @param[in]: none
+ * @param[out]: v[BLACKBOX_FIELDS]
+ */
+void blackbox_Fields(int32_t *v) {
+	const float	f[9] = {roll, pitch, yaw, u_roll, u_pitch, u_yaw, rate_des.x, rate_des.y, rate_des.z};
+	uint32_t		h = 2166136261u;
+	uint8_t			i;
+	
+	v[BLACKBOX_ATTITUDE] = blackbox_Centi(roll);
+	v[BLACKBOX_ATTITUDE + 1] = blackbox_Centi(pitch);
+	v[BLACKBOX_ATTITUDE + 2] = blackbox_Centi(yaw);
+	v[BLACKBOX_DRIFT] = blackbox_Centi(k_roll.x[2]);
+	v[BLACKBOX_DRIFT + 1] = blackbox_Centi(k_pitch.x[2]);
+	v[BLACKBOX_DRIFT + 2] = blackbox_Centi(k_yaw.x[2]);
+	v[BLACKBOX_PID] = blackbox_Centi(u_roll);
+	v[BLACKBOX_PID + 1] = blackbox_Centi(u_pitch);
+	v[BLACKBOX_PID + 2] = blackbox_Centi(u_yaw);
+	for (i = 0; i < 4; i++) v[BLACKBOX_TORQUE + i] = torque[i];
+	v[BLACKBOX_THROTTLE] = user_torque;
+	// exact bits, so a rerun of the flight code sees a difference the hundredths round off
+	h = blackbox_Hash(h, k_roll.x, 3);
+	h = blackbox_Hash(h, k_roll.P, 6);
+	h = blackbox_Hash(h, k_pitch.x, 3);
+	h = blackbox_Hash(h, k_pitch.P, 6);
+	h = blackbox_Hash(h, k_yaw.x, 3);
+	h = blackbox_Hash(h, k_yaw.P, 6);
+	h = blackbox_Hash(h, k_ahrs.q, 4);
+	v[BLACKBOX_STATE] = (int32_t)blackbox_Hash(h, f, 9);
+}
+
+/*
+ * @brief: Rate loop run, from TASK_RATE; written with the next tick
+ * @param[in]: t_us of the gyro sample it read
+ * @param[out]: none
+ */
+void blackbox_Rate(uint32_t t_us) {
+	blackbox_run run;
+	
+	if (blackbox_mode != BLACKBOX_ON) return;
+	run.t_us = t_us;
+	run.throttle = user_torque;
+	if (!spsc_Push(&blackbox_rate_queue, &run)) blackbox_rate_lost++;
+}
+
+/*
+ * @brief: Append this tick to the log: the samples of its estimator run, the
+ * 				rate loop runs since the previous tick, then its record
+ * @param[in]: tick time, hal_Micros()
+ * @param[out]: none
+ */
+void blackbox_Record(uint32_t t_us) {
+	int32_t				v[BLACKBOX_FIELDS];
+	blackbox_run	run;
+	uint16_t			i;
+	
+	if (blackbox_mode != BLACKBOX_ON) return;
+	for (i = 0; i < sensors_batch_n; i++) {
+		const sensors_entry *e = &sensors_batch[i];
+		
+		v[0] = e->data[0];
+		v[1] = e->data[1];
+		v[2] = e->data[2];
+		blackbox_Append(e->t_us, e->sensor, v);
+	}
+	while (spsc_Pop(&blackbox_rate_queue, &run)) {
+		v[0] = run.throttle;
+		blackbox_Append(run.t_us, BLACKBOX_ITEM_RATE, v);
+	}
+	blackbox_Fields(v);
+	blackbox_Append(t_us, BLACKBOX_ITEM_TICK, v);
+	blackbox_records++;
+}
+
+/*
+ * @brief: TASK_LOG: hand queued blocks to the sink
+ * @param[in]: none
+ * @param[out]: none
+ */
+void blackbox_Flush(void) {
+	blackbox_block b;
+	
+	while (spsc_Pop(&blackbox_queue, &b)) {
+		if (blackbox_out != NULL && blackbox_out(blackbox_out_ctx, b.data, b.len)) {
+			blackbox_blocks++;
+		} else {
+			blackbox_lost++;
+		}
+	}
+}
+
+/*
+ * @brief: Default sink: a TELEM_MSG_LOG frame, binary telemetry only
+ * @param[in]: ctx unused, block, length
+ * @param[out]: 0 if the USB ring had no room or telemetry is not binary
+ */
+uint8_t blackbox_SinkUSB(void *ctx, const uint8_t *block, uint8_t len) {
+	telem_writer *w;
+	uint8_t i;
+	
+	(void)ctx;
+	if (telem_mode != TELEM_BINARY) return 0;
+	w = telem_Begin(TELEM_MSG_LOG, len);
+	if (!w) return 0;
+	for (i = 0; i < len; i++) telem_U8(w, block[i]);
+	telem_End(w);
+	return 1;
+}
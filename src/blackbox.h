@@ -0,0 +1,109 @@
+#ifndef _BLACKBOX_H_
+#define _BLACKBOX_H_
+
+#include <stdint.h>
+
+/*
+ * Flight data recorder: every raw sensor sample the estimator took, every
+ * run of the rate loop and one record per control tick with the estimator
+ * state, the PID outputs, the motor commands and the throttle they were
+ * mixed from, packed into blocks of at most BLACKBOX_BLOCK_SIZE bytes:
+ *
+ *   u8 BLACKBOX_FORMAT_VERSION, u16 seq, u8 items, u8 modes, u8 rate_div,
+ *   varint t0, then the items
+ *
+ * The version changes with the layout of the blocks or the meaning of a
+ * field, and the decoder refuses blocks of any other. modes holds
+ * control_estimator, kalman_gain_mode, control_mode and control_frame, and
+ * rate_div control_rate_div, so a replay runs the code the board ran.
+ *
+ * Each item starts with a varint tag, zigzag(t_us - predicted) << 3 |
+ * BLACKBOX_ITEM_*. The prediction is the last item of the same kind plus its
+ * interval, or the item before for the first of its kind in the block, or t0
+ * for the first item. A sample carries its three axes, a tick its
+ * BLACKBOX_FIELDS, each as a zigzag varint of the change against the last of
+ * its kind in the block (the value itself for the first). So a block decodes
+ * on its own and a lost block costs only its own items. Varints are LEB128,
+ * 7 bits a byte, low first.
+ *
+ * The samples and rate runs written before a tick are the ones it took:
+ * sensors_batch of its estimator run and the rate loop runs since the
+ * previous tick, with the gyro sample time each read and the throttle when it
+ * changed. They may spill into the block before the tick's own.
+ *
+ * blackbox_Record encodes in the control task; the rate loop hands its runs
+ * over through a BLACKBOX_RATE_QUEUE deep spsc ring. A full block goes
+ * through a BLACKBOX_QUEUE deep spsc ring to TASK_LOG, which hands it to the
+ * sink in the main loop. The default sink sends it as a TELEM_MSG_LOG frame
+ * over USB CDC; blackbox_SetSink installs another (e.g. external flash).
+ * Blocks the queue or the sink could not take are counted in blackbox_lost
+ * and show up as seq gaps. host/blackbox_decode.h expands a log into columns.
+ *
+ * Off unless __BLACKBOX is BLACKBOX_ON; the USB command 'l' starts and
+ * stops it.
+ */
+
+#define BLACKBOX_OFF									0
+#define BLACKBOX_ON										1
+#ifndef __BLACKBOX
+#define __BLACKBOX										BLACKBOX_OFF
+#endif
+
+// item kinds, the low 3 bits of the tag
+#define BLACKBOX_ITEM_ACCEL						0				// sensor samples, __MEASURE_* order: x, y, z [LSB]
+#define BLACKBOX_ITEM_COMPASS					1
+#define BLACKBOX_ITEM_GYRO						2
+#define BLACKBOX_ITEM_TICK						3				// BLACKBOX_FIELDS
+#define BLACKBOX_ITEM_RATE						4				// rate loop run, t_us of the gyro sample it read
+#define BLACKBOX_ITEM_RATE_THROTTLE		5				// ... at a new throttle, varint user_torque
+
+// modes byte
+#define BLACKBOX_MODE_EST(m)					((m) & 3)						// control_estimator
+#define BLACKBOX_MODE_GAIN(m)					(((m) >> 2) & 1)		// kalman_gain_mode
+#define BLACKBOX_MODE_CONTROL(m)			(((m) >> 3) & 1)		// control_mode
+#define BLACKBOX_MODE_FRAME(m)				(((m) >> 4) & 7)		// control_frame
+
+// tick fields, in encoding order
+#define BLACKBOX_ATTITUDE							0				// roll, pitch, yaw [0.01 deg]
+#define BLACKBOX_DRIFT								3				// Kalman drift roll, pitch, yaw [0.01 deg/s]
+#define BLACKBOX_PID									6				// u_roll, u_pitch, u_yaw [x100]
+#define BLACKBOX_TORQUE								9				// torque[0..3]
+#define BLACKBOX_THROTTLE							13			// user_torque
+#define BLACKBOX_STATE								14			// hash of the estimator and controller float bits
+#define BLACKBOX_FIELDS								15
+
+#define BLACKBOX_FORMAT_VERSION				3
+#define BLACKBOX_BLOCK_SIZE						128			// TELEM_PAYLOAD_MAX
+#define BLACKBOX_BLOCK_HEADER					6
+#define BLACKBOX_ITEM_MAX							(5 + 5 * BLACKBOX_FIELDS)
+#define BLACKBOX_QUEUE								8				// blocks, power of two
+#define BLACKBOX_RATE_QUEUE						32			// rate loop runs between ticks, power of two
+#define BLACKBOX_DEADLINE_US					50000		// TASK_LOG
+
+
+typedef struct {
+	uint8_t		len;
+	uint8_t		data[BLACKBOX_BLOCK_SIZE];
+} blackbox_block;
+
+// returns 0 if the block could not be taken
+typedef uint8_t (*blackbox_sink)(void *ctx, const uint8_t *block, uint8_t len);
+
+
+extern uint8_t			blackbox_mode;
+extern uint32_t			blackbox_records;
+extern uint32_t			blackbox_blocks;							// handed to the sink
+extern uint32_t			blackbox_lost;								// queue full or refused by the sink
+extern uint32_t			blackbox_rate_lost;						// rate loop runs the ring had no room for
+
+extern void			blackbox_Init(void);
+extern void			blackbox_SetSink(blackbox_sink sink, void *ctx);
+extern void			blackbox_Start(void);
+extern void			blackbox_Stop(void);
+extern void			blackbox_Fields(int32_t *v);
+extern void			blackbox_Rate(uint32_t t_us);
+extern void			blackbox_Record(uint32_t t_us);
+extern void			blackbox_Flush(void);
+extern uint8_t	blackbox_SinkUSB(void *ctx, const uint8_t *block, uint8_t len);
+
+#endif
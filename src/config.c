@@ -27,6 +27,8 @@
 
 #include "defines.h"
 #include "config.h"
+#include "hal.h"
+#include "sensors.h"
 
 void PeripheralClock_Config(void) {
 	/// Config PLL for 80MHz
@@ -99,7 +101,7 @@ void Timers_Config(void) {
 
 	// Timer 2
 	TimerConfigure(TIMER2_BASE, TIMER_CFG_PERIODIC);
-	TimerLoadSet(TIMER2_BASE, TIMER_A, (SysCtlClockGet() / 600) - 1); // 600 Hz
+	TimerLoadSet(TIMER2_BASE, TIMER_A, (SysCtlClockGet() / SENSORS_TICK_HZ) - 1); // sampling scheduler
 	TimerIntEnable(TIMER2_BASE, TIMER_TIMA_TIMEOUT);
 	TimerEnable(TIMER2_BASE, TIMER_A);
 	
@@ -107,7 +109,7 @@ void Timers_Config(void) {
 
 void PWM_Config(void) {
 	PWMGenConfigure(PWM1_BASE, PWM_GEN_0, PWM_GEN_MODE_DOWN | PWM_GEN_MODE_GEN_NO_SYNC);
-	PWMGenPeriodSet(PWM1_BASE, PWM_GEN_0, (SysCtlPWMClockGet() / 50)); // 50 Hz
+	PWMGenPeriodSet(PWM1_BASE, PWM_GEN_0, (SysCtlPWMClockGet() / HAL_PWM_HZ)); // ESC frame
 	PWMPulseWidthSet(PWM1_BASE, PWM_OUT_0, (SysCtlPWMClockGet() / 1000)); // 1 mS
 	PWMOutputState(PWM1_BASE, PWM_OUT_0_BIT, true);
 	PWMPulseWidthSet(PWM1_BASE, PWM_OUT_1, (SysCtlPWMClockGet() / 1000)); // 1 mS
@@ -115,7 +117,7 @@ void PWM_Config(void) {
 	PWMGenEnable(PWM1_BASE, PWM_GEN_0);
 	
 	PWMGenConfigure(PWM1_BASE, PWM_GEN_1, PWM_GEN_MODE_DOWN | PWM_GEN_MODE_GEN_NO_SYNC);
-	PWMGenPeriodSet(PWM1_BASE, PWM_GEN_1, (SysCtlPWMClockGet() / 50)); // 50 Hz
+	PWMGenPeriodSet(PWM1_BASE, PWM_GEN_1, (SysCtlPWMClockGet() / HAL_PWM_HZ)); // ESC frame
 	PWMPulseWidthSet(PWM1_BASE, PWM_OUT_2, (SysCtlPWMClockGet() / 1000)); // 1 mS
 	PWMOutputState(PWM1_BASE, PWM_OUT_2_BIT, true);
 	PWMPulseWidthSet(PWM1_BASE, PWM_OUT_3, (SysCtlPWMClockGet() / 1000)); // 1 mS
@@ -156,6 +158,7 @@ void USB_Config(void) {
 	/// Initialize the transmit and receive buffers.
 	USBBufferInit(&g_sTxBuffer);
 	USBBufferInit(&g_sRxBuffer);
+	spsc_Init(&usb_rx_ring, usb_recieve_buffer, USB_BUFFER_SIZE, 1);
 
 	/// Set the USB stack mode to Device mode with VBUS monitoring.
 	USBStackModeSet(0, eUSBModeForceDevice, 0);
@@ -178,6 +181,12 @@ void NVIC_Config(void) {
 	IntEnable(INT_TIMER2A);
 	
 	/// USB interrupt
+	/// USB0 (RxHandler) and the UART0 bridge both push usb_rx_ring through
+	/// USBUARTPrimeTransmit. The ring takes one producer, which holds only
+	/// while neither interrupt can preempt the other: keep their priorities
+	/// equal.
+	IntPrioritySet(INT_USB0, 0);
+	IntPrioritySet(USB_UART_INT, 0);
 	IntEnable(USB_UART_INT);
 	
 	/// UART
@@ -0,0 +1,458 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "hal.h"
+#include "sensors.h"
+#include "control.h"
+#include "fastmath.h"
+#include "telemetry.h"
+#include "tasks.h"
+#include "prof.h"
+#include "blackbox.h"
+#include "param.h"
+
+
+uint8_t				control_estimator = __CONTROL_ESTIMATOR;
+uint8_t				control_mode = __CONTROL_MODE;
+float					control_kp = __KP, control_kd = __KD, control_ki = __KI;
+float					control_angle_kp = __ANGLE_KP, control_yaw_kp = __YAW_KP;
+float					control_rate_kp = __RATE_KP, control_rate_ki = __RATE_KI, control_rate_kd = __RATE_KD;
+float					control_yaw_rate_kp = __YAW_RATE_KP, control_yaw_rate_ki = __YAW_RATE_KI;
+uint16_t			control_rate_div = __RATE_DIV;
+uint8_t				control_frame = __FRAME;
+mixer_data		control_mixer;
+Vect3d				control_compass = {__COMPASS_X_OFFSET, __COMPASS_Y_OFFSET, __COMPASS_Z_OFFSET};
+uint16_t			control_torque_max = __TORQUE_MAX;
+uint32_t			pwm_msec;
+
+uint16_t			user_torque;
+uint16_t			torque[MIXER_MOTORS_MAX];
+float					roll, pitch, yaw;
+float					roll_des, pitch_des, yaw_des;
+float					u_roll, u_pitch, u_yaw;
+Vect3d				rate_des;
+uint16_t			control_period_us, control_exec_us;
+kalman_data		k_roll, k_pitch, k_yaw;
+pid_data			pid_roll, pid_pitch, pid_yaw;
+pid_data			pid_roll_rate, pid_pitch_rate, pid_yaw_rate;
+ahrs_data			k_ahrs;
+
+static uint32_t	control_tick_us;							// TASK_ESTIMATE start of this tick
+static uint32_t	control_sample_us;						// CONTROL_EST_MULTIRATE filters are at this time
+static uint8_t	control_sampled;
+static uint32_t	control_rate_us;							// CONTROL_CASCADE rate loop state
+static uint16_t	control_rate_n;
+static uint8_t	control_rate_started;
+
+static void control_RateReset(void);
+static void control_Motors(void);
+
+
+/*
+ * @brief: Reset attitude filters and controllers, solve the filters'
+ * 				steady-state gain in KALMAN_GAIN_STEADY, read PWM timing, register
+ * 				the control tasks, the rate loop too in CONTROL_CASCADE
+ * @param[in]: none
+ * @param[out]: none
+ */
+void control_Init(void) {
+	kalman_init(&k_roll);
+	kalman_init(&k_pitch);
+	kalman_init(&k_yaw);
+	kalman_steady_reset(&kalman_ss, KALMAN_STEADY_TOL);
+	if (kalman_gain_mode == KALMAN_GAIN_STEADY) kalman_steady_solve(&kalman_ss, 2 * KALMAN_STEADY_ITER_MAX);
+	ahrs_init(&k_ahrs);
+	control_sampled = 0;
+	roll = pitch = yaw = 0;
+	u_roll = u_pitch = u_yaw = 0;
+	pid_init(&pid_roll, -CONTROL_U_MAX, CONTROL_U_MAX, CONTROL_ANGLE_D_HZ);
+	pid_init(&pid_pitch, -CONTROL_U_MAX, CONTROL_U_MAX, CONTROL_ANGLE_D_HZ);
+	pid_init(&pid_yaw, -CONTROL_U_MAX, CONTROL_U_MAX, CONTROL_ANGLE_D_HZ);
+	pid_init(&pid_roll_rate, -CONTROL_U_MAX, CONTROL_U_MAX, CONTROL_RATE_D_HZ);
+	pid_init(&pid_pitch_rate, -CONTROL_U_MAX, CONTROL_U_MAX, CONTROL_RATE_D_HZ);
+	pid_init(&pid_yaw_rate, -CONTROL_U_MAX, CONTROL_U_MAX, CONTROL_RATE_D_HZ);
+	control_RateReset();
+	rate_des.x = rate_des.y = rate_des.z = 0;
+	if (control_frame != MIXER_CUSTOM) mixer_init(&control_mixer, control_frame);
+	if (control_mixer.motors == 0 || control_mixer.motors > HAL_PWM_CHANNELS) {
+		// unknown frame, or more motors than the board has outputs
+		control_frame = MIXER_QUAD_X;
+		mixer_init(&control_mixer, MIXER_QUAD_X);
+	}
+	
+	pwm_msec = hal_PWMMsec();
+	
+	task_Register(TASK_ESTIMATE, "estimate", control_EstimateTask, CONTROL_ESTIMATE_DEADLINE_US);
+	task_Register(TASK_CONTROL, "control", control_Step, CONTROL_STEP_DEADLINE_US);
+	task_Register(TASK_TELEMETRY, "telemetry", control_TelemetryTask, CONTROL_TELEMETRY_DEADLINE_US);
+	task_Register(TASK_COMMAND, "command", control_Command, CONTROL_COMMAND_DEADLINE_US);
+	if (control_mode == CONTROL_CASCADE) task_Register(TASK_RATE, "rate", control_RateTask, CONTROL_RATE_DEADLINE_US);
+}
+
+/*
+ * @brief: Tilt-compensated heading at the current roll and pitch, one sincos
+ * 				per angle
+ * @param[in]: compass reading, raw axes
+ * @param[out]: deg
+ */
+static float control_Heading(float mx, float my, float mz) {
+	float			yaw_x, yaw_y;
+	float			compass_x, compass_y, compass_z;
+	float			sr, cr, sp, cp;
+	
+	fastmath_sincos(roll * FASTMATH_DEG2RAD, &sr, &cr);
+	fastmath_sincos(pitch * FASTMATH_DEG2RAD, &sp, &cp);
+	compass_x = mx - control_compass.x;
+	compass_y = my - control_compass.y;
+	compass_z = mz - control_compass.z;
+	yaw_x = compass_x * cp + (compass_z * sr + compass_y * cr) * sp;
+	yaw_y = compass_z * cr - compass_y * sr;
+	return -fastmath_atan2(yaw_y, yaw_x) * FASTMATH_RAD2DEG;
+}
+
+/*
+ * @brief: Per-axis Kalman filters on accelerometer / tilt-compensated compass angles
+ * @param[in]: none
+ * @param[out]: none
+ */
+static void control_EstimateKalman(void) {
+	float			acc_roll, acc_pitch, acc_yaw;
+	
+	// after a noise parameter change, a few iterations per tick until solved
+	if (kalman_gain_mode == KALMAN_GAIN_STEADY && kalman_ss.state < KALMAN_STEADY_READY) {
+		kalman_steady_solve(&kalman_ss, KALMAN_STEADY_ITER_TICK);
+	}
+	acc_pitch = -fastmath_atan2(accel.x, -accel.z) * FASTMATH_RAD2DEG;
+	acc_roll = 	fastmath_atan2(accel.y, -accel.z) * FASTMATH_RAD2DEG;
+	kalman_innovate(&k_roll,	acc_roll,		gyro.x/14.7f);
+	kalman_innovate(&k_pitch,	acc_pitch,	gyro.y/14.7f);
+	roll	= k_roll.x[0];
+	pitch = k_pitch.x[0];
+	
+	acc_yaw = control_Heading(compass.x, compass.y, compass.z);
+	kalman_innovate(&k_yaw,		acc_yaw,		gyro.z/14.7f);
+	yaw		=	k_yaw.x[0];
+}
+
+/*
+ * @brief: The same filters on every sample of the tick in time order: each
+ * 				sample first predicts all three axes to its timestamp, then a
+ * 				gyro sample corrects the rates and an accelerometer or compass
+ * 				sample the angles; unfiltered readings, none are missed or reused
+ * @param[in]: none
+ * @param[out]: none
+ */
+static void control_EstimateMultirate(void) {
+	const sensors_entry	*e;
+	float			dt;
+	uint16_t	i;
+	
+	for (i = 0; i < sensors_batch_n; i++) {
+		e = &sensors_batch[i];
+		// a FIFO batch can stamp its oldest entries before the last gyro sample
+		if (!control_sampled) {
+			control_sample_us = e->t_us;
+			control_sampled = 1;
+		} else if ((int32_t)(e->t_us - control_sample_us) > 0) {
+			dt = (e->t_us - control_sample_us) * 1e-6f;
+			kalman_predict(&k_roll, dt);
+			kalman_predict(&k_pitch, dt);
+			kalman_predict(&k_yaw, dt);
+			control_sample_us = e->t_us;
+		}
+		switch (e->sensor) {
+			case __MEASURE_GYROSCOPE:
+					kalman_correct_rate(&k_roll,	e->data[0] / __GYRO_LSB_PER_DPS);
+					kalman_correct_rate(&k_pitch,	e->data[1] / __GYRO_LSB_PER_DPS);
+					kalman_correct_rate(&k_yaw,		e->data[2] / __GYRO_LSB_PER_DPS);
+				break;
+			case __MEASURE_ACCELEROMETER:
+					kalman_correct_angle(&k_roll,		fastmath_atan2(e->data[1], -e->data[2]) * FASTMATH_RAD2DEG);
+					kalman_correct_angle(&k_pitch,	-fastmath_atan2(e->data[0], -e->data[2]) * FASTMATH_RAD2DEG);
+				break;
+			default:
+					roll = k_roll.x[0];
+					pitch = k_pitch.x[0];
+					kalman_correct_angle(&k_yaw, control_Heading(e->data[0], e->data[1], e->data[2]));
+				break;
+		}
+	}
+	roll	= k_roll.x[0];
+	pitch = k_pitch.x[0];
+	yaw		=	k_yaw.x[0];
+}
+
+/*
+ * @brief: Quaternion AHRS, sensor axes mapped onto body FRD
+ * 				accel: x, y inverted (mounted 180 deg about z)
+ * 				compass: HMC5883L registers are X, Z, Y
+ * @param[in]: none
+ * @param[out]: none
+ */
+static void control_EstimateAHRS(void) {
+	Vect3d		a, g, m;
+	
+	a.x = -accel.x;
+	a.y = -accel.y;
+	a.z = accel.z;
+	g.x = gyro.x * (FASTMATH_DEG2RAD / __GYRO_LSB_PER_DPS);
+	g.y = gyro.y * (FASTMATH_DEG2RAD / __GYRO_LSB_PER_DPS);
+	g.z = gyro.z * (FASTMATH_DEG2RAD / __GYRO_LSB_PER_DPS);
+	m.x = compass.x - control_compass.x;
+	m.y = compass.z - control_compass.z;
+	m.z = compass.y - control_compass.y;
+	ahrs_update(&k_ahrs, &g, &a, &m, _dt);
+	ahrs_euler(&k_ahrs, &roll, &pitch, &yaw);
+}
+
+/*
+ * @brief: Update roll, pitch, yaw (deg) from the latest sensor readings
+ * @param[in]: none
+ * @param[out]: none
+ */
+void control_Estimate(void) {
+	if (control_estimator == CONTROL_EST_AHRS) {
+		control_EstimateAHRS();
+	} else if (control_estimator == CONTROL_EST_MULTIRATE) {
+		control_EstimateMultirate();
+	} else {
+		control_EstimateKalman();
+	}
+}
+
+/*
+ * @brief: Per-tick telemetry in telem_mode: binary frames, or the text lines
+ * @param[in]: tick start, hal_Micros()
+ * @param[out]: none
+ */
+void control_Telemetry(uint32_t now) {
+	uint8_t		usb_data[128];
+	
+	if (telem_mode == TELEM_BINARY) {
+		telem_Attitude(now, roll, pitch, yaw);
+		telem_Imu(sensors_last);
+		telem_Motors(torque);
+		telem_Timing(now, control_period_us, control_exec_us);
+	} else if (telem_mode == TELEM_TEXT) {
+		sprintf((char*)usb_data, "X:%06i,Y:%06i,Z:%06i\n", (int16_t)(roll*100), (int16_t)(pitch*100), (int16_t)(yaw*100));
+		hal_SerialWrite(usb_data);
+		sprintf((char*)usb_data, "u_roll: %i \t u_pitch: %i \t u_yaw: %i \n", (int32_t)(u_roll*100), (int32_t)(u_pitch*100), (int32_t)(u_yaw*100));
+		hal_SerialWrite(usb_data);
+	}
+}
+
+/*
+ * @brief: TASK_ESTIMATE: take the new sensor samples, update the attitude
+ * @param[in]: none
+ * @param[out]: none
+ */
+void control_EstimateTask(void) {
+	static uint32_t	last;
+	uint32_t	now = hal_Micros(), t;
+	
+	control_period_us = (uint16_t)(now - last);
+	last = now;
+	control_tick_us = now;
+	t = prof_Begin();
+	sensors_Collect();
+	control_Estimate();
+	prof_End(PROF_ESTIMATE, t);
+}
+
+/*
+ * @brief: CONTROL_ANGLE: one angle PID per axis, then the motor outputs
+ * @param[in]: none
+ * @param[out]: none
+ */
+static void control_StepAngle(void) {
+	uint32_t	t;
+	
+	
+	t = prof_Begin();
+	roll_des = 0;
+	pitch_des = 0;
+	yaw_des = 0;
+	
+	u_roll =	pid_update(&pid_roll,		control_kp, control_ki, control_kd, roll_des,		roll,		_dt);
+	u_pitch =	pid_update(&pid_pitch,	control_kp, control_ki, control_kd, pitch_des,	pitch,	_dt);
+	u_yaw =		pid_update(&pid_yaw,		control_kp, control_ki, control_kd, yaw_des,		yaw,		_dt);
+	prof_End(PROF_PID, t);
+	
+	t = prof_Begin();
+	control_Motors();
+	prof_End(PROF_MIXER, t);
+}
+
+static inline float control_Limit(float v, float limit) {
+	return v > limit ? limit : (v < -limit ? -limit : v);
+}
+
+/*
+ * @brief: CONTROL_CASCADE outer loop: angle errors to the rate setpoints the
+ * 				rate loop tracks until the next tick
+ * @param[in]: none
+ * @param[out]: none
+ */
+static void control_StepCascade(void) {
+	uint32_t	t = prof_Begin();
+	float			yaw_err = yaw_des - yaw;
+	
+	// the short way round
+	if (yaw_err > 180.0f) yaw_err -= 360.0f;
+	else if (yaw_err < -180.0f) yaw_err += 360.0f;
+	rate_des.x = control_Limit(control_angle_kp * (roll_des - roll), CONTROL_RATE_MAX);
+	rate_des.y = control_Limit(control_angle_kp * (pitch_des - pitch), CONTROL_RATE_MAX);
+	rate_des.z = control_Limit(control_yaw_kp * yaw_err, CONTROL_RATE_MAX);
+	prof_End(PROF_PID, t);
+}
+
+/*
+ * @brief: TASK_CONTROL: attitude control; the motor outputs too in
+ * 				CONTROL_ANGLE, the rate loop has them in CONTROL_CASCADE
+ * @param[in]: none
+ * @param[out]: none
+ */
+void control_Step(void) {
+	if (control_mode == CONTROL_CASCADE) {
+		control_StepCascade();
+	} else {
+		control_StepAngle();
+	}
+	control_exec_us = (uint16_t)(hal_Micros() - control_tick_us);
+	blackbox_Record(control_tick_us);
+}
+
+/*
+ * @brief: user_torque and u_roll, u_pitch, u_yaw through control_mixer to
+ * 				torque[] and the PWM outputs; the pulse widths keep the fraction the
+ * 				integer torque[] would round off. Zero throttle stops the motors,
+ * 				outputs past the frame's motors hold the zero-throttle pulse
+ * @param[in]: none
+ * @param[out]: none
+ */
+static void control_Motors(void) {
+	float			m[MIXER_MOTORS_MAX];
+	uint8_t		i;
+	
+	if (user_torque) mixer_mix(&control_mixer, user_torque, u_roll, u_pitch, u_yaw, control_torque_max, m);
+	for (i = 0; i < MIXER_MOTORS_MAX; i++) {
+		float v = user_torque && i < control_mixer.motors ? m[i] : 0.0f;
+		
+		torque[i] = (uint16_t)(v + 0.5f);
+		if (i < HAL_PWM_CHANNELS) hal_PWMWrite(i, pwm_msec + (uint32_t)(pwm_msec * v / __TORQUE_MAX));
+	}
+}
+
+/*
+ * @brief: Rate loop state back to rest
+ */
+static void control_RateReset(void) {
+	pid_reset(&pid_roll_rate);
+	pid_reset(&pid_pitch_rate);
+	pid_reset(&pid_yaw_rate);
+	control_rate_n = 0;
+	control_rate_started = 0;
+}
+
+/*
+ * @brief: TASK_RATE, CONTROL_CASCADE inner loop: on every control_rate_div-th
+ * 				gyro sample, rate PID to rate_des and the motor outputs; held at
+ * 				rest while user_torque is 0
+ * @param[in]: none
+ * @param[out]: none
+ */
+void control_RateTask(void) {
+	int16_t		g[3];
+	uint32_t	t, t_us;
+	float			dt;
+	
+	if (++control_rate_n < control_rate_div) return;
+	control_rate_n = 0;
+	t = prof_Begin();
+	sensors_Gyro(g, &t_us);
+	blackbox_Rate(t_us);
+	dt = (float)control_rate_div / __GYRO_HZ;
+	if (control_rate_started && (int32_t)(t_us - control_rate_us) > 0) dt = (t_us - control_rate_us) * 1e-6f;
+	control_rate_us = t_us;
+	control_rate_started = 1;
+	
+	if (!user_torque) {
+		control_RateReset();
+		u_roll = u_pitch = u_yaw = 0;
+	} else {
+		u_roll	= pid_update(&pid_roll_rate,	control_rate_kp, control_rate_ki, control_rate_kd, rate_des.x, g[0] / __GYRO_LSB_PER_DPS, dt);
+		u_pitch	= pid_update(&pid_pitch_rate,	control_rate_kp, control_rate_ki, control_rate_kd, rate_des.y, g[1] / __GYRO_LSB_PER_DPS, dt);
+		u_yaw		= pid_update(&pid_yaw_rate,		control_yaw_rate_kp, control_yaw_rate_ki, 0.0f, rate_des.z, g[2] / __GYRO_LSB_PER_DPS, dt);
+	}
+	control_Motors();
+	prof_End(PROF_RATE, t);
+}
+
+/*
+ * @brief: TASK_TELEMETRY
+ */
+void control_TelemetryTask(void) {
+	uint32_t t = prof_Begin();
+	
+	control_Telemetry(control_tick_us);
+	prof_End(PROF_USB_TX, t);
+}
+
+/*
+ * @brief: TASK_COMMAND: user commands received over USB CDC
+ * 				p: profiling report (prof_Report)
+ * 				l: start/stop the flight data recorder
+ * 				P: parameter requests (param_Command); what follows them is
+ * 				   read as the next command
+ * 				anything else: torque, decimal
+ * @param[in]: none
+ * @param[out]: none
+ */
+void control_Command(void) {
+	uint8_t		usb_data[HAL_SERIAL_RX_SIZE + 1], *c;
+	uint16_t	n, i, used;
+	uint32_t	t = prof_Begin();
+	
+	n = hal_SerialRead(usb_data);
+	usb_data[n] = 0;
+	for (i = 0; i < n; i += used) {
+		c = &usb_data[i];
+		used = n - i;
+		switch (c[0]) {
+			case 'p':
+					prof_Report();
+				break;
+			case 'P':
+					used = param_Command(c, n - i);
+				break;
+			case 'l':
+					if (blackbox_mode == BLACKBOX_ON) {
+						blackbox_Stop();
+					} else {
+						blackbox_Start();
+					}
+				break;
+			default:
+					user_torque = atoi((char *)c);
+					sprintf((char*)usb_data, "torque setted: %d\n", user_torque);
+					telem_Text(usb_data);
+				break;
+		}
+	}
+	prof_End(PROF_USB_RX, t);
+}
+
+/*
+ * @brief: One control tick, TIMER1A: post estimation, control, telemetry and
+ * 				command parsing, in that order of deadlines
+ * @param[in]: none
+ * @param[out]: none
+ */
+void control_Update(void) {
+	task_Post(TASK_ESTIMATE);
+	task_Post(TASK_CONTROL);
+	task_Post(TASK_TELEMETRY);
+	task_Post(TASK_COMMAND);
+}
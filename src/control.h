@@ -0,0 +1,99 @@
+#ifndef _CONTROL_H_
+#define _CONTROL_H_
+
+#include <stdint.h>
+#include "kalman.h"
+#include "ahrs.h"
+#include "pid.h"
+#include "mixer.h"
+
+#define __COMPASS_X_OFFSET					-82.0f
+#define __COMPASS_Y_OFFSET					136.5f
+#define __COMPASS_Z_OFFSET					-283.0f
+
+#define __GYRO_LSB_PER_DPS					14.375f
+
+#define CONTROL_EST_KALMAN					0		// per-axis Kalman on Euler angles
+#define CONTROL_EST_AHRS						1		// quaternion Mahony filter, ahrs.c
+#define CONTROL_EST_MULTIRATE				2		// per-axis Kalman, predict per sample, correct per sensor
+
+#ifndef __CONTROL_ESTIMATOR
+#define __CONTROL_ESTIMATOR					CONTROL_EST_KALMAN
+#endif
+
+#define CONTROL_ANGLE								0		// one angle PID per axis at the control tick
+#define CONTROL_CASCADE							1		// angle loop at the control tick, rate loop per gyro sample
+
+#ifndef __CONTROL_MODE
+#define __CONTROL_MODE							CONTROL_ANGLE
+#endif
+
+#ifndef __FRAME
+#define __FRAME											MIXER_QUAD_X		// airframe, mixer.h
+#endif
+
+#define __KP		0.01f
+#define __KD		0.01f
+#define __KI		0.001f
+
+// CONTROL_CASCADE: angle error (deg) -> rate setpoint (deg/s) -> motor command
+#define __ANGLE_KP							5.0f		// roll, pitch, 1/s
+#define __YAW_KP								2.0f		// 1/s
+#define __RATE_KP								0.2f		// roll, pitch, torque per deg/s
+#define __RATE_KI								1.0f		// torque per deg
+#define __RATE_KD								0.0f		// torque per deg/s^2, filtered at CONTROL_RATE_D_HZ
+#define __YAW_RATE_KP						0.5f
+#define __YAW_RATE_KI						1.0f
+#define __RATE_DIV							1				// rate loop on every n-th gyro sample
+#define CONTROL_RATE_MAX						200.0f	// deg/s, rate setpoint limit
+#define CONTROL_U_MAX								40.0f		// torque, PID output limit per axis
+#define CONTROL_ANGLE_D_HZ					20.0f		// derivative low-pass, CONTROL_ANGLE
+#define CONTROL_RATE_D_HZ						50.0f		// derivative low-pass, rate loop
+
+#define __TORQUE_MAX		100			// full-scale motor command, 2 ms pulse
+
+// task deadlines from the TIMER1A post, increasing in the order they must run
+#define CONTROL_ESTIMATE_DEADLINE_US				2000
+#define CONTROL_STEP_DEADLINE_US						3000		// motor outputs
+#define CONTROL_TELEMETRY_DEADLINE_US				10000
+#define CONTROL_COMMAND_DEADLINE_US					20000
+#define CONTROL_RATE_DEADLINE_US						500			// gyro sample to motor outputs
+
+
+extern uint8_t			control_estimator;
+extern uint8_t			control_mode;														// __CONTROL_MODE, read by control_Init
+extern float				control_kp, control_kd, control_ki;		// __KP, __KD, __KI at boot
+extern Vect3d				control_compass;												// __COMPASS_*_OFFSET at boot
+extern uint16_t			control_torque_max;											// __TORQUE_MAX at boot
+extern float				control_angle_kp, control_yaw_kp;				// __ANGLE_KP, __YAW_KP at boot
+extern float				control_rate_kp, control_rate_ki, control_rate_kd;
+extern float				control_yaw_rate_kp, control_yaw_rate_ki;
+extern uint16_t			control_rate_div;												// __RATE_DIV at boot
+extern uint8_t			control_frame;													// __FRAME, read by control_Init
+extern mixer_data		control_mixer;													// control_frame's table, or a MIXER_CUSTOM one
+extern uint32_t			pwm_msec;
+
+extern uint16_t			user_torque;
+extern uint16_t			torque[MIXER_MOTORS_MAX];							// telemetry and blackbox carry [0..3]
+extern float				roll, pitch, yaw;
+extern float				roll_des, pitch_des, yaw_des;
+extern float				u_roll, u_pitch, u_yaw;
+extern Vect3d				rate_des;																// CONTROL_CASCADE, deg/s
+extern uint16_t			control_period_us;											// between estimator runs
+extern uint16_t			control_exec_us;												// tick start to motor outputs
+extern kalman_data	k_roll, k_pitch, k_yaw;
+extern pid_data			pid_roll, pid_pitch, pid_yaw;						// CONTROL_ANGLE
+extern pid_data			pid_roll_rate, pid_pitch_rate, pid_yaw_rate;	// CONTROL_CASCADE rate loop
+extern ahrs_data		k_ahrs;
+
+extern void control_Init(void);
+extern void control_Estimate(void);
+extern void control_EstimateTask(void);
+extern void control_Step(void);
+extern void control_RateTask(void);
+extern void control_Telemetry(uint32_t now);
+extern void control_TelemetryTask(void);
+extern void control_Command(void);
+extern void control_Update(void);
+
+#endif
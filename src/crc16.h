@@ -0,0 +1,22 @@
+#ifndef _CRC16_H_
+#define _CRC16_H_
+
+#include <stdint.h>
+
+/*
+ * CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF, no reflection, no final xor),
+ * byte-wise from a 512-byte table. Check value: "123456789" -> 0x29B1.
+ */
+
+#define CRC16_INIT						0xFFFF
+
+
+extern const uint16_t	crc16_table[256];
+
+static inline uint16_t crc16_Byte(uint16_t crc, uint8_t b) {
+	return (uint16_t)(crc << 8) ^ crc16_table[(crc >> 8) ^ b];
+}
+
+extern uint16_t				crc16_Update(uint16_t crc, const uint8_t *data, uint32_t len);
+
+#endif
@@ -1,5 +1,6 @@
 #include <stdint.h>
 
 #define __USE_IMU
+#define __USE_I2C_ASYNC
 
 #define I2C_PORT	I2C2_BASE 
@@ -0,0 +1,51 @@
+#include <stdint.h>
+#include "fastmath.h"
+
+
+/*
+ * @brief: atan2 via a minimax odd polynomial of atan on [0, 1]
+ * @param[in]: y, x; atan2(0, 0) returns 0
+ * @param[out]: angle in rad, -pi..pi
+ */
+float fastmath_atan2(float y, float x) {
+	float ax = x < 0 ? -x : x;
+	float ay = y < 0 ? -y : y;
+	float a, s, r;
+	
+	if (ax == 0.0f && ay == 0.0f) return 0.0f;
+	a = ax < ay ? ax / ay : ay / ax;
+	s = a * a;
+	r = a * (0.99997726f + s * (-0.33262347f + s * (0.19354346f + s * (-0.11643287f + s * (0.05265332f + s * -0.01172120f)))));
+	if (ay > ax) r = FASTMATH_PI / 2 - r;
+	if (x < 0) r = FASTMATH_PI - r;
+	return y < 0 ? -r : r;
+}
+
+/*
+ * @brief: sin and cos of one angle: quadrant reduction, minimax polynomials
+ * 				on [-pi/4, pi/4]
+ * @param[in]: x rad
+ * @param[out]: s = sin(x), c = cos(x)
+ */
+void fastmath_sincos(float x, float *s, float *c) {
+	int32_t k = (int32_t)(x * (2.0f / FASTMATH_PI) + (x < 0 ? -0.5f : 0.5f));
+	float r, r2, ps, pc;
+	
+	// x - k*pi/2 with pi/2 split so the first product is exact
+	r = (x - k * 1.5703125f) - k * 4.83826794897e-4f;
+	r2 = r * r;
+	ps = r + r * r2 * (-1.6666667e-1f + r2 * (8.3333310e-3f + r2 * -1.9840874e-4f));
+	pc = 1.0f + r2 * (-0.5f + r2 * (4.1666638e-2f + r2 * (-1.3888378e-3f + r2 * 2.4390014e-5f)));
+	// quadrant: odd k swaps sin and cos, k = 2, 3 negates sin, k = 1, 2 negates cos
+	if (k & 1) {
+		r = ps;
+		ps = pc;
+		pc = -r;
+	}
+	if (k & 2) {
+		ps = -ps;
+		pc = -pc;
+	}
+	*s = ps;
+	*c = pc;
+}
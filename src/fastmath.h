@@ -0,0 +1,23 @@
+#ifndef _FASTMATH_H_
+#define _FASTMATH_H_
+
+#include <stdint.h>
+
+/*
+ * Single-precision trig for the attitude path, built from multiplies, adds and
+ * one divide so the M4F FPU runs it without library calls.
+ *
+ * Max absolute error against double libm (bench_fastmath):
+ *   fastmath_atan2		2.0e-6 rad (1.1e-4 deg), any quadrant
+ *   fastmath_sincos		4.0e-7 for |x| <= 1000 (3 ulp of 1.0)
+ */
+
+#define FASTMATH_PI						3.14159265f
+#define FASTMATH_DEG2RAD				(FASTMATH_PI / 180.0f)
+#define FASTMATH_RAD2DEG				(180.0f / FASTMATH_PI)
+
+
+extern float	fastmath_atan2(float y, float x);
+extern void		fastmath_sincos(float x, float *s, float *c);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef _HAL_H_
+#define _HAL_H_
+
+#include <stdint.h>
+
+/*
+ * Hardware abstraction layer for the flight code.
+ *
+ * Everything above this boundary (control, sensors, drivers) is portable C.
+ * Blocking I2C is reached through i2cu.h; the I2C master primitives below are
+ * what the interrupt-driven engine in i2c_async.c is built on.
+ * hal_SerialTxRing/Commit expose the USB transmit ring itself so a writer can
+ * encode into it in place (telemetry.c); call both with interrupts masked,
+ * other writers hold off from one to the other. hal_Cycles is a free-running cycle
+ * counter for profiling (prof.h), hal_CycleHz its rate. hal_StoreRead/Write
+ * reach HAL_STORE_SIZE bytes of non-volatile store (param.h), by whole words.
+ * Backends: hal_tm4c.c (TivaWare, firmware) and host/hal_linux.c (host build).
+ */
+
+#ifndef HAL_PWM_CHANNELS
+#define HAL_PWM_CHANNELS						4		// motor outputs; the host build has 8 for hex and octo frames
+#endif
+#define HAL_PWM_HZ									400		// ESC frame rate; 1-2 ms pulses, so at most ~490 Hz
+#define HAL_SERIAL_RX_SIZE					256		// most bytes one hal_SerialRead returns (USB_BUFFER_SIZE)
+#define HAL_STORE_SIZE							2048	// TM4C123 EEPROM
+
+#define HAL_TIMER_CONTROL						0		// TIMER1A, 100 Hz control loop
+#define HAL_TIMER_SENSORS						1		// TIMER2A, SENSORS_TICK_HZ sampling scheduler
+
+// external interrupt lines from the sensors
+#define HAL_EXTI_ACCEL							0		// ADXL345 INT1, rising edge
+#define HAL_EXTI_GYRO								1		// ITG3200 INT, rising edge
+#define HAL_EXTI_COMPASS						2		// HMC5883L DRDY, falling edge
+#define HAL_EXTI_LINES							3
+
+// I2C master commands, one bus operation each; completion raises the I2C interrupt
+#define HAL_I2C_SINGLE_SEND					0
+#define HAL_I2C_BURST_SEND_START			1
+#define HAL_I2C_BURST_SEND_CONT				2
+#define HAL_I2C_BURST_SEND_FINISH			3
+#define HAL_I2C_BURST_SEND_STOP				4		// error stop
+#define HAL_I2C_SINGLE_RECEIVE				5
+#define HAL_I2C_BURST_RECEIVE_START		6
+#define HAL_I2C_BURST_RECEIVE_CONT		7
+#define HAL_I2C_BURST_RECEIVE_FINISH	8
+#define HAL_I2C_BURST_RECEIVE_STOP		9		// error stop
+
+
+extern void			hal_PWMWrite(uint8_t channel, uint32_t width);
+extern uint32_t	hal_PWMMsec(void);
+extern void			hal_TimerAck(uint8_t timer);
+extern uint16_t	hal_SerialRead(uint8_t *buffer);
+extern void			hal_SerialWrite(uint8_t *buffer);
+extern uint8_t	*hal_SerialTxRing(uint16_t *size, uint16_t *head, uint16_t *space);
+extern void			hal_SerialTxCommit(uint16_t len);
+
+extern uint32_t	hal_Micros(void);
+extern void			hal_CyclesInit(void);
+extern uint32_t	hal_Cycles(void);
+extern uint32_t	hal_CycleHz(void);
+
+extern uint8_t	hal_StoreRead(uint32_t addr, void *data, uint32_t len);
+extern uint8_t	hal_StoreWrite(uint32_t addr, const void *data, uint32_t len);
+
+extern void			hal_ExtIntEnable(uint8_t line);
+extern uint8_t	hal_ExtIntPending(uint8_t line);
+extern void			hal_ExtIntAck(uint8_t line);
+extern uint8_t	hal_ExtIntLevel(uint8_t line);
+
+extern uint32_t	hal_CriticalEnter(void);
+extern void			hal_CriticalExit(uint32_t state);
+
+extern void			hal_I2CSlave(uint8_t id, uint8_t receive);
+extern void			hal_I2CPut(uint8_t data);
+extern uint8_t	hal_I2CGet(void);
+extern void			hal_I2CCommand(uint8_t cmd);
+extern uint8_t	hal_I2CError(void);
+extern void			hal_I2CIntEnable(void);
+extern void			hal_I2CIntAck(void);
+
+#endif
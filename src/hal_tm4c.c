@@ -0,0 +1,278 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "tm4c123gh6pm.h"
+#include "hw_memmap.h"
+#include "hw_types.h"
+#include "sysctl.h"
+#include "timer.h"
+#include "pwm.h"
+#include "gpio.h"
+#include "i2c.h"
+#include "interrupt.h"
+#include "hw_ints.h"
+#include "hw_nvic.h"
+#include "systick.h"
+#include "eeprom.h"
+
+#include "usb_dev_serial.h"
+
+#include "defines.h"
+#include "hal.h"
+
+
+extern volatile uint32_t g_ui32SysTickCount;				// usb_dev_serial.c
+
+// Cortex-M4 debug registers, not in hw_nvic.h
+#define CORE_DEMCR								0xE000EDFC
+#define CORE_DEMCR_TRCENA					0x01000000
+#define DWT_CTRL									0xE0001000
+#define DWT_CTRL_CYCCNTENA				0x00000001
+#define DWT_CYCCNT								0xE0001004
+
+#if HAL_PWM_CHANNELS > 4
+#error "the board drives PWM1 outputs 0..3 only (PD0, PD1, PA6, PA7)"
+#endif
+static const uint32_t pwm_out[HAL_PWM_CHANNELS] = {PWM_OUT_0, PWM_OUT_1, PWM_OUT_2, PWM_OUT_3};
+// wiring: ADXL345 INT1 -> PE3, ITG3200 INT -> PE2, HMC5883L DRDY -> PE1
+static const uint32_t exti_port[HAL_EXTI_LINES] = {GPIO_PORTE_BASE, GPIO_PORTE_BASE, GPIO_PORTE_BASE};
+static const uint8_t	exti_pin[HAL_EXTI_LINES] = {GPIO_PIN_3, GPIO_PIN_2, GPIO_PIN_1};
+static const uint32_t exti_edge[HAL_EXTI_LINES] = {GPIO_RISING_EDGE, GPIO_RISING_EDGE, GPIO_FALLING_EDGE};
+static const uint32_t exti_int[HAL_EXTI_LINES] = {INT_GPIOE, INT_GPIOE, INT_GPIOE};
+
+static const uint32_t i2c_cmd[] = {
+	I2C_MASTER_CMD_SINGLE_SEND,
+	I2C_MASTER_CMD_BURST_SEND_START,
+	I2C_MASTER_CMD_BURST_SEND_CONT,
+	I2C_MASTER_CMD_BURST_SEND_FINISH,
+	I2C_MASTER_CMD_BURST_SEND_ERROR_STOP,
+	I2C_MASTER_CMD_SINGLE_RECEIVE,
+	I2C_MASTER_CMD_BURST_RECEIVE_START,
+	I2C_MASTER_CMD_BURST_RECEIVE_CONT,
+	I2C_MASTER_CMD_BURST_RECEIVE_FINISH,
+	I2C_MASTER_CMD_BURST_RECEIVE_ERROR_STOP
+};
+
+/*
+ * @brief: Set motor PWM pulse width
+ * @param[in]: channel 0..HAL_PWM_CHANNELS-1, width in PWM clock ticks
+ * @param[out]: none
+ */
+void hal_PWMWrite(uint8_t channel, uint32_t width) {
+	PWMPulseWidthSet(PWM1_BASE, pwm_out[channel], width);
+}
+
+/*
+ * @brief: PWM clock ticks in 1 mS (ESC zero-throttle pulse)
+ * @param[in]: none
+ * @param[out]: ticks
+ */
+uint32_t hal_PWMMsec(void) {
+	return SysCtlPWMClockGet() / 1000;
+}
+
+/*
+ * @brief: Clear the timer interrupt
+ * @param[in]: HAL_TIMER_CONTROL, HAL_TIMER_SENSORS
+ * @param[out]: none
+ */
+void hal_TimerAck(uint8_t timer) {
+	if (timer == HAL_TIMER_CONTROL) {
+		TimerIntClear(TIMER1_BASE, TIMER_TIMA_TIMEOUT);
+	} else {
+		TimerIntClear(TIMER2_BASE, TIMER_TIMA_TIMEOUT);
+	}
+}
+
+/*
+ * @brief: Read data received over USB CDC since the last call
+ * @param[in]: buffer of HAL_SERIAL_RX_SIZE bytes
+ * @param[out]: number of bytes read
+ */
+uint16_t hal_SerialRead(uint8_t *buffer) {
+	return get_USB_CDC_Data(buffer);
+}
+
+/*
+ * @brief: Send NUL-terminated string over USB CDC
+ * @param[in]: buffer, zero-filled on return
+ * @param[out]: none
+ */
+void hal_SerialWrite(uint8_t *buffer) {
+	send_USB_CDC_Data(buffer);
+}
+
+/*
+ * @brief: USB CDC transmit ring (g_sTxBuffer) for in-place writes
+ * @param[in]: none
+ * @param[out]: ring base, its size, write index, free bytes
+ */
+uint8_t *hal_SerialTxRing(uint16_t *size, uint16_t *head, uint16_t *space) {
+	return reserve_USB_CDC_Tx(size, head, space);
+}
+
+/*
+ * @brief: Send len bytes written into the ring from the write index on
+ * @param[in]: len, at most the space hal_SerialTxRing reported
+ * @param[out]: none
+ */
+void hal_SerialTxCommit(uint16_t len) {
+	commit_USB_CDC_Tx(len);
+}
+
+/*
+ * @brief: Configure a sensor interrupt pin for edge interrupts
+ * @param[in]: HAL_EXTI_*
+ * @param[out]: none
+ */
+void hal_ExtIntEnable(uint8_t line) {
+	GPIOPinTypeGPIOInput(exti_port[line], exti_pin[line]);
+	GPIOIntTypeSet(exti_port[line], exti_pin[line], exti_edge[line]);
+	GPIOIntClear(exti_port[line], exti_pin[line]);
+	GPIOIntEnable(exti_port[line], exti_pin[line]);
+	IntEnable(exti_int[line]);
+}
+
+/*
+ * @brief: Edge latched on the line, for the shared port handler
+ */
+uint8_t hal_ExtIntPending(uint8_t line) {
+	return (GPIOIntStatus(exti_port[line], true) & exti_pin[line]) != 0;
+}
+
+void hal_ExtIntAck(uint8_t line) {
+	GPIOIntClear(exti_port[line], exti_pin[line]);
+}
+
+/*
+ * @brief: Current pin level, to catch a line that stayed high without a new edge
+ */
+uint8_t hal_ExtIntLevel(uint8_t line) {
+	return GPIOPinRead(exti_port[line], exti_pin[line]) != 0;
+}
+
+/*
+ * @brief: Microseconds since boot from the SysTick count and counter, wraps
+ * 				every 71 minutes; safe in ISRs that run above SysTick
+ * @param[in]: none
+ * @param[out]: us
+ */
+uint32_t hal_Micros(void) {
+	static uint32_t clock_mhz;
+	uint32_t ticks, value, period = SysTickPeriodGet();
+	
+	if (!clock_mhz) clock_mhz = SysCtlClockGet() / 1000000;
+	do {
+		ticks = g_ui32SysTickCount;
+		value = SysTickValueGet();
+	} while (ticks != g_ui32SysTickCount);
+	// counter reloaded but SysTick_Handler has not run yet
+	if ((HWREG(NVIC_INT_CTRL) & NVIC_INT_CTRL_PEND_SYST) && value > period / 2) ticks++;
+	return ticks * (1000000 / SYSTICKS_PER_SECOND) + (period - 1 - value) / clock_mhz;
+}
+
+/*
+ * @brief: Start the DWT cycle counter
+ * @param[in]: none
+ * @param[out]: none
+ */
+void hal_CyclesInit(void) {
+	HWREG(CORE_DEMCR) |= CORE_DEMCR_TRCENA;
+	HWREG(DWT_CYCCNT) = 0;
+	HWREG(DWT_CTRL) |= DWT_CTRL_CYCCNTENA;
+}
+
+/*
+ * @brief: CPU cycles, wraps every 53 s at 80 MHz
+ */
+uint32_t hal_Cycles(void) {
+	return HWREG(DWT_CYCCNT);
+}
+
+uint32_t hal_CycleHz(void) {
+	return SysCtlClockGet();
+}
+
+/*
+ * @brief: Power up the EEPROM on first use; EEPROMInit recovers from a write
+ * 				interrupted by a reset
+ * @param[in]: none
+ * @param[out]: 1 if usable
+ */
+static uint8_t hal_StoreInit(void) {
+	static uint8_t state;
+	
+	if (!state) {
+		SysCtlPeripheralEnable(SYSCTL_PERIPH_EEPROM0);
+		while (!SysCtlPeripheralReady(SYSCTL_PERIPH_EEPROM0));
+		state = EEPROMInit() == EEPROM_INIT_OK ? 1 : 2;
+	}
+	return state == 1;
+}
+
+/*
+ * @brief: Read from the EEPROM
+ * @param[in]: byte address and length, multiples of 4
+ * @param[out]: data; 1 on success
+ */
+uint8_t hal_StoreRead(uint32_t addr, void *data, uint32_t len) {
+	if ((addr | len) & 3 || addr + len > HAL_STORE_SIZE || !hal_StoreInit()) return 0;
+	EEPROMRead(data, addr, len);
+	return 1;
+}
+
+/*
+ * @brief: Program the EEPROM, busy-waits about 110 us per word plus any
+ * 				block erase; not for the control loop
+ * @param[in]: byte address and length, multiples of 4, data
+ * @param[out]: 1 on success
+ */
+uint8_t hal_StoreWrite(uint32_t addr, const void *data, uint32_t len) {
+	if ((addr | len) & 3 || addr + len > HAL_STORE_SIZE || !hal_StoreInit()) return 0;
+	return EEPROMProgram((uint32_t *)data, addr, len) == 0;
+}
+
+/*
+ * @brief: Mask interrupts
+ * @param[in]: none
+ * @param[out]: previous state for hal_CriticalExit
+ */
+uint32_t hal_CriticalEnter(void) {
+	return IntMasterDisable();
+}
+
+void hal_CriticalExit(uint32_t state) {
+	if (!state) IntMasterEnable();
+}
+
+/*
+ * @brief: I2C master primitives for i2c_async.c, I2C_PORT from defines.h
+ */
+void hal_I2CSlave(uint8_t id, uint8_t receive) {
+	I2CMasterSlaveAddrSet(I2C_PORT, id, receive ? true : false);
+}
+
+void hal_I2CPut(uint8_t data) {
+	I2CMasterDataPut(I2C_PORT, data);
+}
+
+uint8_t hal_I2CGet(void) {
+	return I2CMasterDataGet(I2C_PORT);
+}
+
+void hal_I2CCommand(uint8_t cmd) {
+	I2CMasterControl(I2C_PORT, i2c_cmd[cmd]);
+}
+
+uint8_t hal_I2CError(void) {
+	return I2CMasterErr(I2C_PORT) != I2C_MASTER_ERR_NONE;
+}
+
+void hal_I2CIntEnable(void) {
+	I2CMasterIntClear(I2C_PORT);
+	I2CMasterIntEnable(I2C_PORT);
+	IntEnable(INT_I2C2);
+}
+
+void hal_I2CIntAck(void) {
+	I2CMasterIntClear(I2C_PORT);
+}
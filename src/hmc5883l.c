@@ -13,7 +13,7 @@ int16_t xyz[3], Testx, Testy, Testz, Testxyz[3], TestMax, TestMin, xyz_comp_num[
  * @param[out]: none
  */
 void hmc5883l_Init(void){
-	i2c_WriteByte(I2C_ID_HMC5883L, HMC5883L_RA_CONFIG_A, HMC5883L_AVERAGING_8 | HMC5883L_RATE_15 | HMC5883L_BIAS_NORMAL);
+	i2c_WriteByte(I2C_ID_HMC5883L, HMC5883L_RA_CONFIG_A, HMC5883L_AVERAGING_8 | HMC5883L_RATE_75 | HMC5883L_BIAS_NORMAL);
 	i2c_WriteByte(I2C_ID_HMC5883L, HMC5883L_RA_CONFIG_B, HMC5883L_GAIN_1090);
 	i2c_WriteByte(I2C_ID_HMC5883L, HMC5883L_RA_MODE, HMC5883L_MODE_CONTINUOUS);
 }
@@ -28,6 +28,15 @@ void hmc5883l_ReadXYZ(int16_t *x, int16_t *y, int16_t *z){
 	i2c_WriteByte(I2C_ID_HMC5883L, HMC5883L_RA_MODE, HMC5883L_MODE_SINGLE);
 	//ROM_SysCtlDelay(6*(ROM_SysCtlClockGet()/3000));
 	i2c_ReadBuf(I2C_ID_HMC5883L, HMC5883L_DATA, 6, b);
+	hmc5883l_DecodeXYZ(b, x, y, z);
+}
+
+/*
+ * @brief: Unpack the data registers as read from the bus, with gain compensation
+ * @param[in]: 6 raw bytes, ptr output to individual axes
+ * @param[out]: none
+ */
+void hmc5883l_DecodeXYZ(const uint8_t *b, int16_t *x, int16_t *y, int16_t *z){
 	*x = ((int16_t)(((uint16_t)b[0]<<8) | (uint16_t)b[1]))*xyz_comp_num[0]/xyz_comp_den[0];
 	*y = ((int16_t)(((uint16_t)b[2]<<8) | (uint16_t)b[3]))*xyz_comp_num[1]/xyz_comp_den[1];
 	*z = ((int16_t)(((uint16_t)b[4]<<8) | (uint16_t)b[5]))*xyz_comp_num[2]/xyz_comp_den[2];
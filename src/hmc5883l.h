@@ -55,4 +55,5 @@
 
 extern void hmc5883l_Init(void);
 extern void hmc5883l_ReadXYZ(int16_t *x, int16_t *y, int16_t *z);
+extern void hmc5883l_DecodeXYZ(const uint8_t *b, int16_t *x, int16_t *y, int16_t *z);
 extern void hmc5883l_TempComp(void);
@@ -0,0 +1,164 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+#include "i2c_async.h"
+
+
+#define I2C_STATE_IDLE					0
+#define I2C_STATE_REG						1				// register address sent
+#define I2C_STATE_RECEIVE				2
+#define I2C_STATE_SEND					3
+#define I2C_STATE_STOP					4				// error stop issued
+
+
+static i2c_txn						*i2c_queue[I2C_QUEUE_SIZE];
+static volatile uint8_t		i2c_head, i2c_tail;
+static volatile uint8_t		i2c_state;
+static uint8_t						i2c_count;							// bytes moved in the current register read/write
+static uint8_t						*i2c_buf;
+static uint8_t						i2c_enabled;
+
+
+/*
+ * @brief: First bus operation of the transaction at the head of the queue
+ */
+static void i2c_Start(void) {
+	i2c_txn *t = i2c_queue[i2c_head & (I2C_QUEUE_SIZE - 1)];
+	
+	// a repeated read resumes where it gave way
+	if (t->status != I2C_TXN_BUSY) t->pos = 0;
+	t->status = I2C_TXN_BUSY;
+	i2c_count = 0;
+	i2c_buf = t->buf + t->pos * t->n;
+	hal_I2CSlave(t->id, 0);
+	hal_I2CPut(t->addr);
+	if (t->dir == I2C_TXN_READ) {
+		hal_I2CCommand(HAL_I2C_SINGLE_SEND);
+		i2c_state = I2C_STATE_REG;
+	} else {
+		hal_I2CCommand(HAL_I2C_BURST_SEND_START);
+		i2c_state = I2C_STATE_SEND;
+	}
+}
+
+/*
+ * @brief: Retire the head transaction and start the next one
+ */
+static void i2c_Finish(uint8_t status) {
+	i2c_txn *t = i2c_queue[i2c_head & (I2C_QUEUE_SIZE - 1)];
+	
+	i2c_head++;
+	i2c_state = I2C_STATE_IDLE;
+	t->status = status;
+	if (t->done != NULL) t->done(t);
+	if (i2c_state == I2C_STATE_IDLE && i2c_head != i2c_tail) i2c_Start();
+}
+
+/*
+ * @brief: Reset the queue and enable the I2C master interrupt
+ * @param[in]: none
+ * @param[out]: none
+ */
+void i2c_AsyncInit(void) {
+	i2c_head = 0;
+	i2c_tail = 0;
+	i2c_state = I2C_STATE_IDLE;
+	hal_I2CIntEnable();
+	i2c_enabled = 1;
+}
+
+/*
+ * @brief: Queue a transaction, starting the bus if it is idle
+ * @param[in]: transaction, any context
+ * @param[out]: 1 if queued, 0 if the queue is full, the engine is off or n is 0
+ */
+int32_t i2c_Submit(i2c_txn *txn) {
+	uint32_t irq;
+	
+	if (!i2c_enabled || txn->n == 0) return 0;
+	irq = hal_CriticalEnter();
+	if ((uint8_t)(i2c_tail - i2c_head) >= I2C_QUEUE_SIZE) {
+		hal_CriticalExit(irq);
+		return 0;
+	}
+	txn->status = I2C_TXN_QUEUED;
+	i2c_queue[i2c_tail & (I2C_QUEUE_SIZE - 1)] = txn;
+	i2c_tail++;
+	if (i2c_state == I2C_STATE_IDLE) i2c_Start();
+	hal_CriticalExit(irq);
+	return 1;
+}
+
+/*
+ * @brief: Nothing queued or on the bus
+ */
+uint8_t i2c_AsyncIdle(void) {
+	return i2c_state == I2C_STATE_IDLE && i2c_head == i2c_tail;
+}
+
+/*
+ * @brief: I2C master interrupt: previous bus operation finished, issue the next
+ * @param[in]: none
+ * @param[out]: none
+ */
+void i2c_AsyncISR(void) {
+	i2c_txn *t;
+	
+	hal_I2CIntAck();
+	if (i2c_state == I2C_STATE_IDLE) return;
+	t = i2c_queue[i2c_head & (I2C_QUEUE_SIZE - 1)];
+	
+	if (i2c_state == I2C_STATE_STOP) {
+		i2c_Finish(I2C_TXN_ERROR);
+		return;
+	}
+	if (hal_I2CError()) {
+		// address NAK ends the transfer in hardware; a data NAK mid-burst needs the stop
+		if (i2c_state == I2C_STATE_SEND && i2c_count > 0) {
+			hal_I2CCommand(HAL_I2C_BURST_SEND_STOP);
+			i2c_state = I2C_STATE_STOP;
+		} else if (i2c_state == I2C_STATE_RECEIVE && i2c_count + 1 < t->n) {
+			hal_I2CCommand(HAL_I2C_BURST_RECEIVE_STOP);
+			i2c_state = I2C_STATE_STOP;
+		} else {
+			i2c_Finish(I2C_TXN_ERROR);
+		}
+		return;
+	}
+	
+	switch (i2c_state) {
+		case I2C_STATE_REG:
+				hal_I2CSlave(t->id, 1);
+				hal_I2CCommand(t->n == 1 ? HAL_I2C_SINGLE_RECEIVE : HAL_I2C_BURST_RECEIVE_START);
+				i2c_state = I2C_STATE_RECEIVE;
+			break;
+		
+		case I2C_STATE_RECEIVE:
+				i2c_buf[i2c_count++] = hal_I2CGet();
+				if (i2c_count == t->n && ++t->pos < t->rep) {
+					// block done and the bus is stopped: let waiting transactions go first
+					if ((uint8_t)(i2c_tail - i2c_head) > 1) {
+						i2c_head++;
+						i2c_queue[i2c_tail & (I2C_QUEUE_SIZE - 1)] = t;
+						i2c_tail++;
+					}
+					i2c_Start();
+				} else if (i2c_count == t->n) {
+					i2c_Finish(I2C_TXN_DONE);
+				} else {
+					hal_I2CCommand(i2c_count == t->n - 1 ? HAL_I2C_BURST_RECEIVE_FINISH : HAL_I2C_BURST_RECEIVE_CONT);
+				}
+			break;
+		
+		case I2C_STATE_SEND:
+				if (i2c_count == t->n) {
+					i2c_Finish(I2C_TXN_DONE);
+				} else {
+					hal_I2CPut(t->buf[i2c_count]);
+					i2c_count++;
+					hal_I2CCommand(i2c_count == t->n ? HAL_I2C_BURST_SEND_FINISH : HAL_I2C_BURST_SEND_CONT);
+				}
+			break;
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef _I2C_ASYNC_H_
+#define _I2C_ASYNC_H_
+
+#include <stdint.h>
+
+/*
+ * Interrupt-driven I2C: register reads/writes are queued as transactions and
+ * clocked out by the I2C master interrupt, one bus operation per interrupt,
+ * so nothing spins on I2CMasterBusy. Transactions are owned by the caller and
+ * must stay alive until status is I2C_TXN_DONE or I2C_TXN_ERROR; the callback,
+ * if any, runs in interrupt context and may submit again.
+ *
+ * A repeated read (rep > 1) drains a FIFO behind a data register block in one
+ * transaction and one callback, e.g. ADXL345 entries at DATAX0..DATAZ1.
+ * Between blocks it goes to the back of the queue if anything is waiting, so
+ * a long drain delays other reads by one block at most.
+ *
+ * The blocking i2cu.h calls drive the same master and must not be used once
+ * i2c_AsyncInit() has run.
+ */
+
+#define I2C_QUEUE_SIZE					8				// power of two
+
+#define I2C_TXN_READ						0
+#define I2C_TXN_WRITE						1
+
+#define I2C_TXN_IDLE						0
+#define I2C_TXN_QUEUED					1
+#define I2C_TXN_BUSY						2
+#define I2C_TXN_DONE						3
+#define I2C_TXN_ERROR						4
+
+
+typedef struct i2c_txn i2c_txn;
+typedef void (*i2c_txn_done)(i2c_txn *txn);
+
+struct i2c_txn {
+	uint8_t						id;								// 7-bit slave address
+	uint8_t						addr;							// first register
+	uint8_t						dir;							// I2C_TXN_READ, I2C_TXN_WRITE
+	uint8_t						n;								// bytes, 1..255
+	uint8_t						rep;							// reads: repeat the register read, buf advances n each (0 = once)
+	uint8_t						pos;							// blocks read so far, engine use
+	uint8_t						*buf;
+	i2c_txn_done			done;							// optional completion callback
+	void							*ctx;
+	volatile uint8_t	status;
+};
+
+extern void			i2c_AsyncInit(void);
+extern int32_t	i2c_Submit(i2c_txn *txn);
+extern uint8_t	i2c_AsyncIdle(void);
+extern void			i2c_AsyncISR(void);
+
+#endif
@@ -4,7 +4,11 @@
 #include "itg3200.h"
 
 void itg3200_Init(void) {
-	i2c_WriteByte(I2C_ID_ITG3200, ITG3200_RA_DLPF_FS, ITG3200_DLPF_FS_FULL_SCALE);
+	// 188 Hz DLPF samples at 1 kHz internally, divider 0 keeps 1 kHz output
+	i2c_WriteByte(I2C_ID_ITG3200, ITG3200_RA_DLPF_FS, ITG3200_DLPF_FS_FULL_SCALE | ITG3200_DLPF_FS_FILTER_188HZ);
+	i2c_WriteByte(I2C_ID_ITG3200, ITG3200_RA_SMPLRT_DIV, 0);
+	// INT active high, push-pull, held until the next register read
+	i2c_WriteByte(I2C_ID_ITG3200, ITG3200_RA_INT_CFG, ITG3200_INT_CFG_LATCH_INT_EN | ITG3200_INT_CFG_INT_ANYRD_2CLEAR | ITG3200_INT_CFG_RAW_DRY_EN);
 }
 
 /*
@@ -16,6 +20,15 @@ void itg3200_ReadXYZ(int16_t *x, int16_t *y, int16_t *z) {
 uint8_t b[6];
 	
 	i2c_ReadBuf(I2C_ID_ITG3200, ITG3200_RA_GYRO_XOUT_H, 6, b);
+	itg3200_DecodeXYZ(b, x, y, z);
+}
+
+/*
+ * @brief: Unpack GYRO_XOUT_H..GYRO_ZOUT_L as read from the bus
+ * @param[in]: 6 raw bytes, ptr output to individual axes
+ * @param[out]: none
+ */
+void itg3200_DecodeXYZ(const uint8_t *b, int16_t *x, int16_t *y, int16_t *z) {
 	*x = ((int16_t)(((uint16_t)b[0]<<8) | (uint16_t)b[1]));
 	*y = ((int16_t)(((uint16_t)b[2]<<8) | (uint16_t)b[3]));
 	*z = ((int16_t)(((uint16_t)b[4]<<8) | (uint16_t)b[5]));
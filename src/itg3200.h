@@ -49,3 +49,4 @@
 
 extern void itg3200_Init(void);
 extern void itg3200_ReadXYZ(int16_t *x, int16_t *y, int16_t *z);
+extern void itg3200_DecodeXYZ(const uint8_t *b, int16_t *x, int16_t *y, int16_t *z);
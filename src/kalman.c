@@ -1,82 +1,297 @@
 #include <stdint.h>
+#include <string.h>
+#include <math.h>
 #include "kalman.h"
 
 
+kalman_noise kalman_qr = {_Q00, _Q11, _Q22, _R00, _R11};
+uint8_t kalman_gain_mode = __KALMAN_GAIN;
+kalman_steady kalman_ss;
+
+
 void kalman_init(kalman_data * kd) {
 	
 	kd->x[0] = 0.0f;
 	kd->x[1] = 0.0f;
 	kd->x[2] = 0.0f;
 	
-	kd->P[0][0] = 1000.0f;
-	kd->P[0][1] = 0.0f;
-	kd->P[0][2] = 0.0f;
-	kd->P[1][0] = 0.0f;
-	kd->P[1][1] = 1000.0f;
-	kd->P[1][2] = 0.0f;
-	kd->P[2][0] = 0.0f;
-	kd->P[2][1] = 0.0f;
-	kd->P[2][2] = 1000.0f;
+	kd->P[KALMAN_P00] = 1000.0f;
+	kd->P[KALMAN_P01] = 0.0f;
+	kd->P[KALMAN_P02] = 0.0f;
+	kd->P[KALMAN_P11] = 1000.0f;
+	kd->P[KALMAN_P12] = 0.0f;
+	kd->P[KALMAN_P22] = 1000.0f;
+	
+	kd->n = 0;
+	kd->epoch = kalman_ss.epoch;
+	
+}
 
+/*
+ * @brief: One step of the covariance recursion: predict P, the gain for it,
+ * 				and the corrected P; independent of the measurements
+ * @param[in]: P
+ * @param[out]: P corrected, K
+ */
+static inline void kalman_riccati(float P[6], float K[3][2]) {
+	float pred_P[3][3];
+	float M[3][3];
+	float N[3][2];
+	float S00, S01, S11;
+	float invS, a, b, c;
+	
+	// P'_(k) = A * P_(k-1) * A^T + Q, upper triangle mirrored
+	pred_P[0][1] = P[KALMAN_P01] + _dt * (P[KALMAN_P11] - P[KALMAN_P12]);
+	pred_P[0][2] = P[KALMAN_P02] + _dt * (P[KALMAN_P12] - P[KALMAN_P22]);
+	pred_P[0][0] = P[KALMAN_P00] + _dt * (P[KALMAN_P01] - P[KALMAN_P02]) + _dt * (pred_P[0][1] - pred_P[0][2]) + kalman_qr.q00;
+	pred_P[1][1] = P[KALMAN_P11] + kalman_qr.q11;
+	pred_P[1][2] = P[KALMAN_P12];
+	pred_P[2][2] = P[KALMAN_P22] + kalman_qr.q22;
+	pred_P[1][0] = pred_P[0][1];
+	pred_P[2][0] = pred_P[0][2];
+	pred_P[2][1] = pred_P[1][2];
+	
+	// K_(k) = P * H^T * S^(-1), where S = H * P'_(k) * H^T + R
+	S00 = pred_P[0][0] + kalman_qr.r00;
+	S01 = pred_P[0][1];
+	S11 = pred_P[1][1] + kalman_qr.r11;
+	invS = 1.0f / (S00*S11 - S01*S01);
+	a = S11 * invS;
+	b = S01 * invS;
+	c = S00 * invS;
+	K[0][0] = pred_P[0][0] * a - pred_P[0][1] * b;
+	K[0][1] = pred_P[0][1] * c - pred_P[0][0] * b;
+	K[1][0] = pred_P[1][0] * a - pred_P[1][1] * b;
+	K[1][1] = pred_P[1][1] * c - pred_P[1][0] * b;
+	K[2][0] = pred_P[2][0] * a - pred_P[2][1] * b;
+	K[2][1] = pred_P[2][1] * c - pred_P[2][0] * b;
+	
+	// P_(k) = (I - K_(k) * H) * P'_(k) * (I - K_(k) * H)^T + K_(k) * R * K_(k)^T (Joseph form)
+	// with M = (I - K*H) * P' and N = M * H^T - K * R:  P_ij = M_ij - K_j0 * N_i0 - K_j1 * N_i1
+	M[0][0] = pred_P[0][0] - K[0][0] * pred_P[0][0] - K[0][1] * pred_P[1][0];
+	M[0][1] = pred_P[0][1] - K[0][0] * pred_P[0][1] - K[0][1] * pred_P[1][1];
+	M[0][2] = pred_P[0][2] - K[0][0] * pred_P[0][2] - K[0][1] * pred_P[1][2];
+	M[1][0] = pred_P[1][0] - K[1][0] * pred_P[0][0] - K[1][1] * pred_P[1][0];
+	M[1][1] = pred_P[1][1] - K[1][0] * pred_P[0][1] - K[1][1] * pred_P[1][1];
+	M[1][2] = pred_P[1][2] - K[1][0] * pred_P[0][2] - K[1][1] * pred_P[1][2];
+	M[2][0] = pred_P[2][0] - K[2][0] * pred_P[0][0] - K[2][1] * pred_P[1][0];
+	M[2][1] = pred_P[2][1] - K[2][0] * pred_P[0][1] - K[2][1] * pred_P[1][1];
+	M[2][2] = pred_P[2][2] - K[2][0] * pred_P[0][2] - K[2][1] * pred_P[1][2];
+	N[0][0] = M[0][0] - K[0][0] * kalman_qr.r00;
+	N[0][1] = M[0][1] - K[0][1] * kalman_qr.r11;
+	N[1][0] = M[1][0] - K[1][0] * kalman_qr.r00;
+	N[1][1] = M[1][1] - K[1][1] * kalman_qr.r11;
+	N[2][0] = M[2][0] - K[2][0] * kalman_qr.r00;
+	N[2][1] = M[2][1] - K[2][1] * kalman_qr.r11;
+	P[KALMAN_P00] = M[0][0] - K[0][0] * N[0][0] - K[0][1] * N[0][1];
+	P[KALMAN_P01] = M[0][1] - K[1][0] * N[0][0] - K[1][1] * N[0][1];
+	P[KALMAN_P02] = M[0][2] - K[2][0] * N[0][0] - K[2][1] * N[0][1];
+	P[KALMAN_P11] = M[1][1] - K[1][0] * N[1][0] - K[1][1] * N[1][1];
+	P[KALMAN_P12] = M[1][2] - K[2][0] * N[1][0] - K[2][1] * N[1][1];
+	P[KALMAN_P22] = M[2][2] - K[2][0] * N[2][0] - K[2][1] * N[2][1];
 }
 
+/*
+ * @brief: Predict and correct with angle z1 and rate z2; the steady-state
+ * 				gain replaces the covariance recursion in KALMAN_GAIN_STEADY once
+ * 				kalman_ss is solved and the filter has run its n full updates
+ * @param[in]: filter, measurements
+ * @param[out]: none
+ */
 void kalman_innovate(kalman_data * kd, float z1, float z2) {
 	float pred_x[3];
-	float pred_P[3][3];
-	float AP[3];
 	float K[3][2];
-	float S[2][2];
-	float detS;
+	float y1, y2;
 	
 	///--- Prediction Step ---///
 	// x'_(k) = A * x_(k-1)
 	pred_x[0] = kd->x[0] + (kd->x[1] - kd->x[2]) * _dt;
 	pred_x[1] = kd->x[1];
 	pred_x[2] = kd->x[2];
+	y1 = z1 - pred_x[0];
+	y2 = z2 - pred_x[1];
 	
-	// P'_(k) = A * P_(k-1) * A^T + Q
-	AP[0] = (kd->P[0][0] + _dt * (kd->P[1][0] - kd->P[2][0]));
-	AP[1] = (kd->P[0][1] + _dt * (kd->P[1][1] - kd->P[2][1]));
-	AP[2] = (kd->P[0][2] + _dt * (kd->P[1][2] - kd->P[2][2]));
-	pred_P[0][0] = AP[0] + _dt * (AP[1] - AP[2]) + _Q00;
-	pred_P[0][1] = AP[1];
-	pred_P[0][2] = AP[2];
-	pred_P[1][0] = kd->P[1][0] + _dt * (kd->P[1][1] - kd->P[1][2]);
-	pred_P[1][1] = kd->P[1][1] + _Q11;
-	pred_P[1][2] = kd->P[1][2];
-	pred_P[2][0] = kd->P[2][0] + _dt * (kd->P[2][1] - kd->P[2][2]);
-	pred_P[2][1] = kd->P[2][1];
-	pred_P[2][2] = kd->P[2][2] + _Q22;
-	
+	// the noise changed: count the full updates again
+	if (kd->epoch != kalman_ss.epoch) {
+		kd->epoch = kalman_ss.epoch;
+		kd->n = 0;
+	}
+	if (kalman_gain_mode == KALMAN_GAIN_STEADY && kalman_ss.state == KALMAN_STEADY_READY && kd->n >= kalman_ss.n) {
+		kd->x[0] = pred_x[0] + kalman_ss.K[0][0] * y1 + kalman_ss.K[0][1] * y2;
+		kd->x[1] = pred_x[1] + kalman_ss.K[1][0] * y1 + kalman_ss.K[1][1] * y2;
+		kd->x[2] = pred_x[2] + kalman_ss.K[2][0] * y1 + kalman_ss.K[2][1] * y2;
+		return;
+	}
 	
 	///--- Correction Step ---///
-	// K_(k) = P * H^T * S^(-1), where S = H * P'_(k) * H^T + R
-	S[0][0] = pred_P[0][0] + _R00;
-	S[0][1] = pred_P[0][1];
-	S[1][0] = pred_P[1][0];
-	S[1][1] = pred_P[1][1] + _R11;
-	detS = (S[0][0]*S[1][1] - S[0][1]*S[1][0]);
-	K[0][0] = (pred_P[0][0] * S[1][1] - pred_P[0][1] * S[1][0]) / detS;
-	K[0][1] = (pred_P[0][1] * S[0][0] - pred_P[0][0] * S[0][1]) / detS;
-	K[1][0] = (pred_P[1][0] * S[1][1] - pred_P[1][1] * S[1][0]) / detS;
-	K[1][1] = (pred_P[1][1] * S[0][0] - pred_P[1][0] * S[0][1]) / detS;
-	K[2][0] = (pred_P[2][0] * S[1][1] - pred_P[2][1] * S[1][0]) / detS;
-	K[2][1] = (pred_P[2][1] * S[0][0] - pred_P[2][0] * S[0][1]) / detS;
+	kalman_riccati(kd->P, K);
 	
 	// x_(k) = x'_(k) + K_(k) * (z_k - H * x'_(k))
-	kd->x[0] = pred_x[0] + K[0][0] * (z1 - pred_x[0]) + K[0][1] * (z2 - pred_x[1]);
-	kd->x[1] = pred_x[1] + K[1][0] * (z1 - pred_x[0]) + K[1][1] * (z2 - pred_x[1]);
-	kd->x[2] = pred_x[2] + K[2][0] * (z1 - pred_x[0]) + K[2][1] * (z2 - pred_x[1]);
-	
-	// P_(k) = (I - K_(k) * H) * P'_(k)
-	kd->P[0][0] = (1.0f - K[0][0]) * pred_P[0][0] - K[0][1] * pred_P[1][0];
-	kd->P[0][1] = (1.0f - K[0][0]) * pred_P[0][1] - K[0][1] * pred_P[1][1];
-	kd->P[0][2] = (1.0f - K[0][0]) * pred_P[0][2] - K[0][1] * pred_P[1][2];
-	kd->P[1][0] = (1.0f - K[1][1]) * pred_P[1][0] - K[1][1] * pred_P[0][0];
-	kd->P[1][1] = (1.0f - K[1][1]) * pred_P[1][1] - K[1][1] * pred_P[0][1];
-	kd->P[1][2] = (1.0f - K[1][1]) * pred_P[1][2] - K[1][1] * pred_P[0][2];
-	kd->P[2][0] = pred_P[2][0] - K[2][0] * pred_P[0][0] - K[2][1] * pred_P[1][0];
-	kd->P[2][1] = pred_P[2][1] - K[2][0] * pred_P[0][1] - K[2][1] * pred_P[1][1];
-	kd->P[2][2] = pred_P[2][2] - K[2][0] * pred_P[0][2] - K[2][1] * pred_P[1][2];
+	kd->x[0] = pred_x[0] + K[0][0] * y1 + K[0][1] * y2;
+	kd->x[1] = pred_x[1] + K[1][0] * y1 + K[1][1] * y2;
+	kd->x[2] = pred_x[2] + K[2][0] * y1 + K[2][1] * y2;
+	if (kd->n != UINT32_MAX) kd->n++;
+}
+
+/*
+ * @brief: Multi-rate filter, prediction only: x and P forward by dt, with Q
+ * 				as a rate (kalman_qr per _dt). kalman_predict(_dt) then
+ * 				kalman_correct_rate and kalman_correct_angle is kalman_innovate
+ * 				done as two scalar updates, the same thing since R is diagonal.
+ * @param[in]: filter, s since its last prediction
+ * @param[out]: none
+ */
+void kalman_predict(kalman_data * kd, float dt) {
+	float q = dt * (1.0f / _dt);
+	float P01 = kd->P[KALMAN_P01] + dt * (kd->P[KALMAN_P11] - kd->P[KALMAN_P12]);
+	float P02 = kd->P[KALMAN_P02] + dt * (kd->P[KALMAN_P12] - kd->P[KALMAN_P22]);
+	
+	kd->x[0] += (kd->x[1] - kd->x[2]) * dt;
+	kd->P[KALMAN_P00] += dt * (kd->P[KALMAN_P01] - kd->P[KALMAN_P02]) + dt * (P01 - P02) + kalman_qr.q00 * q;
+	kd->P[KALMAN_P01] = P01;
+	kd->P[KALMAN_P02] = P02;
+	kd->P[KALMAN_P11] += kalman_qr.q11 * q;
+	kd->P[KALMAN_P22] += kalman_qr.q22 * q;
+}
+
+/*
+ * @brief: Scalar correction of state j with measurement z and variance r:
+ * 				c = P h, k = c / (c_j + r), x += k y, and P in Joseph form as in
+ * 				kalman_riccati, so at the gyro rate the update cannot cancel P
+ * 				out of positive definiteness:
+ * 				P = (I - k h^T) P (I - k h^T)^T + k r k^T
+ * 				with M = (I - k h^T) P and n = M h - k r:  P_ab = M_ab - k_b n_a
+ */
+static inline void kalman_correct(kalman_data * kd, uint8_t j, float z, float r) {
+	static const uint8_t col[2][3] = {
+		{KALMAN_P00, KALMAN_P01, KALMAN_P02},
+		{KALMAN_P01, KALMAN_P11, KALMAN_P12},
+	};
+	float c0 = kd->P[col[j][0]], c1 = kd->P[col[j][1]], c2 = kd->P[col[j][2]];
+	float cj = kd->P[col[j][j]];
+	float inv = 1.0f / (cj + r);
+	float y = z - kd->x[j];
+	float k0 = c0 * inv, k1 = c1 * inv, k2 = c2 * inv;
+	float n0 = c0 - k0 * cj - k0 * r;
+	float n1 = c1 - k1 * cj - k1 * r;
+	float n2 = c2 - k2 * cj - k2 * r;
+	
+	kd->x[0] += k0 * y;
+	kd->x[1] += k1 * y;
+	kd->x[2] += k2 * y;
+	kd->P[KALMAN_P00] = kd->P[KALMAN_P00] - k0 * c0 - k0 * n0;
+	kd->P[KALMAN_P01] = kd->P[KALMAN_P01] - k0 * c1 - k1 * n0;
+	kd->P[KALMAN_P02] = kd->P[KALMAN_P02] - k0 * c2 - k2 * n0;
+	kd->P[KALMAN_P11] = kd->P[KALMAN_P11] - k1 * c1 - k1 * n1;
+	kd->P[KALMAN_P12] = kd->P[KALMAN_P12] - k1 * c2 - k2 * n1;
+	kd->P[KALMAN_P22] = kd->P[KALMAN_P22] - k2 * c2 - k2 * n2;
+}
+
+/*
+ * @brief: Multi-rate correction with an angle measurement (accelerometer,
+ * 				compass), variance kalman_qr.r00
+ */
+void kalman_correct_angle(kalman_data * kd, float z1) {
+	kalman_correct(kd, 0, z1, kalman_qr.r00);
+}
+
+/*
+ * @brief: Multi-rate correction with a rate measurement (gyro), variance
+ * 				kalman_qr.r11
+ */
+void kalman_correct_rate(kalman_data * kd, float z2) {
+	kalman_correct(kd, 1, z2, kalman_qr.r11);
+}
+
+static void kalman_steady_start(kalman_steady * s) {
+	kalman_data kd;
+	
+	kalman_init(&kd);
+	memcpy(s->P, kd.P, sizeof(s->P));
+	s->change = 0.0f;
+	s->iter = 0;
+}
+
+/*
+ * @brief: Start solving for the steady-state gain of kalman_qr; call after
+ * 				any change to it. For kalman_ss, every filter starts counting its
+ * 				full updates from 0 again, so none switches on a gain it has not
+ * 				converged to.
+ * @param[in]: solver, relative tolerance: of the distance to the stationary
+ * 				covariance, and of the gain error at the switch (0: switch where
+ * 				the recursion stops changing, and the steady filter is bit for
+ * 				bit the full one)
+ * @param[out]: none
+ */
+void kalman_steady_reset(kalman_steady * s, float tol) {
+	kalman_steady_start(s);
+	s->tol = tol;
+	s->n = 0;
+	s->epoch++;
+	s->state = KALMAN_STEADY_LIMIT;
+}
+
+/*
+ * @brief: Largest change of a gain element over one step, relative to the
+ * 				element
+ */
+static float kalman_steady_change(float K[3][2], float next[3][2]) {
+	float d = 0.0f;
+	uint8_t i;
+	
+	for (i = 0; i < 6; i++) {
+		if (next[i / 2][i % 2] != K[i / 2][i % 2]) {
+			d = fmaxf(d, fabsf(next[i / 2][i % 2] - K[i / 2][i % 2]) / fabsf(next[i / 2][i % 2]));
+		}
+	}
+	return d;
+}
+
+/*
+ * @brief: Advance the solve by up to some iterations of the recursion: first
+ * 				until the gain is within tol of the stationary one (with tol 0,
+ * 				until P stops changing), then, with a tolerance, once more from
+ * 				kalman_init for the first gain within tol of that one
+ * @param[in]: solver, iterations
+ * @param[out]: 1 once K and n are ready
+ */
+uint8_t kalman_steady_solve(kalman_steady * s, uint32_t iterations) {
+	float P[6], K[3][2], d;
+	uint8_t i, close;
 	
+	for (; iterations && s->state < KALMAN_STEADY_READY; iterations--) {
+		memcpy(P, s->P, sizeof(P));
+		kalman_riccati(s->P, K);
+		s->iter++;
+		if (s->state == KALMAN_STEADY_LIMIT) {
+			// the gain change shrinks geometrically, by d / s->change per step,
+			// so what is still to come adds up to about d^2 / (s->change - d)
+			d = kalman_steady_change(s->K, K);
+			close = !memcmp(P, s->P, sizeof(P))
+							|| (s->tol > 0.0f && d < s->change && d * d <= s->tol * (s->change - d));
+			s->change = d;
+			memcpy(s->K, K, sizeof(K));
+			if (close) {
+				s->n = s->iter;
+				if (s->tol > 0.0f) {
+					kalman_steady_start(s);
+					s->state = KALMAN_STEADY_SWITCH;
+				} else {
+					s->state = KALMAN_STEADY_READY;
+				}
+			} else if (s->iter >= KALMAN_STEADY_ITER_MAX) {
+				s->state = KALMAN_STEADY_NONE;
+			}
+		} else {
+			// reached by s->n at the latest
+			for (i = 0, close = 1; i < 6; i++) {
+				close &= fabsf(K[i / 2][i % 2] - s->K[i / 2][i % 2]) <= s->tol * fabsf(s->K[i / 2][i % 2]);
+			}
+			if (close) {
+				s->n = s->iter;
+				s->state = KALMAN_STEADY_READY;
+			}
+		}
+	}
+	return s->state == KALMAN_STEADY_READY;
 }
@@ -1,3 +1,6 @@
+#ifndef _KALMAN_H_
+#define _KALMAN_H_
+
 #include <stdint.h>
 
 
@@ -11,10 +14,73 @@
 #define _R11		1000.0f
 
 
+// kalman_gain_mode
+#define KALMAN_GAIN_FULL				0		// covariance recursion and gain every update
+#define KALMAN_GAIN_STEADY			1		// the converged gain once the recursion has settled
+
+#ifndef __KALMAN_GAIN
+#define __KALMAN_GAIN						KALMAN_GAIN_FULL
+#endif
+
+// steady-state gain solve (kalman_steady_solve)
+#define KALMAN_STEADY_TOL				0.0f		// relative convergence tolerance, 0: exact
+#define KALMAN_STEADY_ITER_MAX	65536		// per phase, then the full filter stays
+#define KALMAN_STEADY_ITER_TICK	16			// per estimator tick while re-solving
+
+#define KALMAN_STEADY_LIMIT			0		// iterating to the stationary covariance
+#define KALMAN_STEADY_SWITCH		1		// iterating again for the first gain within tol
+#define KALMAN_STEADY_READY			2
+#define KALMAN_STEADY_NONE			3		// no stationary point within KALMAN_STEADY_ITER_MAX
+
+
+// Covariance is symmetric: only the upper triangle is stored
+#define KALMAN_P00	0
+#define KALMAN_P01	1
+#define KALMAN_P02	2
+#define KALMAN_P11	3
+#define KALMAN_P12	4
+#define KALMAN_P22	5
+
+
+// runtime copy of _Q00.._R11 for kalman_innovate and kalman_batch (tuning);
+// kalman_fix keeps the constants. Q is per _dt step; kalman_predict scales it
+// to its own dt.
+typedef struct {
+	float q00, q11, q22;
+	float r00, r11;
+} kalman_noise;
+
 typedef struct {
 	float x[3];				// [angle, angular velocity, angular drift velocity]
-	float P[3][3];
+	float P[6];				// [P00, P01, P02, P11, P12, P22]
+	uint32_t n;				// full updates since kalman_init or the last noise change, saturating
+	uint32_t epoch;		// kalman_ss.epoch n was counted in
 } kalman_data;
 
+// The covariance recursion does not depend on the measurements, so every
+// filter started by kalman_init runs the same sequence of gains, and once P
+// stops changing the gain is a constant: solved here once for all axes.
+typedef struct {
+	float K[3][2];		// steady-state gain
+	float P[6];				// solver covariance
+	float tol;
+	float change;			// last relative change of P
+	uint32_t n;				// full updates a filter runs before K is used
+	uint32_t iter;
+	uint32_t epoch;		// bumped by kalman_steady_reset, restarts every filter's n
+	uint8_t state;		// KALMAN_STEADY_*
+} kalman_steady;
+
+extern kalman_noise kalman_qr;
+extern uint8_t kalman_gain_mode;
+extern kalman_steady kalman_ss;
+
 void kalman_init(kalman_data * data);
 void kalman_innovate(kalman_data * data, float z1, float z2);
+void kalman_predict(kalman_data * data, float dt);
+void kalman_correct_angle(kalman_data * data, float z1);
+void kalman_correct_rate(kalman_data * data, float z2);
+void kalman_steady_reset(kalman_steady * s, float tol);
+uint8_t kalman_steady_solve(kalman_steady * s, uint32_t iterations);
+
+#endif
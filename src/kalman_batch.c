@@ -0,0 +1,136 @@
+#include <stdint.h>
+#include "kalman_batch.h"
+
+
+/*
+ * @brief: Lay out n filters in storage and reset them as kalman_init() does
+ * @param[in]: batch, KALMAN_BATCH_FLOATS(n) floats, number of filters
+ * @param[out]: none
+ */
+void kalman_batch_init(kalman_batch * kb, float * storage, uint32_t n) {
+	kalman_data kd;
+	uint32_t i, k;
+	
+	kb->n = n;
+	for (i = 0; i < 3; i++) kb->x[i] = storage + i * n;
+	for (i = 0; i < 6; i++) kb->P[i] = storage + (3 + i) * n;
+	
+	kalman_init(&kd);
+	for (k = 0; k < n; k++) kalman_batch_set(kb, k, &kd);
+}
+
+/*
+ * @brief: Filter k as a kalman_data. The batch has no update count, so the
+ * 				copy starts again at n = 0: in KALMAN_GAIN_STEADY, kalman_innovate
+ * 				runs it on the full update for another kalman_ss.n updates before
+ * 				the constant gain, never sooner than its own P allows
+ * @param[in]: batch, filter
+ * @param[out]: filter state
+ */
+void kalman_batch_get(const kalman_batch * kb, uint32_t k, kalman_data * kd) {
+	uint32_t i;
+	
+	for (i = 0; i < 3; i++) kd->x[i] = kb->x[i][k];
+	for (i = 0; i < 6; i++) kd->P[i] = kb->P[i][k];
+	kd->n = 0;
+	kd->epoch = kalman_ss.epoch;
+}
+
+void kalman_batch_set(kalman_batch * kb, uint32_t k, const kalman_data * kd) {
+	uint32_t i;
+	
+	for (i = 0; i < 3; i++) kb->x[i][k] = kd->x[i];
+	for (i = 0; i < 6; i++) kb->P[i][k] = kd->P[i];
+}
+
+/*
+ * Arrays are restrict parameters rather than restrict locals: GCC only trusts
+ * the former and otherwise gives up on the alias checks.
+ */
+static void kalman_batch_kernel(uint32_t n, kalman_noise qr,
+																float * restrict x0, float * restrict x1, float * restrict x2,
+																float * restrict P00, float * restrict P01, float * restrict P02,
+																float * restrict P11, float * restrict P12, float * restrict P22,
+																const float * restrict m1, const float * restrict m2) {
+	const float q00 = qr.q00, q11 = qr.q11, q22 = qr.q22, r00 = qr.r00, r11 = qr.r11;
+	uint32_t k;
+	
+	for (k = 0; k < n; k++) {
+		float px0, px1, px2;
+		float pP00, pP01, pP02, pP11, pP12, pP22;
+		float S00, S01, S11, inv, a, b, c;
+		float K00, K01, K10, K11, K20, K21;
+		float M00, M01, M02, M10, M11, M12, M20, M21, M22;
+		float N00, N01, N10, N11, N20, N21;
+		float y1, y2;
+		
+		///--- Prediction Step ---///
+		px0 = x0[k] + (x1[k] - x2[k]) * _dt;
+		px1 = x1[k];
+		px2 = x2[k];
+		
+		pP01 = P01[k] + _dt * (P11[k] - P12[k]);
+		pP02 = P02[k] + _dt * (P12[k] - P22[k]);
+		pP00 = P00[k] + _dt * (P01[k] - P02[k]) + _dt * (pP01 - pP02) + q00;
+		pP11 = P11[k] + q11;
+		pP12 = P12[k];
+		pP22 = P22[k] + q22;
+		
+		///--- Correction Step ---///
+		S00 = pP00 + r00;
+		S01 = pP01;
+		S11 = pP11 + r11;
+		inv = 1.0f / (S00*S11 - S01*S01);
+		a = S11 * inv;
+		b = S01 * inv;
+		c = S00 * inv;
+		K00 = pP00 * a - pP01 * b;
+		K01 = pP01 * c - pP00 * b;
+		K10 = pP01 * a - pP11 * b;
+		K11 = pP11 * c - pP01 * b;
+		K20 = pP02 * a - pP12 * b;
+		K21 = pP12 * c - pP02 * b;
+		
+		y1 = m1[k] - px0;
+		y2 = m2[k] - px1;
+		x0[k] = px0 + K00 * y1 + K01 * y2;
+		x1[k] = px1 + K10 * y1 + K11 * y2;
+		x2[k] = px2 + K20 * y1 + K21 * y2;
+		
+		// Joseph form, see kalman_innovate()
+		M00 = pP00 - K00 * pP00 - K01 * pP01;
+		M01 = pP01 - K00 * pP01 - K01 * pP11;
+		M02 = pP02 - K00 * pP02 - K01 * pP12;
+		M10 = pP01 - K10 * pP00 - K11 * pP01;
+		M11 = pP11 - K10 * pP01 - K11 * pP11;
+		M12 = pP12 - K10 * pP02 - K11 * pP12;
+		M20 = pP02 - K20 * pP00 - K21 * pP01;
+		M21 = pP12 - K20 * pP01 - K21 * pP11;
+		M22 = pP22 - K20 * pP02 - K21 * pP12;
+		N00 = M00 - K00 * r00;
+		N01 = M01 - K01 * r11;
+		N10 = M10 - K10 * r00;
+		N11 = M11 - K11 * r11;
+		N20 = M20 - K20 * r00;
+		N21 = M21 - K21 * r11;
+		P00[k] = M00 - K00 * N00 - K01 * N01;
+		P01[k] = M01 - K10 * N00 - K11 * N01;
+		P02[k] = M02 - K20 * N00 - K21 * N01;
+		P11[k] = M11 - K10 * N10 - K11 * N11;
+		P12[k] = M12 - K20 * N10 - K21 * N11;
+		P22[k] = M22 - K20 * N20 - K21 * N21;
+	}
+}
+
+/*
+ * @brief: kalman_innovate() on every filter of the batch, with the noise in
+ * 				kalman_qr
+ * @param[in]: batch, z1[k] angle and z2[k] rate measurements of filter k
+ * @param[out]: none
+ */
+void kalman_batch_innovate(kalman_batch * kb, const float * z1, const float * z2) {
+	kalman_batch_kernel(kb->n, kalman_qr, kb->x[0], kb->x[1], kb->x[2],
+											kb->P[KALMAN_P00], kb->P[KALMAN_P01], kb->P[KALMAN_P02],
+											kb->P[KALMAN_P11], kb->P[KALMAN_P12], kb->P[KALMAN_P22],
+											z1, z2);
+}
@@ -0,0 +1,33 @@
+#ifndef _KALMAN_BATCH_H_
+#define _KALMAN_BATCH_H_
+
+#include <stdint.h>
+#include "kalman.h"
+
+/*
+ * N independent kalman_data filters stored as structure-of-arrays, updated
+ * in one call. Every term of kalman_innovate() is a loop over the filters,
+ * so the host compiler vectorizes it and the M4 streams it without reloading
+ * per-filter state. detS is inverted once per filter instead of six divides.
+ * Batch filters always run the full update; the steady-state gain
+ * (KALMAN_GAIN_STEADY) applies only to kalman_data filters.
+ *
+ * Storage is caller-owned: KALMAN_BATCH_FLOATS(n) floats; n a multiple of 8
+ * keeps every array aligned for AVX.
+ */
+
+#define KALMAN_BATCH_FLOATS(n)		(9 * (n))
+
+
+typedef struct {
+	uint32_t	n;
+	float			*x[3];				// x[i][k]: state i of filter k
+	float			*P[6];				// packed as kalman_data.P
+} kalman_batch;
+
+void kalman_batch_init(kalman_batch * kb, float * storage, uint32_t n);
+void kalman_batch_innovate(kalman_batch * kb, const float * z1, const float * z2);
+void kalman_batch_get(const kalman_batch * kb, uint32_t k, kalman_data * kd);
+void kalman_batch_set(kalman_batch * kb, uint32_t k, const kalman_data * kd);
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdint.h>
+#include "kalman_fix.h"
+
+
+#define PQ(f)				((int32_t)((f) * (float)(1 << KALMAN_FIX_PFRAC) + 0.5f))
+#define KQ(f)				((int32_t)((f) * (float)(1 << KALMAN_FIX_KFRAC) + 0.5f))
+
+#define DT_Q30			KQ(_dt)
+
+
+/*
+ * @brief: (a * b) >> 30, rounded; a is Q2.30, result has b's format
+ */
+static inline int32_t kfix_mul(int32_t a, int32_t b) {
+	return (int32_t)(((int64_t)a * b + (1 << (KALMAN_FIX_KFRAC - 1))) >> KALMAN_FIX_KFRAC);
+}
+
+/*
+ * @brief: Count leading zeros of a non-zero 64-bit value
+ */
+static inline uint32_t kfix_clz64(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+	return (uint32_t)__builtin_clzll(v);
+#else
+	uint32_t n = 0;
+	
+	while (!(v & 0x8000000000000000ull)) {
+		v <<= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+/*
+ * @brief: 2^61 / d for d in [2^30, 2^31), ~30 bits
+ * 				16-bit hardware divide seed, one Newton-Raphson step
+ */
+static inline int64_t kfix_recip(uint32_t d) {
+	int64_t inv = (int64_t)(0x80000000u / (d >> 15)) << 15;
+	int64_t e = ((int64_t)1 << 61) - (int64_t)d * inv;
+	
+	return inv + (((e >> 30) * inv) >> 31);
+}
+
+void kalman_fix_init(kalman_fix_data * kd) {
+	
+	kd->x[0] = 0;
+	kd->x[1] = 0;
+	kd->x[2] = 0;
+	
+	kd->P[KALMAN_P00] = PQ(1000.0f);
+	kd->P[KALMAN_P01] = 0;
+	kd->P[KALMAN_P02] = 0;
+	kd->P[KALMAN_P11] = PQ(1000.0f);
+	kd->P[KALMAN_P12] = 0;
+	kd->P[KALMAN_P22] = PQ(1000.0f);
+
+}
+
+/*
+ * Same equations as kalman_innovate(); the divisions by detS become one
+ * reciprocal and six multiplies.
+ */
+void kalman_fix_innovate(kalman_fix_data * kd, int32_t z1, int32_t z2) {
+	int32_t pred_x[3];
+	int32_t pred_P[3][3];
+	int32_t K[3][2];
+	int32_t M[3][3];
+	int32_t N[3][2];
+	int32_t S00, S01, S11;
+	int32_t y1, y2;
+	int64_t detS, num;
+	int64_t inv;
+	uint32_t d;
+	int32_t sh;
+	uint8_t i, j;
+	
+	///--- Prediction Step ---///
+	// x'_(k) = A * x_(k-1)
+	pred_x[0] = kd->x[0] + kfix_mul(DT_Q30, kd->x[1] - kd->x[2]);
+	pred_x[1] = kd->x[1];
+	pred_x[2] = kd->x[2];
+	
+	// P'_(k) = A * P_(k-1) * A^T + Q, upper triangle mirrored
+	pred_P[0][1] = kd->P[KALMAN_P01] + kfix_mul(DT_Q30, kd->P[KALMAN_P11] - kd->P[KALMAN_P12]);
+	pred_P[0][2] = kd->P[KALMAN_P02] + kfix_mul(DT_Q30, kd->P[KALMAN_P12] - kd->P[KALMAN_P22]);
+	pred_P[0][0] = kd->P[KALMAN_P00] + kfix_mul(DT_Q30, kd->P[KALMAN_P01] - kd->P[KALMAN_P02]) + kfix_mul(DT_Q30, pred_P[0][1] - pred_P[0][2]) + PQ(_Q00);
+	pred_P[1][1] = kd->P[KALMAN_P11] + PQ(_Q11);
+	pred_P[1][2] = kd->P[KALMAN_P12];
+	pred_P[2][2] = kd->P[KALMAN_P22] + PQ(_Q22);
+	pred_P[1][0] = pred_P[0][1];
+	pred_P[2][0] = pred_P[0][2];
+	pred_P[2][1] = pred_P[1][2];
+	
+	
+	///--- Correction Step ---///
+	// K_(k) = P * H^T * S^(-1), where S = H * P'_(k) * H^T + R
+	S00 = pred_P[0][0] + PQ(_R00);
+	S01 = pred_P[0][1];
+	S11 = pred_P[1][1] + PQ(_R11);
+	detS = (int64_t)S00*S11 - (int64_t)S01*S01;
+	
+	// normalize detS to [2^30, 2^31) and take a single reciprocal
+	sh = 33 - (int32_t)kfix_clz64((uint64_t)detS);
+	d = (uint32_t)(sh >= 0 ? detS >> sh : detS << -sh);
+	inv = kfix_recip(d);
+	
+	for (i = 0; i < 3; i++) {
+		num = (int64_t)pred_P[i][0] * S11 - (int64_t)pred_P[i][1] * S01;
+		num = sh >= 0 ? num >> sh : num * ((int64_t)1 << -sh);
+		K[i][0] = (int32_t)((num * inv) >> (61 - KALMAN_FIX_KFRAC));
+		num = (int64_t)pred_P[i][1] * S00 - (int64_t)pred_P[i][0] * S01;
+		num = sh >= 0 ? num >> sh : num * ((int64_t)1 << -sh);
+		K[i][1] = (int32_t)((num * inv) >> (61 - KALMAN_FIX_KFRAC));
+	}
+	
+	// x_(k) = x'_(k) + K_(k) * (z_k - H * x'_(k))
+	y1 = z1 - pred_x[0];
+	y2 = z2 - pred_x[1];
+	kd->x[0] = pred_x[0] + kfix_mul(K[0][0], y1) + kfix_mul(K[0][1], y2);
+	kd->x[1] = pred_x[1] + kfix_mul(K[1][0], y1) + kfix_mul(K[1][1], y2);
+	kd->x[2] = pred_x[2] + kfix_mul(K[2][0], y1) + kfix_mul(K[2][1], y2);
+	
+	// Joseph form, see kalman_innovate()
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 3; j++) {
+			M[i][j] = pred_P[i][j] - kfix_mul(K[i][0], pred_P[0][j]) - kfix_mul(K[i][1], pred_P[1][j]);
+		}
+		N[i][0] = M[i][0] - kfix_mul(K[i][0], PQ(_R00));
+		N[i][1] = M[i][1] - kfix_mul(K[i][1], PQ(_R11));
+	}
+	kd->P[KALMAN_P00] = M[0][0] - kfix_mul(K[0][0], N[0][0]) - kfix_mul(K[0][1], N[0][1]);
+	kd->P[KALMAN_P01] = M[0][1] - kfix_mul(K[1][0], N[0][0]) - kfix_mul(K[1][1], N[0][1]);
+	kd->P[KALMAN_P02] = M[0][2] - kfix_mul(K[2][0], N[0][0]) - kfix_mul(K[2][1], N[0][1]);
+	kd->P[KALMAN_P11] = M[1][1] - kfix_mul(K[1][0], N[1][0]) - kfix_mul(K[1][1], N[1][1]);
+	kd->P[KALMAN_P12] = M[1][2] - kfix_mul(K[2][0], N[1][0]) - kfix_mul(K[2][1], N[1][1]);
+	kd->P[KALMAN_P22] = M[2][2] - kfix_mul(K[2][0], N[2][0]) - kfix_mul(K[2][1], N[2][1]);
+	
+}
@@ -0,0 +1,39 @@
+#ifndef _KALMAN_FIX_H_
+#define _KALMAN_FIX_H_
+
+#include <stdint.h>
+#include "kalman.h"
+
+/*
+ * Fixed-point kalman_innovate.
+ *
+ * State and measurements are Q16.16 (deg, deg/s). Gains are Q2.30.
+ * Covariance precision is a compile-time choice:
+ *   default           Q16.16
+ *   __KALMAN_FIX_Q30  Q2.30 of P/2048 (i.e. Q13.19): 8x finer, P < 4096
+ * The Kalman gain does not change when P, Q and R are scaled together, so
+ * normalizing by 2048 only moves the binary point.
+ */
+
+#ifdef __KALMAN_FIX_Q30
+#define KALMAN_FIX_PFRAC		19
+#else
+#define KALMAN_FIX_PFRAC		16
+#endif
+
+#define KALMAN_FIX_FRAC			16
+#define KALMAN_FIX_KFRAC		30
+
+#define KALMAN_FIX(f)				((int32_t)((f) * (float)(1 << KALMAN_FIX_FRAC) + ((f) >= 0 ? 0.5f : -0.5f)))
+#define KALMAN_FIX_FLOAT(q)	((float)(q) * (1.0f / (float)(1 << KALMAN_FIX_FRAC)))
+
+
+typedef struct {
+	int32_t x[3];				// Q16.16 [angle, angular velocity, angular drift velocity]
+	int32_t P[6];				// KALMAN_P00.. packed upper triangle, KALMAN_FIX_PFRAC fraction bits
+} kalman_fix_data;
+
+void kalman_fix_init(kalman_fix_data * data);
+void kalman_fix_innovate(kalman_fix_data * data, int32_t z1, int32_t z2);
+
+#endif
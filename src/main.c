@@ -29,26 +29,17 @@
 #include "config.h"
 #include "var.h"
 
-#include "adxl345.h"
-#include "hmc5883l.h"
-#include "itg3200.h"
+#include "hal.h"
+#include "i2c_async.h"
+#include "sensors.h"
+#include "control.h"
+#include "telemetry.h"
+#include "spsc.h"
+#include "tasks.h"
+#include "prof.h"
+#include "blackbox.h"
+#include "param.h"
 
-#include "kalman.h"
-
-
-#define	__MEASURE_ACCELEROMETER         0
-#define __MEASURE_COMPASS						1
-#define __MEASURE_GYROSCOPE					2
-
-#define __COMPASS_X_OFFSET					-82.0f
-#define __COMPASS_Y_OFFSET					136.5f
-#define __COMPASS_Z_OFFSET					-283.0f
-
-#define __KP		0.01f
-#define __KD		0.01f
-#define __KI		0.001f
-
-#define __TORQUE_MAX		100
 
 enum {
 	__BT_STANDBY,
@@ -56,133 +47,49 @@ enum {
 };
 
 
-uint32_t			pwm_msec;
+#define BT_RING_SIZE				16
+#define BT_DEADLINE_US			20000
 
-uint16_t			user_torque;
-uint16_t			torque[4];
-Vect3d				accel, gyro, compass;
-Vect3d				gyro_prev;
-uint8_t				sensors_state;
-float					roll, pitch, yaw;
-float					roll_des, pitch_des, yaw_des;
-float					u_roll, u_pitch, u_yaw;
-kalman_data		k_roll, k_pitch, k_yaw;
 
 uint8_t				bt_reciever_state;
 uint8_t				bt_byte;
 
+static uint8_t		bt_buffer[BT_RING_SIZE];
+static spsc_ring	bt_ring;								// UART1_Handler -> bt_Task
+
+static void bt_Task(void);
+
 
 void TIMER1A_Handler(void) {
-	uint16_t	i;
-	uint8_t		usb_data[128];
-	uint16_t	data_len;
-	float			acc_roll, acc_pitch, acc_yaw;
-	float			yaw_x, yaw_y;
-	float			compass_x, compass_y, compass_z;
-	float			roll_err, pitch_err, yaw_err;
-	
-	
-	acc_pitch =-((atan2f(accel.x, -accel.z)*180)/3.14159f);
-	acc_roll = 	((atan2f(accel.y, -accel.z)*180)/3.14159f);
-	kalman_innovate(&k_roll,	acc_roll,		gyro.x/14.7f);
-	kalman_innovate(&k_pitch,	acc_pitch,	gyro.y/14.7f);
-	roll	= k_roll.x[0];
-	pitch = k_pitch.x[0];
-	
-	compass_x = compass.x - __COMPASS_X_OFFSET;
-	compass_y = compass.y - __COMPASS_Y_OFFSET;
-	compass_z = compass.z - __COMPASS_Z_OFFSET;
-	yaw_x = compass_x * cosf(pitch*3.14159f/180) + compass_z * sinf(roll*3.14159f/180) * sinf(pitch*3.14159f/180) + compass_y * cosf(roll*3.14159f/180) * sinf(pitch*3.14159f/180);
-	yaw_y = compass_z * cosf(roll*3.14159f/180) - compass_y * sinf(roll*3.14159f/180);
-	acc_yaw = -((atan2f(yaw_y, yaw_x)*180)/3.14159f);
-	kalman_innovate(&k_yaw,		acc_yaw,		gyro.z/14.7f);
-	yaw		=	k_yaw.x[0];
-	/*
-	sprintf((char*)usb_data, "X:%06i,Y:%06i,Z:%06i\n", (int16_t)(roll*100), (int16_t)(pitch*100), (int16_t)(yaw*100));
-	send_USB_CDC_Data(usb_data);
-	*/
-	
-	roll_des = 0;
-	pitch_des = 0;
-	yaw_des = 0;
-	
-	roll_err	+= roll_des - roll;
-	pitch_err	+= pitch_des - pitch;
-	yaw_err		+= yaw_des - yaw;
-	
-	u_roll =	__KP * (roll_des - roll)		+ __KD * (((roll_des - roll)/_dt)		- gyro.x/14.7f*_dt) + __KI * roll_err;
-	u_pitch =	__KP * (pitch_des - pitch)	+ __KD * (((pitch_des - pitch)/_dt)	- gyro.y/14.7f*_dt) + __KI * pitch_err;
-	u_yaw =		__KP * (yaw_des - yaw)			+ __KD * (((yaw_des - yaw)/_dt)			- gyro.z/14.7f*_dt) + __KI * yaw_err;
+	control_Update();
 	
-	/*		
-	sprintf((char*)usb_data, "X:%06i,Y:%06i,Z:%06i\n", (int16_t)(roll*100), (int16_t)(pitch*100), (int16_t)(yaw*100));
-	send_USB_CDC_Data(usb_data);
-	sprintf((char*)usb_data, "u_roll: %i \t u_pitch: %i \t u_yaw: %i \n", (int32_t)(u_roll*100), (int32_t)(u_pitch*100), (int32_t)(u_yaw*100));
-	send_USB_CDC_Data(usb_data);
-	*/
-	
-	if (get_USB_CDC_Data(usb_data)) {
-		switch (usb_data[0]) {
-			default:
-					user_torque = atoi((char *)usb_data);
-					sprintf((char*)usb_data, "torque setted: %d\n", user_torque);
-					send_USB_CDC_Data(usb_data);
-				break;
-		}
-	}
-	
-	torque[0] = /*(uint16_t)(- u_pitch + u_roll) +*/ user_torque;
-	torque[1] = /*(uint16_t)(+ u_pitch + u_roll) +*/ user_torque;
-	torque[2] = /*(uint16_t)(- u_pitch - u_roll) +*/ user_torque;
-	torque[3] = /*(uint16_t)(+ u_pitch - u_roll) +*/ user_torque;
+	hal_TimerAck(HAL_TIMER_CONTROL);	// Clear the timer interrupt
+}
+
+void TIMER2A_Handler(void) {
+	uint32_t t = prof_Begin();
 	
-	for (i = 0; i < 4; i++) {
-		if (torque[i] > __TORQUE_MAX) torque[i] = __TORQUE_MAX;
-		if (torque[i] > __TORQUE_MAX) torque[i] = __TORQUE_MAX;
-	}
+	sensors_Poll();
+	prof_End(PROF_SENSORS, t);
 	
-	PWMPulseWidthSet(PWM1_BASE, PWM_OUT_0, pwm_msec + (pwm_msec * torque[0] / __TORQUE_MAX));
-	PWMPulseWidthSet(PWM1_BASE, PWM_OUT_1, pwm_msec + (pwm_msec * torque[1] / __TORQUE_MAX));
-	PWMPulseWidthSet(PWM1_BASE, PWM_OUT_2, pwm_msec + (pwm_msec * torque[2] / __TORQUE_MAX));
-	PWMPulseWidthSet(PWM1_BASE, PWM_OUT_3, pwm_msec + (pwm_msec * torque[3] / __TORQUE_MAX));
-
-	TimerIntClear(TIMER1_BASE, TIMER_TIMA_TIMEOUT);	// Clear the timer interrupt
+	hal_TimerAck(HAL_TIMER_SENSORS);	// Clear the timer interrupt
 }
 
-void TIMER2A_Handler(void) {
-	int16_t accel_data[3];
-	int16_t gyro_data[3];
-	int16_t compass_data[3];
+void I2C2_Handler(void) {
+	i2c_AsyncISR();
+}
 
-#ifdef __USE_IMU	
-	switch (sensors_state) {
-		case __MEASURE_ACCELEROMETER:
-				adxl345_ReadXYZ(&accel_data[0], &accel_data[1], &accel_data[2]);
-				accel.x += ((float)accel_data[0] - accel.x)/10;
-				accel.y += ((float)accel_data[1] - accel.y)/10;
-				accel.z += ((float)accel_data[2] - accel.z)/10;
-				sensors_state = __MEASURE_GYROSCOPE;
-			break;
-		
-		case __MEASURE_GYROSCOPE:
-				itg3200_ReadXYZ(&gyro_data[0], &gyro_data[1], &gyro_data[2]);
-				gyro.x += ((float)gyro_data[0] - gyro.x)/10;
-				gyro.y += ((float)gyro_data[1] - gyro.y)/10;
-				gyro.z += ((float)gyro_data[2] - gyro.z)/10;
-				sensors_state = __MEASURE_COMPASS;
-			break;
-		
-		case __MEASURE_COMPASS:
-				hmc5883l_ReadXYZ(&compass_data[0], &compass_data[1], &compass_data[2]);
-				compass.x += ((float)compass_data[0] - compass.x)/10;
-				compass.y += ((float)compass_data[1] - compass.y)/10;
-				compass.z += ((float)compass_data[2] - compass.z)/10;
-				sensors_state = __MEASURE_ACCELEROMETER;
-			break;
-	}
-#endif
+// sensor interrupt lines, all on port E
+void GPIOPortE_Handler(void) {
+	static const uint8_t sensor[HAL_EXTI_LINES] = {__MEASURE_ACCELEROMETER, __MEASURE_GYROSCOPE, __MEASURE_COMPASS};
+	uint8_t line;
 	
-	TimerIntClear(TIMER2_BASE, TIMER_TIMA_TIMEOUT);	// Clear the timer interrupt
+	for (line = 0; line < HAL_EXTI_LINES; line++) {
+		if (hal_ExtIntPending(line)) {
+			hal_ExtIntAck(line);
+			sensors_DataReady(sensor[line]);
+		}
+	}
 }
 
 int main(void)
@@ -198,62 +105,75 @@ int main(void)
 	UART_Config();
 	USB_Config();
 	I2C_Config();
+	param_Init();
+	prof_Init();
+	task_Init();
+	spsc_Init(&bt_ring, bt_buffer, BT_RING_SIZE, 1);
+	task_Register(TASK_BLUETOOTH, "bluetooth", bt_Task, BT_DEADLINE_US);
+	blackbox_Init();
 	NVIC_Config();
-
-#ifdef __USE_IMU
-	adxl345_Init();
-	hmc5883l_Init();
-	itg3200_Init();
-#endif
 	
-	kalman_init(&k_roll);
-	kalman_init(&k_pitch);
-	kalman_init(&k_yaw);
+	sensors_Init();
+	control_Init();
 	
-	pwm_msec = SysCtlPWMClockGet() / 1000;
-
+	// interrupts post, everything else runs here
   while(1)
   {
-
+		task_RunNext();
   }
 }
 
+/*
+ * @brief: TASK_BLUETOOTH: torque commands received on UART1
+ * @param[in]: none
+ * @param[out]: none
+ */
+static void bt_Task(void) {
+uint8_t		usb_data[128];
+	
+	while (spsc_Pop(&bt_ring, &bt_byte)) {
+		BT_data = bt_byte;
+		sprintf((char*)usb_data, "Recieved data: %c\n", BT_data);
+		telem_Text(usb_data);
+		
+		switch (bt_reciever_state) {
+			case __BT_STANDBY:
+				switch (BT_data) {
+					case 't':
+						bt_reciever_state = __BT_RECEIVE_TORQUE;
+						break;
+					default:
+						break;
+				}
+				break;
+			
+			case __BT_RECEIVE_TORQUE:
+				user_torque = BT_data;
+				sprintf((char*)usb_data, "torque setted: %d\n", user_torque);
+				telem_Text(usb_data);
+				bt_reciever_state = __BT_STANDBY;
+				break;
+		}
+		
+		if (LED_state) {
+			GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_2, GPIO_PIN_2);
+		} else {
+			GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_2, 0);
+		}
+		LED_state = !LED_state;
+	}
+}
+
 void UART1_Handler(void)
 {
-uint8_t		usb_data[128];
 uint32_t	UART_Int_Status;
+uint8_t		c;
 	
 	UART_Int_Status = UARTIntStatus(UART1_BASE, true);
 	UARTIntClear(UART1_BASE, UART_Int_Status);
 	
-	BT_data = UARTCharGet(UART1_BASE);
+	c = UARTCharGet(UART1_BASE);
 	//UARTCharPut(UART1_BASE, BT_data+1);
-	sprintf((char*)usb_data, "Recieved data: %c\n", BT_data);
-	send_USB_CDC_Data(usb_data);
-	
-	switch (bt_reciever_state) {
-		case __BT_STANDBY:
-			switch (BT_data) {
-				case 't':
-					bt_reciever_state = __BT_RECEIVE_TORQUE;
-					break;
-				default:
-					break;
-			}
-			break;
-			
-		case __BT_RECEIVE_TORQUE:
-			user_torque = BT_data;
-			sprintf((char*)usb_data, "torque setted: %d\n", user_torque);
-			send_USB_CDC_Data(usb_data);
-			bt_reciever_state = __BT_STANDBY;
-			break;
-	}
-	
-	if (LED_state) {
-		GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_2, GPIO_PIN_2);
-	} else {
-		GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_2, 0);
-	}
-	LED_state = !LED_state;
+	spsc_Push(&bt_ring, &c);
+	task_Post(TASK_BLUETOOTH);
 }
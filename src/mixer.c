@@ -0,0 +1,132 @@
+#include <stdint.h>
+
+#include "mixer.h"
+
+
+// motor order is the ESC wiring, PWM channel 0 first
+static const mixer_data mixer_frames[MIXER_FRAMES] = {
+	// MIXER_QUAD_X: rear-left, front-left, rear-right, front-right
+	{4, {
+		{+1.0f, -1.0f, -1.0f},
+		{+1.0f, +1.0f, +1.0f},
+		{-1.0f, -1.0f, +1.0f},
+		{-1.0f, +1.0f, -1.0f},
+	}},
+	// MIXER_QUAD_PLUS: front, right, rear, left
+	{4, {
+		{ 0.0f, +1.0f, -1.0f},
+		{-1.0f,  0.0f, +1.0f},
+		{ 0.0f, -1.0f, -1.0f},
+		{+1.0f,  0.0f, +1.0f},
+	}},
+	// MIXER_HEX_X: clockwise from 30 deg right of the nose, every 60 deg
+	{6, {
+		{-0.5f,       +0.8660254f, -1.0f},
+		{-1.0f,        0.0f,       +1.0f},
+		{-0.5f,       -0.8660254f, -1.0f},
+		{+0.5f,       -0.8660254f, +1.0f},
+		{+1.0f,        0.0f,       -1.0f},
+		{+0.5f,       +0.8660254f, +1.0f},
+	}},
+	// MIXER_OCTO_X: clockwise from 22.5 deg right of the nose, every 45 deg
+	{8, {
+		{-0.3826834f, +0.9238795f, -1.0f},
+		{-0.9238795f, +0.3826834f, +1.0f},
+		{-0.9238795f, -0.3826834f, -1.0f},
+		{-0.3826834f, -0.9238795f, +1.0f},
+		{+0.3826834f, -0.9238795f, -1.0f},
+		{+0.9238795f, -0.3826834f, +1.0f},
+		{+0.9238795f, +0.3826834f, -1.0f},
+		{+0.3826834f, +0.9238795f, +1.0f},
+	}},
+};
+
+
+/*
+ * @brief: Built-in frame table
+ * @param[in]: mixer, MIXER_QUAD_X .. MIXER_OCTO_X
+ * @param[out]: 1, 0 for an unknown frame (mixer unchanged)
+ */
+uint8_t mixer_init(mixer_data * m, uint8_t frame) {
+	if (frame >= MIXER_FRAMES) return 0;
+	*m = mixer_frames[frame];
+	return 1;
+}
+
+/*
+ * @brief: Caller's table, e.g. an H or a wide X frame
+ * @param[in]: mixer, rows of roll, pitch, yaw, number of motors
+ * @param[out]: 1, 0 for 0 or more than MIXER_MOTORS_MAX motors (mixer unchanged)
+ */
+uint8_t mixer_custom(mixer_data * m, const float (*mix)[3], uint8_t motors) {
+	uint8_t i;
+	
+	if (motors == 0 || motors > MIXER_MOTORS_MAX) return 0;
+	m->motors = motors;
+	for (i = 0; i < motors; i++) {
+		m->mix[i][0] = mix[i][0];
+		m->mix[i][1] = mix[i][1];
+		m->mix[i][2] = mix[i][2];
+	}
+	return 1;
+}
+
+/*
+ * @brief: Motor outputs for a throttle and the attitude commands, desaturated
+ * @param[in]: mixer, throttle and roll, pitch, yaw in output units, top of
+ * 				the output range
+ * @param[out]: out[0..motors-1] within [0, out_max]; MIXER_SAT_* bits for
+ * 				what had to give
+ */
+uint8_t mixer_mix(const mixer_data * m, float throttle, float roll, float pitch, float yaw, float out_max, float * out) {
+	float rp[MIXER_MOTORS_MAX], y[MIXER_MOTORS_MAX];
+	float rp_min = 0.0f, rp_max = 0.0f, a_min = 0.0f, a_max = 0.0f, a, k_rp = 1.0f, k_y = 1.0f;
+	uint8_t i, sat = 0;
+	
+	for (i = 0; i < m->motors; i++) {
+		rp[i] = m->mix[i][0] * roll + m->mix[i][1] * pitch;
+		y[i] = m->mix[i][2] * yaw;
+		a = rp[i] + y[i];
+		if (i == 0 || rp[i] < rp_min) rp_min = rp[i];
+		if (i == 0 || rp[i] > rp_max) rp_max = rp[i];
+		if (i == 0 || a < a_min) a_min = a;
+		if (i == 0 || a > a_max) a_max = a;
+	}
+	
+	if (a_max - a_min > out_max) {
+		if (rp_max - rp_min >= out_max) {
+			// roll and pitch alone fill the range: no yaw, roll and pitch scaled
+			k_rp = out_max / (rp_max - rp_min);
+			k_y = 0.0f;
+			sat |= MIXER_SAT_RP | MIXER_SAT_YAW;
+		} else {
+			// the spread is convex in the yaw share, so the linear
+			// interpolation to out_max is a share that fits
+			k_y = (out_max - (rp_max - rp_min)) / ((a_max - a_min) - (rp_max - rp_min));
+			sat |= MIXER_SAT_YAW;
+		}
+		for (i = 0; i < m->motors; i++) {
+			a = k_rp * rp[i] + k_y * y[i];
+			if (i == 0 || a < a_min) a_min = a;
+			if (i == 0 || a > a_max) a_max = a;
+		}
+	}
+	
+	if (throttle + a_max > out_max) {
+		throttle = out_max - a_max;
+		sat |= MIXER_SAT_THROTTLE;
+	}
+	if (throttle + a_min < 0.0f) {
+		throttle = -a_min;
+		sat |= MIXER_SAT_THROTTLE;
+	}
+	
+	for (i = 0; i < m->motors; i++) {
+		a = throttle + k_rp * rp[i] + k_y * y[i];
+		// rounding only
+		if (a < 0.0f) a = 0.0f;
+		if (a > out_max) a = out_max;
+		out[i] = a;
+	}
+	return sat;
+}
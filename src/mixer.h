@@ -0,0 +1,48 @@
+#ifndef _MIXER_H_
+#define _MIXER_H_
+
+#include <stdint.h>
+
+/*
+ * Motor mixer: one row per motor, the share of the roll, pitch and yaw
+ * commands that motor takes, so every output is
+ *
+ *   out[i] = throttle + mix[i][0] roll + mix[i][1] pitch + mix[i][2] yaw
+ *
+ * in one pass over the table. Body axes x forward, y right, z down; a motor
+ * at angle a from the nose (towards the right arm), spinning dir (+1
+ * clockwise seen from above) has the row {-sin a, cos a, -dir}; quad X keeps
+ * the +-1 rows the firmware always flew.
+ *
+ * Saturation keeps attitude authority before thrust. If the spread of the
+ * attitude part does not fit the output range, yaw gives way first, and only
+ * then roll and pitch, scaled together. The throttle then moves down (or up)
+ * until every output is inside [0, out_max], so the differences between the
+ * motors, which are what turns the frame, survive intact.
+ */
+
+#define MIXER_QUAD_X						0
+#define MIXER_QUAD_PLUS					1
+#define MIXER_HEX_X							2
+#define MIXER_OCTO_X						3
+#define MIXER_CUSTOM						4		// table from mixer_custom
+#define MIXER_FRAMES						4		// built-in
+
+#define MIXER_MOTORS_MAX				8
+
+// mixer_mix return bits
+#define MIXER_SAT_THROTTLE			0x01	// throttle moved to fit the range
+#define MIXER_SAT_YAW						0x02	// yaw reduced
+#define MIXER_SAT_RP						0x04	// roll and pitch reduced
+
+
+typedef struct {
+	uint8_t		motors;
+	float			mix[MIXER_MOTORS_MAX][3];		// roll, pitch, yaw per motor
+} mixer_data;
+
+uint8_t mixer_init(mixer_data * m, uint8_t frame);
+uint8_t mixer_custom(mixer_data * m, const float (*mix)[3], uint8_t motors);
+uint8_t mixer_mix(const mixer_data * m, float throttle, float roll, float pitch, float yaw, float out_max, float * out);
+
+#endif
@@ -0,0 +1,220 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "hal.h"
+#include "control.h"
+#include "kalman.h"
+#include "telemetry.h"
+#include "crc16.h"
+#include "param.h"
+
+
+const param_entry param_table[PARAM_COUNT] = {
+	{"kp",					&control_kp,					PARAM_F32,	__KP,									0.0f,			100.0f},
+	{"kd",					&control_kd,					PARAM_F32,	__KD,									0.0f,			100.0f},
+	{"ki",					&control_ki,					PARAM_F32,	__KI,									0.0f,			100.0f},
+	{"q00",					&kalman_qr.q00,				PARAM_F32,	_Q00,									1e-6f,		1e6f},
+	{"q11",					&kalman_qr.q11,				PARAM_F32,	_Q11,									1e-6f,		1e6f},
+	{"q22",					&kalman_qr.q22,				PARAM_F32,	_Q22,									1e-6f,		1e6f},
+	{"r00",					&kalman_qr.r00,				PARAM_F32,	_R00,									1e-6f,		1e6f},
+	{"r11",					&kalman_qr.r11,				PARAM_F32,	_R11,									1e-6f,		1e6f},
+	{"compass_x",		&control_compass.x,		PARAM_F32,	__COMPASS_X_OFFSET,		-4096.0f,	4096.0f},
+	{"compass_y",		&control_compass.y,		PARAM_F32,	__COMPASS_Y_OFFSET,		-4096.0f,	4096.0f},
+	{"compass_z",		&control_compass.z,		PARAM_F32,	__COMPASS_Z_OFFSET,		-4096.0f,	4096.0f},
+	{"torque_max",	&control_torque_max,	PARAM_U16,	__TORQUE_MAX,					0.0f,			__TORQUE_MAX},
+	{"angle_kp",		&control_angle_kp,		PARAM_F32,	__ANGLE_KP,						0.0f,			100.0f},
+	{"yaw_kp",			&control_yaw_kp,			PARAM_F32,	__YAW_KP,							0.0f,			100.0f},
+	{"rate_kp",			&control_rate_kp,			PARAM_F32,	__RATE_KP,						0.0f,			100.0f},
+	{"rate_ki",			&control_rate_ki,			PARAM_F32,	__RATE_KI,						0.0f,			100.0f},
+	{"rate_kd",			&control_rate_kd,			PARAM_F32,	__RATE_KD,						0.0f,			100.0f},
+	{"yaw_rate_kp",	&control_yaw_rate_kp,	PARAM_F32,	__YAW_RATE_KP,				0.0f,			100.0f},
+	{"yaw_rate_ki",	&control_yaw_rate_ki,	PARAM_F32,	__YAW_RATE_KI,				0.0f,			100.0f},
+	{"rate_div",		&control_rate_div,		PARAM_U16,	__RATE_DIV,						1.0f,			100.0f},
+};
+
+
+static inline void param_Put32(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t param_Get32(const uint8_t *p) {
+	return p[0] | p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/*
+ * @brief: Defaults, then whatever the store holds
+ * @param[in]: none
+ * @param[out]: none
+ */
+void param_Init(void) {
+	param_Defaults();
+	param_Load();
+}
+
+/*
+ * @brief: Current value as stored and sent: float bits, or the u16 widened
+ * @param[in]: PARAM_*
+ * @param[out]: bits; PARAM_OK or PARAM_EID
+ */
+uint8_t param_Get(uint8_t id, uint32_t *bits) {
+	const param_entry *e;
+	
+	if (id >= PARAM_COUNT) return PARAM_EID;
+	e = &param_table[id];
+	if (e->type == PARAM_F32) {
+		memcpy(bits, e->var, 4);
+	} else {
+		*bits = *(uint16_t *)e->var;
+	}
+	return PARAM_OK;
+}
+
+/*
+ * @brief: Range-checked write; the control loop sees it on its next read, a
+ * 				noise constant restarts the steady-state gain solve
+ * @param[in]: PARAM_*, bits as param_Get returns them
+ * @param[out]: PARAM_OK, PARAM_EID or PARAM_ERANGE (value unchanged)
+ */
+uint8_t param_Set(uint8_t id, uint32_t bits) {
+	const param_entry *e;
+	float f;
+	
+	if (id >= PARAM_COUNT) return PARAM_EID;
+	e = &param_table[id];
+	if (e->type == PARAM_F32) {
+		memcpy(&f, &bits, 4);
+		if (!(f >= e->min && f <= e->max)) return PARAM_ERANGE;
+		*(float *)e->var = f;
+		if (id >= PARAM_Q00 && id <= PARAM_R11) kalman_steady_reset(&kalman_ss, kalman_ss.tol);
+	} else {
+		if (bits < e->min || bits > e->max) return PARAM_ERANGE;
+		*(uint16_t *)e->var = (uint16_t)bits;
+	}
+	return PARAM_OK;
+}
+
+void param_Defaults(void) {
+	uint8_t i;
+	
+	for (i = 0; i < PARAM_COUNT; i++) {
+		if (param_table[i].type == PARAM_F32) {
+			*(float *)param_table[i].var = param_table[i].def;
+		} else {
+			*(uint16_t *)param_table[i].var = (uint16_t)param_table[i].def;
+		}
+	}
+	kalman_steady_reset(&kalman_ss, kalman_ss.tol);
+}
+
+/*
+ * @brief: Write every parameter to the store, PARAM_LAYOUT_VERSION layout
+ * @param[in]: none
+ * @param[out]: PARAM_OK or PARAM_ESTORE
+ */
+uint8_t param_Save(void) {
+	uint32_t	img[PARAM_STORE_SIZE / 4];	// EEPROMProgram takes words
+	uint32_t	bits;
+	uint16_t	crc;
+	uint8_t		i, *b = (uint8_t *)img, *p = b + 8;
+	
+	param_Put32(b, PARAM_MAGIC);
+	param_Put32(b + 4, PARAM_LAYOUT_VERSION | (uint32_t)PARAM_COUNT << 16);
+	for (i = 0; i < PARAM_COUNT; i++, p += 8) {
+		param_Get(i, &bits);
+		param_Put32(p, i | (uint32_t)param_table[i].type << 8);
+		param_Put32(p + 4, bits);
+	}
+	crc = crc16_Update(CRC16_INIT, b, PARAM_STORE_SIZE - 4);
+	param_Put32(p, crc);
+	return hal_StoreWrite(PARAM_STORE_ADDR, img, PARAM_STORE_SIZE) ? PARAM_OK : PARAM_ESTORE;
+}
+
+/*
+ * @brief: Apply a stored image; entries are read one at a time, so an image
+ * 				from a build with more parameters needs no bigger buffer
+ * @param[in]: none
+ * @param[out]: PARAM_OK, or PARAM_ESTORE with nothing changed
+ */
+uint8_t param_Load(void) {
+	uint32_t	head_w[2], e_w[2];		// EEPROMRead fills words
+	uint8_t		*head = (uint8_t *)head_w, *e = (uint8_t *)e_w;
+	uint16_t	version, entries, crc = CRC16_INIT, i;
+	uint32_t	addr;
+	
+	if (!hal_StoreRead(PARAM_STORE_ADDR, head, 8) || param_Get32(head) != PARAM_MAGIC) return PARAM_ESTORE;
+	version = (uint16_t)param_Get32(head + 4);
+	entries = (uint16_t)(param_Get32(head + 4) >> 16);
+	if (version != PARAM_LAYOUT_VERSION || 8 + 8 * (uint32_t)entries + 4 > HAL_STORE_SIZE) return PARAM_ESTORE;
+	
+	// check the whole image before applying any of it
+	crc = crc16_Update(crc, head, 8);
+	for (i = 0, addr = PARAM_STORE_ADDR + 8; i < entries; i++, addr += 8) {
+		if (!hal_StoreRead(addr, e, 8)) return PARAM_ESTORE;
+		crc = crc16_Update(crc, e, 8);
+	}
+	if (!hal_StoreRead(addr, e, 4) || (uint16_t)param_Get32(e) != crc) return PARAM_ESTORE;
+	
+	for (i = 0, addr = PARAM_STORE_ADDR + 8; i < entries; i++, addr += 8) {
+		hal_StoreRead(addr, e, 8);
+		if (e[0] < PARAM_COUNT && e[1] == param_table[e[0]].type) param_Set(e[0], param_Get32(e + 4));
+	}
+	return PARAM_OK;
+}
+
+/*
+ * @brief: Serve the 'P' requests at the start of a USB read; a request cut
+ * 				short by the end of the read gets a PARAM_EREQ reply
+ * @param[in]: received bytes
+ * @param[out]: bytes consumed, at least 1 if data starts with 'P'; one
+ * 				TELEM_MSG_PARAM reply per request
+ */
+uint16_t param_Command(const uint8_t *data, uint16_t len) {
+	uint16_t	used = 0;
+	uint32_t	bits;
+	uint8_t		op, id, status, n;
+	
+	while (used < len && data[used] == 'P') {
+		op = len - used > 1 ? data[used + 1] : 0xFF;
+		id = len - used > 2 ? data[used + 2] : 0xFF;
+		n = op == PARAM_OP_SET ? 7 : 3;
+		bits = 0;
+		if (len - used < n) {
+			status = PARAM_EREQ;
+			n = (uint8_t)(len - used);
+		} else {
+			switch (op) {
+				case PARAM_OP_GET:
+						status = param_Get(id, &bits);
+					break;
+				case PARAM_OP_SET:
+						status = param_Set(id, param_Get32(&data[used + 3]));
+						if (status != PARAM_EID) param_Get(id, &bits);
+					break;
+				case PARAM_OP_SAVE:
+						// the EEPROM stalls the CPU for milliseconds
+						status = user_torque ? PARAM_EBUSY : param_Save();
+					break;
+				case PARAM_OP_LOAD:
+						// would swap every gain at once in flight
+						status = user_torque ? PARAM_EBUSY : param_Load();
+					break;
+				case PARAM_OP_DEFAULTS:
+						status = PARAM_EBUSY;
+						if (!user_torque) {
+							param_Defaults();
+							status = PARAM_OK;
+						}
+					break;
+				default:
+						status = PARAM_EREQ;
+					break;
+			}
+		}
+		telem_Param(op, id, status, id < PARAM_COUNT ? param_table[id].type : 0xFF, bits);
+		used += n;
+	}
+	return used;
+}
@@ -0,0 +1,102 @@
+#ifndef _PARAM_H_
+#define _PARAM_H_
+
+#include <stdint.h>
+
+/*
+ * Runtime parameters: the gains, filter noise, compass offsets and torque
+ * limit the flight code used to take from macros. Each is a plain global
+ * (control_kp, kalman_qr.q00, ...) that boots at its macro value, so the
+ * control loop reads it as before, with no lookup at all. param_table maps
+ * the PARAM_* ids onto them for everything else: typed get/set with range
+ * checks, the USB protocol and persistence.
+ *
+ * USB CDC requests, one or more per read, answered with one
+ * TELEM_MSG_PARAM frame each (u8 op, u8 id, u8 status, u8 type, u32 value):
+ *
+ *   'P' PARAM_OP_GET id
+ *   'P' PARAM_OP_SET id u32      value bits, little-endian (float or u16)
+ *   'P' PARAM_OP_SAVE 0          to the store
+ *   'P' PARAM_OP_LOAD 0          from the store
+ *   'P' PARAM_OP_DEFAULTS 0      back to the macros
+ *
+ * Save, load and defaults are refused (PARAM_EBUSY) while the motors run.
+ * A request cut short by the end of the read is answered PARAM_EREQ; bytes
+ * after the last request go through control_Command again.
+ *
+ * Store layout, version PARAM_LAYOUT_VERSION at PARAM_STORE_ADDR (TM4C123
+ * EEPROM, a file on the host):
+ *
+ *   u32 PARAM_MAGIC, u16 version, u16 entries,
+ *   entries x {u8 id, u8 type, u16 0, u32 value}, u16 crc16, u16 0
+ *
+ * Entries are matched by id and type, so an image from a build with fewer
+ * parameters loads what it has and one with more skips what it does not
+ * know. PARAM_* ids are append-only; change the version only for a layout
+ * that older code must not read.
+ */
+
+#define PARAM_F32										0
+#define PARAM_U16										1
+
+// ids: wire and store numbering, append only
+#define PARAM_KP										0
+#define PARAM_KD										1
+#define PARAM_KI										2
+#define PARAM_Q00										3
+#define PARAM_Q11										4
+#define PARAM_Q22										5
+#define PARAM_R00										6
+#define PARAM_R11										7
+#define PARAM_COMPASS_X							8				// offsets, raw LSB
+#define PARAM_COMPASS_Y							9
+#define PARAM_COMPASS_Z							10
+#define PARAM_TORQUE_MAX						11			// motor command limit
+#define PARAM_ANGLE_KP							12			// CONTROL_CASCADE
+#define PARAM_YAW_KP								13
+#define PARAM_RATE_KP								14
+#define PARAM_RATE_KI								15
+#define PARAM_RATE_KD								16
+#define PARAM_YAW_RATE_KP						17
+#define PARAM_YAW_RATE_KI						18
+#define PARAM_RATE_DIV							19			// rate loop on every n-th gyro sample
+#define PARAM_COUNT									20
+
+#define PARAM_OP_GET								0
+#define PARAM_OP_SET								1
+#define PARAM_OP_SAVE								2
+#define PARAM_OP_LOAD								3
+#define PARAM_OP_DEFAULTS						4
+
+#define PARAM_OK										0
+#define PARAM_EID										1				// no such parameter
+#define PARAM_ERANGE								2				// outside [min, max] or NaN
+#define PARAM_ESTORE								3				// store unreadable, blank or corrupt
+#define PARAM_EREQ									4				// malformed request
+#define PARAM_EBUSY									5				// save, load or defaults while the motors run
+
+#define PARAM_MAGIC									0x50594B53	// "SKYP"
+#define PARAM_LAYOUT_VERSION				1
+#define PARAM_STORE_ADDR						0
+#define PARAM_STORE_SIZE						(8 + 8 * PARAM_COUNT + 4)
+
+
+typedef struct {
+	const char	*name;
+	void				*var;
+	uint8_t			type;
+	float				def, min, max;
+} param_entry;
+
+
+extern const param_entry	param_table[PARAM_COUNT];
+
+extern void			param_Init(void);
+extern uint8_t	param_Get(uint8_t id, uint32_t *bits);
+extern uint8_t	param_Set(uint8_t id, uint32_t bits);
+extern void			param_Defaults(void);
+extern uint8_t	param_Save(void);
+extern uint8_t	param_Load(void);
+extern uint16_t	param_Command(const uint8_t *data, uint16_t len);
+
+#endif
@@ -0,0 +1,62 @@
+#include <stdint.h>
+
+#include "pid.h"
+
+
+/*
+ * @brief: Output limits and derivative filter, conditional integration,
+ * 				state at rest
+ * @param[in]: controller, output range, derivative cutoff in Hz (0: none)
+ * @param[out]: none
+ */
+void pid_init(pid_data * pd, float out_min, float out_max, float d_hz) {
+	pd->out_min = out_min;
+	pd->out_max = out_max;
+	pd->tau = d_hz > 0.0f ? 1.0f / (PID_TWO_PI * d_hz) : 0.0f;
+	pd->kt = 0.0f;
+	pid_reset(pd);
+}
+
+/*
+ * @brief: Forget the integral and the derivative history, keep the limits
+ */
+void pid_reset(pid_data * pd) {
+	pd->integ = 0.0f;
+	pd->d = 0.0f;
+	pd->meas_last = 0.0f;
+	pd->started = 0;
+}
+
+/*
+ * @brief: One update; the first after a reset has no derivative
+ * @param[in]: controller, gains, setpoint and measurement, s since the last
+ * 				update (> 0)
+ * @param[out]: output within [out_min, out_max]
+ */
+float pid_update(pid_data * pd, float kp, float ki, float kd, float setpoint, float meas, float dt) {
+	float e = setpoint - meas;
+	float integ, u_pd, u_raw, u;
+	
+	if (pd->started) pd->d = (pd->tau * pd->d + meas - pd->meas_last) / (pd->tau + dt);
+	pd->meas_last = meas;
+	pd->started = 1;
+	
+	u_pd = kp * e - kd * pd->d;
+	integ = pd->integ + ki * e * dt;
+	u_raw = u_pd + integ;
+	if (pd->kt > 0.0f) {
+		u = u_raw > pd->out_max ? pd->out_max : (u_raw < pd->out_min ? pd->out_min : u_raw);
+		integ += pd->kt * (u - u_raw) * dt;
+	} else if ((u_raw > pd->out_max && e > 0.0f) || (u_raw < pd->out_min && e < 0.0f)) {
+		// saturated and the error would wind further: hold
+		integ = pd->integ;
+	}
+	if (integ > pd->out_max) integ = pd->out_max;
+	if (integ < pd->out_min) integ = pd->out_min;
+	pd->integ = integ;
+	
+	u = u_pd + integ;
+	if (u > pd->out_max) u = pd->out_max;
+	if (u < pd->out_min) u = pd->out_min;
+	return u;
+}
@@ -0,0 +1,45 @@
+#ifndef _PID_H_
+#define _PID_H_
+
+#include <stdint.h>
+
+/*
+ * PID with persistent state, one pid_data per axis and loop. The gains come
+ * with each call so the runtime parameters (param.h) take effect on the next
+ * update without touching the state; dt comes with each call too, so one
+ * controller runs at any rate, or at a jittered one.
+ *
+ *   u = kp e + I - kd d/dt(meas),   e = setpoint - meas
+ *
+ * The derivative is taken on the measurement, so a setpoint step does not
+ * kick, through a first-order low-pass at d_hz. The filter and the
+ * difference share one division:
+ *
+ *   D' = (tau D + meas - meas_last) / (tau + dt),   tau = 1 / (2 pi d_hz)
+ *
+ * the backward-Euler form of the filtered derivative, and the plain finite
+ * difference for d_hz 0. The output is clamped to [out_min, out_max].
+ * Anti-windup, with kt 0: the integral holds while the output is saturated
+ * and the error would push it further (conditional integration); with
+ * kt > 0: back-calculation, the integral bleeds by kt (u - u_unsaturated) dt.
+ * The integral itself never leaves the output range.
+ */
+
+#define PID_TWO_PI				6.2831853f
+
+
+typedef struct {
+	float			integ;								// integral term, output units
+	float			d;										// filtered derivative of the measurement
+	float			meas_last;
+	float			tau;									// derivative filter time constant, s
+	float			out_min, out_max;
+	float			kt;										// back-calculation gain, 1/s; 0: conditional integration
+	uint8_t		started;
+} pid_data;
+
+void pid_init(pid_data * pd, float out_min, float out_max, float d_hz);
+void pid_reset(pid_data * pd);
+float pid_update(pid_data * pd, float kp, float ki, float kd, float setpoint, float meas, float dt);
+
+#endif
@@ -0,0 +1,95 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hal.h"
+#include "telemetry.h"
+#include "prof.h"
+
+
+const char			*prof_names[PROF_COUNT] = {"estimate", "pid", "mixer", "usb_tx", "usb_rx", "sensors", "rate"};
+prof_probe			prof_probes[PROF_COUNT];
+
+
+/*
+ * @brief: Start the cycle counter, clear every probe
+ * @param[in]: none
+ * @param[out]: none
+ */
+void prof_Init(void) {
+	uint8_t i;
+	
+	hal_CyclesInit();
+	for (i = 0; i < PROF_COUNT; i++) prof_Snapshot(i, NULL, 1);
+}
+
+/*
+ * @brief: Histogram bucket of a duration
+ * @param[in]: cycles
+ * @param[out]: 0..PROF_BUCKETS-1
+ */
+uint8_t prof_Bucket(uint32_t cycles) {
+	uint8_t b;
+	
+	cycles >>= PROF_BUCKET_SHIFT;
+	if (!cycles) return 0;
+#if defined(__GNUC__)
+	b = (uint8_t)(31 - __builtin_clz(cycles));
+#elif defined(__CC_ARM)
+	b = (uint8_t)(31 - __clz(cycles));
+#else
+	for (b = 0; cycles >> 1; cycles >>= 1) b++;
+#endif
+	return b < PROF_BUCKETS ? b : PROF_BUCKETS - 1;
+}
+
+/*
+ * @brief: Account one run of a probed section
+ * @param[in]: PROF_*, duration in cycles
+ * @param[out]: none
+ */
+void prof_Record(uint8_t id, uint32_t cycles) {
+	prof_probe *p = &prof_probes[id];
+	
+	if (!p->count || cycles < p->min) p->min = cycles;
+	if (cycles > p->max) p->max = cycles;
+	p->count++;
+	p->sum += cycles;
+	p->hist[prof_Bucket(cycles)]++;
+}
+
+/*
+ * @brief: Copy a probe consistently against the context that records it
+ * @param[in]: PROF_*, reset to start a new window
+ * @param[out]: copy, may be NULL
+ */
+void prof_Snapshot(uint8_t id, prof_probe *out, uint8_t reset) {
+	uint32_t irq = hal_CriticalEnter();
+	
+	if (out != NULL) *out = prof_probes[id];
+	if (reset) memset(&prof_probes[id], 0, sizeof(prof_probe));
+	hal_CriticalExit(irq);
+}
+
+/*
+ * @brief: Send every probe and start a new window
+ * @param[in]: none
+ * @param[out]: none
+ */
+void prof_Report(void) {
+	prof_probe p;
+	uint8_t text[96];
+	uint32_t hz = hal_CycleHz();
+	uint8_t i;
+	
+	for (i = 0; i < PROF_COUNT; i++) {
+		prof_Snapshot(i, &p, 1);
+		if (telem_mode == TELEM_BINARY) {
+			telem_Profile(i, hz, &p);
+		} else {
+			sprintf((char *)text, "prof %s n %u min %u max %u mean %u cyc @ %u Hz\n", prof_names[i], (unsigned)p.count,
+							(unsigned)p.min, (unsigned)p.max, (unsigned)(p.count ? p.sum / p.count : 0), (unsigned)hz);
+			telem_Text(text);
+		}
+	}
+}
@@ -0,0 +1,90 @@
+#ifndef _PROF_H_
+#define _PROF_H_
+
+#include <stdint.h>
+#include "hal.h"
+
+/*
+ * Cycle-count probes around the hot paths of the loop.
+ *
+ *   uint32_t t = prof_Begin();
+ *   ...
+ *   prof_End(PROF_PID, t);
+ *
+ * hal_Cycles() is the DWT cycle counter on the TM4C (80 MHz, wraps in 53 s)
+ * and the TSC or CLOCK_MONOTONIC on the host; hal_CycleHz() converts. Each
+ * probe keeps count, min, max, sum and a log2 histogram of its durations
+ * since the last prof_Report, which sends one TELEM_MSG_PROFILE frame per
+ * probe (a text line in TELEM_TEXT mode) and starts a new window. The USB
+ * command 'p' asks for a report.
+ *
+ * A probe must only be recorded from one context (one interrupt, or the
+ * main loop). -D__PROFILE=0 compiles the probes out.
+ */
+
+#ifndef __PROFILE
+#define __PROFILE											1
+#endif
+
+// probe ids
+#define PROF_ESTIMATE									0				// sensors_Collect, attitude filters
+#define PROF_PID											1
+#define PROF_MIXER										2				// torque to PWM
+#define PROF_USB_TX										3				// control_Telemetry
+#define PROF_USB_RX										4				// command read and parse
+#define PROF_SENSORS									5				// TIMER2A_Handler: sensors_Poll, I2C starts
+#define PROF_RATE											6				// control_RateTask: rate PID and motor outputs
+#define PROF_COUNT										7
+
+// histogram bucket b counts durations in [2^(b+PROF_BUCKET_SHIFT), 2^(b+PROF_BUCKET_SHIFT+1))
+// cycles; the first and last also take everything below and above
+#define PROF_BUCKETS									16
+#define PROF_BUCKET_SHIFT							4
+
+
+typedef struct {
+	uint32_t	count;
+	uint32_t	min, max;											// cycles
+	uint64_t	sum;
+	uint32_t	hist[PROF_BUCKETS];
+} prof_probe;
+
+
+extern const char		*prof_names[PROF_COUNT];
+extern prof_probe		prof_probes[PROF_COUNT];
+
+extern void			prof_Init(void);
+extern void			prof_Record(uint8_t id, uint32_t cycles);
+extern uint8_t	prof_Bucket(uint32_t cycles);
+extern void			prof_Snapshot(uint8_t id, prof_probe *out, uint8_t reset);
+extern void			prof_Report(void);
+
+
+/*
+ * @brief: Start of a probed section
+ * @param[in]: none
+ * @param[out]: start, for prof_End
+ */
+static inline uint32_t prof_Begin(void) {
+#if __PROFILE
+	return hal_Cycles();
+#else
+	return 0;
+#endif
+}
+
+/*
+ * @brief: End of a probed section
+ * @param[in]: PROF_*, prof_Begin result
+ * @param[out]: none
+ */
+static inline void prof_End(uint8_t id, uint32_t start) {
+#if __PROFILE
+	prof_Record(id, hal_Cycles() - start);
+#else
+	(void)id;
+	(void)start;
+#endif
+}
+
+#endif
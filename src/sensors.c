@@ -0,0 +1,479 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "defines.h"
+#include "hal.h"
+#include "sensors.h"
+#include "tasks.h"
+
+#include "adxl345.h"
+#include "hmc5883l.h"
+#include "itg3200.h"
+#include "i2cu.h"
+#include "i2c_async.h"
+
+
+Vect3d						accel, gyro, compass;
+sensors_sample		sensors_last[SENSORS_COUNT];
+sensors_channel		sensors_chan[SENSORS_COUNT];
+uint8_t						sensors_acq = __SENSORS_ACQ;
+uint8_t						sensors_accel_mode = __ACCEL_MODE;
+int16_t						sensors_accel_fifo[ADXL345_FIFO_SIZE][3];
+uint8_t						sensors_accel_fifo_n;
+spsc_ring					sensors_ring;
+sensors_entry			sensors_batch[SENSORS_RING_SIZE];
+uint16_t					sensors_batch_n;
+
+static const uint8_t	sensors_id[SENSORS_COUNT]		= {I2C_ID_ADXL345, I2C_ID_HMC5883L, I2C_ID_ITG3200};
+static const uint8_t	sensors_reg[SENSORS_COUNT]	= {ADXL345_RA_DATAX0, HMC5883L_DATA, ITG3200_RA_GYRO_XOUT_H};
+static const uint8_t	sensors_order[SENSORS_COUNT]	= {__MEASURE_GYROSCOPE, __MEASURE_ACCELEROMETER, __MEASURE_COMPASS};
+static const uint8_t	sensors_line[SENSORS_COUNT]	= {HAL_EXTI_ACCEL, HAL_EXTI_COMPASS, HAL_EXTI_GYRO};
+
+static uint32_t				sensors_trig_us[SENSORS_COUNT];		// what started the read in flight
+
+static sensors_entry	sensors_ring_buf[SENSORS_RING_SIZE];
+
+#ifdef __USE_I2C_ASYNC
+static uint8_t		sensors_raw[SENSORS_COUNT][6];
+static i2c_txn		sensors_txn[SENSORS_COUNT];
+static uint8_t		sensors_accel_raw[__ACCEL_WATERMARK][6];
+static i2c_txn		sensors_accel_txn;
+#else
+static volatile uint8_t	sensors_pending;							// data-ready edges for sensors_Poll, bit per sensor
+static uint32_t					sensors_edge_us[SENSORS_COUNT];
+#endif
+
+
+/*
+ * @brief: Low-pass a new sample into the filtered reading
+ */
+static void sensors_Filter(Vect3d *v, const int16_t *data) {
+	v->x += ((float)data[0] - v->x)/10;
+	v->y += ((float)data[1] - v->y)/10;
+	v->z += ((float)data[2] - v->z)/10;
+}
+
+/*
+ * @brief: Queue a decoded sample for sensors_Collect; dropped if the control
+ * 				loop has fallen SENSORS_RING_SIZE samples behind
+ */
+static void sensors_Push(uint8_t sensor, const int16_t *data, uint32_t t_us) {
+	sensors_entry e;
+	
+	e.data[0] = data[0];
+	e.data[1] = data[1];
+	e.data[2] = data[2];
+	e.sensor = sensor;
+	e.t_us = t_us;
+	spsc_Push(&sensors_ring, &e);
+}
+
+/*
+ * @brief: Trigger to filter input of a completed read
+ */
+static void sensors_Latency(uint8_t sensor, uint32_t now) {
+	sensors_channel *ch = &sensors_chan[sensor];
+	uint32_t lat = now - sensors_trig_us[sensor];
+	
+	if (lat > ch->lat_max) ch->lat_max = lat;
+	ch->lat_sum += lat;
+}
+
+/*
+ * @brief: Decode, timestamp and queue one read, update interval statistics
+ */
+static void sensors_Sample(uint8_t sensor, const uint8_t *raw) {
+	sensors_channel *ch = &sensors_chan[sensor];
+	sensors_sample *s = &sensors_last[sensor];
+	uint32_t now = hal_Micros(), dt;
+	int16_t data[3];
+	
+	switch (sensor) {
+		case __MEASURE_ACCELEROMETER:
+				adxl345_DecodeXYZ(raw, &data[0], &data[1], &data[2]);
+			break;
+		
+		case __MEASURE_GYROSCOPE:
+				itg3200_DecodeXYZ(raw, &data[0], &data[1], &data[2]);
+			break;
+		
+		default:
+				hmc5883l_DecodeXYZ(raw, &data[0], &data[1], &data[2]);
+			break;
+	}
+	sensors_Push(sensor, data, now);
+	
+	if (ch->samples) {
+		dt = now - s->t_us;
+		if (dt < ch->dt_min) ch->dt_min = dt;
+		if (dt > ch->dt_max) ch->dt_max = dt;
+		ch->dt_sum += dt;
+	}
+	ch->samples++;
+	sensors_Latency(sensor, now);
+	s->x = data[0];
+	s->y = data[1];
+	s->z = data[2];
+	s->t_us = now;
+	// the rate loop runs on each gyro sample, if it is registered
+	if (sensor == __MEASURE_GYROSCOPE) task_Post(TASK_RATE);
+}
+
+/*
+ * @brief: Decode and queue a FIFO drain of n entries, oldest first; the
+ * 				completion time stamps the newest and the interval is spread evenly
+ */
+static void sensors_AccelBatch(const uint8_t (*raw)[6], uint8_t n) {
+	sensors_channel *ch = &sensors_chan[__MEASURE_ACCELEROMETER];
+	sensors_sample *s = &sensors_last[__MEASURE_ACCELEROMETER];
+	uint32_t now = hal_Micros(), dt;
+	uint8_t i;
+	
+	dt = ch->samples ? (now - s->t_us) / n : 0;
+	for (i = 0; i < n; i++) {
+		int16_t *data = sensors_accel_fifo[i];
+		
+		adxl345_DecodeXYZ(raw[i], &data[0], &data[1], &data[2]);
+		sensors_Push(__MEASURE_ACCELEROMETER, data, now - (n - 1 - i) * dt);
+	}
+	sensors_accel_fifo_n = n;
+	
+	if (ch->samples) {
+		if (dt < ch->dt_min) ch->dt_min = dt;
+		if (dt > ch->dt_max) ch->dt_max = dt;
+		ch->dt_sum += (uint64_t)dt * n;
+	}
+	ch->samples += n;
+	sensors_Latency(__MEASURE_ACCELEROMETER, now);
+	s->x = sensors_accel_fifo[n - 1][0];
+	s->y = sensors_accel_fifo[n - 1][1];
+	s->z = sensors_accel_fifo[n - 1][2];
+	s->t_us = now;
+}
+
+#ifdef __USE_I2C_ASYNC
+static void sensors_AccelDrain(uint32_t trig);
+
+/*
+ * @brief: FIFO drain completion, I2C interrupt context; entries that arrived
+ * 				during the drain keep INT1 high, so go round again
+ */
+static void sensors_AccelDone(i2c_txn *txn) {
+	if (txn->status == I2C_TXN_DONE) {
+		sensors_AccelBatch((const uint8_t (*)[6])txn->buf, txn->rep);
+	} else {
+		sensors_chan[__MEASURE_ACCELEROMETER].errors++;
+	}
+	if (hal_ExtIntLevel(HAL_EXTI_ACCEL)) sensors_AccelDrain(hal_Micros());
+}
+
+/*
+ * @brief: Queue one read of __ACCEL_WATERMARK FIFO entries; INT1 high
+ * 				guarantees at least that many are there
+ */
+static void sensors_AccelDrain(uint32_t trig) {
+	i2c_txn *t = &sensors_accel_txn;
+	
+	if (t->status == I2C_TXN_QUEUED || t->status == I2C_TXN_BUSY) return;
+	sensors_trig_us[__MEASURE_ACCELEROMETER] = trig;
+	t->id = I2C_ID_ADXL345;
+	t->addr = ADXL345_RA_DATAX0;
+	t->dir = I2C_TXN_READ;
+	t->n = 6;
+	t->rep = __ACCEL_WATERMARK;
+	t->buf = sensors_accel_raw[0];
+	t->done = sensors_AccelDone;
+	if (i2c_Submit(t)) {
+		sensors_chan[__MEASURE_ACCELEROMETER].reads++;
+	} else {
+		sensors_chan[__MEASURE_ACCELEROMETER].overruns++;
+	}
+}
+#else
+/*
+ * @brief: Blocking FIFO drain, one register read per entry
+ */
+static void sensors_AccelDrain(uint32_t trig) {
+	uint8_t raw[__ACCEL_WATERMARK][6];
+	uint8_t i;
+	
+	sensors_trig_us[__MEASURE_ACCELEROMETER] = trig;
+	for (i = 0; i < __ACCEL_WATERMARK; i++) {
+		sensors_chan[__MEASURE_ACCELEROMETER].reads++;
+		if (i2c_ReadBuf(I2C_ID_ADXL345, ADXL345_RA_DATAX0, 6, raw[i]) != 6) {
+			sensors_chan[__MEASURE_ACCELEROMETER].errors++;
+			return;
+		}
+	}
+	sensors_AccelBatch((const uint8_t (*)[6])raw, __ACCEL_WATERMARK);
+}
+#endif
+
+#ifdef __USE_I2C_ASYNC
+/*
+ * @brief: Read completion, I2C interrupt context
+ */
+static void sensors_Done(i2c_txn *txn) {
+	uint8_t sensor = (uint8_t)(txn - sensors_txn);
+	
+	if (txn->status == I2C_TXN_DONE) {
+		sensors_Sample(sensor, txn->buf);
+	} else {
+		sensors_chan[sensor].errors++;
+	}
+}
+#endif
+
+/*
+ * @brief: Start a read of one sensor's data registers
+ * @param[in]: __MEASURE_*, hal_Micros() of the tick or edge asking for it
+ */
+static void sensors_Read(uint8_t sensor, uint32_t trig) {
+#ifdef __USE_I2C_ASYNC
+	i2c_txn *t = &sensors_txn[sensor];
+	
+	if (t->status == I2C_TXN_QUEUED || t->status == I2C_TXN_BUSY) {
+		sensors_chan[sensor].overruns++;
+		return;
+	}
+	sensors_trig_us[sensor] = trig;
+	t->id = sensors_id[sensor];
+	t->addr = sensors_reg[sensor];
+	t->dir = I2C_TXN_READ;
+	t->n = 6;
+	t->buf = sensors_raw[sensor];
+	t->done = sensors_Done;
+	if (i2c_Submit(t)) {
+		sensors_chan[sensor].reads++;
+	} else {
+		sensors_chan[sensor].overruns++;
+	}
+#else
+	uint8_t raw[6];
+	
+	sensors_trig_us[sensor] = trig;
+	sensors_chan[sensor].reads++;
+	if (i2c_ReadBuf(sensors_id[sensor], sensors_reg[sensor], 6, raw) == 6) {
+		sensors_Sample(sensor, raw);
+	} else {
+		sensors_chan[sensor].errors++;
+	}
+#endif
+}
+
+/*
+ * @brief: Sensor is read from its interrupt line rather than the scheduler
+ */
+static uint8_t sensors_Irq(uint8_t sensor) {
+	if (sensor == __MEASURE_ACCELEROMETER && sensors_accel_mode == SENSORS_ACCEL_FIFO) return 1;
+	return sensors_acq == SENSORS_ACQ_DRDY;
+}
+
+/*
+ * @brief: A read of the sensor is queued or on the bus
+ */
+static uint8_t sensors_Busy(uint8_t sensor) {
+#ifdef __USE_I2C_ASYNC
+	const i2c_txn *t = &sensors_txn[sensor];
+	
+	if (sensor == __MEASURE_ACCELEROMETER && sensors_accel_mode == SENSORS_ACCEL_FIFO) t = &sensors_accel_txn;
+	return t->status == I2C_TXN_QUEUED || t->status == I2C_TXN_BUSY;
+#else
+	(void)sensor;
+	return 0;
+#endif
+}
+
+/*
+ * @brief: Read the sensor's data registers, or drain the accelerometer FIFO
+ */
+static void sensors_Acquire(uint8_t sensor, uint32_t trig) {
+	if (sensor == __MEASURE_ACCELEROMETER && sensors_accel_mode == SENSORS_ACCEL_FIFO) {
+		sensors_AccelDrain(trig);
+	} else {
+		sensors_Read(sensor, trig);
+	}
+}
+
+/*
+ * @brief: Reset the readings and configure the IMU sensors
+ * @param[in]: none
+ * @param[out]: none
+ */
+void sensors_Init(void) {
+	static const Vect3d zero = {0, 0, 0};
+	uint8_t i;
+	
+	accel = zero;
+	gyro = zero;
+	compass = zero;
+	memset(sensors_last, 0, sizeof(sensors_last));
+	memset(sensors_chan, 0, sizeof(sensors_chan));
+	memset(sensors_trig_us, 0, sizeof(sensors_trig_us));
+	spsc_Init(&sensors_ring, sensors_ring_buf, SENSORS_RING_SIZE, sizeof(sensors_entry));
+	sensors_accel_fifo_n = 0;
+	sensors_SetRate(__MEASURE_ACCELEROMETER, sensors_Irq(__MEASURE_ACCELEROMETER) ? 0 : __ACCEL_HZ);
+	sensors_SetRate(__MEASURE_GYROSCOPE, sensors_Irq(__MEASURE_GYROSCOPE) ? 0 : __GYRO_HZ);
+	sensors_SetRate(__MEASURE_COMPASS, sensors_Irq(__MEASURE_COMPASS) ? 0 : __COMPASS_HZ);
+	sensors_StatsReset();
+#ifdef __USE_IMU
+	adxl345_Init();
+	if (sensors_accel_mode == SENSORS_ACCEL_FIFO) adxl345_InitFifo(__ACCEL_FIFO_BW, __ACCEL_WATERMARK);
+	hmc5883l_Init();
+	itg3200_Init();
+#ifdef __USE_I2C_ASYNC
+	// configuration above is blocking; from here on the bus belongs to the ISR
+	memset(sensors_txn, 0, sizeof(sensors_txn));
+	memset(&sensors_accel_txn, 0, sizeof(sensors_accel_txn));
+	i2c_AsyncInit();
+#else
+	sensors_pending = 0;
+#endif
+	for (i = 0; i < SENSORS_COUNT; i++) {
+		if (sensors_Irq(i)) hal_ExtIntEnable(sensors_line[i]);
+	}
+#endif
+}
+
+/*
+ * @brief: Sampling rate of one sensor
+ * @param[in]: __MEASURE_*, Hz up to SENSORS_TICK_HZ, 0 stops it
+ * @param[out]: none
+ */
+void sensors_SetRate(uint8_t sensor, uint16_t hz) {
+	if (sensor >= SENSORS_COUNT) return;
+	if (hz > SENSORS_TICK_HZ) hz = SENSORS_TICK_HZ;
+	sensors_chan[sensor].hz = hz;
+	sensors_chan[sensor].phase = 0;
+}
+
+/*
+ * @brief: Clear sample counters and interval statistics
+ * @param[in]: none
+ * @param[out]: none
+ */
+void sensors_StatsReset(void) {
+	uint8_t i;
+	
+	for (i = 0; i < SENSORS_COUNT; i++) {
+		sensors_chan[i].samples = 0;
+		sensors_chan[i].reads = 0;
+		sensors_chan[i].overruns = 0;
+		sensors_chan[i].errors = 0;
+		sensors_chan[i].dt_min = 0xFFFFFFFF;
+		sensors_chan[i].dt_max = 0;
+		sensors_chan[i].dt_sum = 0;
+		sensors_chan[i].lat_max = 0;
+		sensors_chan[i].lat_sum = 0;
+	}
+}
+
+/*
+ * @brief: Scheduler tick: read the sensors whose rate accumulator wrapped,
+ * 				up to SENSORS_TICK_READS; the others stay due for the next tick
+ * @param[in]: none
+ * @param[out]: none
+ */
+void sensors_Poll(void) {
+#ifdef __USE_IMU
+	uint32_t now = hal_Micros();
+	uint8_t i, s, reads = 0;
+#ifndef __USE_I2C_ASYNC
+	uint32_t irq;
+	uint8_t pending;
+#endif
+	
+	for (i = 0; i < SENSORS_COUNT; i++) {
+		sensors_channel *ch;
+		
+		s = sensors_order[i];
+		ch = &sensors_chan[s];
+		ch->phase += ch->hz;
+		if (ch->phase >= SENSORS_TICK_HZ && reads < SENSORS_TICK_READS) {
+			ch->phase -= SENSORS_TICK_HZ;
+			sensors_Read(s, now);
+			reads++;
+		}
+	}
+#ifndef __USE_I2C_ASYNC
+	// blocking reads are not done in the GPIO interrupt
+	irq = hal_CriticalEnter();
+	pending = sensors_pending;
+	sensors_pending = 0;
+	hal_CriticalExit(irq);
+	for (i = 0; i < SENSORS_COUNT; i++) {
+		s = sensors_order[i];
+		if (pending & (1 << s)) sensors_Acquire(s, sensors_edge_us[s]);
+	}
+#endif
+	// ADXL345 INT1 and ITG3200 INT hold until read: a lost edge leaves them high
+	if (sensors_Irq(__MEASURE_GYROSCOPE) && !sensors_Busy(__MEASURE_GYROSCOPE) && hal_ExtIntLevel(HAL_EXTI_GYRO)) {
+		sensors_Acquire(__MEASURE_GYROSCOPE, now);
+	}
+	if (sensors_Irq(__MEASURE_ACCELEROMETER) && !sensors_Busy(__MEASURE_ACCELEROMETER) && hal_ExtIntLevel(HAL_EXTI_ACCEL)) {
+		sensors_Acquire(__MEASURE_ACCELEROMETER, now);
+	}
+#endif
+}
+
+/*
+ * @brief: Data-ready (or FIFO watermark) edge from a sensor, GPIO interrupt
+ * 				context: read it now, or leave it for the next tick without async I2C
+ * @param[in]: __MEASURE_*
+ * @param[out]: none
+ */
+void sensors_DataReady(uint8_t sensor) {
+#ifdef __USE_IMU
+	if (sensor >= SENSORS_COUNT) return;
+#ifdef __USE_I2C_ASYNC
+	sensors_Acquire(sensor, hal_Micros());
+#else
+	sensors_edge_us[sensor] = hal_Micros();
+	sensors_pending |= 1 << sensor;
+#endif
+#endif
+}
+
+/*
+ * @brief: Apply the samples in sensors_batch to accel, gyro and compass,
+ * 				oldest first; samples read back from a flight log can go
+ * 				through it again
+ * @param[in]: none
+ * @param[out]: none
+ */
+void sensors_FilterBatch(void) {
+	static Vect3d * const reading[SENSORS_COUNT] = {&accel, &compass, &gyro};
+	uint16_t i;
+	
+	for (i = 0; i < sensors_batch_n; i++) sensors_Filter(reading[sensors_batch[i].sensor], sensors_batch[i].data);
+}
+
+/*
+ * @brief: Take the samples queued since the last call into sensors_batch and
+ * 				filter them; the one consumer of sensors_ring
+ * @param[in]: none
+ * @param[out]: none
+ */
+void sensors_Collect(void) {
+	// the ring holds at most SENSORS_RING_SIZE, so one read takes them all
+	sensors_batch_n = (uint16_t)spsc_Read(&sensors_ring, sensors_batch, SENSORS_RING_SIZE);
+	sensors_FilterBatch();
+}
+
+/*
+ * @brief: Newest gyro sample, for the rate loop; copied with interrupts off
+ * 				since the read that completes it may land mid-copy
+ * @param[in]: none
+ * @param[out]: raw axes, hal_Micros() of the read
+ */
+void sensors_Gyro(int16_t *data, uint32_t *t_us) {
+	const sensors_sample *s = &sensors_last[__MEASURE_GYROSCOPE];
+	uint32_t irq = hal_CriticalEnter();
+	
+	data[0] = s->x;
+	data[1] = s->y;
+	data[2] = s->z;
+	*t_us = s->t_us;
+	hal_CriticalExit(irq);
+}
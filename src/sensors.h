@@ -0,0 +1,107 @@
+#ifndef _SENSORS_H_
+#define _SENSORS_H_
+
+#include <stdint.h>
+#include "var.h"
+#include "adxl345.h"
+#include "spsc.h"
+
+/*
+ * Sampling scheduler: TIMER2A ticks at SENSORS_TICK_HZ and every sensor has
+ * its own rate. A rate accumulator decides which sensors are due on a tick;
+ * due reads are issued gyro first, then accelerometer, then compass, at most
+ * SENSORS_TICK_READS of them so a tick's reads fit the tick on the bus. A
+ * sensor due beyond that is read on the next tick and keeps its rate.
+ *
+ * In SENSORS_ACQ_DRDY acquisition the scheduler reads nothing; each sensor
+ * is read from its data-ready interrupt (sensors_DataReady), so every read
+ * returns a new conversion. The tick only recovers latched lines whose edge
+ * was lost.
+ *
+ * In SENSORS_ACCEL_FIFO mode the ADXL345 streams into its own FIFO instead
+ * and raises INT1 at the watermark; the interrupt drains the entries in one
+ * queued transaction and filters them as a batch.
+ *
+ * Decoded samples reach accel, gyro and compass through sensors_ring: the
+ * context that completes a read pushes them, control_Update pulls them with
+ * sensors_Collect and applies the low-pass there, so the readings the
+ * estimator uses are never written under it. The unfiltered samples of the
+ * last sensors_Collect stay in sensors_batch, timestamped, for estimators
+ * that take every sample (CONTROL_EST_MULTIRATE) and the flight data
+ * recorder. Each gyro sample also posts TASK_RATE, which reads it with
+ * sensors_Gyro (CONTROL_CASCADE).
+ */
+
+#define	__MEASURE_ACCELEROMETER					0
+#define __MEASURE_COMPASS								1
+#define __MEASURE_GYROSCOPE							2
+#define SENSORS_COUNT										3
+
+#define SENSORS_TICK_HZ									2000			// TIMER2A
+#define SENSORS_TICK_READS							2					// 212 us each at 400 kHz, in a 500 us tick
+#define __ACCEL_HZ											400				// ADXL345 output data rate
+#define __GYRO_HZ												1000			// ITG3200 sample rate
+#define __COMPASS_HZ										75				// HMC5883L continuous mode
+
+#define SENSORS_ACQ_TIMER								0					// scheduler reads at the configured rates
+#define SENSORS_ACQ_DRDY								1					// data-ready interrupts
+#ifndef __SENSORS_ACQ
+#define __SENSORS_ACQ										SENSORS_ACQ_TIMER
+#endif
+
+#define SENSORS_ACCEL_POLLED						0					// read at __ACCEL_HZ by the scheduler, or on data ready
+#define SENSORS_ACCEL_FIFO							1					// watermark interrupt, batch drain
+#ifndef __ACCEL_MODE
+#define __ACCEL_MODE										SENSORS_ACCEL_POLLED
+#endif
+#define __ACCEL_FIFO_BW									ADXL345_BW_400		// 800 Hz output data rate
+#define __ACCEL_WATERMARK								8					// entries per batch, < ADXL345_FIFO_SIZE
+#define SENSORS_RING_SIZE								64				// samples between control ticks, power of two
+
+
+typedef struct {
+	int16_t			x, y, z;
+	uint32_t		t_us;												// hal_Micros() when the read completed
+} sensors_sample;
+
+typedef struct {
+	int16_t			data[3];
+	uint8_t			sensor;											// __MEASURE_*
+	uint32_t		t_us;												// hal_Micros() of the conversion
+} sensors_entry;
+
+typedef struct {
+	uint16_t		hz;
+	uint16_t		phase;											// rate accumulator
+	uint32_t		samples;
+	uint32_t		reads;											// bus transactions issued
+	uint32_t		overruns;										// due while the previous read was on the bus
+	uint32_t		errors;											// bus errors
+	uint32_t		dt_min, dt_max;							// us between consecutive samples
+	uint64_t		dt_sum;
+	uint32_t		lat_max;										// us from the tick or data-ready edge to the filter
+	uint64_t		lat_sum;										// per completed read
+} sensors_channel;
+
+
+extern Vect3d						accel, gyro, compass;
+extern sensors_sample		sensors_last[SENSORS_COUNT];
+extern sensors_channel	sensors_chan[SENSORS_COUNT];
+extern uint8_t					sensors_acq;
+extern uint8_t					sensors_accel_mode;
+extern int16_t					sensors_accel_fifo[ADXL345_FIFO_SIZE][3];	// last batch, oldest first
+extern uint8_t					sensors_accel_fifo_n;
+extern spsc_ring				sensors_ring;
+extern sensors_entry		sensors_batch[SENSORS_RING_SIZE];		// last sensors_Collect, oldest first
+extern uint16_t					sensors_batch_n;
+
+extern void sensors_Init(void);
+extern void sensors_SetRate(uint8_t sensor, uint16_t hz);
+extern void sensors_StatsReset(void);
+extern void sensors_Poll(void);
+extern void sensors_DataReady(uint8_t sensor);
+extern void sensors_FilterBatch(void);
+extern void sensors_Collect(void);
+extern void sensors_Gyro(int16_t *data, uint32_t *t_us);
+
+#endif
@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "spsc.h"
+
+
+#if defined(__GNUC__)
+static inline uint32_t spsc_Acquire(const uint32_t *p) {
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void spsc_Release(uint32_t *p, uint32_t v) {
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+#elif defined(__CC_ARM)
+static __inline uint32_t spsc_Acquire(const uint32_t *p) {
+	uint32_t v = *(volatile const uint32_t *)p;
+	
+	__dmb(0xF);
+	return v;
+}
+
+static __inline void spsc_Release(uint32_t *p, uint32_t v) {
+	__dmb(0xF);
+	*(volatile uint32_t *)p = v;
+}
+#else
+#error "spsc.c: no acquire/release load/store for this compiler"
+#endif
+
+
+/*
+ * @brief: Copy n elements between a ring position and linear memory, split at the wrap
+ */
+static void spsc_CopyIn(spsc_ring *r, uint32_t pos, const uint8_t *src, uint32_t n) {
+	uint32_t i = pos & r->mask;
+	uint32_t first = r->mask + 1 - i < n ? r->mask + 1 - i : n;
+	
+	memcpy(r->buf + i * r->esize, src, first * r->esize);
+	if (first < n) memcpy(r->buf, src + first * r->esize, (n - first) * r->esize);
+}
+
+static void spsc_CopyOut(spsc_ring *r, uint32_t pos, uint8_t *dst, uint32_t n) {
+	uint32_t i = pos & r->mask;
+	uint32_t first = r->mask + 1 - i < n ? r->mask + 1 - i : n;
+	
+	memcpy(dst, r->buf + i * r->esize, first * r->esize);
+	if (first < n) memcpy(dst + first * r->esize, r->buf, (n - first) * r->esize);
+}
+
+/*
+ * @brief: Empty ring over caller storage; not concurrent with push or pop
+ * @param[in]: ring, capacity * esize bytes of storage, capacity (power of two), element size
+ * @param[out]: none
+ */
+void spsc_Init(spsc_ring *r, void *buf, uint32_t capacity, uint32_t esize) {
+	memset(r, 0, sizeof(*r));
+	r->buf = buf;
+	r->mask = capacity - 1;
+	r->esize = esize;
+}
+
+/*
+ * @brief: Producer: append one element
+ * @param[in]: ring, element
+ * @param[out]: 1, or 0 if the ring is full (counted in dropped)
+ */
+uint8_t spsc_Push(spsc_ring *r, const void *e) {
+	uint32_t head = r->head;
+	
+	if (head - r->tail_seen > r->mask) {
+		r->tail_seen = spsc_Acquire(&r->tail);
+		if (head - r->tail_seen > r->mask) {
+			r->dropped++;
+			return 0;
+		}
+	}
+	memcpy(r->buf + (head & r->mask) * r->esize, e, r->esize);
+	spsc_Release(&r->head, head + 1);
+	return 1;
+}
+
+/*
+ * @brief: Consumer: take the oldest element
+ * @param[in]: ring
+ * @param[out]: element; returns 1, or 0 if the ring is empty
+ */
+uint8_t spsc_Pop(spsc_ring *r, void *e) {
+	uint32_t tail = r->tail;
+	
+	if (tail == r->head_seen) {
+		r->head_seen = spsc_Acquire(&r->head);
+		if (tail == r->head_seen) return 0;
+	}
+	memcpy(e, r->buf + (tail & r->mask) * r->esize, r->esize);
+	spsc_Release(&r->tail, tail + 1);
+	return 1;
+}
+
+/*
+ * @brief: Producer: append up to n elements, as many as fit
+ * @param[in]: ring, elements, count
+ * @param[out]: elements written; the rest are counted in dropped
+ */
+uint32_t spsc_Write(spsc_ring *r, const void *data, uint32_t n) {
+	uint32_t head = r->head, space = r->mask + 1 - (head - r->tail_seen);
+	
+	if (space < n) {
+		r->tail_seen = spsc_Acquire(&r->tail);
+		space = r->mask + 1 - (head - r->tail_seen);
+		if (space < n) {
+			r->dropped += n - space;
+			n = space;
+		}
+	}
+	if (!n) return 0;
+	spsc_CopyIn(r, head, data, n);
+	spsc_Release(&r->head, head + n);
+	return n;
+}
+
+/*
+ * @brief: Consumer: take up to n elements, oldest first
+ * @param[in]: ring, room for n elements
+ * @param[out]: elements read
+ */
+uint32_t spsc_Read(spsc_ring *r, void *data, uint32_t n) {
+	uint32_t tail = r->tail, avail = r->head_seen - tail;
+	
+	if (avail < n) {
+		r->head_seen = spsc_Acquire(&r->head);
+		avail = r->head_seen - tail;
+	}
+	if (n > avail) n = avail;
+	if (!n) return 0;
+	spsc_CopyOut(r, tail, data, n);
+	spsc_Release(&r->tail, tail + n);
+	return n;
+}
+
+/*
+ * @brief: Elements waiting, a snapshot: more may arrive or leave meanwhile
+ */
+uint32_t spsc_Count(spsc_ring *r) {
+	return spsc_Acquire(&r->head) - spsc_Acquire(&r->tail);
+}
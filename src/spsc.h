@@ -0,0 +1,50 @@
+#ifndef _SPSC_H_
+#define _SPSC_H_
+
+#include <stdint.h>
+
+/*
+ * Single-producer single-consumer ring of fixed-size elements, for handing
+ * data from an interrupt to the code that uses it without masking
+ * interrupts. Exactly one context may push and one may pop; neither blocks.
+ * Several interrupts may share one side only if none of them can preempt
+ * another, i.e. they run at the same NVIC priority: usb_rx_ring is pushed
+ * from both the USB0 and UART0 interrupts on that basis.
+ *
+ * head and tail run freely and are masked on use, so the capacity is a power
+ * of two and every slot is usable. Each side publishes its index with a
+ * release store and reads the other's with an acquire load: on the M4 that
+ * is a DMB, on x86 a compiler barrier. Each side also keeps the last index it
+ * saw of the other side, so it only touches the shared one when the ring
+ * looks full (or empty). The storage belongs to the caller.
+ */
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define SPSC_ALIGN				__attribute__((aligned(64)))		// producer and consumer on their own cache lines
+#else
+#define SPSC_ALIGN
+#endif
+
+
+typedef struct {
+	uint8_t		*buf;
+	uint32_t	mask;														// capacity - 1
+	uint32_t	esize;													// bytes per element
+	// producer
+	SPSC_ALIGN uint32_t	head;
+	uint32_t	tail_seen;
+	uint32_t	dropped;												// pushes refused, ring full
+	// consumer
+	SPSC_ALIGN uint32_t	tail;
+	uint32_t	head_seen;
+} spsc_ring;
+
+
+extern void			spsc_Init(spsc_ring *r, void *buf, uint32_t capacity, uint32_t esize);
+extern uint8_t	spsc_Push(spsc_ring *r, const void *e);
+extern uint8_t	spsc_Pop(spsc_ring *r, void *e);
+extern uint32_t	spsc_Write(spsc_ring *r, const void *data, uint32_t n);
+extern uint32_t	spsc_Read(spsc_ring *r, void *data, uint32_t n);
+extern uint32_t	spsc_Count(spsc_ring *r);
+
+#endif
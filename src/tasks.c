@@ -0,0 +1,134 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "hal.h"
+#include "tasks.h"
+
+
+uint8_t					task_mode = __TASKS_MODE;
+task_info				task_table[TASK_COUNT];
+
+static volatile uint32_t	task_pending;					// bit per task id
+
+
+/*
+ * @brief: Run one task and account for it
+ */
+static void task_Run(task_info *t, uint32_t posted) {
+	uint32_t start = hal_Micros(), end, exec;
+	
+	t->run();
+	end = hal_Micros();
+	exec = end - start;
+	t->runs++;
+	t->exec_sum_us += exec;
+	if (exec > t->wcet_us) t->wcet_us = exec;
+	if (start - posted > t->lat_max_us) t->lat_max_us = start - posted;
+	if (end - posted > t->deadline_us) t->late++;
+}
+
+/*
+ * @brief: Empty task table, nothing pending
+ * @param[in]: none
+ * @param[out]: none
+ */
+void task_Init(void) {
+	memset(task_table, 0, sizeof(task_table));
+	task_pending = 0;
+}
+
+/*
+ * @brief: Install a task
+ * @param[in]: TASK_*, name for reports, body, deadline from post to finish in us
+ * @param[out]: none
+ */
+void task_Register(uint8_t id, const char *name, task_fn run, uint32_t deadline_us) {
+	task_info *t;
+	
+	if (id >= TASK_COUNT) return;
+	t = &task_table[id];
+	t->name = name;
+	t->run = run;
+	t->deadline_us = deadline_us;
+}
+
+/*
+ * @brief: Ask for a task to run, from any context; a post while the task is
+ * 				still pending is merged into it and counted as an overrun
+ * @param[in]: TASK_*
+ * @param[out]: none
+ */
+void task_Post(uint8_t id) {
+	task_info *t;
+	uint32_t irq, now = hal_Micros();
+	
+	if (id >= TASK_COUNT || task_table[id].run == NULL) return;
+	t = &task_table[id];
+	if (task_mode == TASKS_ISR) {
+		t->posts++;
+		task_Run(t, now);
+		return;
+	}
+	irq = hal_CriticalEnter();
+	t->posts++;
+	if (task_pending & (1u << id)) {
+		t->overruns++;
+	} else {
+		t->posted_us = now;
+		task_pending |= 1u << id;
+	}
+	hal_CriticalExit(irq);
+}
+
+/*
+ * @brief: Main loop: run the pending task with the earliest deadline
+ * @param[in]: none
+ * @param[out]: 1 if a task ran, 0 if none was pending
+ */
+uint8_t task_RunNext(void) {
+	task_info *t;
+	uint32_t irq, pending, posted, due, best_due = 0;
+	uint8_t id, best = TASK_COUNT;
+	
+	irq = hal_CriticalEnter();
+	pending = task_pending;
+	for (id = 0; pending; id++, pending >>= 1) {
+		if (!(pending & 1)) continue;
+		due = task_table[id].posted_us + task_table[id].deadline_us;
+		if (best == TASK_COUNT || (int32_t)(due - best_due) < 0) {
+			best = id;
+			best_due = due;
+		}
+	}
+	if (best == TASK_COUNT) {
+		hal_CriticalExit(irq);
+		return 0;
+	}
+	t = &task_table[best];
+	posted = t->posted_us;
+	task_pending &= ~(1u << best);
+	hal_CriticalExit(irq);
+	
+	task_Run(t, posted);
+	return 1;
+}
+
+/*
+ * @brief: Clear the counters, keep the tasks
+ * @param[in]: none
+ * @param[out]: none
+ */
+void task_StatsReset(void) {
+	uint8_t i;
+	
+	for (i = 0; i < TASK_COUNT; i++) {
+		task_table[i].posts = 0;
+		task_table[i].runs = 0;
+		task_table[i].overruns = 0;
+		task_table[i].late = 0;
+		task_table[i].wcet_us = 0;
+		task_table[i].exec_sum_us = 0;
+		task_table[i].lat_max_us = 0;
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef _TASKS_H_
+#define _TASKS_H_
+
+#include <stdint.h>
+
+/*
+ * Run-to-completion tasks for the main loop. Interrupts only post work
+ * (task_Post); main() calls task_RunNext() forever, which runs the pending
+ * task with the earliest deadline (post time + deadline_us), ties going to
+ * the lower id. Tasks that depend on each other and are posted together,
+ * like estimate -> control, get increasing deadlines so they run in order.
+ * Nothing preempts a running task but interrupts, so a long task delays the
+ * others; the counters show by how much.
+ *
+ * In TASKS_ISR mode task_Post runs the task at once in the posting
+ * interrupt, which is how the control loop ran before, with the same
+ * counters.
+ */
+
+#define TASKS_ISR											0				// run in the posting interrupt
+#define TASKS_LOOP										1				// run from the main loop
+#ifndef __TASKS_MODE
+#define __TASKS_MODE									TASKS_LOOP
+#endif
+
+// ids; TIMER1A posts the first four every control tick
+#define TASK_ESTIMATE									0				// sensors_Collect, attitude filters
+#define TASK_CONTROL									1				// PID, motor outputs
+#define TASK_TELEMETRY								2
+#define TASK_COMMAND									3				// USB CDC commands
+#define TASK_BLUETOOTH								4				// UART1 bytes
+#define TASK_LOG											5				// blackbox blocks to their sink
+#define TASK_RATE											6				// rate loop, posted per gyro sample (CONTROL_CASCADE)
+#define TASK_COUNT										7
+
+
+typedef void (*task_fn)(void);
+
+typedef struct {
+	const char	*name;
+	task_fn			run;
+	uint32_t		deadline_us;									// from post to finish
+	uint32_t		posted_us;
+	uint32_t		posts, runs;
+	uint32_t		overruns;											// posted again before it ran
+	uint32_t		late;													// finished after its deadline
+	uint32_t		wcet_us;											// longest run
+	uint64_t		exec_sum_us;
+	uint32_t		lat_max_us;										// post to start
+} task_info;
+
+
+extern uint8_t			task_mode;
+extern task_info		task_table[TASK_COUNT];
+
+extern void			task_Init(void);
+extern void			task_Register(uint8_t id, const char *name, task_fn run, uint32_t deadline_us);
+extern void			task_Post(uint8_t id);
+extern uint8_t	task_RunNext(void);
+extern void			task_StatsReset(void);
+
+#endif
@@ -0,0 +1,302 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+#include "crc16.h"
+#include "telemetry.h"
+
+
+struct telem_writer {
+	uint8_t			*ring;
+	uint16_t		size;
+	uint16_t		idx;														// next byte
+	uint16_t		code_idx;												// COBS code byte of the open block
+	uint8_t			code;
+	uint8_t			open;
+	uint16_t		len;														// bytes written, to commit
+	uint16_t		crc;
+};
+
+
+uint8_t						telem_mode = __TELEMETRY;
+uint32_t					telem_frames;
+uint32_t					telem_dropped;
+
+static telem_writer	telem_w;
+static uint8_t			telem_seq;
+
+
+/*
+ * @brief: Next ring slot, wrapping
+ */
+static inline void telem_Advance(telem_writer *w) {
+	if (++w->idx == w->size) w->idx = 0;
+	w->len++;
+}
+
+/*
+ * @brief: COBS-encode one byte into the ring; a zero or a full block closes
+ * 				the block by writing its code byte and opens the next one
+ */
+static inline void telem_Raw(telem_writer *w, uint8_t b) {
+	if (b) {
+		w->ring[w->idx] = b;
+		telem_Advance(w);
+		w->code++;
+	}
+	if (!b || w->code == 0xFF) {
+		w->ring[w->code_idx] = w->code;
+		w->code_idx = w->idx;
+		telem_Advance(w);
+		w->code = 1;
+	}
+}
+
+/*
+ * @brief: CRC and COBS-encode an n-byte little-endian field; the same as n
+ * 				telem_Raw calls, with the writer state kept in registers
+ */
+static void telem_Field(telem_writer *w, uint32_t v, uint8_t n) {
+	uint8_t		*ring = w->ring;
+	uint16_t	size = w->size, idx = w->idx, code_idx = w->code_idx, len = w->len, crc = w->crc;
+	uint8_t		code = w->code, b;
+	
+	while (n--) {
+		b = (uint8_t)v;
+		v >>= 8;
+		crc = crc16_Byte(crc, b);
+		if (b) {
+			ring[idx] = b;
+			if (++idx == size) idx = 0;
+			len++;
+			code++;
+		}
+		if (!b || code == 0xFF) {
+			ring[code_idx] = code;
+			code_idx = idx;
+			if (++idx == size) idx = 0;
+			len++;
+			code = 1;
+		}
+	}
+	w->idx = idx;
+	w->code_idx = code_idx;
+	w->len = len;
+	w->crc = crc;
+	w->code = code;
+}
+
+static int16_t telem_Centi(float deg) {
+	float v = deg * 100.0f;
+	
+	if (v > 32767.0f) return 32767;
+	if (v < -32767.0f) return -32767;
+	return (int16_t)(v < 0 ? v - 0.5f : v + 0.5f);
+}
+
+/*
+ * @brief: Reserve the USB transmit ring and open a frame in it; interrupts are
+ * 				masked only while reserving, the frame is encoded with them on
+ * @param[in]: TELEM_MSG_*, payload bytes that will follow (<= TELEM_PAYLOAD_MAX)
+ * @param[out]: the frame's writer for the field calls and telem_End; NULL if
+ * 				the frame does not fit, or interrupted another open frame, and
+ * 				was dropped
+ */
+telem_writer *telem_Begin(uint8_t id, uint8_t n) {
+	telem_writer *w = &telem_w;
+	uint16_t space;
+	uint32_t irq;
+	
+	irq = hal_CriticalEnter();
+	if (w->open) {
+		telem_dropped++;
+		hal_CriticalExit(irq);
+		return NULL;
+	}
+	w->ring = hal_SerialTxRing(&w->size, &w->idx, &space);
+	if (n > TELEM_PAYLOAD_MAX || space < TELEM_FRAME_MAX(n)) {
+		hal_SerialTxCommit(0);
+		telem_dropped++;
+		hal_CriticalExit(irq);
+		return NULL;
+	}
+	w->open = 1;
+	hal_CriticalExit(irq);
+	w->len = 0;
+	w->crc = CRC16_INIT;
+	w->code_idx = w->idx;
+	w->code = 1;
+	telem_Advance(w);
+	telem_Field(w, id | telem_seq << 8, 2);
+	return w;
+}
+
+/*
+ * @brief: Payload fields, little-endian; no-ops on the NULL writer of a
+ * 				dropped frame
+ */
+void telem_U8(telem_writer *w, uint8_t v) {
+	if (w) telem_Field(w, v, 1);
+}
+
+void telem_U16(telem_writer *w, uint16_t v) {
+	if (w) telem_Field(w, v, 2);
+}
+
+void telem_U32(telem_writer *w, uint32_t v) {
+	if (w) telem_Field(w, v, 4);
+}
+
+/*
+ * @brief: Append the CRC, close the last block and the frame, commit it to
+ * 				USB and release the ring (interrupts masked for the commit only)
+ */
+void telem_End(telem_writer *w) {
+	uint16_t crc;
+	uint32_t irq;
+	
+	if (!w) return;
+	crc = w->crc;
+	telem_Raw(w, (uint8_t)crc);
+	telem_Raw(w, (uint8_t)(crc >> 8));
+	w->ring[w->code_idx] = w->code;
+	w->ring[w->idx] = 0;
+	telem_Advance(w);
+	irq = hal_CriticalEnter();
+	hal_SerialTxCommit(w->len);
+	telem_seq++;
+	telem_frames++;
+	w->open = 0;
+	hal_CriticalExit(irq);
+}
+
+/*
+ * @brief: Attitude estimate
+ * @param[in]: timestamp, roll, pitch, yaw in deg
+ * @param[out]: none
+ */
+void telem_Attitude(uint32_t t_us, float roll, float pitch, float yaw) {
+	telem_writer *w = telem_Begin(TELEM_MSG_ATTITUDE, TELEM_ATTITUDE_SIZE);
+	
+	if (!w) return;
+	telem_U32(w, t_us);
+	telem_U16(w, (uint16_t)telem_Centi(roll));
+	telem_U16(w, (uint16_t)telem_Centi(pitch));
+	telem_U16(w, (uint16_t)telem_Centi(yaw));
+	telem_End(w);
+}
+
+/*
+ * @brief: Last raw reading of each sensor
+ * @param[in]: sensors_last, indexed by __MEASURE_*
+ * @param[out]: none
+ */
+void telem_Imu(const sensors_sample *last) {
+	static const uint8_t order[SENSORS_COUNT] = {__MEASURE_ACCELEROMETER, __MEASURE_GYROSCOPE, __MEASURE_COMPASS};
+	telem_writer *w;
+	uint8_t i;
+	
+	w = telem_Begin(TELEM_MSG_IMU, TELEM_IMU_SIZE);
+	if (!w) return;
+	for (i = 0; i < SENSORS_COUNT; i++) {
+		const sensors_sample *s = &last[order[i]];
+		
+		telem_U16(w, (uint16_t)s->x);
+		telem_U16(w, (uint16_t)s->y);
+		telem_U16(w, (uint16_t)s->z);
+	}
+	telem_End(w);
+}
+
+/*
+ * @brief: Motor commands
+ * @param[in]: torque[4], 0..__TORQUE_MAX
+ * @param[out]: none
+ */
+void telem_Motors(const uint16_t *torque) {
+	telem_writer *w;
+	uint8_t i;
+	
+	w = telem_Begin(TELEM_MSG_MOTORS, TELEM_MOTORS_SIZE);
+	if (!w) return;
+	for (i = 0; i < 4; i++) telem_U16(w, torque[i]);
+	telem_End(w);
+}
+
+/*
+ * @brief: Control loop timing and frames dropped so far (low 16 bits)
+ * @param[in]: timestamp, us since the previous tick, us spent in the previous tick
+ * @param[out]: none
+ */
+void telem_Timing(uint32_t t_us, uint16_t period_us, uint16_t exec_us) {
+	telem_writer *w = telem_Begin(TELEM_MSG_TIMING, TELEM_TIMING_SIZE);
+	
+	if (!w) return;
+	telem_U32(w, t_us);
+	telem_U16(w, period_us);
+	telem_U16(w, exec_us);
+	telem_U16(w, (uint16_t)telem_dropped);
+	telem_End(w);
+}
+
+/*
+ * @brief: One profiling probe, histogram counts saturated to 16 bits
+ * @param[in]: PROF_*, hal_CycleHz(), the probe's window
+ * @param[out]: none
+ */
+void telem_Profile(uint8_t probe, uint32_t hz, const prof_probe *p) {
+	telem_writer *w;
+	uint8_t i;
+	
+	w = telem_Begin(TELEM_MSG_PROFILE, TELEM_PROFILE_SIZE);
+	if (!w) return;
+	telem_U8(w, probe);
+	telem_U32(w, hz);
+	telem_U32(w, p->count);
+	telem_U32(w, p->min);
+	telem_U32(w, p->max);
+	telem_U32(w, p->count ? (uint32_t)(p->sum / p->count) : 0);
+	for (i = 0; i < PROF_BUCKETS; i++) telem_U16(w, p->hist[i] > 0xFFFF ? 0xFFFF : (uint16_t)p->hist[i]);
+	telem_End(w);
+}
+
+/*
+ * @brief: Reply to a parameter request, in any telem_mode since the request
+ * 				itself was binary
+ * @param[in]: PARAM_OP_*, PARAM_* id, PARAM_OK or error, PARAM_F32/U16, value bits
+ * @param[out]: none
+ */
+void telem_Param(uint8_t op, uint8_t id, uint8_t status, uint8_t type, uint32_t value) {
+	telem_writer *w = telem_Begin(TELEM_MSG_PARAM, TELEM_PARAM_SIZE);
+	
+	if (!w) return;
+	telem_U8(w, op);
+	telem_U8(w, id);
+	telem_U8(w, status);
+	telem_U8(w, type);
+	telem_U32(w, value);
+	telem_End(w);
+}
+
+/*
+ * @brief: Send a NUL-terminated message: a TELEM_MSG_TEXT frame in binary
+ * 				mode so it cannot break the framing, plain text otherwise
+ * @param[in]: buffer, zero-filled on return as by hal_SerialWrite
+ * @param[out]: none
+ */
+void telem_Text(uint8_t *buffer) {
+	telem_writer *w;
+	uint8_t i, n;
+	
+	if (telem_mode != TELEM_BINARY) {
+		hal_SerialWrite(buffer);
+		return;
+	}
+	for (n = 0; n < TELEM_PAYLOAD_MAX && buffer[n]; n++);
+	w = telem_Begin(TELEM_MSG_TEXT, n);
+	if (w) {
+		for (i = 0; i < n; i++) telem_U8(w, buffer[i]);
+		telem_End(w);
+	}
+	for (i = 0; i < n; i++) buffer[i] = 0;
+}
@@ -0,0 +1,83 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <stdint.h>
+#include "sensors.h"
+#include "prof.h"
+
+/*
+ * Binary telemetry over USB CDC.
+ *
+ * Frame on the wire: COBS(id, seq, payload, crc16) then 0x00.
+ *   id				TELEM_MSG_*
+ *   seq			frame counter, wraps; a gap is frames lost on the way
+ *   payload	little-endian fields, layouts below
+ *   crc16		CRC-16/CCITT-FALSE (crc16.h) over id..payload, low byte first
+ * COBS leaves no zero inside a frame, so 0x00 only ever delimits and a
+ * receiver that starts mid-stream or sees a damaged frame picks up again at
+ * the next delimiter. Overhead is 6 bytes for payloads up to 250 bytes.
+ *
+ * Frames are encoded field by field straight into the USB transmit ring
+ * (hal_SerialTxRing): no text formatting, no staging buffer, no NUL scan.
+ * A frame that does not fit the free space is dropped whole and counted.
+ * telem_Begin reserves the ring and telem_End commits it, each with
+ * interrupts masked for a few instructions; the CRC and COBS work in between
+ * runs with them on. While a frame is open no one else writes the ring: the
+ * UART0 bridge leaves its bytes in the UART FIFO until the commit, and a
+ * writer in an interrupt that lands on an open frame is dropped and counted
+ * instead of nesting. telem_Begin returns the open frame's writer, or NULL
+ * for a dropped one; the field calls and telem_End take it and do nothing
+ * with NULL, so a dropped writer's fields never land in the frame it
+ * interrupted.
+ * host/telem_decode.h is the receiving side.
+ */
+
+#define TELEM_OFF											0
+#define TELEM_TEXT										1				// X:/Y:/Z: and u_roll lines, sprintf
+#define TELEM_BINARY									2
+#ifndef __TELEMETRY
+#define __TELEMETRY										TELEM_BINARY
+#endif
+
+// message ids and payloads
+#define TELEM_MSG_ATTITUDE						0x01		// u32 t_us, i16 roll, pitch, yaw [0.01 deg]
+#define TELEM_MSG_IMU									0x02		// i16 accel xyz, gyro xyz, compass xyz [raw LSB]
+#define TELEM_MSG_MOTORS							0x03		// u16 torque[4]
+#define TELEM_MSG_TIMING							0x04		// u32 t_us, u16 period_us, u16 exec_us, u16 dropped
+#define TELEM_MSG_PROFILE							0x05		// u8 probe, u32 cycle_hz, count, min, max, mean [cycles], u16 hist[PROF_BUCKETS]
+#define TELEM_MSG_LOG									0x06		// blackbox block, blackbox.h
+#define TELEM_MSG_PARAM								0x07		// u8 op, u8 id, u8 status, u8 type, u32 value, param.h
+#define TELEM_MSG_TEXT								0x7F		// characters, no NUL
+
+#define TELEM_ATTITUDE_SIZE						10
+#define TELEM_IMU_SIZE								18
+#define TELEM_MOTORS_SIZE							8
+#define TELEM_TIMING_SIZE							10
+#define TELEM_PROFILE_SIZE						(21 + 2 * PROF_BUCKETS)
+#define TELEM_PARAM_SIZE							8
+#define TELEM_PAYLOAD_MAX							128
+#define TELEM_FRAME_MAX(n)						((n) + 6)	// id, seq, crc, COBS code, delimiter
+
+
+typedef struct telem_writer telem_writer;
+
+
+extern uint8_t		telem_mode;
+extern uint32_t		telem_frames;									// committed to the ring
+extern uint32_t		telem_dropped;								// no room in the ring
+
+extern telem_writer	*telem_Begin(uint8_t id, uint8_t n);
+extern void			telem_U8(telem_writer *w, uint8_t v);
+extern void			telem_U16(telem_writer *w, uint16_t v);
+extern void			telem_U32(telem_writer *w, uint32_t v);
+extern void			telem_End(telem_writer *w);
+
+extern void			telem_Attitude(uint32_t t_us, float roll, float pitch, float yaw);
+extern void			telem_Imu(const sensors_sample *last);
+extern void			telem_Motors(const uint16_t *torque);
+extern void			telem_Timing(uint32_t t_us, uint16_t period_us, uint16_t exec_us);
+extern void			telem_Profile(uint8_t probe, uint32_t hz, const prof_probe *p);
+extern void			telem_Param(uint8_t op, uint8_t id, uint8_t status, uint8_t type, uint32_t value);
+extern void			telem_Text(uint8_t *buffer);
+
+#endif
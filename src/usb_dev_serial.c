@@ -50,6 +50,7 @@
 #include "usb_serial_structs.h"
 #include "utils/uartstdio.h"
 #include "usb_dev_serial.h"
+#include "spsc.h"
 
 //*****************************************************************************
 //
@@ -97,7 +98,12 @@
 //*****************************************************************************
 volatile uint32_t g_ui32UARTTxCount = 0;
 volatile uint32_t g_ui32UARTRxCount = 0;
-uint8_t usb_recieve_buffer[USB_BUFFER_SIZE];
+uint8_t usb_recieve_buffer[USB_BUFFER_SIZE];			// storage of usb_rx_ring
+// Two interrupts push this ring, USB0 (RxHandler) and UART0 (the TX FIFO
+// refill), both through USBUARTPrimeTransmit. They count as the ring's one
+// producer only because they run at the same NVIC priority and so never
+// preempt each other (NVIC_Config). Do not move either one.
+spsc_ring usb_rx_ring;
 
 #ifdef DEBUG
 uint32_t g_ui32UARTRxErrors = 0;
@@ -160,6 +166,17 @@ static void SetControlLineState(uint16_t ui16State);
 static bool SetLineCoding(tLineCoding *psLineCoding);
 static void GetLineCoding(tLineCoding *psLineCoding);
 static void SendBreak(bool bSend);
+static int32_t ReadUARTData(void);
+
+//*****************************************************************************
+//
+// Set from reserve_USB_CDC_Tx to commit_USB_CDC_Tx while a frame is written
+// into the transmit ring in place; the UART bridge then leaves its bytes in
+// the UART FIFO (tx_deferred) and the commit moves them.
+//
+//*****************************************************************************
+static volatile bool tx_reserved = false;
+static volatile bool tx_deferred = false;
 
 //*****************************************************************************
 //
@@ -179,20 +196,14 @@ __error__(char *pcFilename, uint32_t ui32Line)
 
 //*****************************************************************************
 //
-// This function reads data from real men's buffer, end sets its poiter
-// to current element to zero. Why? Because every other functions for
-// reading usb-uart data sucks.
+// This function takes the bytes received since the last call. They come
+// through usb_rx_ring, filled from the USB and UART interrupts by
+// USBUARTPrimeTransmit, so nothing here races with it. Those two interrupts
+// share the producer side, see usb_rx_ring.
 //
 //*****************************************************************************
 uint16_t get_USB_CDC_Data(uint8_t *buffer) {
-uint16_t i;
-	
-	for (i = 0; i < g_ui32UARTTxCount; i++) {
-		buffer[i] = usb_recieve_buffer[i];
-	}
-	g_ui32UARTTxCount = 0;
-
-	return i;
+	return (uint16_t)spsc_Read(&usb_rx_ring, buffer, USB_BUFFER_SIZE);
 }
 
 void send_USB_CDC_Data(uint8_t *buffer) {
@@ -211,6 +222,36 @@ uint16_t data_len;
 	}
 }
 
+//*****************************************************************************
+//
+// Write straight into the transmit ring instead of copying a buffer in: get
+// the ring, its write index and the free space, fill bytes from the write
+// index on (wrapping at size), then commit them for transmission (0 bytes to
+// give the ring back unused). Both run with interrupts masked; in between
+// the ring is reserved and UART0_Handler does not write to it.
+//
+//*****************************************************************************
+uint8_t *reserve_USB_CDC_Tx(uint16_t *size, uint16_t *head, uint16_t *space) {
+tUSBRingBufObject	ring;
+	
+	USBBufferInfoGet(&g_sTxBuffer, &ring);
+	*size = (uint16_t)ring.ui32Size;
+	*head = (uint16_t)ring.ui32WriteIndex;
+	*space = (uint16_t)USBBufferSpaceAvailable(&g_sTxBuffer);
+	tx_reserved = true;
+	
+	return ring.pui8Buffer;
+}
+
+void commit_USB_CDC_Tx(uint16_t len) {
+	if (len) USBBufferDataWritten(&g_sTxBuffer, len);
+	tx_reserved = false;
+	if (tx_deferred) {
+		tx_deferred = false;
+		CheckForSerialStateChange(&g_sCDCDevice, ReadUARTData());
+	}
+}
+
 //*****************************************************************************
 //
 // This function is called whenever serial data is received from the UART.
@@ -291,6 +332,16 @@ ReadUARTData(void)
     //
     i32Errors = 0;
 
+    //
+    // A telemetry frame is being written into the buffer in place: leave the
+    // characters in the FIFO, commit_USB_CDC_Tx moves them.
+    //
+    if(tx_reserved)
+    {
+        tx_deferred = true;
+        return(0);
+    }
+
     //
     // How much space do we have in the buffer?
     //
@@ -391,8 +442,9 @@ USBUARTPrimeTransmit(uint32_t ui32Base)
             //
             UARTCharPutNonBlocking(ui32Base, ui8Char);
 					
-						// save data as a man
-						usb_recieve_buffer[g_ui32UARTTxCount] = ui8Char;
+						// hand over to get_USB_CDC_Data; dropped when full. USB0 and
+						// UART0 both get here, at equal priority (see usb_rx_ring)
+						spsc_Push(&usb_rx_ring, &ui8Char);
 					
             //
             // Update our count of bytes transmitted via the UART.
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include "spsc.h"
 
 //*****************************************************************************
 //
@@ -61,6 +62,9 @@ extern volatile uint32_t g_ui32UARTRxCount;
 
 #define USB_BUFFER_SIZE	256
 extern uint8_t usb_recieve_buffer[USB_BUFFER_SIZE];
+extern spsc_ring usb_rx_ring;											// USBUARTPrimeTransmit -> get_USB_CDC_Data
 
 extern uint16_t get_USB_CDC_Data(uint8_t *buffer);
 extern void			send_USB_CDC_Data(uint8_t *buffer);
+extern uint8_t	*reserve_USB_CDC_Tx(uint16_t *size, uint16_t *head, uint16_t *space);
+extern void			commit_USB_CDC_Tx(uint16_t len);
@@ -1,3 +1,6 @@
+#ifndef _VAR_H_
+#define _VAR_H_
+
 #include <stdint.h>
 
 typedef struct {
@@ -9,3 +12,5 @@ typedef struct {
 extern uint8_t		BT_state;
 extern uint8_t		BT_data;
 extern uint8_t		LED_state;
+
+#endif